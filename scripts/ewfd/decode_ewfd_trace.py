@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Decode an EWFD binary trace dump into the old EWFD_LOG text lines.
+
+The dump is written by ewfd_trace_dump() (src/feature/ewfd/ewfd_trace.c)
+on SIGUSR1 or on the DUMPEWFDTRACE control command.  Records from all
+threads are merged and sorted by timestamp, so the output can be fed to the
+same analysis scripts as the old logs.
+
+Usage: decode_ewfd_trace.py [--op NAME ...] [--circ ID] DataDirectory/ewfd-trace
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"EWFDTRC1"
+FILE_HEADER = struct.Struct("=8sIIII")
+RING_HEADER = struct.Struct("=II")
+RECORD = struct.Struct("=QIHHQQ")
+
+# must match enum ewfd_trace_op in ewfd_trace.h
+OPS = {
+    1: "SEND_CELL",
+    2: "RECV_CELL",
+    3: "APPEND_CELL",
+    4: "EVENT_TICK",
+    5: "EVENT_PROCESS",
+    6: "EVENT_READD",
+    7: "EVENT_OUTDATED",
+    8: "CMUX_PICK_NONE",
+    9: "ADVANCE_DELAY",
+    10: "DELAY_TRIGGER",
+    11: "SEND_DUMMY",
+    12: "SCHEDULE_TICK",
+    13: "PADDING_TICK",
+}
+
+RELAY_COMMANDS = {
+    1: "BEGIN", 2: "DATA", 3: "END", 4: "CONNECTED", 5: "SENDME",
+    6: "EXTEND", 7: "EXTENDED", 8: "TRUNCATE", 9: "TRUNCATED", 10: "DROP",
+    11: "RESOLVE", 12: "RESOLVED", 13: "BEGIN_DIR", 14: "EXTEND2",
+    15: "EXTENDED2", 32: "ESTABLISH_INTRO", 33: "ESTABLISH_RENDEZVOUS",
+    34: "INTRODUCE1", 35: "INTRODUCE2", 36: "RENDEZVOUS1", 37: "RENDEZVOUS2",
+    38: "INTRO_ESTABLISHED", 39: "RENDEZVOUS_ESTABLISHED",
+    40: "INTRODUCE_ACK", 41: "PADDING_NEGOTIATE", 42: "PADDING_NEGOTIATED",
+    43: "XOFF", 44: "XON", 100: "DELAY_PKT",
+}
+
+CELL_COMMANDS = {
+    0: "padding", 1: "create", 2: "created", 3: "relay", 4: "destroy",
+    5: "create_fast", 6: "created_fast", 7: "versions", 8: "netinfo",
+    9: "relay_early", 10: "create2", 11: "created2",
+    12: "padding_negotiate", 128: "vpadding", 129: "certs",
+    130: "auth_challenge", 131: "authenticate", 132: "authorize",
+}
+
+# must match the EWFD_MODE_* enum in circuitmux_ewfd.h
+DELAY_STATES = {
+    0: "NORMAL", 1: "WAIT_TO_BURST", 2: "BURST", 3: "GAP", 4: "DESTROY",
+}
+
+
+def relay_cmd(c):
+    return RELAY_COMMANDS.get(c, "Unrecognized relay command %u" % c)
+
+
+def format_record(ts_us, circ, op, a0, a1):
+    now_ms = ts_us // 1000
+    if op == 1:
+        return "[send cell] command: [%s] circ:%d" % (relay_cmd(a0), circ)
+    if op == 2:
+        return "[receive cell] command: [%s] circ:%d on stream: %d" % (
+            relay_cmd(a0), circ, a1)
+    if op == 3:
+        return "[send-cell] append to queue circ: %u cell-cmd: %s q-len: %d" % (
+            circ, CELL_COMMANDS.get(a0, "unknown"), a1)
+    if op == 4:
+        return "[delay-event] step:on_tick cur_ti:%d" % a0
+    if op == 5:
+        return ("[delay-event] step:process_one_event circ:%d ev-id:%d "
+                "insert-ti:%d is_processed:%d" % (
+                    circ, a0 & 0xffffffff, a1, a0 >> 32))
+    if op == 6:
+        return "[delay-event] step:readd_event circ:%d id:%d insert-ti:%d cur_ti:%d" % (
+            circ, a0, a1, now_ms)
+    if op == 7:
+        return "[EWFD-Event] remove outdated event id: %d %d" % (a0, a1)
+    if op == 8:
+        return "[delay-event] step:pick_active_no_circ cmux-id:%d" % a0
+    if op == 9:
+        return "[delay-event] step:advance_delay circ:%d state:%s gap:%d cur_ti:%d" % (
+            circ, DELAY_STATES.get(a0, str(a0)), a1, now_ms)
+    if op == 10:
+        return "[delay-event] step:trigger_event-trigger circ:%d state:%s remain:%d ti:%d" % (
+            circ, DELAY_STATES.get(a0, str(a0)), a1, now_ms)
+    if op == 11:
+        return "[delay-event] step:send_dummy_packet circ:%d dummy:%d" % (circ, a0)
+    if op in (12, 13):
+        tag = "schedule-tick-n" if op == 12 else "padding-tick-n"
+        return "[%s] [%u] want: %d actual: %d delta: %d next: %d" % (
+            tag, circ, a0, now_ms, now_ms - a0, a0 + a1)
+    return "[unknown op %d] circ:%d args: %d %d" % (op, circ, a0, a1)
+
+
+def read_records(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, rec_size, ring_num, _ = FILE_HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError("%s is not an EWFD trace dump" % path)
+    if rec_size != RECORD.size:
+        raise ValueError("unsupported record size %d (version %d)" % (
+            rec_size, version))
+
+    records = []
+    pos = FILE_HEADER.size
+    for _ in range(ring_num):
+        _, rec_num = RING_HEADER.unpack_from(data, pos)
+        pos += RING_HEADER.size
+        for _ in range(rec_num):
+            records.append(RECORD.unpack_from(data, pos))
+            pos += RECORD.size
+    records.sort(key=lambda r: r[0])
+    return records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("trace", help="trace file written by tor")
+    parser.add_argument("--op", action="append", default=[],
+                        help="only show this op (e.g. SEND_DUMMY), repeatable")
+    parser.add_argument("--circ", type=int, help="only show this circuit id")
+    args = parser.parse_args()
+
+    ops = set(o.upper() for o in args.op)
+    for ts_us, circ, op, thread_idx, a0, a1 in read_records(args.trace):
+        if ops and OPS.get(op) not in ops:
+            continue
+        if args.circ is not None and circ != args.circ:
+            continue
+        print("%d.%06d [t%d] %s" % (ts_us // 1000000, ts_us % 1000000,
+                                    thread_idx,
+                                    format_record(ts_us, circ, op, a0, a1)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -69,6 +69,7 @@
 #include "app/main/main.h"
 #include "app/main/subsysmgr.h"
 #include "core/mainloop/connection.h"
+#include "core/mainloop/cpuworker.h"
 #include "core/mainloop/mainloop.h"
 #include "core/mainloop/netstatus.h"
 #include "core/or/channel.h"
@@ -89,6 +90,8 @@
 #include "feature/control/control_auth.h"
 #include "feature/control/control_events.h"
 #include "feature/dirclient/dirclient_modes.h"
+#include "feature/ewfd/ewfd_conf.h"
+#include "feature/ewfd/ewfd_rt.h"
 #include "feature/hibernate/hibernate.h"
 #include "feature/hs/hs_config.h"
 #include "feature/metrics/metrics.h"
@@ -754,6 +757,9 @@ static const config_var_t option_vars_[] = {
   /* eWFD Settings */
   V(EWFDPolicy, INT, "0"),
   V(EWFDEnableDebugLog, BOOL, "1"),
+  V(EWFDUnit, LINELIST, NULL),
+  V(EWFDOffloadUnits, BOOL, "0"),
+  V(EWFDDataStreamFile, FILENAME, NULL),
   OBSOLETE("TestingConsensusMaxDownloadTries"),
   OBSOLETE("ClientBootstrapConsensusMaxDownloadTries"),
   OBSOLETE("ClientBootstrapConsensusAuthorityOnlyMaxDownloadTries"),
@@ -2258,6 +2264,35 @@ options_act,(const or_options_t *old_options))
   /* Change the cell EWMA settings */
   cmux_ewma_set_options(options, networkstatus_get_latest_consensus());
 
+  /* EWFD programs are loaded, verified and compiled on the cpuworkers, which
+   * clients do not start on their own. A change to EWFDUnit swaps the units
+   * used by new circuits once the compilation is done. With
+   * EWFDOffloadUnits, padding and schedule units run on the cpuworkers too
+   * and only their cell events are queued from the main loop. The C debug
+   * units keep static state and always run on the main loop, so offloading
+   * has no effect while they are in use. */
+  {
+    bool offload = options->EWFDOffloadUnits;
+    if (!ewfd_rt_set_offload(offload)) {
+      log_warn(LD_CONFIG, "EWFDOffloadUnits has no effect while the C debug "
+               "units are in use. Running EWFD units on the main loop.");
+      offload = false;
+    }
+    if (options->EWFDUnit || offload) {
+      cpu_init();
+    }
+  }
+  if (old_options &&
+      !config_lines_eq(old_options->EWFDUnit, options->EWFDUnit)) {
+    ewfd_reload_unit_confs(options->EWFDUnit);
+  }
+  /* The data stream shared by all EWFD units is swapped once no unit job is
+   * running on the cpuworkers. On error the old stream stays in use. */
+  if (old_options && !opt_streq(old_options->EWFDDataStreamFile,
+                                options->EWFDDataStreamFile)) {
+    ewfd_map_data_stream_file(options->EWFDDataStreamFile);
+  }
+
   /* Update the BridgePassword's hashed version as needed.  We store this as a
    * digest so that we can do side-channel-proof comparisons on it.
    */
@@ -4052,6 +4087,10 @@ options_validate_cb(const void *old_options_, void *options_, char **msg)
     return -1;
   }
 
+  if (ewfd_validate_unit_lines(options->EWFDUnit, msg) < 0) {
+    return -1;
+  }
+
   return 0;
 }
 
@@ -850,6 +850,12 @@ struct or_options_t {
   int EWFDPolicy;
   /* default 1, disable the debug log for performance evaluation */
   int EWFDEnableDebugLog; 
+  /* EWFD units loaded from bytecode or ELF files, one unit per line */
+  struct config_line_t *EWFDUnit;
+  /* run padding/schedule units on the cpuworkers instead of the main loop */
+  int EWFDOffloadUnits;
+  /* file of native uint32 values shared by the data streams of all units */
+  char *EWFDDataStreamFile;
 
   /** Optionally, IPv4 and IPv6 GeoIP data. */
   char *GeoIPFile;
@@ -58,11 +58,13 @@
 #include "feature/stats/bwhist.h"
 #include "feature/stats/rephist.h"
 #include "feature/ewfd/utils.h"
+#include "feature/ewfd/ewfd_trace.h"
 #include "lib/compress/compress.h"
 #include "lib/buf/buffers.h"
 #include "lib/crypt_ops/crypto_format.h"
 #include "lib/crypt_ops/crypto_rand.h"
 #include "lib/crypt_ops/crypto_s2k.h"
+#include "lib/net/buffers_net.h"
 #include "lib/net/resolve.h"
 #include "lib/trace/trace.h"
 
@@ -418,9 +420,26 @@ dumpstats(int severity)
         (int) (get_bytes_written()/elapsed));
   }
 
+  {
+    buf_flush_stats_t flush_stats;
+    buf_flush_get_socket_stats(&flush_stats);
+    if (flush_stats.n_bytes)
+      tor_log(severity, LD_NET,
+          "Non-TLS socket writes: %"PRIu64" bytes in %"PRIu64" syscalls "
+          "(%.3e syscalls per byte, %.0f bytes per syscall)",
+          (flush_stats.n_bytes), (flush_stats.n_syscalls),
+          ((double)flush_stats.n_syscalls) / flush_stats.n_bytes,
+          ((double)flush_stats.n_bytes) / flush_stats.n_syscalls);
+  }
+
   tor_log(severity, LD_NET, "--------------- Dumping memory information:");
   dumpmemusage(severity);
 
+  {
+    char *trace_fname = ewfd_trace_dump_default();
+    tor_free(trace_fname);
+  }
+
   rep_hist_dump_stats(now,severity);
   hs_service_dump_stats(severity);
 }
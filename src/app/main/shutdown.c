@@ -25,6 +25,7 @@
 #include "core/or/circuitpadding.h"
 #include "core/or/connection_edge.h"
 #include "core/or/dos.h"
+#include "core/or/relay.h"
 #include "core/or/scheduler.h"
 #include "feature/client/addressmap.h"
 #include "feature/client/bridges.h"
@@ -139,6 +140,7 @@ tor_free_all(int postfork)
   circuitmux_ewma_free_all();
   accounting_free_all();
   circpad_free_all();
+  cell_pools_free_all();
 
   if (!postfork) {
     config_free_all();
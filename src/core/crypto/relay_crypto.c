@@ -97,6 +97,34 @@ relay_crypt_one_payload(crypto_cipher_t *cipher, uint8_t *in)
   crypto_cipher_crypt_inplace(cipher, (char*) in, CELL_PAYLOAD_SIZE);
 }
 
+/** Apply <b>ciphers</b>[i] to CELL_PAYLOAD_SIZE bytes of
+ * <b>payloads</b>[i] (in place), for every i less than <b>n</b>.
+ *
+ * The result is the same as calling relay_crypt_one_payload() on each pair
+ * in order; callers that have several cells in hand (possibly for different
+ * circuits) should use this so the payloads are crypted back to back.
+ *
+ * Gathering the payloads that share a cipher into one buffer and making a
+ * single cipher call per run measured no faster than this loop (see
+ * bench_cell_aes): OpenSSL already runs its interleaved AES-NI counter-mode
+ * loop inside each 509-byte call, and its key schedule is private, so cells
+ * under different keys cannot be interleaved from here.  What we can do is
+ * make sure the next payload is on its way into cache while the current one
+ * is crypted, since queued cells are rarely hot.
+ */
+void
+relay_crypt_payloads(crypto_cipher_t *const *ciphers,
+                     uint8_t *const *payloads, int n)
+{
+  for (int i = 0; i < n; ++i) {
+    if (i + 1 < n) {
+      for (int off = 0; off < CELL_PAYLOAD_SIZE; off += 64)
+        PREFETCH_FOR_WRITE(payloads[i + 1] + off);
+    }
+    relay_crypt_one_payload(ciphers[i], payloads[i]);
+  }
+}
+
 /** Return the sendme_digest within the <b>crypto</b> object. */
 uint8_t *
 relay_crypto_get_sendme_digest(relay_crypto_t *crypto)
@@ -186,26 +214,76 @@ relay_decrypt_cell(circuit_t *circ, cell_t *cell,
              "Incoming cell at client not recognized. Closing.");
       return -1;
     } else {
-      relay_crypto_t *crypto = &TO_OR_CIRCUIT(circ)->crypto;
       /* We're in the middle. Encrypt one layer. */
-      relay_crypt_one_payload(crypto->b_crypto, cell->payload);
+      relay_crypt_or_circ_cells(TO_OR_CIRCUIT(circ), &cell, 1,
+                                cell_direction);
     }
   } else /* cell_direction == CELL_DIRECTION_OUT */ {
     /* We're in the middle. Decrypt one layer. */
-    relay_crypto_t *crypto = &TO_OR_CIRCUIT(circ)->crypto;
+    relay_crypt_or_circ_cells(TO_OR_CIRCUIT(circ), &cell, 1, cell_direction);
+    relay_or_circ_cell_recognize(TO_OR_CIRCUIT(circ), cell, cell_direction,
+                                 recognized);
+  }
+  return 0;
+}
 
-    relay_crypt_one_payload(crypto->f_crypto, cell->payload);
+/** Apply to each of the <b>n</b> cells in <b>cells</b>, in order, the layer
+ * of crypto that relay_decrypt_cell() applies to a cell arriving on
+ * <b>circ</b> in <b>cell_direction</b>.
+ *
+ * Since an or_circuit_t only ever uses one cipher per direction, a run of
+ * cells for the same circuit can be crypted together before any of them is
+ * handled.  Each cell must then go through relay_or_circ_cell_recognize()
+ * (in the same order) instead of relay_decrypt_cell().
+ */
+void
+relay_crypt_or_circ_cells(or_circuit_t *circ, cell_t *const *cells, int n,
+                          cell_direction_t cell_direction)
+{
+  crypto_cipher_t *ciphers[RELAY_CRYPT_OR_CIRC_CELLS_MAX];
+  uint8_t *payloads[RELAY_CRYPT_OR_CIRC_CELLS_MAX];
+  crypto_cipher_t *cipher;
 
-    relay_header_unpack(&rh, cell->payload);
-    if (rh.recognized == 0) {
-      /* it's possibly recognized. have to check digest to be sure. */
-      if (relay_digest_matches(crypto->f_digest, cell)) {
-        *recognized = 1;
-        return 0;
-      }
+  tor_assert(circ);
+  tor_assert(n <= RELAY_CRYPT_OR_CIRC_CELLS_MAX);
+  tor_assert(cell_direction == CELL_DIRECTION_IN ||
+             cell_direction == CELL_DIRECTION_OUT);
+
+  cipher = (cell_direction == CELL_DIRECTION_OUT) ?
+    circ->crypto.f_crypto : circ->crypto.b_crypto;
+  for (int i = 0; i < n; ++i) {
+    ciphers[i] = cipher;
+    payloads[i] = cells[i]->payload;
+  }
+  relay_crypt_payloads(ciphers, payloads, n);
+}
+
+/** Given a <b>cell</b> that relay_crypt_or_circ_cells() already crypted
+ * for <b>circ</b>, set *<b>recognized</b> to 1 if it is addressed to us,
+ * updating the running digest as relay_decrypt_cell() would.  Cells going
+ * towards the origin are never recognized in the middle of a circuit.
+ */
+void
+relay_or_circ_cell_recognize(or_circuit_t *circ, cell_t *cell,
+                             cell_direction_t cell_direction,
+                             char *recognized)
+{
+  relay_header_t rh;
+
+  tor_assert(circ);
+  tor_assert(cell);
+  tor_assert(recognized);
+
+  if (cell_direction != CELL_DIRECTION_OUT)
+    return;
+
+  relay_header_unpack(&rh, cell->payload);
+  if (rh.recognized == 0) {
+    /* it's possibly recognized. have to check digest to be sure. */
+    if (relay_digest_matches(circ->crypto.f_digest, cell)) {
+      *recognized = 1;
     }
   }
-  return 0;
 }
 
 /**
@@ -19,6 +19,13 @@ int relay_crypto_init(relay_crypto_t *crypto,
 int relay_decrypt_cell(circuit_t *circ, cell_t *cell,
                        cell_direction_t cell_direction,
                        crypt_path_t **layer_hint, char *recognized);
+/** Most cells relay_crypt_or_circ_cells() accepts in one call. */
+#define RELAY_CRYPT_OR_CIRC_CELLS_MAX 32
+void relay_crypt_or_circ_cells(or_circuit_t *circ, cell_t *const *cells,
+                               int n, cell_direction_t cell_direction);
+void relay_or_circ_cell_recognize(or_circuit_t *circ, cell_t *cell,
+                                  cell_direction_t cell_direction,
+                                  char *recognized);
 void relay_encrypt_cell_outbound(cell_t *cell, origin_circuit_t *or_circ,
                             crypt_path_t *layer_hint);
 void relay_encrypt_cell_inbound(cell_t *cell, or_circuit_t *or_circ);
@@ -35,6 +42,10 @@ void relay_crypto_record_sendme_digest(relay_crypto_t *crypto,
 void
 relay_crypt_one_payload(crypto_cipher_t *cipher, uint8_t *in);
 
+void
+relay_crypt_payloads(crypto_cipher_t *const *ciphers,
+                     uint8_t *const *payloads, int n);
+
 void
 relay_set_digest(crypto_digest_t *digest, cell_t *cell);
 
@@ -0,0 +1,336 @@
+/* Copyright (c) 2007-2021, The Tor Project, Inc. */
+/* See LICENSE for licensing information */
+
+/**
+ * \file cell_pool.c
+ * \brief Slab allocator for fixed-size cell objects.
+ *
+ * Every cell that passes through a circuit queue is a packed_cell_t that
+ * lives for a few milliseconds, so a busy relay would otherwise spend a good
+ * share of its time in malloc() and free().  A cell_pool_t hands out objects
+ * of one size from slabs of about CELL_POOL_SLAB_SIZE bytes.  Slabs and
+ * objects start on a cache line, and no two objects share one.
+ *
+ * Each slab keeps its own list of free slots.  The pool keeps its slabs on
+ * three lists: partially used ones, which allocation takes from first, full
+ * ones, and empty ones.  Empty slabs are kept for reuse up to a byte limit
+ * set with cell_pool_set_max_cached() and released beyond it.
+ * cell_pool_trim() releases them all.
+ *
+ * Every slot ends with a pointer back to its slab, so that releasing an
+ * object does not need to search for it.
+ *
+ * Pools are not thread-safe.  Like the cell queues, they are only used from
+ * the main thread.
+ **/
+
+#include "orconfig.h"
+#include "core/or/cell_pool.h"
+#include "lib/log/util_bug.h"
+#include "lib/malloc/malloc.h"
+#include "ext/tor_queue.h"
+
+#include <string.h>
+
+/** Alignment of slabs and of every object in them. */
+#define CELL_POOL_ALIGN 64
+/** Target size of a slab. */
+#define CELL_POOL_SLAB_SIZE (32*1024)
+
+/** Round <b>n</b> up to a multiple of CELL_POOL_ALIGN. */
+#define CELL_POOL_ROUND_UP(n) \
+  (((n) + CELL_POOL_ALIGN - 1) & ~(size_t)(CELL_POOL_ALIGN - 1))
+
+/** A run of slots for objects of one pool. */
+typedef struct cell_pool_slab_t {
+  /** The pool this slab belongs to. */
+  cell_pool_t *pool;
+  /** Start of the allocation holding this slab, for tor_free(). */
+  void *mem;
+  /** Free slots; each holds a pointer to the next one. */
+  void *free_list;
+  /** Number of slots on <b>free_list</b>. */
+  int n_free;
+  /** Links in one of the pool's slab lists. */
+  TOR_LIST_ENTRY(cell_pool_slab_t) node;
+} cell_pool_slab_t;
+
+TOR_LIST_HEAD(cell_pool_slab_list_t, cell_pool_slab_t);
+
+struct cell_pool_t {
+  /** Name for logs and metrics. */
+  const char *name;
+  /** Size of the objects the user asked for. */
+  size_t obj_size;
+  /** Bytes per slot: the object, then the slab pointer, rounded up. */
+  size_t slot_size;
+  /** Offset of the first slot from the start of the slab. */
+  size_t slab_header_size;
+  /** Number of slots in each slab. */
+  int slots_per_slab;
+  /** Bytes we ask tor_malloc() for, per slab. */
+  size_t slab_alloc_size;
+  /** Most bytes of empty slabs we keep around. */
+  size_t max_cached_bytes;
+
+  struct cell_pool_slab_list_t partial;
+  struct cell_pool_slab_list_t full;
+  struct cell_pool_slab_list_t empty;
+
+  size_t n_used;
+  size_t n_slabs;
+  size_t n_empty_slabs;
+  uint64_t n_allocs;
+  uint64_t n_slab_allocs;
+  uint64_t n_slab_frees;
+};
+
+/** Return a pointer to the slab-pointer field at the end of the slot that
+ * starts at <b>obj</b>. */
+static inline cell_pool_slab_t **
+cell_pool_slot_slab_ptr(const cell_pool_t *pool, void *obj)
+{
+  return (cell_pool_slab_t **)
+    ((char *)obj + pool->slot_size - sizeof(cell_pool_slab_t *));
+}
+
+/** Allocate and return a new pool for objects of <b>obj_size</b> bytes.
+ * <b>name</b> must outlive the pool. */
+cell_pool_t *
+cell_pool_new(const char *name, size_t obj_size)
+{
+  cell_pool_t *pool = tor_malloc_zero(sizeof(cell_pool_t));
+
+  tor_assert(obj_size > 0);
+
+  pool->name = name;
+  pool->obj_size = obj_size;
+  if (obj_size < sizeof(void *))
+    obj_size = sizeof(void *);
+  pool->slot_size = CELL_POOL_ROUND_UP(obj_size + sizeof(cell_pool_slab_t *));
+  pool->slab_header_size = CELL_POOL_ROUND_UP(sizeof(cell_pool_slab_t));
+  if (pool->slab_header_size + pool->slot_size < CELL_POOL_SLAB_SIZE) {
+    pool->slots_per_slab = (int)
+      ((CELL_POOL_SLAB_SIZE - pool->slab_header_size) / pool->slot_size);
+  } else {
+    pool->slots_per_slab = 1;
+  }
+  pool->slab_alloc_size = pool->slab_header_size +
+    pool->slots_per_slab * pool->slot_size + CELL_POOL_ALIGN - 1;
+
+  TOR_LIST_INIT(&pool->partial);
+  TOR_LIST_INIT(&pool->full);
+  TOR_LIST_INIT(&pool->empty);
+  return pool;
+}
+
+/** Allocate a slab for <b>pool</b>, with all its slots free. */
+static cell_pool_slab_t *
+cell_pool_slab_new(cell_pool_t *pool)
+{
+  void *mem = tor_malloc(pool->slab_alloc_size);
+  cell_pool_slab_t *slab = (cell_pool_slab_t *)
+    CELL_POOL_ROUND_UP((uintptr_t)mem);
+  char *slot;
+  int i;
+
+  memset(slab, 0, sizeof(*slab));
+  slab->pool = pool;
+  slab->mem = mem;
+
+  /* Chain the slots in address order, so that a fresh slab is handed out
+   * front to back. */
+  slot = (char *)slab + pool->slab_header_size +
+    (pool->slots_per_slab - 1) * pool->slot_size;
+  for (i = 0; i < pool->slots_per_slab; ++i, slot -= pool->slot_size) {
+    *cell_pool_slot_slab_ptr(pool, slot) = slab;
+    *(void **)slot = slab->free_list;
+    slab->free_list = slot;
+  }
+  slab->n_free = pool->slots_per_slab;
+
+  ++pool->n_slabs;
+  ++pool->n_slab_allocs;
+  return slab;
+}
+
+/** Release <b>slab</b>, which must have no live object and be on no list. */
+static void
+cell_pool_slab_free(cell_pool_t *pool, cell_pool_slab_t *slab)
+{
+  /* The slab header lives inside mem: don't let tor_free() clear it. */
+  void *mem = slab->mem;
+  tor_assert(slab->n_free == pool->slots_per_slab);
+  --pool->n_slabs;
+  ++pool->n_slab_frees;
+  tor_free(mem);
+}
+
+/** Release every slab of <b>pool</b>, and the pool itself.  Objects still
+ * handed out become invalid. */
+void
+cell_pool_free_(cell_pool_t *pool)
+{
+  cell_pool_slab_t *slab;
+  struct cell_pool_slab_list_t *lists[3];
+  void *mem;
+  int i;
+
+  if (!pool)
+    return;
+
+  lists[0] = &pool->partial;
+  lists[1] = &pool->full;
+  lists[2] = &pool->empty;
+  for (i = 0; i < 3; ++i) {
+    while ((slab = TOR_LIST_FIRST(lists[i]))) {
+      TOR_LIST_REMOVE(slab, node);
+      mem = slab->mem;
+      tor_free(mem);
+    }
+  }
+  tor_free(pool);
+}
+
+/** Return a zeroed object from <b>pool</b>. */
+void *
+cell_pool_alloc(cell_pool_t *pool)
+{
+  cell_pool_slab_t *slab;
+  void *obj;
+
+  tor_assert(pool);
+
+  slab = TOR_LIST_FIRST(&pool->partial);
+  if (!slab) {
+    slab = TOR_LIST_FIRST(&pool->empty);
+    if (slab) {
+      TOR_LIST_REMOVE(slab, node);
+      --pool->n_empty_slabs;
+    } else {
+      slab = cell_pool_slab_new(pool);
+    }
+    TOR_LIST_INSERT_HEAD(&pool->partial, slab, node);
+  }
+
+  obj = slab->free_list;
+  slab->free_list = *(void **)obj;
+  if (--slab->n_free == 0) {
+    TOR_LIST_REMOVE(slab, node);
+    TOR_LIST_INSERT_HEAD(&pool->full, slab, node);
+  }
+
+  ++pool->n_used;
+  ++pool->n_allocs;
+  memset(obj, 0, pool->obj_size);
+  return obj;
+}
+
+/** Give <b>obj</b>, which came from cell_pool_alloc() on <b>pool</b>, back
+ * to it. */
+void
+cell_pool_release(cell_pool_t *pool, void *obj)
+{
+  cell_pool_slab_t *slab;
+
+  if (!obj)
+    return;
+
+  slab = *cell_pool_slot_slab_ptr(pool, obj);
+  tor_assert(slab->pool == pool);
+  tor_assert(pool->n_used > 0);
+
+  if (slab->n_free == 0) {
+    TOR_LIST_REMOVE(slab, node);
+    TOR_LIST_INSERT_HEAD(&pool->partial, slab, node);
+  }
+  *(void **)obj = slab->free_list;
+  slab->free_list = obj;
+  --pool->n_used;
+
+  if (++slab->n_free < pool->slots_per_slab)
+    return;
+
+  /* The slab is empty: keep it if we are under the cache limit. */
+  TOR_LIST_REMOVE(slab, node);
+  if ((pool->n_empty_slabs + 1) * pool->slab_alloc_size >
+      pool->max_cached_bytes) {
+    cell_pool_slab_free(pool, slab);
+  } else {
+    TOR_LIST_INSERT_HEAD(&pool->empty, slab, node);
+    ++pool->n_empty_slabs;
+  }
+}
+
+/** Release empty slabs of <b>pool</b> until the ones left take at most
+ * <b>max_bytes</b>.  Return the number of bytes released. */
+static size_t
+cell_pool_trim_to(cell_pool_t *pool, size_t max_bytes)
+{
+  cell_pool_slab_t *slab;
+  size_t freed = 0;
+
+  while (pool->n_empty_slabs * pool->slab_alloc_size > max_bytes) {
+    slab = TOR_LIST_FIRST(&pool->empty);
+    tor_assert(slab);
+    TOR_LIST_REMOVE(slab, node);
+    --pool->n_empty_slabs;
+    cell_pool_slab_free(pool, slab);
+    freed += pool->slab_alloc_size;
+  }
+  return freed;
+}
+
+/** Keep at most <b>max_bytes</b> of empty slabs in <b>pool</b>, releasing
+ * any beyond that now. */
+void
+cell_pool_set_max_cached(cell_pool_t *pool, size_t max_bytes)
+{
+  tor_assert(pool);
+  pool->max_cached_bytes = max_bytes;
+  cell_pool_trim_to(pool, max_bytes);
+}
+
+/** Release every empty slab of <b>pool</b>.  Return the number of bytes
+ * released. */
+size_t
+cell_pool_trim(cell_pool_t *pool)
+{
+  tor_assert(pool);
+  return cell_pool_trim_to(pool, 0);
+}
+
+/** Return the name <b>pool</b> was created with. */
+const char *
+cell_pool_get_name(const cell_pool_t *pool)
+{
+  return pool->name;
+}
+
+/** Return the number of bytes each object of <b>pool</b> takes, alignment
+ * padding and slab back-pointer included. */
+size_t
+cell_pool_get_slot_size(const cell_pool_t *pool)
+{
+  return pool->slot_size;
+}
+
+/** Fill <b>out</b> with the current usage of <b>pool</b>. */
+void
+cell_pool_get_stats(const cell_pool_t *pool, cell_pool_stats_t *out)
+{
+  tor_assert(pool);
+  tor_assert(out);
+
+  memset(out, 0, sizeof(*out));
+  out->slot_size = pool->slot_size;
+  out->n_used = pool->n_used;
+  out->n_free = (pool->n_slabs - pool->n_empty_slabs) *
+    pool->slots_per_slab - pool->n_used;
+  out->n_empty_slabs = pool->n_empty_slabs;
+  out->n_slabs = pool->n_slabs;
+  out->bytes_allocated = pool->n_slabs * pool->slab_alloc_size;
+  out->n_allocs = pool->n_allocs;
+  out->n_slab_allocs = pool->n_slab_allocs;
+  out->n_slab_frees = pool->n_slab_frees;
+}
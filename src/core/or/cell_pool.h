@@ -0,0 +1,53 @@
+/* Copyright (c) 2007-2021, The Tor Project, Inc. */
+/* See LICENSE for licensing information */
+
+/**
+ * \file cell_pool.h
+ * \brief Header file for cell_pool.c.
+ **/
+
+#ifndef TOR_CELL_POOL_H
+#define TOR_CELL_POOL_H
+
+#include "lib/cc/torint.h"
+#include "lib/malloc/malloc.h"
+
+typedef struct cell_pool_t cell_pool_t;
+
+/** Usage counters of a cell_pool_t, see cell_pool_get_stats(). */
+typedef struct cell_pool_stats_t {
+  /** Bytes taken by each object, including alignment padding. */
+  size_t slot_size;
+  /** Objects handed out and not yet released. */
+  size_t n_used;
+  /** Free slots in slabs that still hold live objects. */
+  size_t n_free;
+  /** Slabs with no live object, kept for reuse. */
+  size_t n_empty_slabs;
+  /** All slabs, empty or not. */
+  size_t n_slabs;
+  /** Bytes held by all slabs. */
+  size_t bytes_allocated;
+  /** Number of cell_pool_alloc() calls so far. */
+  uint64_t n_allocs;
+  /** Number of slabs allocated and released so far. */
+  uint64_t n_slab_allocs;
+  uint64_t n_slab_frees;
+} cell_pool_stats_t;
+
+cell_pool_t *cell_pool_new(const char *name, size_t obj_size);
+void cell_pool_free_(cell_pool_t *pool);
+#define cell_pool_free(pool) \
+  FREE_AND_NULL(cell_pool_t, cell_pool_free_, (pool))
+
+void *cell_pool_alloc(cell_pool_t *pool);
+void cell_pool_release(cell_pool_t *pool, void *obj);
+
+void cell_pool_set_max_cached(cell_pool_t *pool, size_t max_bytes);
+size_t cell_pool_trim(cell_pool_t *pool);
+
+const char *cell_pool_get_name(const cell_pool_t *pool);
+size_t cell_pool_get_slot_size(const cell_pool_t *pool);
+void cell_pool_get_stats(const cell_pool_t *pool, cell_pool_stats_t *out);
+
+#endif /* !defined(TOR_CELL_POOL_H) */
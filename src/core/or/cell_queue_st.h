@@ -29,6 +29,11 @@ struct cell_queue_t {
   /** Linked list of packed_cell_t*/
   TOR_SIMPLEQ_HEAD(cell_simpleq_t, packed_cell_t) head;
   int n; /**< The number of cells in the queue. */
+  /** EWFD delay descriptors kept beside the cells, NULL if none. */
+  struct ewfd_delay_desc_queue_t *ewfd_delay;
+  /** EWFD dummy cells waiting to be sent; they are only built and
+   * encrypted when flushed, after every real cell in the queue. */
+  int ewfd_dummy_n;
 };
 
 #endif /* !defined(PACKED_CELL_ST_H) */
@@ -57,7 +57,7 @@
 #define CHANNEL_FILE_PRIVATE
 
 // enable temp log for debug
-#define EWFD_USE_TEMP_LOG
+// #define EWFD_USE_TEMP_LOG
 
 #include "core/or/or.h"
 #include "app/config/config.h"
@@ -947,6 +947,8 @@ channel_free_(channel_t *chan)
     chan->cmux = NULL;
   }
 
+  circid_table_clear(&chan->circid_table);
+
   tor_free(chan);
 }
 
@@ -1018,6 +1020,8 @@ channel_force_xfree(channel_t *chan)
     chan->cmux = NULL;
   }
 
+  circid_table_clear(&chan->circid_table);
+
   tor_free(chan);
 }
 
@@ -1118,6 +1122,26 @@ channel_set_cell_handlers(channel_t *chan,
   chan->cell_handler = cell_handler;
 }
 
+/**
+ * Set the handler for runs of same-circuit relay cells on a channel.
+ *
+ * This is optional; without it, channel_process_relay_cells() falls back to
+ * the fixed-length cell handler.
+ */
+void
+channel_set_relay_cells_handler(channel_t *chan,
+                                channel_cells_handler_fn_ptr handler)
+{
+  tor_assert(chan);
+  tor_assert(CHANNEL_CAN_HANDLE_CELLS(chan));
+
+  log_debug(LD_CHANNEL,
+           "Setting relay_cells_handler callback for channel %p to %p",
+           chan, handler);
+
+  chan->relay_cells_handler = handler;
+}
+
 /*
  * On closing channels
  *
@@ -2007,6 +2031,41 @@ channel_process_cell(channel_t *chan, cell_t *cell)
   chan->cell_handler(chan, cell);
 }
 
+/**
+ * Process <b>n_cells</b> relay cells that arrived on <b>chan</b>, in order,
+ * all with the same circuit ID.
+ *
+ * The channel hands the whole run to its relay cells handler if it has one,
+ * and to its cell handler one cell at a time otherwise.
+ */
+void
+channel_process_relay_cells(channel_t *chan, cell_t **cells, int n_cells)
+{
+  tor_assert(chan);
+  tor_assert(CHANNEL_IS_CLOSING(chan) || CHANNEL_IS_MAINT(chan) ||
+             CHANNEL_IS_OPEN(chan));
+  tor_assert(cells);
+
+  if (!chan->relay_cells_handler) {
+    for (int i = 0; i < n_cells; ++i)
+      channel_process_cell(chan, cells[i]);
+    return;
+  }
+
+  /* Timestamp for receiving */
+  channel_timestamp_recv(chan);
+  /* Update received counters. */
+  chan->n_cells_recved += n_cells;
+  chan->n_bytes_recved +=
+    (uint64_t)n_cells * get_cell_network_size(chan->wide_circ_ids);
+
+  log_debug(LD_CHANNEL,
+            "Processing %d incoming relay cells for channel %p (global ID "
+            "%"PRIu64 ")", n_cells, chan,
+            (chan->global_identifier));
+  chan->relay_cells_handler(chan, cells, n_cells);
+}
+
 /** If <b>packed_cell</b> on <b>chan</b> is a destroy cell, then set
  * *<b>circid_out</b> to its circuit ID, and return true.  Otherwise, return
  * false. */
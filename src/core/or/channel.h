@@ -10,6 +10,7 @@
 #define TOR_CHANNEL_H
 
 #include "core/or/or.h"
+#include "core/or/circid_table.h"
 #include "core/or/circuitmux.h"
 #include "lib/container/handles.h"
 #include "lib/crypt_ops/crypto_ed25519.h"
@@ -23,6 +24,7 @@ struct tor_timer_t;
 /* Channel handler function pointer typedefs */
 typedef void (*channel_listener_fn_ptr)(channel_listener_t *, channel_t *);
 typedef void (*channel_cell_handler_fn_ptr)(channel_t *, cell_t *);
+typedef void (*channel_cells_handler_fn_ptr)(channel_t *, cell_t **, int);
 
 /**
  * This enum is used by channelpadding to decide when to pad channels.
@@ -323,6 +325,8 @@ struct channel_t {
 
   /** Registered handlers for incoming cells */
   channel_cell_handler_fn_ptr cell_handler;
+  /** Optional handler for a run of relay cells on one circuit */
+  channel_cells_handler_fn_ptr relay_cells_handler;
 
   /* Methods implemented by the lower layer */
 
@@ -409,6 +413,11 @@ struct channel_t {
   /** For how many circuits are we n_chan?  What about p_chan? */
   unsigned int num_n_circuits, num_p_circuits;
 
+  /** Map from circuit ID to the circuits that use this channel as n_chan or
+   * p_chan, and to the IDs reserved until a destroy cell is sent.  Only
+   * circuitlist.c should touch this. */
+  circid_table_t circid_table;
+
   /**
    * True iff this channel shouldn't get any new circs attached to it,
    * because the connection is too old, or because there's a better one.
@@ -539,6 +548,8 @@ channel_cell_handler_fn_ptr channel_get_cell_handler(channel_t *chan);
 
 void channel_set_cell_handlers(channel_t *chan,
                                channel_cell_handler_fn_ptr cell_handler);
+void channel_set_relay_cells_handler(channel_t *chan,
+                                     channel_cells_handler_fn_ptr handler);
 
 /* Clean up closed channels and channel listeners periodically; these are
  * called from run_scheduled_events() in main.c.
@@ -627,6 +638,8 @@ void channel_listener_queue_incoming(channel_listener_t *listener,
 
 /* Incoming cell handling */
 void channel_process_cell(channel_t *chan, cell_t *cell);
+void channel_process_relay_cells(channel_t *chan, cell_t **cells,
+                                 int n_cells);
 
 /* Request from lower layer for more cells if available */
 MOCK_DECL(ssize_t, channel_flush_some_cells,
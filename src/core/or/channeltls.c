@@ -1054,6 +1054,21 @@ channel_tls_time_process_cell(cell_t *cell, channel_tls_t *chan, int *time,
 #define PROCESS_CELL(tp, cl, cn) channel_tls_process_ ## tp ## _cell(cl, cn)
 #endif /* defined(KEEP_TIMING_STATS) */
 
+/**
+ * Account for a fixed-length cell read on <b>chan</b>.
+ */
+static void
+channel_tls_note_cell_read(channel_tls_t *chan)
+{
+  /* We note that we're on the internet whenever we read a cell. This is
+   * a fast operation. */
+  entry_guards_note_internet_connectivity(get_guard_selection_info());
+  rep_hist_padding_count_read(PADDING_TYPE_TOTAL);
+
+  if (TLS_CHAN_TO_BASE(chan)->padding_enabled)
+    rep_hist_padding_count_read(PADDING_TYPE_ENABLED_TOTAL);
+}
+
 /**
  * Handle an incoming cell on a channel_tls_t.
  *
@@ -1107,13 +1122,7 @@ channel_tls_handle_cell(cell_t *cell, or_connection_t *conn)
   if (conn->base_.state == OR_CONN_STATE_OR_HANDSHAKING_V3)
     or_handshake_state_record_cell(conn, conn->handshake_state, cell, 1);
 
-  /* We note that we're on the internet whenever we read a cell. This is
-   * a fast operation. */
-  entry_guards_note_internet_connectivity(get_guard_selection_info());
-  rep_hist_padding_count_read(PADDING_TYPE_TOTAL);
-
-  if (TLS_CHAN_TO_BASE(chan)->padding_enabled)
-    rep_hist_padding_count_read(PADDING_TYPE_ENABLED_TOTAL);
+  channel_tls_note_cell_read(chan);
 
   switch (cell->command) {
     case CELL_PADDING:
@@ -1166,6 +1175,73 @@ channel_tls_handle_cell(cell_t *cell, or_connection_t *conn)
   }
 }
 
+/** Return true iff <b>cell</b> is a relay cell that
+ * channel_tls_handle_cells() may hand over along with its neighbours. */
+static inline int
+channel_tls_cell_is_batchable(const cell_t *cell)
+{
+  return cell->command == CELL_RELAY || cell->command == CELL_RELAY_EARLY;
+}
+
+/**
+ * Handle the <b>n_cells</b> fixed-length cells in <b>cells</b>, which
+ * arrived on <b>conn</b> in that order.
+ *
+ * Once the connection is open, the cells are grouped by circuit ID, keeping
+ * their order within each circuit, and each run of relay cells for one
+ * circuit goes to channel_process_relay_cells() in a single call, so the
+ * circuit is looked up and its crypto applied once per run.  Cells for
+ * different circuits are independent, so reordering them is safe; anything
+ * else is handled on its own with channel_tls_handle_cell().
+ */
+void
+channel_tls_handle_cells(cell_t *cells, int n_cells, or_connection_t *conn)
+{
+  cell_t *order[CHANNEL_TLS_CELL_BATCH_MAX];
+  channel_tls_t *chan;
+  int i, j;
+
+  tor_assert(cells);
+  tor_assert(conn);
+  tor_assert(n_cells <= CHANNEL_TLS_CELL_BATCH_MAX);
+
+  chan = conn->chan;
+
+  if (!chan || TO_CONN(conn)->state != OR_CONN_STATE_OPEN) {
+    for (i = 0; i < n_cells; ++i)
+      channel_tls_handle_cell(&cells[i], conn);
+    return;
+  }
+
+  /* Stable insertion sort by circuit ID: batches are small, and usually
+   * already come in runs. */
+  for (i = 0; i < n_cells; ++i) {
+    for (j = i; j > 0 && order[j-1]->circ_id > cells[i].circ_id; --j)
+      order[j] = order[j-1];
+    order[j] = &cells[i];
+  }
+
+  for (i = 0; i < n_cells; i = j) {
+    if (conn->base_.marked_for_close)
+      return;
+
+    if (!channel_tls_cell_is_batchable(order[i])) {
+      channel_tls_handle_cell(order[i], conn);
+      j = i + 1;
+      continue;
+    }
+
+    for (j = i + 1; j < n_cells; ++j) {
+      if (!channel_tls_cell_is_batchable(order[j]) ||
+          order[j]->circ_id != order[i]->circ_id)
+        break;
+    }
+    for (int k = i; k < j; ++k)
+      channel_tls_note_cell_read(chan);
+    channel_process_relay_cells(TLS_CHAN_TO_BASE(chan), &order[i], j - i);
+  }
+}
+
 /**
  * Handle an incoming variable-length cell on a channel_tls_t.
  *
@@ -50,7 +50,11 @@ const channel_t * channel_tls_to_base_const(const channel_tls_t *tlschan);
 const channel_tls_t * channel_tls_from_base_const(const channel_t *chan);
 
 /* Things for connection_or.c to call back into */
+/** Most cells connection_or.c passes to channel_tls_handle_cells() at once */
+#define CHANNEL_TLS_CELL_BATCH_MAX 32
 void channel_tls_handle_cell(cell_t *cell, or_connection_t *conn);
+void channel_tls_handle_cells(cell_t *cells, int n_cells,
+                              or_connection_t *conn);
 void channel_tls_handle_state_change_on_orconn(channel_tls_t *chan,
                                                or_connection_t *conn,
                                                uint8_t state);
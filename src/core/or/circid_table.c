@@ -0,0 +1,137 @@
+/* Copyright (c) 2001 Matej Pfajfar.
+ * Copyright (c) 2001-2004, Roger Dingledine.
+ * Copyright (c) 2004-2006, Roger Dingledine, Nick Mathewson.
+ * Copyright (c) 2007-2021, The Tor Project, Inc. */
+/* See LICENSE for licensing information */
+
+/**
+ * \file circid_table.c
+ * \brief Per-channel map from circuit ID to circuit.
+ *
+ * Every cell that arrives on a channel needs its circuit looked up by
+ * circuit ID, so this lookup is on the critical path.  Each channel keeps
+ * its own circid_table_t: an open-addressed table with linear probing, kept
+ * at most half full.  A lookup hashes the ID with one multiplication and
+ * usually finds its entry in the first slot it reads.  Since the table only
+ * holds the circuits of one channel, it stays small and hot in the cache
+ * even when the relay as a whole has a very large number of circuits.
+ *
+ * Removal shifts later entries of the probe run back instead of leaving
+ * tombstones, so lookups never get slower as circuits come and go.
+ **/
+
+#include "core/or/or.h"
+#include "core/or/circid_table.h"
+#include "lib/crypt_ops/crypto_rand.h"
+
+/** log2 of the number of slots in a freshly allocated table. */
+#define CIRCID_TABLE_MIN_BITS 4
+
+/** Return the number of slots in <b>t</b>. */
+static inline uint32_t
+circid_table_n_slots(const circid_table_t *t)
+{
+  return t->ents ? t->mask + 1 : 0;
+}
+
+/** Replace the slots of <b>t</b> with 2^<b>bits</b> empty ones, and put
+ * back every entry the table held. */
+static void
+circid_table_resize(circid_table_t *t, uint8_t bits)
+{
+  circid_table_ent_t *old_ents = t->ents;
+  uint32_t old_n_slots = circid_table_n_slots(t);
+  uint32_t i, j;
+
+  tor_assert(bits < 32);
+  if (!old_ents) {
+    crypto_fast_rng_getbytes(get_thread_fast_rng(),
+                             (uint8_t *)&t->hash_key, sizeof(t->hash_key));
+    t->hash_key |= 1;
+  }
+  t->bits = bits;
+  t->mask = (UINT32_C(1) << bits) - 1;
+  t->ents = tor_calloc(t->mask + 1, sizeof(circid_table_ent_t));
+
+  for (i = 0; i < old_n_slots; ++i) {
+    if (!old_ents[i].in_use)
+      continue;
+    for (j = circid_table_slot(t, old_ents[i].circ_id); t->ents[j].in_use;
+         j = (j + 1) & t->mask)
+      ;
+    t->ents[j] = old_ents[i];
+  }
+  tor_free(old_ents);
+}
+
+/** Return the entry for <b>circ_id</b> in <b>t</b>, adding an empty one
+ * (with no circuit) if there is none.  The entry stays valid until the
+ * table is next modified. */
+circid_table_ent_t *
+circid_table_insert(circid_table_t *t, circid_t circ_id)
+{
+  circid_table_ent_t *ent;
+  uint32_t i;
+
+  ent = circid_table_find(t, circ_id);
+  if (ent)
+    return ent;
+
+  /* Keep the load factor at or under one half. */
+  if (!t->ents)
+    circid_table_resize(t, CIRCID_TABLE_MIN_BITS);
+  else if ((t->n_entries + 1) * 2 > circid_table_n_slots(t))
+    circid_table_resize(t, t->bits + 1);
+
+  for (i = circid_table_slot(t, circ_id); t->ents[i].in_use;
+       i = (i + 1) & t->mask)
+    ;
+  ent = &t->ents[i];
+  ent->circ_id = circ_id;
+  ent->in_use = 1;
+  ++t->n_entries;
+  return ent;
+}
+
+/** Remove the entry for <b>circ_id</b> from <b>t</b>.  If there was one,
+ * copy it to <b>removed_out</b> (if provided) and return 1; otherwise
+ * return 0. */
+int
+circid_table_remove(circid_table_t *t, circid_t circ_id,
+                    circid_table_ent_t *removed_out)
+{
+  circid_table_ent_t *ent = circid_table_find(t, circ_id);
+  uint32_t hole, i, home;
+
+  if (!ent)
+    return 0;
+  if (removed_out)
+    *removed_out = *ent;
+
+  /* Walk the rest of the probe run, moving back into the hole every entry
+   * whose home slot does not lie strictly between the hole and itself. */
+  hole = (uint32_t)(ent - t->ents);
+  for (i = (hole + 1) & t->mask; t->ents[i].in_use; i = (i + 1) & t->mask) {
+    home = circid_table_slot(t, t->ents[i].circ_id);
+    if (((i - home) & t->mask) >= ((i - hole) & t->mask)) {
+      t->ents[hole] = t->ents[i];
+      hole = i;
+    }
+  }
+  memset(&t->ents[hole], 0, sizeof(t->ents[hole]));
+  --t->n_entries;
+
+  /* Give memory back once a busy channel has quietened down. */
+  if (t->bits > CIRCID_TABLE_MIN_BITS &&
+      t->n_entries * 8 < circid_table_n_slots(t))
+    circid_table_resize(t, t->bits - 1);
+  return 1;
+}
+
+/** Remove every entry from <b>t</b> and release its storage. */
+void
+circid_table_clear(circid_table_t *t)
+{
+  tor_free(t->ents);
+  memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,78 @@
+/* Copyright (c) 2001 Matej Pfajfar.
+ * Copyright (c) 2001-2004, Roger Dingledine.
+ * Copyright (c) 2004-2006, Roger Dingledine, Nick Mathewson.
+ * Copyright (c) 2007-2021, The Tor Project, Inc. */
+/* See LICENSE for licensing information */
+
+/**
+ * \file circid_table.h
+ * \brief Header file for circid_table.c.
+ **/
+
+#ifndef TOR_CIRCID_TABLE_H
+#define TOR_CIRCID_TABLE_H
+
+#include "core/or/or.h"
+
+/** One slot of a circid_table_t. */
+typedef struct circid_table_ent_t {
+  /** The circuit ID this slot holds; meaningless unless <b>in_use</b>. */
+  circid_t circ_id;
+  /** True iff this slot holds an entry. */
+  uint32_t in_use;
+  /** The circuit with this ID, or NULL if the ID is only reserved until a
+   * queued destroy cell is sent. */
+  circuit_t *circuit;
+  /* For debugging 12184: when was this placeholder item added? */
+  time_t made_placeholder_at;
+} circid_table_ent_t;
+
+/** An open-addressed map from circuit ID to circuit, for the circuits of a
+ * single channel.  An all-zero circid_table_t is a valid empty table. */
+typedef struct circid_table_t {
+  /** Array of <b>mask</b>+1 slots, or NULL if we have never had an entry. */
+  circid_table_ent_t *ents;
+  /** Number of slots minus one; the number of slots is a power of two. */
+  uint32_t mask;
+  /** log2 of the number of slots. */
+  uint8_t bits;
+  /** Number of slots in use. */
+  uint32_t n_entries;
+  /** Random odd multiplier for hashing, chosen when <b>ents</b> is first
+   * allocated, so that the other end of the channel can't pick circuit
+   * IDs that collide. */
+  uint64_t hash_key;
+} circid_table_t;
+
+/** Return the slot where a probe for <b>circ_id</b> starts in <b>t</b>. */
+static inline uint32_t
+circid_table_slot(const circid_table_t *t, circid_t circ_id)
+{
+  /* Multiply-shift hashing: the top bits of the product are well mixed. */
+  return (uint32_t) ((t->hash_key * (uint64_t)circ_id) >> (64 - t->bits));
+}
+
+/** Return the entry for <b>circ_id</b> in <b>t</b>, or NULL if there is
+ * none.  The entry stays valid until the table is next modified. */
+static inline circid_table_ent_t *
+circid_table_find(const circid_table_t *t, circid_t circ_id)
+{
+  uint32_t i;
+
+  if (!t->n_entries)
+    return NULL;
+  for (i = circid_table_slot(t, circ_id); ; i = (i + 1) & t->mask) {
+    circid_table_ent_t *ent = &t->ents[i];
+    if (!ent->in_use)
+      return NULL;
+    if (ent->circ_id == circ_id)
+      return ent;
+  }
+}
+
+circid_table_ent_t *circid_table_insert(circid_table_t *t, circid_t circ_id);
+int circid_table_remove(circid_table_t *t, circid_t circ_id,
+                        circid_table_ent_t *removed_out);
+void circid_table_clear(circid_table_t *t);
+
+#endif /* !defined(TOR_CIRCID_TABLE_H) */
@@ -1,8 +1,9 @@
 
 #define CIRCUITMUX_PRIVATE
 #include "core/or/circuitmux.h"
-#define EWFD_USE_TEMP_LOG
+// #define EWFD_USE_TEMP_LOG
 #include "feature/ewfd/debug.h"
+#include "feature/ewfd/ewfd_trace.h"
 #define CIRCUITMUX_EWFD_PRIVATE
 #include "circuitmux_ewfd.h"
 
@@ -30,6 +31,7 @@
 
 
 #include "feature/ewfd/ewfd_op.h"
+#include "feature/ewfd/ewfd_conf.h"
 #include "lib/crypt_ops/crypto_util.h"
 
 extern circuitmux_policy_t ewma_policy;
@@ -101,7 +103,6 @@ ewfd_delay_cmp_cmux(circuitmux_t *cmux_1, circuitmux_policy_data_t *pol_data_1,
               circuitmux_t *cmux_2, circuitmux_policy_data_t *pol_data_2);
 
 static int compare_cell_ewfd_active_circ(const void *p1, const void *p2);
-static int compare_cell_ewfd_sleep_circ(const void *p1, const void *p2);
 
 static void ewfd_add_to_active_queue(ewfd_policy_data_t* pol, cell_ewfd_delay_t *item);
 static void ewfd_add_to_inactive_queue(ewfd_policy_data_t* pol, cell_ewfd_delay_t *item);
@@ -115,6 +116,11 @@ static void ewfd_cmux_revoke_inactive_queue(cell_ewfd_delay_t *delay_item, circu
 
 static void ewfd_send_dummy_packet(circuit_t *circ, cell_ewfd_delay_t *delay_item);
 
+static bool ewfd_delay_trigger_item(ewfd_policy_data_t *pol, ewfd_policy_circ_data_t *circ_data, uint64_t cur_ti);
+static uint64_t ewfd_delay_next_wake_ti(const cell_ewfd_delay_t *item, uint64_t now_ti);
+static void ewfd_delay_rearm_wake(ewfd_policy_data_t *pol, cell_ewfd_delay_t *item, uint64_t now_ti);
+static void ewfd_remove_sleeper_item(ewfd_policy_data_t *pol, cell_ewfd_delay_t *item);
+
 circuitmux_policy_t ewfd_delay_policy = {
   /*.alloc_cmux_data =*/ ewfd_delay_alloc_cmux_data,
   /*.free_cmux_data =*/ ewfd_delay_free_cmux_data,
@@ -147,22 +153,50 @@ gap:
 */
 
 
-static inline circuitmux_t* ewfd_get_cmux_from_circ(circuit_t *circ) {
-  channel_t *chan = NULL;
-
-
+// circ已经释放或者还没有attach到chan时返回NULL
+static inline channel_t* ewfd_get_chan_from_circ(circuit_t *circ) {
   if (circ->magic == OR_CIRCUIT_MAGIC) {
-    or_circuit_t *or_circ = TO_OR_CIRCUIT(circ);
-    chan = or_circ->p_chan;
+    return TO_OR_CIRCUIT(circ)->p_chan;
   } else if (circ->magic == ORIGIN_CIRCUIT_MAGIC) {
-    chan = circ->n_chan;
-  } else { // is release
-    return NULL;
+    return circ->n_chan;
   }
+  return NULL;
+}
 
-  tor_assert(chan);
+/* 有sleep circ的cmux列表，唤醒时只遍历这些cmux
+* ewfd_next_wake_ti: 所有cmux中最早的唤醒时间，add时只会提前，可能偏早
+*/
+static smartlist_t *ewfd_sleep_cmux_list = NULL;
+static uint64_t ewfd_next_wake_ti = UINT64_MAX;
 
-  return chan->cmux;
+static void ewfd_sleep_cmux_add(ewfd_policy_data_t *pol) {
+  if (pol->sleep_idx != -1) {
+    return;
+  }
+  if (ewfd_sleep_cmux_list == NULL) {
+    ewfd_sleep_cmux_list = smartlist_new();
+  }
+  pol->sleep_idx = smartlist_len(ewfd_sleep_cmux_list);
+  smartlist_add(ewfd_sleep_cmux_list, pol);
+}
+
+static void ewfd_sleep_cmux_remove(ewfd_policy_data_t *pol) {
+  if (pol->sleep_idx == -1) {
+    return;
+  }
+  // smartlist_del把最后一个移到当前位置，更新它的idx
+  smartlist_del(ewfd_sleep_cmux_list, pol->sleep_idx);
+  if (pol->sleep_idx < smartlist_len(ewfd_sleep_cmux_list)) {
+    ewfd_policy_data_t *moved = smartlist_get(ewfd_sleep_cmux_list, pol->sleep_idx);
+    moved->sleep_idx = pol->sleep_idx;
+  }
+  pol->sleep_idx = -1;
+
+  if (smartlist_len(ewfd_sleep_cmux_list) == 0) {
+    smartlist_free(ewfd_sleep_cmux_list);
+    ewfd_sleep_cmux_list = NULL;
+    ewfd_next_wake_ti = UINT64_MAX;
+  }
 }
 
 
@@ -173,7 +207,7 @@ static circuitmux_policy_data_t * ewfd_delay_alloc_cmux_data(circuitmux_t *cmux)
   ewfd_policy_data_t *pol = tor_malloc_zero(sizeof(*pol));
   pol->base_.magic = EWFD_POL_DATA_MAGIC;
   pol->active_circuit_pqueue = smartlist_new();
-  pol->inactive_circuit_pqueue = smartlist_new();
+  pol->sleep_idx = -1;
   pol->idx = ewfd_cmux_idx++;
   return TO_CMUX_POL_DATA(pol);
 }
@@ -187,7 +221,11 @@ static void ewfd_delay_free_cmux_data(circuitmux_t *cmux,
 
   ewfd_policy_data_t *pol = TO_EWFD_POL_DATA(pol_data);
   smartlist_free(pol->active_circuit_pqueue);
-  smartlist_free(pol->inactive_circuit_pqueue);
+  ewfd_sleep_cmux_remove(pol);
+  if (pol->sleep_wheel) {
+    ewfd_wheel_clear(pol->sleep_wheel);
+    tor_free(pol->sleep_wheel);
+  }
   memwipe(pol, 0xda, sizeof(ewfd_policy_data_t));
   tor_free(pol);
 }
@@ -205,7 +243,6 @@ ewfd_delay_alloc_circ_data(circuitmux_t *cmux, circuitmux_policy_data_t *pol_dat
   pol_circ->circ = circ;
   pol_circ->cell_ewfd_delay.delay_state = EWFD_MODE_NORMAL;
   pol_circ->cell_ewfd_delay.active_hindex = -1;
-  pol_circ->cell_ewfd_delay.inactive_hindex = -1;
 
   return TO_CMUX_POL_CIRC_DATA(pol_circ);
 }
@@ -226,6 +263,7 @@ static void ewfd_delay_free_circ_data(circuitmux_t *cmux,
   // remove pol from queues
   ewfd_remove_active_item(pol, &circ_data->cell_ewfd_delay);
   ewfd_remove_inactive_item(pol, &circ_data->cell_ewfd_delay);
+  ewfd_remove_sleeper_item(pol, &circ_data->cell_ewfd_delay);
 
   ewfd_log_all_queue_circuits(pol, "[delay-event] free-policy");
 
@@ -259,6 +297,7 @@ static void ewfd_delay_notify_circ_active(circuitmux_t *cmux,
     uint64_t gap_finish_ti = delay_item->burst_finish_ti + delay_item->gap_ti;
     if (gap_finish_ti <= cur_ti) {
       delay_item->delay_state = EWFD_MODE_BURST;
+      ewfd_delay_rearm_wake(pol, delay_item, cur_ti);
     }
   }
 
@@ -350,6 +389,7 @@ static void ewfd_delay_set_n_cells(circuitmux_t *cmux,
       delay_item->burst_send_cnt = 0;
       delay_item->cur_send_cnt = 0;
       ewfd_add_to_inactive_queue(pol, delay_item);
+      ewfd_delay_rearm_wake(pol, delay_item, monotime_absolute_msec());
     }
   }
 }
@@ -422,7 +462,7 @@ static circuit_t * ewfd_delay_pick_active_circuit(circuitmux_t *cmux,
       tor_assert(false);
     }
   } else {
-    EWFD_TEMP_LOG("[delay-event] step:pick_active_no_circ");
+    EWFD_TRACE(EWFD_TRACE_CMUX_PICK_NONE, 0, pol->idx, 0);
   }
 
   // tor_assert(circ);
@@ -440,28 +480,22 @@ static void ewfd_add_to_active_queue(ewfd_policy_data_t* pol, cell_ewfd_delay_t
     smartlist_pqueue_remove(pol->active_circuit_pqueue, compare_cell_ewfd_active_circ,
       offsetof(cell_ewfd_delay_t, active_hindex), item);
   }
-  if (item->inactive_hindex != -1) {
-    smartlist_pqueue_remove(pol->inactive_circuit_pqueue, compare_cell_ewfd_sleep_circ,
-      offsetof(cell_ewfd_delay_t, inactive_hindex), item);
-  }
+  ewfd_remove_inactive_item(pol, item);
   tor_assert(item->delay_state == EWFD_MODE_NORMAL || item->delay_state == EWFD_MODE_BURST);
   smartlist_pqueue_add(pol->active_circuit_pqueue, compare_cell_ewfd_active_circ,
     offsetof(cell_ewfd_delay_t, active_hindex), item);
 }
 
 
+/* inactive只记录状态，唤醒的顺序由sleep_wheel决定，不需要再维护一个按时间排序的堆
+*/
 static void ewfd_add_to_inactive_queue(ewfd_policy_data_t* pol, cell_ewfd_delay_t *item)
 {
-  if (item->active_hindex != -1) {
-    smartlist_pqueue_remove(pol->active_circuit_pqueue, compare_cell_ewfd_active_circ,
-      offsetof(cell_ewfd_delay_t, active_hindex), item);
+  ewfd_remove_active_item(pol, item);
+  if (!item->is_inactive) {
+    item->is_inactive = 1;
+    pol->inactive_num++;
   }
-  if (item->inactive_hindex != -1) {
-    smartlist_pqueue_remove(pol->inactive_circuit_pqueue, compare_cell_ewfd_sleep_circ,
-      offsetof(cell_ewfd_delay_t, inactive_hindex), item);
-  }
-  smartlist_pqueue_add(pol->inactive_circuit_pqueue, compare_cell_ewfd_sleep_circ,
-    offsetof(cell_ewfd_delay_t, inactive_hindex), item);
 }
 
 static void ewfd_remove_active_item(ewfd_policy_data_t *pol, cell_ewfd_delay_t *ewfd_item) {
@@ -480,12 +514,10 @@ static void ewfd_remove_active_item(ewfd_policy_data_t *pol, cell_ewfd_delay_t *
 static void ewfd_remove_inactive_item(ewfd_policy_data_t *pol, cell_ewfd_delay_t *ewfd_item)
 {
   tor_assert(pol);
-  tor_assert(pol->inactive_circuit_pqueue);
   tor_assert(ewfd_item);
-  if (ewfd_item->inactive_hindex != -1) {
-    smartlist_pqueue_remove(pol->inactive_circuit_pqueue,
-                        compare_cell_ewfd_sleep_circ,
-                        offsetof(cell_ewfd_delay_t, inactive_hindex), ewfd_item);
+  if (ewfd_item->is_inactive) {
+    ewfd_item->is_inactive = 0;
+    pol->inactive_num--;
   }
 }
 
@@ -534,21 +566,6 @@ static int compare_cell_ewfd_active_circ(const void *p1, const void *p2) {
   // return 0;
 }
 
-/*
-*  1. 发送时间更接近的
-*/
-static int compare_cell_ewfd_sleep_circ(const void *p1, const void *p2) {
-  const cell_ewfd_delay_t *a = p1, *b = p2;
-  uint64_t a_gap_finish_ti = a->burst_finish_ti + a->gap_ti;
-  uint64_t b_gap_finish_ti = b->burst_finish_ti + b->gap_ti;
-  if (a_gap_finish_ti < b_gap_finish_ti) {
-    return 1;
-  } else if (a_gap_finish_ti > b_gap_finish_ti) {
-    return 0;
-  }
-  return 0;
-}
-
 /* 对列选取
 *  1. 选取真实包最多的  
 */
@@ -583,7 +600,7 @@ static int ewfd_delay_cmp_cmux(circuitmux_t *cmux_1, circuitmux_policy_data_t *p
 
 
 
-static const char* get_delay_state_string(int delay_state) 
+ATTR_UNUSED static const char* get_delay_state_string(int delay_state)
 {
   switch (delay_state) {
     case EWFD_MODE_NORMAL:
@@ -656,6 +673,7 @@ bool circuitmux_set_advance_delay(circuit_t *circ, uint64_t gap_ti_ms, uint32_t
     delay_item->burst_send_cnt = pkt_num;
     delay_item->cur_send_cnt = 0;
     delay_item->burst_finish_ti = monotime_absolute_msec();
+    ewfd_delay_rearm_wake(pol, delay_item, delay_item->burst_finish_ti);
     return true;
   }
 
@@ -669,10 +687,7 @@ bool circuitmux_set_advance_delay(circuit_t *circ, uint64_t gap_ti_ms, uint32_t
     }
   }
 
-  EWFD_LOG("[delay-event] step:advance_delay cmux-id:%d circ:%d state:%s gap:%lu cur_ti:%lu want:%u cur:%u burst:%u remain:%u in_active:%d, in_sleep:%d", 
-      pol->idx, ewfd_get_circuit_id(circ), get_delay_state_string(delay_item->delay_state), gap_finish_ti, cur_ti, 
-      pkt_num, delay_item->cur_send_cnt, delay_item->burst_send_cnt, delay_item->remain_real_pkt, 
-      delay_item->active_hindex != -1);
+  EWFD_TRACE(EWFD_TRACE_ADVANCE_DELAY, ewfd_get_circuit_id(circ), delay_item->delay_state, gap_finish_ti);
 
   // 上次gap是否结束
   if (delay_item->delay_state != EWFD_MODE_WAIT_TO_BURST) {
@@ -683,13 +698,13 @@ bool circuitmux_set_advance_delay(circuit_t *circ, uint64_t gap_ti_ms, uint32_t
     return false;
   }
 
-  EWFD_TEMP_LOG("[delay-state] step:advance_delay_trigger cmux:%p cmux-id:%d circ:%d state:%s->%s cur:%u burst:%u remain:%u", cmux, pol->idx, ewfd_get_circuit_id(circ), 
-    get_delay_state_string(delay_item->delay_state), "BURST", delay_item->cur_send_cnt, delay_item->burst_send_cnt, delay_item->remain_real_pkt);
+  EWFD_TRACE(EWFD_TRACE_DELAY_TRIGGER, ewfd_get_circuit_id(circ), EWFD_MODE_BURST, delay_item->remain_real_pkt);
   
   delay_item->delay_state = EWFD_MODE_BURST;
   delay_item->gap_ti = gap_ti_ms;
   delay_item->cur_send_cnt = 0;
   delay_item->burst_send_cnt = pkt_num;
+  ewfd_delay_rearm_wake(pol, delay_item, cur_ti);
 
   // 由WAIT_TO_BURST唤醒, 需要从inactive队列中拉出来
   ewfd_cmux_revoke_inactive_queue(delay_item, circ, pol, chan);
@@ -703,30 +718,15 @@ bool circuitmux_set_advance_delay(circuit_t *circ, uint64_t gap_ti_ms, uint32_t
 * 2. 对于没有包的burst队列，发送一个dummy包  
 * @return true: should release
 */
-bool circuitmux_trigger_inactive_circ(circuit_t *circ, uint64_t tick_ms)
+static bool ewfd_delay_trigger_item(ewfd_policy_data_t *pol, ewfd_policy_circ_data_t *circ_data, uint64_t cur_ti)
 {
-  channel_t *chan = NULL;
+  cell_ewfd_delay_t *delay_item = &circ_data->cell_ewfd_delay;
+  circuit_t *circ = circ_data->circ;
 
-  if (circ->magic == OR_CIRCUIT_MAGIC) {
-    or_circuit_t *or_circ = TO_OR_CIRCUIT(circ);
-    chan = or_circ->p_chan;
-  } else if (circ->magic == ORIGIN_CIRCUIT_MAGIC) {
-    chan = circ->n_chan;
-  } else { // is release
+  if (circ->magic != OR_CIRCUIT_MAGIC && circ->magic != ORIGIN_CIRCUIT_MAGIC) { // is release
     return true;
   }
 
-  tor_assert(chan);
-
-  circuitmux_t *cmux = chan->cmux;
-  tor_assert(cmux);
-
-  circuitmux_policy_circ_data_t* circ_policy = circuitmux_find_circ_policy(cmux, circ);
-
-  ewfd_policy_data_t *pol = TO_EWFD_POL_DATA(cmux->policy_data);
-  ewfd_policy_circ_data_t *circ_data = TO_EWFD_POL_CIRC_DATA(circ_policy);
-  cell_ewfd_delay_t *delay_item = &circ_data->cell_ewfd_delay;
-
   // 不再需要检查
   if (delay_item->delay_state == EWFD_MODE_DESTROY || delay_item->delay_state == EWFD_MODE_NORMAL) {
     EWFD_TEMP_LOG("[delay-event] step:trigger_event-release circ:%d state:%s li:%d", 
@@ -740,13 +740,8 @@ bool circuitmux_trigger_inactive_circ(circuit_t *circ, uint64_t tick_ms)
   ewfd_log_all_queue_circuits(pol, "[delay-event] trigger_event");
 
   // 检查gap是否结束
-  /*
-  GAP结束，如何退出？
-  GAP结束了，不再trigger-event?
-  */
-  uint64_t cur_ti = monotime_absolute_msec();
+  uint64_t gap_finish_ti = delay_item->burst_finish_ti + delay_item->gap_ti;
   if (delay_item->delay_state == EWFD_MODE_GAP) {
-    uint64_t gap_finish_ti = delay_item->burst_finish_ti + delay_item->gap_ti;
     if (gap_finish_ti <= cur_ti) {
       delay_item->delay_state = EWFD_MODE_WAIT_TO_BURST;
     }
@@ -755,8 +750,7 @@ bool circuitmux_trigger_inactive_circ(circuit_t *circ, uint64_t tick_ms)
   // wait_to_burst 啥都不做
   if (delay_item->delay_state == EWFD_MODE_WAIT_TO_BURST) {
     // 已经结束，set_advance已经不调用
-    uint64_t gap_finish_ti = delay_item->burst_finish_ti + delay_item->gap_ti;
-    if (gap_finish_ti + 500 <= cur_ti) {
+    if (gap_finish_ti + EWFD_DELAY_WAIT_BURST_MS <= cur_ti) {
       delay_item->delay_state = EWFD_MODE_NORMAL;
 
       if (delay_item->remain_real_pkt == 0) {
@@ -764,7 +758,7 @@ bool circuitmux_trigger_inactive_circ(circuit_t *circ, uint64_t tick_ms)
         ewfd_remove_inactive_item(pol, delay_item);
       } else {
         ewfd_add_to_active_queue(pol, delay_item);
-        scheduler_channel_has_waiting_cells(chan);
+        scheduler_channel_has_waiting_cells(ewfd_get_chan_from_circ(circ));
       }
       return true;
     }
@@ -772,24 +766,172 @@ bool circuitmux_trigger_inactive_circ(circuit_t *circ, uint64_t tick_ms)
   }
 
   if (delay_item->delay_state == EWFD_MODE_BURST) {
-    EWFD_TEMP_LOG("[delay-event] step:trigger_event-trigger circ:%d state:%s remain:%u cur:%u burst:%u ti:%lu li:%d", 
-      ewfd_get_circuit_id(circ), get_delay_state_string(delay_item->delay_state), 
-      delay_item->remain_real_pkt, delay_item->cur_send_cnt, delay_item->burst_send_cnt, cur_ti, __LINE__);
+    EWFD_TRACE(EWFD_TRACE_DELAY_TRIGGER, ewfd_get_circuit_id(circ), delay_item->delay_state,
+      delay_item->remain_real_pkt);
      // add dummy packet
     if (delay_item->burst_send_cnt > delay_item->cur_send_cnt && delay_item->remain_real_pkt == 0) {
       ewfd_send_dummy_packet(circ, delay_item);
     } 
-    if (delay_item->inactive_hindex != -1) {
+    if (delay_item->is_inactive) {
       // 唤醒调度
       ewfd_add_to_active_queue(pol, delay_item);
-      scheduler_channel_has_waiting_cells(chan);
+      scheduler_channel_has_waiting_cells(ewfd_get_chan_from_circ(circ));
     }
   }
 
-
   return false;
 }
 
+/* 下一次需要trigger的时间
+* GAP: gap结束的时间
+* WAIT_TO_BURST: gap结束之后EWFD_DELAY_WAIT_BURST_MS回到NORMAL
+* 其他: 每个tick检查一次 (BURST时补dummy包，NORMAL时释放)
+*/
+static uint64_t ewfd_delay_next_wake_ti(const cell_ewfd_delay_t *item, uint64_t now_ti) {
+  uint64_t gap_finish_ti = item->burst_finish_ti + item->gap_ti;
+  switch (item->delay_state) {
+    case EWFD_MODE_GAP:
+      return gap_finish_ti;
+    case EWFD_MODE_WAIT_TO_BURST:
+      return gap_finish_ti + EWFD_DELAY_WAIT_BURST_MS;
+    default:
+      return now_ti + EWFD_EVENT_QUEUE_TICK_MS;
+  }
+}
+
+static void ewfd_delay_arm_wake(ewfd_policy_data_t *pol, cell_ewfd_delay_t *item, uint64_t wake_ti) {
+  ewfd_wheel_del(pol->sleep_wheel, &item->wake_node);
+  ewfd_wheel_add(pol->sleep_wheel, &item->wake_node, wake_ti);
+  if (wake_ti < ewfd_next_wake_ti) {
+    ewfd_next_wake_ti = wake_ti;
+  }
+}
+
+// 状态变化之后，已经在轮上的item按新状态重新计算唤醒时间
+static void ewfd_delay_rearm_wake(ewfd_policy_data_t *pol, cell_ewfd_delay_t *item, uint64_t now_ti) {
+  if (!ewfd_wheel_node_pending(&item->wake_node)) {
+    return;
+  }
+  ewfd_delay_arm_wake(pol, item, ewfd_delay_next_wake_ti(item, now_ti));
+}
+
+static void ewfd_remove_sleeper_item(ewfd_policy_data_t *pol, cell_ewfd_delay_t *item) {
+  if (pol->sleep_wheel == NULL) {
+    return;
+  }
+  ewfd_wheel_del(pol->sleep_wheel, &item->wake_node);
+  if (pol->sleep_wheel->node_num == 0) {
+    ewfd_sleep_cmux_remove(pol);
+  }
+}
+
+STATIC void ewfd_delay_add_sleeper(ewfd_policy_data_t *pol, ewfd_policy_circ_data_t *circ_data, uint64_t now_ti) {
+  cell_ewfd_delay_t *item = &circ_data->cell_ewfd_delay;
+
+  if (pol->sleep_wheel == NULL) {
+    pol->sleep_wheel = tor_malloc_zero(sizeof(ewfd_wheel_st));
+    ewfd_wheel_init(pol->sleep_wheel, now_ti);
+  } else if (pol->sleep_wheel->node_num == 0) {
+    // 空闲后先把时间轮推进到当前时间
+    ewfd_wheel_update(pol->sleep_wheel, now_ti);
+  }
+  ewfd_sleep_cmux_add(pol);
+
+  // 已经在轮上，只会提前唤醒
+  uint64_t wake_ti = ewfd_delay_next_wake_ti(item, now_ti);
+  if (ewfd_wheel_node_pending(&item->wake_node) && item->wake_node.expire_ti <= wake_ti) {
+    return;
+  }
+  ewfd_delay_arm_wake(pol, item, wake_ti);
+}
+
+/* 只取出到期的item，没释放的按新状态重新放回轮上
+* @return 唤醒的circ数量
+*/
+STATIC int ewfd_delay_wake_due(ewfd_policy_data_t *pol, uint64_t now_ti) {
+  ewfd_wheel_st *wheel = pol->sleep_wheel;
+  ewfd_wheel_node_st *node;
+  int woken = 0;
+
+  if (wheel == NULL || ewfd_wheel_next_expire(wheel) > now_ti) {
+    return 0;
+  }
+
+  ewfd_wheel_update(wheel, now_ti);
+  while ((node = ewfd_wheel_get_expired(wheel)) != NULL) {
+    cell_ewfd_delay_t *item = SUBTYPE_P(node, cell_ewfd_delay_t, wake_node);
+    ewfd_policy_circ_data_t *circ_data = SUBTYPE_P(item, ewfd_policy_circ_data_t, cell_ewfd_delay);
+    woken++;
+    if (!ewfd_delay_trigger_item(pol, circ_data, now_ti)) {
+      // 必须晚于now_ti，否则会再次进入expired链表
+      ewfd_delay_arm_wake(pol, item, MAX(ewfd_delay_next_wake_ti(item, now_ti), now_ti + 1));
+    }
+  }
+
+  if (wheel->node_num == 0) {
+    ewfd_sleep_cmux_remove(pol);
+  }
+  return woken;
+}
+
+// 找到circ在当前chan的cmux上的policy数据，circ没有attach时返回false
+static bool ewfd_find_delay_data(circuit_t *circ, ewfd_policy_data_t **pol_out,
+                                 ewfd_policy_circ_data_t **circ_data_out) {
+  channel_t *chan = ewfd_get_chan_from_circ(circ);
+  if (chan == NULL || chan->cmux == NULL || chan->cmux->policy != &ewfd_delay_policy) {
+    return false;
+  }
+  circuitmux_policy_circ_data_t *circ_policy = circuitmux_find_circ_policy(chan->cmux, circ);
+  if (circ_policy == NULL) {
+    return false;
+  }
+  *pol_out = TO_EWFD_POL_DATA(chan->cmux->policy_data);
+  *circ_data_out = TO_EWFD_POL_CIRC_DATA(circ_policy);
+  return true;
+}
+
+void circuitmux_ewfd_add_sleeper(circuit_t *circ) {
+  ewfd_policy_data_t *pol;
+  ewfd_policy_circ_data_t *circ_data;
+  if (!ewfd_find_delay_data(circ, &pol, &circ_data)) {
+    return;
+  }
+  ewfd_delay_add_sleeper(pol, circ_data, monotime_absolute_msec());
+}
+
+void circuitmux_ewfd_remove_sleeper(circuit_t *circ) {
+  ewfd_policy_data_t *pol;
+  ewfd_policy_circ_data_t *circ_data;
+  if (!ewfd_find_delay_data(circ, &pol, &circ_data)) {
+    return;
+  }
+  ewfd_remove_sleeper_item(pol, &circ_data->cell_ewfd_delay);
+}
+
+int circuitmux_ewfd_wake_sleepers(uint64_t now_ti) {
+  int woken = 0;
+  uint64_t next_ti = UINT64_MAX;
+
+  if (ewfd_sleep_cmux_list == NULL || now_ti < ewfd_next_wake_ti) {
+    return 0;
+  }
+
+  // wake_due可能把当前cmux从列表删除 (最后一个移到当前位置)，所以倒序遍历
+  for (int i = smartlist_len(ewfd_sleep_cmux_list) - 1; i >= 0; i--) {
+    ewfd_policy_data_t *pol = smartlist_get(ewfd_sleep_cmux_list, i);
+    woken += ewfd_delay_wake_due(pol, now_ti);
+    if (pol->sleep_idx != -1) {
+      next_ti = MIN(next_ti, ewfd_wheel_next_expire(pol->sleep_wheel));
+    }
+  }
+  ewfd_next_wake_ti = next_ti;
+  return woken;
+}
+
+uint64_t circuitmux_ewfd_next_wake_ti(void) {
+  return ewfd_next_wake_ti;
+}
+
 static int ewfd_get_cell_on_queue(circuit_t *circ) {
   cell_queue_t *queue = NULL;
   if (circ->magic == OR_CIRCUIT_MAGIC) {
@@ -802,10 +944,9 @@ static int ewfd_get_cell_on_queue(circuit_t *circ) {
 }
 
 static void ewfd_log_all_queue_circuits(ewfd_policy_data_t *pol, const char *context) {
-#ifdef EWFD_TEMP_LOG
+#ifdef EWFD_USE_TEMP_LOG
   char active_circs[512] = {0};
-  char inactive_circs[512] = {0};
-  int active_pos = 0, inactive_pos = 0;
+  int active_pos = 0;
   
   // Build active queue circuit list
   SMARTLIST_FOREACH_BEGIN(pol->active_circuit_pqueue, cell_ewfd_delay_t *, it) {
@@ -821,29 +962,14 @@ static void ewfd_log_all_queue_circuits(ewfd_policy_data_t *pol, const char *con
     }
   } SMARTLIST_FOREACH_END(it);
 
-  SMARTLIST_FOREACH_BEGIN(pol->inactive_circuit_pqueue, cell_ewfd_delay_t *, it) {
-    ewfd_policy_circ_data_t *circ_data = SUBTYPE_P(it, ewfd_policy_circ_data_t, cell_ewfd_delay);
-    if (circ_data && circ_data->circ) {
-      int written = snprintf(inactive_circs + inactive_pos, sizeof(inactive_circs) - inactive_pos, 
-                           "%d(%s,%u/%u,%u),", ewfd_get_circuit_id(circ_data->circ), 
-                           get_delay_state_string(it->delay_state), it->cur_send_cnt, it->burst_send_cnt, it->remain_real_pkt);
-      if (written > 0 && inactive_pos + written < sizeof(inactive_circs)) {
-        inactive_pos += written;
-      }
-    }
-  } SMARTLIST_FOREACH_END(it);
-  
   // Remove trailing comma if exists
   if (active_pos > 0 && active_circs[active_pos-1] == ',') {
     active_circs[active_pos-1] = '\0';
   }
-  if (inactive_pos > 0 && inactive_circs[inactive_pos-1] == ',') {
-    inactive_circs[inactive_pos-1] = '\0';
-  }
   
-  EWFD_TEMP_LOG("%s cmux-id[%d] active[%u]:[%s] inactive[%u]:[%s]", 
+  EWFD_TEMP_LOG("%s cmux-id[%d] active[%u]:[%s] inactive[%d] sleep[%u]", 
     context, pol->idx, smartlist_len(pol->active_circuit_pqueue), active_circs,
-    smartlist_len(pol->inactive_circuit_pqueue), inactive_circs);
+    pol->inactive_num, pol->sleep_wheel ? pol->sleep_wheel->node_num : 0);
 #endif
 }
 
@@ -866,8 +992,7 @@ static void ewfd_cmux_revoke_inactive_queue(cell_ewfd_delay_t *delay_item, circu
 
 
 static void ewfd_send_dummy_packet(circuit_t *circ, cell_ewfd_delay_t *delay_item) {
-  EWFD_TEMP_LOG("[delay-event] step:send_dummy_packet circ:%d dummy:%u", 
-    ewfd_get_circuit_id(circ), delay_item->send_dummy_pkt);
+  EWFD_TRACE(EWFD_TRACE_SEND_DUMMY, ewfd_get_circuit_id(circ), delay_item->send_dummy_pkt, 0);
   ewfd_paddding_op_dummy_impl(circ);
   delay_item->send_dummy_pkt++;
 }
\ No newline at end of file
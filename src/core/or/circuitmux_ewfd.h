@@ -12,7 +12,15 @@ circuitmux_policy_t* ewfd_get_mux_policy(void);
 
 // need wait ?
 bool circuitmux_set_advance_delay(circuit_t *circ, uint64_t gap_ti_ms, uint32_t pkt_num);
-bool circuitmux_trigger_inactive_circ(circuit_t *circ, uint64_t tick_ms);
+
+/* delay circ的唤醒：每个cmux一个按唤醒时间索引的时间轮，只处理到期的circ
+*/
+void circuitmux_ewfd_add_sleeper(circuit_t *circ);
+void circuitmux_ewfd_remove_sleeper(circuit_t *circ);
+// 唤醒所有cmux上到期的circ，返回唤醒的circ数量
+int circuitmux_ewfd_wake_sleepers(uint64_t now_ti);
+// 下一次需要唤醒的时间 (可能偏早)，没有sleep的circ时返回UINT64_MAX
+uint64_t circuitmux_ewfd_next_wake_ti(void);
 
 enum EWFDDelayMODE {
   EWFD_MODE_NORMAL = 0, // 直接send，不管模式
@@ -22,8 +30,13 @@ enum EWFDDelayMODE {
   EWFD_MODE_DESTROY, // 4
 };
 
+// WAIT_TO_BURST之后多久没有新的burst，回到NORMAL
+#define EWFD_DELAY_WAIT_BURST_MS 500
+
 #ifdef CIRCUITMUX_EWFD_PRIVATE
 
+#include "feature/ewfd/ewfd_wheel.h"
+
 /*** EWFD structures ***/
 
 typedef struct cell_ewfd_ewma_t cell_ewfd_ewma_t;
@@ -71,9 +84,12 @@ typedef struct cell_ewfd_delay_t {
   uint32_t remain_real_pkt;  // remain real packets on queue ()
   uint32_t send_dummy_pkt; // 发送了多少dummy包
   uint8_t delay_state; // burst or gap
+  // notify_inactive之后不在active队列里，等待唤醒
+  uint8_t is_inactive;
 
   int active_hindex;
-  int inactive_hindex;
+  // 下一次唤醒的时间，挂在cmux的sleep_wheel上
+  ewfd_wheel_node_st wake_node;
 } cell_ewfd_delay_t;
 
 /* circuitmux_t 保存多个circuit, 用policy记录这些circuit，每个circuit有自己的policy
@@ -91,12 +107,16 @@ typedef struct ewfd_policy_data_t {
    */
   smartlist_t *active_circuit_pqueue;
 
-  smartlist_t *inactive_circuit_pqueue;
+  // inactive的circ只需要计数，按唤醒时间的索引在sleep_wheel里
+  int inactive_num;
 
   /**
    * For delay based WP defense, we need to make the circuit sleep for a while to make a GAP after a burst stream.
+   * 有delay的circ按下一次唤醒的时间挂在时间轮上，第一次add时分配
    */
-  // smartlist_t *sleep_circuit_pqueue;
+  ewfd_wheel_st *sleep_wheel;
+  // 在全局sleep cmux列表中的位置，-1表示没有sleep的circ
+  int sleep_idx;
 
   int idx;
 
@@ -167,6 +187,11 @@ TO_EWFD_POL_CIRC_DATA(circuitmux_policy_circ_data_t *pol)
 STATIC void cell_ewfd_ewma_initialize_ticks(void);
 STATIC unsigned cell_ewfd_ewma_get_current_tick_and_fraction(double *remainder_out);
 
+STATIC void ewfd_delay_add_sleeper(ewfd_policy_data_t *pol,
+                                   ewfd_policy_circ_data_t *circ_data,
+                                   uint64_t now_ti);
+STATIC int ewfd_delay_wake_due(ewfd_policy_data_t *pol, uint64_t now_ti);
+
 #endif //CIRCUITMUX_EWFD_PRIVATE
 
 #endif //EWFD_CIRCUITMUX_EWFD_H_
@@ -39,6 +39,7 @@
 #include "core/or/or.h"
 #include "app/config/config.h"
 #include "core/crypto/onion_crypto.h"
+#include "core/crypto/relay_crypto.h"
 #include "core/mainloop/connection.h"
 #include "core/mainloop/cpuworker.h"
 #include "core/or/channel.h"
@@ -86,6 +87,8 @@ static void command_handle_incoming_channel(channel_listener_t *listener,
 static void command_process_create_cell(cell_t *cell, channel_t *chan);
 static void command_process_created_cell(cell_t *cell, channel_t *chan);
 static void command_process_relay_cell(cell_t *cell, channel_t *chan);
+static void command_process_relay_cell_on_circ(cell_t *cell, channel_t *chan,
+                                               circuit_t *circ, bool crypted);
 static void command_process_destroy_cell(cell_t *cell, channel_t *chan);
 
 /** Convert the cell <b>command</b> into a lower-case, human-readable
@@ -473,6 +476,20 @@ command_process_created_cell(cell_t *cell, channel_t *chan)
   }
 }
 
+/** Return the direction of a relay cell that arrived on <b>chan</b> with
+ * <b>circ_id</b> for <b>circ</b>. */
+static int
+command_relay_cell_direction(const circuit_t *circ, const channel_t *chan,
+                             circid_t circ_id)
+{
+  if (!CIRCUIT_IS_ORIGIN(circ) &&
+      chan == CONST_TO_OR_CIRCUIT(circ)->p_chan &&
+      circ_id == CONST_TO_OR_CIRCUIT(circ)->p_circ_id)
+    return CELL_DIRECTION_OUT;
+  else
+    return CELL_DIRECTION_IN;
+}
+
 /** Process a 'relay' or 'relay_early' <b>cell</b> that just arrived from
  * <b>conn</b>. Make sure it came in with a recognized circ_id. Pass it on to
  * circuit_receive_relay_cell() for actual processing.
@@ -480,11 +497,7 @@ command_process_created_cell(cell_t *cell, channel_t *chan)
 static void
 command_process_relay_cell(cell_t *cell, channel_t *chan)
 {
-  const or_options_t *options = get_options();
   circuit_t *circ;
-  int reason, direction;
-  uint32_t orig_delivered_bw = 0;
-  uint32_t orig_overhead_bw = 0;
 
   circ = circuit_get_by_circid_channel(cell->circ_id, chan);
 
@@ -496,6 +509,70 @@ command_process_relay_cell(cell_t *cell, channel_t *chan)
     return;
   }
 
+  command_process_relay_cell_on_circ(cell, chan, circ, false);
+}
+
+/** Process the <b>n_cells</b> 'relay' or 'relay_early' cells in
+ * <b>cells</b>, which all arrived from <b>chan</b> with the same circ_id,
+ * in order.
+ *
+ * This is what command_process_relay_cell() would do to each of them, except
+ * that the circuit is looked up once for the whole run, and on an
+ * or_circuit_t our layer of crypto is applied to every cell up front with
+ * relay_crypt_or_circ_cells().
+ */
+void
+command_process_relay_cells(channel_t *chan, cell_t **cells, int n_cells)
+{
+  circuit_t *circ;
+  bool crypted = false;
+
+  tor_assert(chan);
+  tor_assert(n_cells > 0);
+
+  stats_n_relay_cells_processed += n_cells;
+
+  circ = circuit_get_by_circid_channel(cells[0]->circ_id, chan);
+
+  if (circ && n_cells > 1 && n_cells <= RELAY_CRYPT_OR_CIRC_CELLS_MAX &&
+      !CIRCUIT_IS_ORIGIN(circ) &&
+      circ->state != CIRCUIT_STATE_ONIONSKIN_PENDING) {
+    /* Cells the circuit ends up dropping are crypted for nothing, which is
+     * harmless: the circuit is closing by then. */
+    relay_crypt_or_circ_cells(TO_OR_CIRCUIT(circ), cells, n_cells,
+                              command_relay_cell_direction(circ, chan,
+                                                     cells[0]->circ_id));
+    crypted = true;
+  }
+
+  for (int i = 0; i < n_cells; ++i) {
+    /* A lookup would no longer find a circuit that got marked while we
+     * handled the earlier cells. */
+    if (!circ || circ->marked_for_close) {
+      log_debug(LD_OR,
+                "unknown circuit %u on connection from %s. Dropping.",
+                (unsigned)cells[i]->circ_id,
+                channel_describe_peer(chan));
+      continue;
+    }
+    command_process_relay_cell_on_circ(cells[i], chan, circ, crypted);
+  }
+}
+
+/** Helper for command_process_relay_cell() and
+ * command_process_relay_cells(): handle <b>cell</b>, which arrived on
+ * <b>chan</b> for <b>circ</b>.  If <b>crypted</b>, our layer of crypto has
+ * already been applied to it.
+ */
+static void
+command_process_relay_cell_on_circ(cell_t *cell, channel_t *chan,
+                                   circuit_t *circ, bool crypted)
+{
+  const or_options_t *options = get_options();
+  int reason, direction;
+  uint32_t orig_delivered_bw = 0;
+  uint32_t orig_overhead_bw = 0;
+
   if (circ->state == CIRCUIT_STATE_ONIONSKIN_PENDING) {
     log_fn(LOG_PROTOCOL_WARN,LD_PROTOCOL,"circuit in create_wait. Closing.");
     circuit_mark_for_close(circ, END_CIRC_REASON_TORPROTOCOL);
@@ -528,12 +605,7 @@ command_process_relay_cell(cell_t *cell, channel_t *chan)
     orig_overhead_bw = ocirc->n_overhead_read_circ_bw;
   }
 
-  if (!CIRCUIT_IS_ORIGIN(circ) &&
-      chan == TO_OR_CIRCUIT(circ)->p_chan &&
-      cell->circ_id == TO_OR_CIRCUIT(circ)->p_circ_id)
-    direction = CELL_DIRECTION_OUT;
-  else
-    direction = CELL_DIRECTION_IN;
+  direction = command_relay_cell_direction(circ, chan, cell->circ_id);
 
   /* If we have a relay_early cell, make sure that it's outbound, and we've
    * gotten no more than MAX_RELAY_EARLY_CELLS_PER_CIRCUIT of them. */
@@ -572,7 +644,11 @@ command_process_relay_cell(cell_t *cell, channel_t *chan)
     }
   }
 
-  if ((reason = circuit_receive_relay_cell(cell, circ, direction)) < 0) {
+  if (crypted)
+    reason = circuit_receive_crypted_relay_cell(cell, circ, direction);
+  else
+    reason = circuit_receive_relay_cell(cell, circ, direction);
+  if (reason < 0) {
     log_fn(LOG_DEBUG,LD_PROTOCOL,"circuit_receive_relay_cell "
            "(%s) failed. Closing.",
            direction==CELL_DIRECTION_OUT?"forward":"backward");
@@ -706,6 +782,7 @@ command_setup_channel(channel_t *chan)
 
   channel_set_cell_handlers(chan,
                             command_process_cell);
+  channel_set_relay_cells_handler(chan, command_process_relay_cells);
 }
 
 /** Given a listener, install the right handler to process incoming
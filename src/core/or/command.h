@@ -15,6 +15,8 @@
 #include "core/or/channel.h"
 
 void command_process_cell(channel_t *chan, cell_t *cell);
+void command_process_relay_cells(channel_t *chan, cell_t **cells,
+                                 int n_cells);
 void command_setup_channel(channel_t *chan);
 void command_setup_listener(channel_listener_t *chan_l);
 
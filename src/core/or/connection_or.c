@@ -31,6 +31,7 @@
 #define CHANNEL_OBJECT_PRIVATE
 #define CONNECTION_OR_PRIVATE
 #define ORCONN_EVENT_PRIVATE
+#include "core/or/cell_pool.h"
 #include "core/or/channel.h"
 #include "core/or/channeltls.h"
 #include "core/or/circuitbuild.h"
@@ -506,13 +507,55 @@ var_cell_pack_header(const var_cell_t *cell, char *hdr_out, int wide_circ_ids)
   return r;
 }
 
+/** Largest payload for which var_cell_new() allocates from var_cell_pool:
+ * every link handshake cell but CERTS fits. */
+#define VAR_CELL_POOL_MAX_PAYLOAD CELL_PAYLOAD_SIZE
+
+/** Placed in front of every var_cell_t from var_cell_new(), so that
+ * var_cell_free_() can tell where the cell came from even after the caller
+ * shortened its payload_len. */
+typedef union var_cell_alloc_hdr_t {
+  /** True iff the cell came from var_cell_pool. */
+  uint8_t pooled;
+  /** Keep the var_cell_t after us aligned. */
+  uint64_t align_;
+} var_cell_alloc_hdr_t;
+
+/** Slabs that var_cell_new() allocates small cells from. */
+static cell_pool_t *var_cell_pool = NULL;
+/** Cache limit to apply to var_cell_pool once it exists. */
+static size_t var_cell_pool_max_cached = 0;
+
+/** Return the pool for small var cells, creating it if needed. */
+static cell_pool_t *
+get_var_cell_pool(void)
+{
+  if (PREDICT_UNLIKELY(!var_cell_pool)) {
+    var_cell_pool = cell_pool_new("var_cell",
+                                  sizeof(var_cell_alloc_hdr_t) +
+                                  offsetof(var_cell_t, payload) +
+                                  VAR_CELL_POOL_MAX_PAYLOAD);
+    cell_pool_set_max_cached(var_cell_pool, var_cell_pool_max_cached);
+  }
+  return var_cell_pool;
+}
+
 /** Allocate and return a new var_cell_t with <b>payload_len</b> bytes of
  * payload space. */
 var_cell_t *
 var_cell_new(uint16_t payload_len)
 {
-  size_t size = offsetof(var_cell_t, payload) + payload_len;
-  var_cell_t *cell = tor_malloc_zero(size);
+  var_cell_alloc_hdr_t *hdr;
+  var_cell_t *cell;
+
+  if (payload_len <= VAR_CELL_POOL_MAX_PAYLOAD) {
+    hdr = cell_pool_alloc(get_var_cell_pool());
+    hdr->pooled = 1;
+  } else {
+    hdr = tor_malloc_zero(sizeof(var_cell_alloc_hdr_t) +
+                          offsetof(var_cell_t, payload) + payload_len);
+  }
+  cell = (var_cell_t *)(hdr + 1);
   cell->payload_len = payload_len;
   cell->command = 0;
   cell->circ_id = 0;
@@ -527,12 +570,9 @@ var_cell_t *
 var_cell_copy(const var_cell_t *src)
 {
   var_cell_t *copy = NULL;
-  size_t size = 0;
 
   if (src != NULL) {
-    size = offsetof(var_cell_t, payload) + src->payload_len;
-    copy = tor_malloc_zero(size);
-    copy->payload_len = src->payload_len;
+    copy = var_cell_new(src->payload_len);
     copy->command = src->command;
     copy->circ_id = src->circ_id;
     memcpy(copy->payload, src->payload, copy->payload_len);
@@ -545,7 +585,53 @@ var_cell_copy(const var_cell_t *src)
 void
 var_cell_free_(var_cell_t *cell)
 {
-  tor_free(cell);
+  var_cell_alloc_hdr_t *hdr;
+
+  if (!cell)
+    return;
+  hdr = ((var_cell_alloc_hdr_t *)cell) - 1;
+  if (hdr->pooled)
+    cell_pool_release(var_cell_pool, hdr);
+  else
+    tor_free(hdr);
+}
+
+/** Keep at most <b>max_bytes</b> of empty slabs in the var cell pool. */
+void
+var_cell_pool_set_max_cached(size_t max_bytes)
+{
+  var_cell_pool_max_cached = max_bytes;
+  if (var_cell_pool)
+    cell_pool_set_max_cached(var_cell_pool, max_bytes);
+}
+
+/** Release the empty slabs of the var cell pool.  Return the number of
+ * bytes released. */
+size_t
+var_cell_pool_trim(void)
+{
+  return var_cell_pool ? cell_pool_trim(var_cell_pool) : 0;
+}
+
+/** Fill <b>out</b> with the usage of the var cell pool. */
+void
+var_cell_pool_get_stats(cell_pool_stats_t *out)
+{
+  cell_pool_get_stats(get_var_cell_pool(), out);
+}
+
+/** Release the var cell pool at shutdown, unless cells are still around. */
+void
+var_cell_pool_free_all(void)
+{
+  cell_pool_stats_t stats;
+
+  if (!var_cell_pool)
+    return;
+  cell_pool_get_stats(var_cell_pool, &stats);
+  if (stats.n_used == 0)
+    cell_pool_free(var_cell_pool);
+  var_cell_pool_max_cached = 0;
 }
 
 /** We've received an EOF from <b>conn</b>. Mark it for close and return. */
@@ -2387,6 +2473,14 @@ connection_or_process_cells_from_inbuf(or_connection_t *conn)
    * buffer and copy the cell.
    */
 
+  cell_t cells[CHANNEL_TLS_CELL_BATCH_MAX];
+  int n_cells = 0;
+
+  /* Once the connection is open, complete fixed-length cells are collected
+   * and handed to channel_tls_handle_cells() together, so that it can group
+   * them by circuit.  A variable-length cell, a partial cell or a full batch
+   * ends the batch; before that, each cell is handled as it arrives, since
+   * the handshake cells change how the ones after them are read. */
   while (1) {
     log_debug(LD_OR,
               TOR_SOCKET_T_FORMAT": starting, inbuf_datalen %d "
@@ -2394,6 +2488,10 @@ connection_or_process_cells_from_inbuf(or_connection_t *conn)
               conn->base_.s,(int)connection_get_inbuf_len(TO_CONN(conn)),
               tor_tls_get_pending_bytes(conn->tls));
     if (connection_fetch_var_cell_from_buf(conn, &var_cell)) {
+      if (n_cells) {
+        channel_tls_handle_cells(cells, n_cells, conn);
+        n_cells = 0;
+      }
       if (!var_cell)
         return 0; /* not yet. */
 
@@ -2408,10 +2506,12 @@ connection_or_process_cells_from_inbuf(or_connection_t *conn)
       const int wide_circ_ids = conn->wide_circ_ids;
       size_t cell_network_size = get_cell_network_size(conn->wide_circ_ids);
       char buf[CELL_MAX_NETWORK_SIZE];
-      cell_t cell;
       if (connection_get_inbuf_len(TO_CONN(conn))
-          < cell_network_size) /* whole response available? */
+          < cell_network_size) { /* whole response available? */
+        if (n_cells)
+          channel_tls_handle_cells(cells, n_cells, conn);
         return 0; /* not yet */
+      }
 
       /* Touch the channel's active timestamp if there is one */
       if (conn->chan)
@@ -2422,9 +2522,13 @@ connection_or_process_cells_from_inbuf(or_connection_t *conn)
 
       /* retrieve cell info from buf (create the host-order struct from the
        * network-order string) */
-      cell_unpack(&cell, buf, wide_circ_ids);
+      cell_unpack(&cells[n_cells++], buf, wide_circ_ids);
 
-      channel_tls_handle_cell(&cell, conn);
+      if (TO_CONN(conn)->state != OR_CONN_STATE_OPEN ||
+          n_cells == CHANNEL_TLS_CELL_BATCH_MAX) {
+        channel_tls_handle_cells(cells, n_cells, conn);
+        n_cells = 0;
+      }
     }
   }
 }
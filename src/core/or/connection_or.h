@@ -106,6 +106,11 @@ var_cell_t *var_cell_new(uint16_t payload_len);
 var_cell_t *var_cell_copy(const var_cell_t *src);
 void var_cell_free_(var_cell_t *cell);
 #define var_cell_free(cell) FREE_AND_NULL(var_cell_t, var_cell_free_, (cell))
+struct cell_pool_stats_t;
+void var_cell_pool_set_max_cached(size_t max_bytes);
+size_t var_cell_pool_trim(void);
+void var_cell_pool_get_stats(struct cell_pool_stats_t *out);
+void var_cell_pool_free_all(void);
 
 /* DOCDOC */
 #define MIN_LINK_PROTO_FOR_WIDE_CIRC_IDS 4
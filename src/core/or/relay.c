@@ -48,7 +48,7 @@
 #include "core/or/command.h"
 #define RELAY_PRIVATE
 
-#define EWFD_USE_TEMP_LOG
+// #define EWFD_USE_TEMP_LOG
 
 #include "core/or/or.h"
 #include "feature/client/addressmap.h"
@@ -90,6 +90,7 @@
 #include "feature/stats/rephist.h"
 
 #include "core/or/cell_st.h"
+#include "core/or/cell_pool.h"
 #include "core/or/cell_queue_st.h"
 #include "core/or/cpath_build_state_st.h"
 #include "feature/dircommon/dir_connection_st.h"
@@ -107,10 +108,16 @@
 #include "lib/log/util_bug.h"
 #include <stdint.h>
 #include "feature/ewfd/debug.h"
+#include "feature/ewfd/ewfd_op.h"
+#include "feature/ewfd/ewfd.h"
+#include "feature/ewfd/ewfd_trace.h"
 
 static edge_connection_t *relay_lookup_conn(circuit_t *circ, cell_t *cell,
                                             cell_direction_t cell_direction,
                                             crypt_path_t *layer_hint);
+static int circuit_receive_relay_cell_impl(cell_t *cell, circuit_t *circ,
+                                           cell_direction_t cell_direction,
+                                           bool crypted);
 
 static void circuit_resume_edge_reading(circuit_t *circ,
                                         crypt_path_t *layer_hint);
@@ -237,6 +244,28 @@ circuit_update_channel_usage(circuit_t *circ, cell_t *cell)
 int
 circuit_receive_relay_cell(cell_t *cell, circuit_t *circ,
                            cell_direction_t cell_direction)
+{
+  return circuit_receive_relay_cell_impl(cell, circ, cell_direction, false);
+}
+
+/** As circuit_receive_relay_cell(), but <b>cell</b> is on an or_circuit_t
+ * and relay_crypt_or_circ_cells() has already applied our layer of crypto
+ * to it. */
+int
+circuit_receive_crypted_relay_cell(cell_t *cell, circuit_t *circ,
+                                   cell_direction_t cell_direction)
+{
+  tor_assert(!CIRCUIT_IS_ORIGIN(circ));
+  return circuit_receive_relay_cell_impl(cell, circ, cell_direction, true);
+}
+
+/** Helper for circuit_receive_relay_cell() and
+ * circuit_receive_crypted_relay_cell(): if <b>crypted</b>, only check
+ * whether the cell is recognized instead of crypting it first. */
+static int
+circuit_receive_relay_cell_impl(cell_t *cell, circuit_t *circ,
+                                cell_direction_t cell_direction,
+                                bool crypted)
 {
   channel_t *chan = NULL;
   crypt_path_t *layer_hint=NULL;
@@ -250,8 +279,11 @@ circuit_receive_relay_cell(cell_t *cell, circuit_t *circ,
   if (circ->marked_for_close)
     return 0;
 
-  if (relay_decrypt_cell(circ, cell, cell_direction, &layer_hint, &recognized)
-      < 0) {
+  if (crypted) {
+    relay_or_circ_cell_recognize(TO_OR_CIRCUIT(circ), cell, cell_direction,
+                                 &recognized);
+  } else if (relay_decrypt_cell(circ, cell, cell_direction, &layer_hint,
+                                &recognized) < 0) {
     log_fn(LOG_PROTOCOL_WARN, LD_PROTOCOL,
            "relay crypt failed. Dropping connection.");
     return -END_CIRC_REASON_INTERNAL;
@@ -664,8 +696,7 @@ relay_send_command_from_edge_,(streamid_t stream_id, circuit_t *circ,
   pad_cell_payload(cell.payload, payload_len);
 
   // send cell: from circ to next
-  EWFD_LOG("[send cell] command: [%s] %s in %s:%d.", relay_command_to_string(relay_command),
-   ewfd_get_circuit_info(circ), filename, lineno);
+  EWFD_TRACE(EWFD_TRACE_SEND_CELL, ewfd_get_circuit_id(circ), relay_command, 0);
 
   log_debug(LD_OR,"delivering %d cell %s.", relay_command,
             cell_direction == CELL_DIRECTION_OUT ? "forward" : "backward");
@@ -1644,8 +1675,8 @@ handle_relay_cell_command(cell_t *cell, circuit_t *circ,
 
   tor_assert(rh);
 
-  EWFD_LOG("[receive cell] command: [%s] circ:%d %s on stream: %d", relay_command_to_string(rh->command), 
-    ewfd_get_circuit_id(circ), ewfd_get_circuit_info(circ),  rh->stream_id);
+  EWFD_TRACE(EWFD_TRACE_RECV_CELL, ewfd_get_circuit_id(circ), rh->command,
+             rh->stream_id);
 
   /* First pass the cell to the circuit padding subsystem, in case it's a
    * padding cell or circuit that should be handled there. */
@@ -2593,12 +2624,46 @@ circuit_consider_stop_edge_reading(circuit_t *circ, crypt_path_t *layer_hint)
 /** The total number of cells we have allocated. */
 static size_t total_cells_allocated = 0;
 
+/** Each cell pool keeps at most 1/CELL_POOL_CACHE_FRACTION of
+ * MaxMemInQueues in empty slabs for reuse. */
+#define CELL_POOL_CACHE_FRACTION 64
+
+/** Slabs that packed_cell_new() allocates from. */
+static cell_pool_t *packed_cell_pool = NULL;
+
+/** The MaxMemInQueues value the cell pool cache limits were last set from. */
+static uint64_t cell_pools_max_mem = 0;
+
+/** Return the pool for packed cells, creating it if needed. */
+static inline cell_pool_t *
+get_packed_cell_pool(void)
+{
+  if (PREDICT_UNLIKELY(!packed_cell_pool)) {
+    packed_cell_pool = cell_pool_new("packed_cell", sizeof(packed_cell_t));
+    cell_pool_set_max_cached(packed_cell_pool,
+                    (size_t)(cell_pools_max_mem / CELL_POOL_CACHE_FRACTION));
+  }
+  return packed_cell_pool;
+}
+
+/** Let the cell pools keep up to 1/CELL_POOL_CACHE_FRACTION of
+ * <b>max_mem_in_queues</b> each in empty slabs. */
+static void
+cell_pools_set_max_mem(uint64_t max_mem_in_queues)
+{
+  size_t max_cached = (size_t)(max_mem_in_queues / CELL_POOL_CACHE_FRACTION);
+
+  cell_pools_max_mem = max_mem_in_queues;
+  cell_pool_set_max_cached(get_packed_cell_pool(), max_cached);
+  var_cell_pool_set_max_cached(max_cached);
+}
+
 /** Release storage held by <b>cell</b>. */
 static inline void
 packed_cell_free_unchecked(packed_cell_t *cell)
 {
   --total_cells_allocated;
-  tor_free(cell);
+  cell_pool_release(packed_cell_pool, cell);
 }
 
 /** Allocate and return a new packed_cell_t. */
@@ -2606,7 +2671,7 @@ packed_cell_t *
 packed_cell_new(void)
 {
   ++total_cells_allocated;
-  return tor_malloc_zero(sizeof(packed_cell_t));
+  return cell_pool_alloc(get_packed_cell_pool());
 }
 
 /** Return a packed cell used outside by channel_t lower layer */
@@ -2635,6 +2700,55 @@ dump_cell_pool_usage(int severity)
   tor_log(severity, LD_MM,
           "%d cells allocated on %d circuits. %d cells leaked.",
           n_cells, n_circs, (int)total_cells_allocated - n_cells);
+
+  cell_pool_stats_t stats[2];
+  cell_pools_get_stats(&stats[0], &stats[1]);
+  for (int i = 0; i < 2; ++i) {
+    tor_log(severity, LD_MM,
+            "Cell pool %s: %zu in use, %zu free in %zu slabs "
+            "(%zu empty) taking %zu bytes; %"PRIu64" allocations, "
+            "%"PRIu64" slabs allocated, %"PRIu64" released.",
+            i == 0 ? "packed_cell" : "var_cell",
+            stats[i].n_used, stats[i].n_free, stats[i].n_slabs,
+            stats[i].n_empty_slabs, stats[i].bytes_allocated,
+            stats[i].n_allocs, stats[i].n_slab_allocs,
+            stats[i].n_slab_frees);
+  }
+}
+
+/** Fill <b>packed_out</b> and <b>var_out</b> with the usage of the packed
+ * cell and var cell pools. */
+void
+cell_pools_get_stats(cell_pool_stats_t *packed_out,
+                     cell_pool_stats_t *var_out)
+{
+  cell_pool_get_stats(get_packed_cell_pool(), packed_out);
+  var_cell_pool_get_stats(var_out);
+}
+
+/** Release every empty slab the cell pools keep for reuse.  Return the
+ * number of bytes released. */
+size_t
+cell_pools_trim(void)
+{
+  return cell_pool_trim(get_packed_cell_pool()) + var_cell_pool_trim();
+}
+
+/** Release the cell pools at shutdown, unless cells are still around. */
+void
+cell_pools_free_all(void)
+{
+  cell_pool_stats_t stats;
+
+  var_cell_pool_free_all();
+  if (!packed_cell_pool)
+    return;
+  /* A cell released after its pool is gone would crash; the process is
+   * about to exit anyway, so leave the pool to it then. */
+  cell_pool_get_stats(packed_cell_pool, &stats);
+  if (stats.n_used == 0)
+    cell_pool_free(packed_cell_pool);
+  cell_pools_max_mem = 0;
 }
 
 /** Allocate a new copy of packed <b>cell</b>. */
@@ -2692,6 +2806,20 @@ cell_queue_clear(cell_queue_t *queue)
   }
   TOR_SIMPLEQ_INIT(&queue->head);
   queue->n = 0;
+  queue->ewfd_dummy_n = 0;
+  ewfd_cell_queue_free_delay(queue);
+}
+
+/** Return the number of cells <b>queue</b> can send: queued cells plus
+ * pending EWFD dummy cells that are built at flush time, plus EWFD delay
+ * descriptors.  While the delay at the head of the queue is waiting, nothing
+ * can be sent. */
+static inline int
+cell_queue_num_sendable(const cell_queue_t *queue)
+{
+  if (queue->ewfd_delay)
+    return ewfd_cell_queue_num_sendable(queue);
+  return queue->n + queue->ewfd_dummy_n;
 }
 
 /** Extract and return the cell at the head of <b>queue</b>; return NULL if
@@ -2704,6 +2832,8 @@ cell_queue_pop(cell_queue_t *queue)
     return NULL;
   TOR_SIMPLEQ_REMOVE_HEAD(&queue->head, next);
   --queue->n;
+  if (queue->ewfd_delay)
+    ewfd_cell_queue_note_pop(queue);
   return cell;
 }
 
@@ -2773,12 +2903,13 @@ destroy_cell_to_packed_cell(destroy_cell_t *inp, int wide_circ_ids)
   return packed;
 }
 
-/** Return the total number of bytes used for each packed_cell in a queue.
- * Approximate. */
+/** Return the total number of bytes used for each packed_cell in a queue:
+ * the size of its slot in the packed cell pool.  Slabs kept for reuse are
+ * not charged to any cell. */
 size_t
 packed_cell_mem_cost(void)
 {
-  return sizeof(packed_cell_t);
+  return cell_pool_get_slot_size(get_packed_cell_pool());
 }
 
 /* DOCDOC */
@@ -2807,6 +2938,9 @@ cell_queues_check_size(void)
 {
   size_t removed = 0;
   time_t now = time(NULL);
+  if (PREDICT_UNLIKELY(get_options()->MaxMemInQueues != cell_pools_max_mem))
+    cell_pools_set_max_mem(get_options()->MaxMemInQueues);
+
   size_t alloc = cell_queues_get_total_allocation();
   alloc += half_streams_get_total_allocation();
   alloc += buf_get_total_allocation();
@@ -2818,8 +2952,13 @@ cell_queues_check_size(void)
   alloc += geoip_client_cache_total;
   const size_t dns_cache_total = dns_cache_total_allocation();
   alloc += dns_cache_total;
+  /* EWFD events and delay descriptors sit next to the cell queues. */
+  alloc += ewfd_framework_get_total_allocation();
   if (alloc >= get_options()->MaxMemInQueues_low_threshold) {
     last_time_under_memory_pressure = approx_time();
+    /* Slabs kept for reuse are not counted above, but give them back
+     * before anything else goes. */
+    cell_pools_trim();
     if (alloc >= get_options()->MaxMemInQueues) {
       /* Note this overload down */
       rep_hist_note_overload(OVERLOAD_GENERAL);
@@ -2904,9 +3043,11 @@ update_circuit_on_cmux_(circuit_t *circ, cell_direction_t direction,
 
   /* Update the number of cells we have for the circuit mux */
   if (direction == CELL_DIRECTION_OUT) {
-    circuitmux_set_num_cells(cmux, circ, circ->n_chan_cells.n);
+    circuitmux_set_num_cells(cmux, circ,
+                             cell_queue_num_sendable(&circ->n_chan_cells));
   } else {
-    circuitmux_set_num_cells(cmux, circ, or_circ->p_chan_cells.n);
+    circuitmux_set_num_cells(cmux, circ,
+                             cell_queue_num_sendable(&or_circ->p_chan_cells));
   }
 }
 
@@ -3065,7 +3206,7 @@ channel_flush_from_first_active_circuit, (channel_t *chan, int max))
     }
 
     /* Circuitmux told us this was active, so it should have cells */
-    if (/*BUG(*/ queue->n == 0 /*)*/) {
+    if (/*BUG(*/ cell_queue_num_sendable(queue) == 0 /*)*/) {
       log_warn(LD_BUG, "Found a supposedly active circuit with no cells "
                "to send. Trying to recover.");
       circuitmux_set_num_cells(cmux, circ, 0);
@@ -3074,14 +3215,30 @@ channel_flush_from_first_active_circuit, (channel_t *chan, int max))
       continue;
     }
 
-    tor_assert(queue->n > 0);
-
     /*
      * Get just one cell here; once we've sent it, that can change the circuit
      * selection, so we have to loop around for another even if this circuit
      * has more than one.
+     *
+     * Pending EWFD dummies are built and encrypted only once every real
+     * cell ahead of them is gone, so the relay crypto order matches the
+     * order on the wire.  EWFD delay descriptors hold back the cells
+     * behind them until their trigger time, and send dummies when there are
+     * not enough real cells.
      */
-    cell = cell_queue_pop(queue);
+    if (ewfd_cell_queue_get_delay_num(queue) > 0) {
+      uint8_t n_cell;
+      cell = ewfd_cell_queue_pop_simple_delay(queue, chan->wide_circ_ids,
+                                              &n_cell);
+    } else if (queue->n > 0) {
+      cell = cell_queue_pop(queue);
+    } else {
+      cell = ewfd_cell_queue_pop_dummy(circ, queue);
+    }
+    if (!cell) {
+      circuitmux_set_num_cells(cmux, circ, cell_queue_num_sendable(queue));
+      continue;
+    }
 
     /* Calculate the exact time that this cell has spent in the queue. */
     if (get_options()->CellStatistics ||
@@ -3144,8 +3301,8 @@ channel_flush_from_first_active_circuit, (channel_t *chan, int max))
      */
     // EWFD_TEMP_LOG("[delay-event] step:first_active_circuit circ:%d queue-n-cells:%d", ewfd_get_circuit_id(circ), queue->n);
     circuitmux_notify_xmit_cells(cmux, circ, 1);
-    circuitmux_set_num_cells(cmux, circ, queue->n);
-    if (queue->n == 0)
+    circuitmux_set_num_cells(cmux, circ, cell_queue_num_sendable(queue));
+    if (cell_queue_num_sendable(queue) == 0)
       log_debug(LD_GENERAL, "Made a circuit inactive.");
 
     /* Is the cell queue low enough to unblock all the streams that are waiting
@@ -3243,8 +3400,8 @@ append_cell_to_circuit_queue(circuit_t *circ, channel_t *chan,
     streams_blocked = circ->streams_blocked_on_p_chan;
   }
 
-  EWFD_TEMP_LOG("[send-cell] append to queue circ: %u cell-cmd: %s stream: %d q-len: %d", ewfd_get_circuit_id(circ),
-    cell_command_to_string(cell->command), fromstream, queue->n + 1);
+  EWFD_TRACE(EWFD_TRACE_APPEND_CELL, ewfd_get_circuit_id(circ), cell->command,
+             queue->n + 1);
 
   if (PREDICT_UNLIKELY(queue->n >= max_circuit_cell_queue_size)) {
     log_fn(LOG_PROTOCOL_WARN, LD_PROTOCOL,
@@ -19,6 +19,8 @@ extern uint64_t stats_n_circ_max_cell_reached;
 void relay_consensus_has_changed(const networkstatus_t *ns);
 int circuit_receive_relay_cell(cell_t *cell, circuit_t *circ,
                                cell_direction_t cell_direction);
+int circuit_receive_crypted_relay_cell(cell_t *cell, circuit_t *circ,
+                                       cell_direction_t cell_direction);
 size_t cell_queues_get_total_allocation(void);
 
 void relay_header_pack(uint8_t *dest, const relay_header_t *src);
@@ -55,6 +57,11 @@ extern uint64_t oom_stats_n_bytes_removed_geoip;
 extern uint64_t oom_stats_n_bytes_removed_hsdir;
 
 void dump_cell_pool_usage(int severity);
+struct cell_pool_stats_t;
+void cell_pools_get_stats(struct cell_pool_stats_t *packed_out,
+                          struct cell_pool_stats_t *var_out);
+size_t cell_pools_trim(void);
+void cell_pools_free_all(void);
 size_t packed_cell_mem_cost(void);
 
 int have_been_under_memory_pressure(void);
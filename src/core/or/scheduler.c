@@ -1,7 +1,7 @@
 /* Copyright (c) 2013-2021, The Tor Project, Inc. */
 /* See LICENSE for licensing information */
 #include "lib/time/compat_time.h"
-#define EWFD_USE_TEMP_LOG
+// #define EWFD_USE_TEMP_LOG
 
 #include "core/or/or.h"
 #include "app/config/config.h"
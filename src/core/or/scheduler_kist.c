@@ -8,7 +8,7 @@
 
 #define SCHEDULER_KIST_PRIVATE
 
-#define EWFD_USE_TEMP_LOG
+// #define EWFD_USE_TEMP_LOG
 #include "feature/ewfd/debug.h"
 
 #include "core/or/or.h"
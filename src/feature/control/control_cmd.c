@@ -32,6 +32,7 @@
 #include "feature/control/control_events.h"
 #include "feature/control/control_getinfo.h"
 #include "feature/control/control_proto.h"
+#include "feature/ewfd/ewfd_trace.h"
 #include "feature/hs/hs_control.h"
 #include "feature/hs/hs_service.h"
 #include "feature/nodelist/nodelist.h"
@@ -1428,6 +1429,30 @@ handle_control_droptimeouts(control_connection_t *conn,
   return 0;
 }
 
+static const control_cmd_syntax_t dumpewfdtrace_syntax = {
+  .max_args = 0,
+};
+
+/** Implementation for the DUMPEWFDTRACE command: write the EWFD trace rings
+ * to DataDirectory/ewfd-trace and reply with the file name. */
+static int
+handle_control_dumpewfdtrace(control_connection_t *conn,
+                             const control_cmd_args_t *args)
+{
+  (void) args; /* We don't take arguments. */
+
+  char *fname = ewfd_trace_dump_default();
+  if (!fname) {
+    control_write_endreply(conn, 551, "Unable to dump EWFD trace");
+    return 0;
+  }
+  control_printf_midreply(conn, 250, "FILENAME=%s", fname);
+  send_control_done(conn);
+  tor_free(fname);
+
+  return 0;
+}
+
 static const char *hsfetch_keywords[] = {
   "SERVER", NULL,
 };
@@ -2146,6 +2171,7 @@ static const control_cmd_def_t CONTROL_COMMANDS[] =
   ONE_LINE(authchallenge, CMD_FL_WIPE),
   ONE_LINE(dropguards, 0),
   ONE_LINE(droptimeouts, 0),
+  ONE_LINE(dumpewfdtrace, 0),
   ONE_LINE(hsfetch, 0),
   MULTLINE(hspost, 0),
   ONE_LINE(add_onion, CMD_FL_WIPE),
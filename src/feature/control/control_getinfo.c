@@ -66,6 +66,7 @@
 #include "feature/nodelist/node_st.h"
 #include "feature/nodelist/routerinfo_st.h"
 #include "feature/nodelist/routerlist_st.h"
+#include "feature/ewfd/ewfd_trace.h"
 
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -97,6 +98,8 @@ getinfo_helper_misc(control_connection_t *conn, const char *question,
     const char *a = get_torrc_fname(1);
     if (a)
       *answer = tor_strdup(a);
+  } else if (!strcmp(question, "ewfd/trace")) {
+    *answer = ewfd_trace_get_summary();
   } else if (!strcmp(question, "config-text")) {
     *answer = options_dump(get_options(), OPTIONS_DUMP_MINIMAL);
   } else if (!strcmp(question, "config-can-saveconf")) {
@@ -1497,6 +1500,8 @@ typedef struct getinfo_item_t {
  * to answer them. */
 static const getinfo_item_t getinfo_items[] = {
   ITEM("version", misc, "The current version of Tor."),
+  ITEM("ewfd/trace", misc,
+       "Whether EWFD tracing is on, and how many rings and records it holds."),
   ITEM("bw-event-cache", misc, "Cached BW events for a short interval."),
   ITEM("config-file", misc, "Current location of the \"torrc\" file."),
   ITEM("config-defaults-file", misc, "Current location of the defaults file."),
@@ -1,11 +1,13 @@
 #include "feature/ewfd/circuit_padding.h"
 #include "feature/ewfd/ewfd_unit.h"
 #include "feature/ewfd/utils.h"
+#include "feature/ewfd/ewfd_trace.h"
 #include "feature/ewfd/debug.h"
 #include "feature/ewfd/ewfd_rt.h"
 #include "feature/ewfd/ewfd_conf.h"
 #include "feature/ewfd/ewfd.h"
 #include "feature/ewfd/ewfd_ticker.h"
+#include "feature/ewfd/ewfd_op.h"
 
 #include "circpad_negotiation.h"
 #include "core/or/circuit_st.h"
@@ -104,8 +106,13 @@ static bool start_efwd_padding_ticker(circuit_t *circ);
 // 
 static void halt_ewfd_padding_ticker(ewfd_padding_runtime_st *ewfd_rt);
 static bool notify_peer_units_states(ewfd_padding_runtime_st *ewfd_rt, int state);
-static void trigger_efwd_schedule_ticker(tor_timer_t *timer, void *args, const struct monotime_t *time);
-static void trigger_efwd_padding_ticker(tor_timer_t *timer, void *args, const struct monotime_t *time);
+static void trigger_efwd_schedule_ticker(void *args);
+static void trigger_efwd_padding_ticker(void *args);
+// 同一次唤醒中到期的ticker批量执行
+static void trigger_efwd_schedule_tickers(ewfd_ticker_st **tickers, int num);
+static void trigger_efwd_padding_tickers(ewfd_ticker_st **tickers, int num);
+static void rearm_efwd_schedule_ticker(ewfd_padding_runtime_st *ewfd_rt);
+static void rearm_efwd_padding_ticker(ewfd_padding_runtime_st *ewfd_rt);
 
 const char *padding_state_to_str(uint8_t state) {
 	if (state < EWFD_PEER_STATE_MAX) {
@@ -187,6 +194,35 @@ int add_ewfd_units_on_circ(circuit_t *circ) {
 	return 0;
 }
 
+ewfd_unit_stats_st ewfd_unit_stats[EWFD_MAX_UNIT_UUID];
+const uint32_t ewfd_exec_hist_bounds_usec[EWFD_EXEC_HIST_BUCKETS - 1] = {
+	1, 2, 5, 10, 20, 50, 100,
+};
+
+void ewfd_unit_stats_add_exec(uint8_t unit_uuid, uint64_t nsec, int num) {
+	ewfd_unit_stats_st *stats = &ewfd_unit_stats[unit_uuid];
+	uint64_t usec = nsec / MAX(num, 1) / 1000;
+	int bucket = 0;
+	while (bucket < EWFD_EXEC_HIST_BUCKETS - 1 && usec > ewfd_exec_hist_bounds_usec[bucket]) {
+		bucket++;
+	}
+	stats->exec_hist[bucket] += num;
+	stats->exec_num += num;
+	stats->exec_nsec += nsec;
+}
+
+ewfd_unit_stats_st *ewfd_unit_stats_on_circ(circuit_t *circ) {
+	ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ(circ);
+	if (ewfd_rt == NULL) {
+		return NULL;
+	}
+	ewfd_padding_unit_st *unit = ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot];
+	if (unit == NULL || unit->conf == NULL) {
+		return NULL;
+	}
+	return &ewfd_unit_stats[unit->conf->unit_uuid];
+}
+
 ewfd_padding_runtime_st* ewfd_get_runtime_on_circ(circuit_t *circ) {
 	if (circ && circ->ewfd_padding_rt) {
 		// 防止circuit复用
@@ -208,10 +244,14 @@ bool is_valid_circuit(uintptr_t on_circ) {
 在circuit释放之后，queue里面仍然存在packet
 */
 void free_ewfd_runtime_on_circ(circuit_t *circ) {
+	// 没有runtime的circ也可能还有event在队列里, circ释放前全部删除
+	ewfd_remove_circ_events((uintptr_t) circ);
 	if (circ->ewfd_padding_rt == NULL) {
 		return;
 	}
 	on_ewfd_runtime_destory(circ);
+	// cpuworker中还没完成的unit结果不再回写
+	ewfd_rt_forget_runtime(circ->ewfd_padding_rt);
 
 	for (int i = 0; i < MAX_EWFD_UNITS_ON_CIRC; i++) {
 		if (circ->ewfd_padding_rt->schedule_slots[i] != NULL) {
@@ -227,6 +267,7 @@ void free_ewfd_runtime_on_circ(circuit_t *circ) {
 	}
 
 	tor_assert(circ->ewfd_padding_rt->units_num == 0);
+	ewfd_cell_queue_drop_dummy(circ);
 
 	// free timer
 	ewfd_free_ticker(&circ->ewfd_padding_rt->padding_unit_ctx.ticker);
@@ -452,7 +493,13 @@ int trigger_ewfd_units_on_circ(circuit_t *circ, bool is_send, bool toward_origin
 	// if (relay_command != RELAY_COMMAND_DROP) {
 		
 	// }
-	ewfd_rt->circ_status.last_cell_ti = monotime_absolute_msec();
+	ewfd_rt->circ_status.last_cell_ti = (uint32_t) monotime_absolute_msec();
+	if (is_send) {
+		ewfd_unit_stats_st *stats = ewfd_unit_stats_on_circ(circ);
+		if (stats != NULL) {
+			stats->real_cells++;
+		}
+	}
 	ewfd_rt->circ_status.send_cell_cnt += is_send;
 	ewfd_rt->circ_status.recv_cell_cnt += !is_send;
 
@@ -494,8 +541,10 @@ static void ewfd_init_runtime(circuit_t *circ) {
 static ewfd_padding_unit_st* new_ewfd_padding_unit(ewfd_padding_runtime_st *cur_rt, ewfd_padding_conf_st *conf) {
 	ewfd_padding_unit_st *unit = tor_malloc_zero(sizeof(ewfd_padding_unit_st));
 	unit->conf = conf;
+	ewfd_padding_conf_incref(conf);
 	unit->ewfd_unit = init_ewfd_unit(conf);
 	cur_rt->units_num++;
+	ewfd_unit_stats[conf->unit_uuid].active_units++;
 
 	// increase padding machine counter, do not decrease
 	cur_rt->last_unit_idx++;
@@ -509,7 +558,10 @@ static ewfd_padding_unit_st* new_ewfd_padding_unit(ewfd_padding_runtime_st *cur_
 
 static void free_ewfd_padding_unit(ewfd_padding_runtime_st *cur_rt, ewfd_padding_unit_st *unit) {
 	cur_rt->units_num--;
-	free_ewfd_unit(unit->ewfd_unit);
+	ewfd_unit_stats[unit->conf->unit_uuid].active_units--;
+	ewfd_rt_free_unit(unit->ewfd_unit);
+	// 热加载之后旧的conf只被已有的unit引用，最后一个unit释放时回收
+	ewfd_padding_conf_decref(unit->conf);
 	tor_free(unit);
 }
 
@@ -641,6 +693,8 @@ static bool free_ewfd_padding_unit_by_uuid(circuit_t *circ, int unit_uuid, uint3
 			if (circ->ewfd_padding_rt->padding_slots[i]->unit_version != unit_version) {
 				EWFD_LOG("ERROR: padding unit version mismatch. uuid: %d, version: %d, expected: %d", unit_uuid, unit_version, circ->ewfd_padding_rt->padding_slots[i]->unit_version);
 			}
+			// 其他unit入队的dummy继续发送
+			ewfd_cell_queue_drop_unit_dummy(circ, circ->ewfd_padding_rt->padding_slots[i]);
 			free_ewfd_padding_unit(circ->ewfd_padding_rt, circ->ewfd_padding_rt->padding_slots[i]);
 			circ->ewfd_padding_rt->padding_slots[i] = NULL;
 			return true;
@@ -784,11 +838,11 @@ static bool start_efwd_schedule_ticker(circuit_t *circ) {
 	tor_assert(ewfd_rt->schedule_slots[slot]);
 
 	EWFD_LOG("start_efwd_schedule_ticker circ: %u", ewfd_get_circuit_id(ewfd_rt->on_circ));
-	ewfd_init_ticker(&ewfd_rt->schedule_unit_ctx.ticker, trigger_efwd_schedule_ticker, circ);
+	ewfd_init_ticker(&ewfd_rt->schedule_unit_ctx.ticker, EWFD_TICK_SCHEDULE, trigger_efwd_schedule_ticker, circ);
 
 	// uint32_t next_tick = ewfd_rt->schedule_slots[slot]->conf->tick_interval;
 	uint64_t next_tick = 1; // 第一次立刻触发
-	ewfd_schedule_ticker(ewfd_rt->schedule_unit_ctx.ticker, next_tick);
+	ewfd_schedule_ticker(&ewfd_rt->schedule_unit_ctx.ticker, next_tick);
 	
 	ewfd_rt->schedule_unit_ctx.is_enable = true;
 	ewfd_rt->schedule_unit_ctx.padding_start_ti = monotime_absolute_msec();
@@ -813,18 +867,18 @@ static bool start_efwd_padding_ticker(circuit_t *circ) {
 
 	// set timer
 	EWFD_LOG("start_efwd_padding_ticker circ: %u", ewfd_get_circuit_id(ewfd_rt->on_circ));
-	ewfd_init_ticker(&ewfd_rt->padding_unit_ctx.ticker, trigger_efwd_padding_ticker, circ);
+	ewfd_init_ticker(&ewfd_rt->padding_unit_ctx.ticker, EWFD_TICK_PADDING, trigger_efwd_padding_ticker, circ);
 
 	// uint32_t next_tick = ewfd_rt->padding_slots[slot]->conf->tick_interval;
 	uint32_t next_tick = 1; // 第一次立刻触发
 
-	ewfd_schedule_ticker(ewfd_rt->padding_unit_ctx.ticker, next_tick);
+	ewfd_schedule_ticker(&ewfd_rt->padding_unit_ctx.ticker, next_tick);
 	
 	uint64_t now_ti = monotime_absolute_msec() + next_tick;
 	ewfd_rt->padding_unit_ctx.is_enable = true;
 	ewfd_rt->padding_unit_ctx.padding_start_ti = now_ti;
-	ewfd_rt->circ_status.padding_start_ti = now_ti;
-	ewfd_rt->circ_status.last_padding_ti = now_ti;
+	ewfd_rt->circ_status.padding_start_ti = (uint32_t) now_ti;
+	ewfd_rt->circ_status.last_padding_ti = (uint32_t) now_ti;
 	ewfd_rt->circ_status.on_circ = (uintptr_t) ewfd_rt->on_circ;
 	ewfd_rt->padding_unit_ctx.next_tick = 0;
 	// ewfd_rt->padding_unit_ctx.next_tick = ewfd_rt->padding_unit_ctx.padding_start_ti;
@@ -845,15 +899,30 @@ static void halt_ewfd_padding_ticker(ewfd_padding_runtime_st *ewfd_rt) {
 		return;
 	}
 	ewfd_rt->padding_unit_ctx.is_enable = false;
-	if (ewfd_rt->padding_unit_ctx.ticker) {
-		ewfd_remove_ticker(&ewfd_rt->padding_unit_ctx.ticker);
-	}
+	ewfd_remove_ticker(&ewfd_rt->padding_unit_ctx.ticker);
 #if 0
 	EWFD_LOG("[padding-tick-s] [%u] slot: %d", ewfd_get_circuit_id(ewfd_rt->on_circ), ewfd_rt->padding_unit_ctx.active_slot);
 #endif
 }
 
-static void trigger_efwd_schedule_ticker(tor_timer_t *timer, void *args, const struct monotime_t *time) {
+// ticker的arg是circ, 跳过已经释放runtime的circ
+static int collect_ewfd_runtimes(ewfd_ticker_st **tickers, int num, ewfd_padding_runtime_st **rts) {
+	int rt_num = 0;
+	for (int i = 0; i < num; i++) {
+		ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ((circuit_t *) tickers[i]->arg);
+		if (ewfd_rt != NULL) {
+			rts[rt_num++] = ewfd_rt;
+		}
+	}
+	return rt_num;
+}
+
+void ewfd_init_tick_batch(void) {
+	ewfd_set_tick_batch_fn(EWFD_TICK_SCHEDULE, trigger_efwd_schedule_tickers);
+	ewfd_set_tick_batch_fn(EWFD_TICK_PADDING, trigger_efwd_padding_tickers);
+}
+
+static void trigger_efwd_schedule_ticker(void *args) {
 	ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ((circuit_t *)args);
 	if (ewfd_rt == NULL) {
 		return;
@@ -861,10 +930,24 @@ static void trigger_efwd_schedule_ticker(tor_timer_t *timer, void *args, const s
 
 	// handle schedule tick
 	run_ewfd_schedule_vm(ewfd_rt);
+	rearm_efwd_schedule_ticker(ewfd_rt);
+}
 
-	uint64_t now_ti = monotime_absolute_msec();
-	uint64_t detla = now_ti - ewfd_rt->schedule_unit_ctx.last_tick_ti;
+static void trigger_efwd_schedule_tickers(ewfd_ticker_st **tickers, int num) {
+	ewfd_padding_runtime_st *rts[EWFD_TICK_BATCH_MAX];
+	int rt_num = collect_ewfd_runtimes(tickers, num, rts);
+
+	if (ewfd_rt_offload_batch(EWFD_TICK_SCHEDULE, rts, rt_num, rearm_efwd_schedule_ticker)) {
+		return;
+	}
+	run_ewfd_schedule_vm_batch(rts, rt_num);
+	for (int i = 0; i < rt_num; i++) {
+		rearm_efwd_schedule_ticker(rts[i]);
+	}
+}
 
+static void rearm_efwd_schedule_ticker(ewfd_padding_runtime_st *ewfd_rt) {
+	uint64_t now_ti = monotime_absolute_msec();
 	uint64_t next_tick = ewfd_rt->schedule_unit_ctx.next_tick;
 	// schedule again
 	if (next_tick != 0) {
@@ -872,20 +955,16 @@ static void trigger_efwd_schedule_ticker(tor_timer_t *timer, void *args, const s
 		// timeout.tv_sec = next_tick * 1000 / TOR_USEC_PER_SEC;
 		// timeout.tv_usec = (next_tick * 1000) % TOR_USEC_PER_SEC;
 		// timer_schedule(ewfd_rt->schedule_unit_ctx.ticker, &timeout);
-		ewfd_schedule_ticker(ewfd_rt->schedule_unit_ctx.ticker, next_tick);
+		ewfd_schedule_ticker(&ewfd_rt->schedule_unit_ctx.ticker, next_tick);
 	}
 
-// 每个circuit每秒2次
-#if 0
-	uint32_t gid = ewfd_get_circuit_id(ewfd_rt->on_circ);
-	EWFD_LOG("[schedule-tick-n] [%u] want: %lu actual: %lu delta: %lu next: %lu", gid, 
-		ewfd_rt->schedule_unit_ctx.last_tick_ti, now_ti, detla, 
-		ewfd_rt->schedule_unit_ctx.last_tick_ti + next_tick);
-#endif
+	// 每个circuit每秒2次, actual/delta由记录的时间戳计算
+	EWFD_TRACE(EWFD_TRACE_SCHEDULE_TICK, ewfd_get_circuit_id(ewfd_rt->on_circ),
+		ewfd_rt->schedule_unit_ctx.last_tick_ti, next_tick);
 	ewfd_rt->schedule_unit_ctx.last_tick_ti = now_ti;
 }
 
-static void trigger_efwd_padding_ticker(tor_timer_t *timer, void *args, const struct monotime_t *time) {
+static void trigger_efwd_padding_ticker(void *args) {
 	ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ((circuit_t *)args);
 	if (ewfd_rt == NULL) {
 		return;
@@ -893,21 +972,31 @@ static void trigger_efwd_padding_ticker(tor_timer_t *timer, void *args, const st
 
 	// handle padding tick
 	run_ewfd_padding_vm(ewfd_rt);
+	rearm_efwd_padding_ticker(ewfd_rt);
+}
 
+static void trigger_efwd_padding_tickers(ewfd_ticker_st **tickers, int num) {
+	ewfd_padding_runtime_st *rts[EWFD_TICK_BATCH_MAX];
+	int rt_num = collect_ewfd_runtimes(tickers, num, rts);
+
+	if (ewfd_rt_offload_batch(EWFD_TICK_PADDING, rts, rt_num, rearm_efwd_padding_ticker)) {
+		return;
+	}
+	run_ewfd_padding_vm_batch(rts, rt_num);
+	for (int i = 0; i < rt_num; i++) {
+		rearm_efwd_padding_ticker(rts[i]);
+	}
+}
+
+static void rearm_efwd_padding_ticker(ewfd_padding_runtime_st *ewfd_rt) {
 	uint64_t now_ti =  monotime_absolute_msec();
-	uint64_t detla = (now_ti - ewfd_rt->padding_unit_ctx.last_tick_ti);
-	
 	uint64_t next_tick = ewfd_rt->padding_unit_ctx.next_tick;
 	// schedule again
 	if (next_tick != 0) {
-		ewfd_schedule_ticker(ewfd_rt->padding_unit_ctx.ticker, next_tick);
+		ewfd_schedule_ticker(&ewfd_rt->padding_unit_ctx.ticker, next_tick);
 	}
 
-#if 0
-	uint32_t gid = ewfd_get_circuit_id(ewfd_rt->on_circ);
-	EWFD_LOG("[padding-tick-n] [%u] want: %lu actual: %lu delta: %lu next: %lu", gid,
-		ewfd_rt->padding_unit_ctx.last_tick_ti, now_ti, detla, 
-		ewfd_rt->padding_unit_ctx.last_tick_ti + next_tick);
-#endif
+	EWFD_TRACE(EWFD_TRACE_PADDING_TICK, ewfd_get_circuit_id(ewfd_rt->on_circ),
+		ewfd_rt->padding_unit_ctx.last_tick_ti, next_tick);
 	ewfd_rt->padding_unit_ctx.last_tick_ti = now_ti;
 }
@@ -11,6 +11,7 @@ Padding 协议，padding unit的启动和调度
 #include <stdint.h>
 #include <stdbool.h>
 #include "feature/ewfd/ewfd_unit.h"
+#include "feature/ewfd/ewfd_ticker.h"
 
 
 #define MAX_EWFD_UNITS_ON_CIRC 5
@@ -50,6 +51,8 @@ typedef struct ewfd_padding_conf_t {
 	uint8_t target_hopnum;
 	uint32_t tick_interval;  // ms for tick gap, 10-6 second, 
 	bool use_jit;
+	bool owns_code; // torrc加载的conf自己持有code, 释放conf时一起释放
+	uint32_t refcnt; // client conf和使用该conf的unit各持有一个引用
 	ewfd_code_st *init_code; // init map/timeline
 	ewfd_code_st *main_code; // logic
 } ewfd_padding_conf_st;
@@ -62,34 +65,42 @@ typedef struct ewfd_padding_unit_t {
 	uint8_t unit_version; 	// 区分同一uuid的padding unit, version = current unit_cnt
 	uint8_t peer_state;		// 确认peer是否已经启动
 	uint8_t retry_num;		// 重试次数
+	uint32_t queued_dummy;	// 该unit已入队还没发送的dummy, STOP时只丢弃这部分
 	struct ewfd_padding_conf_t *conf;
 	struct ewfd_unit_t *ewfd_unit; // 保存ebpf jit函数
 } ewfd_padding_unit_st;
 
 /** 传递到eBPF vm的参数，一块连续的内存
+ * 布局必须和 lib/ebpf/ewfd-defense/bpf/headers/ewfd.h 一致，eBPF程序按那个头文件编译
+ * ewfd_unit和on_circ是handle，verifier只允许程序原样传给helper
 */
 typedef struct ewfd_circ_status_t {
 	uint64_t ewfd_unit;
 	// __IN
 	// uint32_t last_delay_ti;
-	uint64_t padding_start_ti; // first padding init time
-	uint64_t last_padding_ti;  // previous padding unit exec time
-	uint64_t last_cell_ti;     // last cell send/receive time
-	uint64_t now_ti;
+	uint32_t padding_start_ti; // first padding init time
+	uint32_t last_padding_ti;  // previous padding unit exec time
+	uint32_t last_cell_ti;     // last cell send/receive time
+	uint32_t now_ti;
 	
-	uintptr_t on_circ;
+	uint64_t on_circ;
 
 	uint32_t send_cell_cnt;
+	uint32_t send_dummy_cnt;
 	uint32_t recv_cell_cnt;
 
 	// command 
 	uint8_t cur_padding_unit;
 	uint8_t last_relay_cmd;
 	uint8_t current_relay_cmd;
+	uint8_t defense_status;
+
+	// queue
+	uint32_t queue_occupacy;
 
 	// __OUT 
-	uint64_t next_tick;
-} __attribute__((packed, aligned(4))) ewfd_circ_status_st;
+	uint32_t next_tick;
+} __attribute__((aligned(8))) ewfd_circ_status_st;
 
 // // 当前直接用函数：ewfd_padding_op
 // typedef struct ewfd_padding_op_t {
@@ -108,7 +119,7 @@ typedef struct ewfd_unit_ctx_t {
 	uint64_t padding_start_ti; // abusoluate time
 	uint32_t total_dummy_pkt;
 	uint32_t total_delay_pkt;
-	tor_timer_t *ticker;
+	ewfd_ticker_st ticker; // 挂在全局tick driver上
 } ewfd_unit_ctx_st;
 
 /** 目标：padding-unit和schedule-unit尽量共享最多的结构体，ctx只需要一个，避免同步tor状态同步两次
@@ -146,10 +157,36 @@ uint8_t get_current_padding_unit_uuid(ewfd_padding_runtime_st *ewfd_rt);
 
 int trigger_ewfd_units_on_circ(circuit_t *circ, bool is_send, bool toward_origin, uint8_t relay_command);
 
+/* 按unit uuid统计padding开销和unit执行耗时，导出到MetricsPort (见relay_metrics.c)
+* exec_hist: 单次执行耗时按ewfd_exec_hist_bounds_usec分桶，每个桶只记自己的次数
+*/
+#define EWFD_MAX_UNIT_UUID 256
+#define EWFD_EXEC_HIST_BUCKETS 8
+
+typedef struct ewfd_unit_stats_t {
+	uint64_t real_cells; // unit生效时circ上发送的真实cell
+	uint64_t dummy_cells; // unit发出的dummy cell
+	uint64_t exec_num;
+	uint64_t exec_nsec;
+	uint64_t exec_hist[EWFD_EXEC_HIST_BUCKETS];
+	int64_t active_units; // 当前挂在circ上的unit数量
+} ewfd_unit_stats_st;
+
+extern ewfd_unit_stats_st ewfd_unit_stats[EWFD_MAX_UNIT_UUID];
+extern const uint32_t ewfd_exec_hist_bounds_usec[EWFD_EXEC_HIST_BUCKETS - 1];
+
+// num次执行一共耗时nsec
+void ewfd_unit_stats_add_exec(uint8_t unit_uuid, uint64_t nsec, int num);
+// circ上当前生效的padding unit的统计，没有返回NULL
+ewfd_unit_stats_st *ewfd_unit_stats_on_circ(circuit_t *circ);
+
 bool ewfd_schedule_alter_unit(circuit_t *circ, uint8_t op, uint8_t target_unit, void *args);
 
 const char *padding_state_to_str(uint8_t state);
 
+// 到期的padding/schedule ticker交给ewfd_rt批量执行
+void ewfd_init_tick_batch(void);
+
 // other events
 // int on_add_ewfd_units_on_circ();
 // int on_remove_ewfd_units_on_circ();
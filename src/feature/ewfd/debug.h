@@ -3,7 +3,7 @@
 
 #include "core/or/or.h"
 
-#define EWFD_DEBUG // enable debug
+// #define EWFD_DEBUG // enable debug, 热路径上的事件用ewfd_trace.h记录
 // #define USE_EWFD_STATISTICS // enable state logs
 
 /*----------------------------------------------------------------------------
@@ -26,8 +26,9 @@ void ewfd_my_log_caller(const char *fn, const char *fi, int li, const char *form
 			log_fn_(LOG_LAST_LEV, LD_GENERAL, __FUNCTION__, args)
 	#endif // SHOW_LOG_FILE_PATH
 #else
+	// 不求值参数，但保留格式检查，避免只用于log的变量产生unused警告
 	#define EWFD_LOG(args...) \
-		do {} while(0)
+		do { if (0) log_fn_(LOG_LAST_LEV, LD_GENERAL, __FUNCTION__, args); } while(0)
 #endif // EWFD_DEBUG
 
 /* 用于python脚本统计padding包
@@ -20,6 +20,15 @@ int ewfd_op_delay(uintptr_t on_circ, uint32_t insert_ti, uint32_t delay_ms, uint
 // 获取当前circ上的delay事件，如果太多就不需要调度了
 int ewfd_get_event_num(uintptr_t on_circ);
 
+// 按类型统计circ上等待中的事件, O(1)
+enum EWFD_EVENT_TYPE {
+	EWFD_EVENT_TYPE_DUMMY = 0,
+	EWFD_EVENT_TYPE_DELAY = 1, // delay + delay gap
+	EWFD_EVENT_TYPE_NOTIFY = 2,
+	EWFD_EVENT_TYPE_NUM,
+};
+int ewfd_get_event_num_by_type(uintptr_t on_circ, int event_type);
+
 
 
 #endif // EWFD_EBPF_API_H_
@@ -1,5 +1,6 @@
 #include "lib/smartlist_core/smartlist_core.h"
 #include "lib/time/compat_time.h"
+#include "lib/defs/time.h"
 #include <stdio.h>
 // #define EWFD_USE_TEMP_LOG
 #include "feature/ewfd/debug.h"
@@ -9,6 +10,7 @@
 // #define EWFD_UNITEST_TEST_PRIVATE
 #include "feature/ewfd/ewfd.h"
 #include "feature/ewfd/ewfd_ticker.h"
+#include "feature/ewfd/ewfd_rt.h"
 #include "feature/ewfd/utils.h"
 #include "feature/ewfd/circuit_padding.h"
 #include "lib/log/util_bug.h"
@@ -17,6 +19,9 @@
 #include "core/or/cell_st.h"
 #include "ext/tor_queue.h"
 #include "feature/ewfd/ewfd_conf.h"
+#include "app/config/config.h"
+#include "feature/ewfd/ewfd_unit.h"
+#include "lib/ebpf/libebpf.h"
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
@@ -25,16 +30,28 @@
 #include "core/or/circuitlist.h"
 #include "feature/ewfd/ewfd_op.h"
 #include "feature/ewfd/ebpf_api.h"
+#include "feature/ewfd/ewfd_wheel.h"
+#include "feature/ewfd/ewfd_pool.h"
+#include "feature/ewfd/ewfd_trace.h"
+#include "lib/cc/compat_compiler.h"
+#include "lib/thread/threads.h"
+#include "ht.h"
+#include "siphash.h"
 
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
 
-// eBPF code list
+// eBPF code list, 只在主线程读写; worker执行unit用到的conf由job持有引用
 ewfd_client_conf_st *ewfd_client_conf = NULL;
+// 主线程的framework
 ewfd_framework_st *ewfd_framework_instance = NULL;
 
+// cpuworker执行unit时的framework, 主线程不设置
+static tor_threadlocal_t ewfd_framework_tls;
+static bool ewfd_framework_tls_inited = false;
+
 enum EWFD_OP_TYPE {
 	EWFD_OP_DUMMY = 0,
 	// simple delay
@@ -52,7 +69,8 @@ enum EWFD_NOTIFY_REASON {
 
 // delay/dummy全部操作的参数都放在这struct里
 typedef struct ewfd_op_event_t {
-	TOR_SIMPLEQ_ENTRY(ewfd_op_event_t) next;
+	ewfd_wheel_node_st wheel_node; // 按insert_ti挂在时间轮上
+	TOR_LIST_ENTRY(ewfd_op_event_t) circ_node; // 同一个circ的event链表
 	uintptr_t on_circ;
 	uint64_t insert_ti;
 	uint32_t event_id;
@@ -69,35 +87,48 @@ typedef struct ewfd_op_event_t {
 	uint8_t ewfd_op;
 } ewfd_op_event_st;
 
-typedef struct ewfd_event_queue_t {
-	TOR_SIMPLEQ_HEAD(packet_simpleq_t, ewfd_op_event_t) head;
-	uint32_t queue_len;
-} ewfd_event_queue_st;
+/* 每个circ上挂着的event，circ关闭时不用遍历全局队列
+*/
+typedef struct ewfd_circ_events_t {
+	HT_ENTRY(ewfd_circ_events_t) node;
+	uintptr_t on_circ;
+	TOR_LIST_HEAD(circ_event_list_t, ewfd_op_event_t) events;
+	uint32_t event_num;
+	uint32_t type_num[EWFD_EVENT_TYPE_NUM]; // 每类event的数量
+} ewfd_circ_events_st;
+
+static inline unsigned int
+ewfd_circ_events_hash_(ewfd_circ_events_st *a)
+{
+	return (unsigned) siphash24g(&a->on_circ, sizeof(a->on_circ));
+}
+
+static inline int
+ewfd_circ_events_eq_(ewfd_circ_events_st *a, ewfd_circ_events_st *b)
+{
+	return a->on_circ == b->on_circ;
+}
+
+HT_HEAD(ewfd_circ_event_map, ewfd_circ_events_t);
+HT_PROTOTYPE(ewfd_circ_event_map, ewfd_circ_events_t, node,
+			ewfd_circ_events_hash_, ewfd_circ_events_eq_);
+HT_GENERATE2(ewfd_circ_event_map, ewfd_circ_events_t, node,
+			ewfd_circ_events_hash_, ewfd_circ_events_eq_, 0.6,
+			tor_reallocarray_, tor_free_);
 
-// put in queue
-/* 如果sleep太久，后面就唤醒
+/* 全局事件队列：时间轮按insert_ti排序，circ_map按circ索引
 */
-struct ewfd_delay_entry_t;
-typedef struct ewfd_delay_queue_t {
-	TOR_SIMPLEQ_HEAD(delay_circ_simpleq_t, ewfd_delay_entry_t) head;
+typedef struct ewfd_event_queue_t {
+	ewfd_wheel_st wheel;
+	struct ewfd_circ_event_map circ_map;
 	uint32_t queue_len;
-} ewfd_delay_queue_st;
-
+} ewfd_event_queue_st;
 
 /*
-* 定期检查每个cmux的inactive队列，唤醒对应的circ
-* 退出：on_circ被终结，或者api上关闭了操作 
+* delay的circ不再放在全局队列里轮询：每个cmux按唤醒时间把circ挂在时间轮上，
+* tick时只唤醒到期的circ (见circuitmux_ewfd.c)
+* 退出：on_circ被终结，或者回到NORMAL状态
 */
-enum EWFD_DELAY_STATE {
-	EWFD_DELAY_STATE_ACTIVE = 1,
-	EWFD_DELAY_STATE_INACTIVE = 2,
-};
-
-typedef struct ewfd_delay_entry_t {
-	TOR_SIMPLEQ_ENTRY(ewfd_delay_entry_t) next;
-	uintptr_t on_circ;
-	uint32_t event_num;
-} ewfd_delay_entry_st;
 
 static void parser_client_conf(void);
 
@@ -113,19 +144,18 @@ delay/dummy op：用一个队列还是2个队列？
 static void init_ewfd_queues(ewfd_framework_st *framework);
 static void free_ewfd_queues(ewfd_framework_st *framework);
 
-// 固定GAP (EWFD_EVENT_QUEUE_TICK) 触发事件队列
-void on_event_queue_tick(periodic_timer_t *timer, void *data);
+// 按最早到期的event设置one-shot timer
+static void arm_framework_ticker(uint64_t now_ti);
+static void on_framework_ticker(tor_timer_t *timer, void *args, const struct monotime_t *time);
+void on_event_queue_tick(tor_timer_t *timer, void *data);
 
-static int ewfd_add_to_event_queue(ewfd_op_event_st *event);
+static int ewfd_add_to_event_queue(ewfd_framework_st *framework, ewfd_op_event_st *event);
 static bool handle_one_event(ewfd_op_event_st *event);
 static const char* event_op_to_str(ewfd_op_event_st *event);
 
 static void ewfd_remove_remain_events(uintptr_t on_circ);
 
 // 定时触发这些 circuts中的inactive队列  
-/*
-* TODO: 改成time wheel触发
-*/
 static void ewfd_add_delay_trigger_event(uintptr_t on_circ, uint32_t gap_ms);
 static void ewfd_remove_delay_trigger_event(uintptr_t on_circ);
 static void ewfd_try_trigger_delay_events(uint64_t cur_ti);
@@ -135,39 +165,88 @@ static void ewfd_try_trigger_delay_events(uint64_t cur_ti);
 */
 // static void ewfd_check_queue_delay();
 
-static uint32_t total_event_alloc = 0;
+ewfd_event_queue_stats_st ewfd_event_queue_stats;
+
+/* event/circ_events都是高频分配的小对象，从对象池里分配
+*/
+static ewfd_pool_st ewfd_event_pool = EWFD_POOL_INIT("op_event", sizeof(ewfd_op_event_st));
+static ewfd_pool_st ewfd_circ_events_pool = EWFD_POOL_INIT("circ_events", sizeof(ewfd_circ_events_st));
+
+static ewfd_pool_st *ewfd_pools[] = {
+	&ewfd_event_pool,
+	&ewfd_circ_events_pool,
+	&ewfd_delay_desc_pool,
+	&ewfd_delay_queue_pool,
+};
 
-static inline ewfd_op_event_st *alloc_ewfd_event(uintptr_t on_circ, uint64_t insert_ti, uint8_t ewfd_op) {
-	total_event_alloc++;
-	ewfd_op_event_st *event = tor_malloc_zero(sizeof(ewfd_op_event_st));
+/* 对象池不是线程安全的，worker上的event直接malloc，提交到主线程时换成池里的event
+*/
+static inline ewfd_op_event_st *alloc_ewfd_event(ewfd_framework_st *framework, uintptr_t on_circ,
+		uint64_t insert_ti, uint8_t ewfd_op) {
+	framework->event_alloc++;
+	ewfd_op_event_st *event;
+	if (framework->pending_ops != NULL) {
+		event = tor_malloc_zero(sizeof(ewfd_op_event_st));
+	} else {
+		event = ewfd_pool_alloc(&ewfd_event_pool);
+	}
 	event->on_circ = on_circ;
 	event->ewfd_op = ewfd_op;
 	event->insert_ti = insert_ti;
-	event->event_id = total_event_alloc; // for debug
+	event->event_id = framework->event_alloc; // for debug
 	return event;
 }
 
 static inline void free_ewfd_event(ewfd_op_event_st *event) {
-	total_event_alloc--;
-	tor_free(event);
+	ewfd_framework_instance->event_alloc--;
+	ewfd_pool_free(&ewfd_event_pool, event);
 }
 
-static inline void ewfd_event_queue_remove_first(ewfd_event_queue_st *queue, bool free_event) {
-	ewfd_op_event_st *event = TOR_SIMPLEQ_FIRST(&queue->head);
-	if (event != NULL) {
-		TOR_SIMPLEQ_REMOVE_HEAD(&queue->head, next);
-		queue->queue_len--;
-		if (free_event) {
-			free_ewfd_event(event);
-		}
+static inline int ewfd_event_type(const ewfd_op_event_st *event) {
+	switch (event->ewfd_op) {
+		case EWFD_OP_DUMMY:
+			return EWFD_EVENT_TYPE_DUMMY;
+		case EWFD_OP_NOTIFY:
+			return EWFD_EVENT_TYPE_NOTIFY;
+		default:
+			return EWFD_EVENT_TYPE_DELAY;
+	}
+}
+
+static ewfd_circ_events_st *ewfd_get_circ_events(ewfd_event_queue_st *queue, uintptr_t on_circ) {
+	ewfd_circ_events_st search;
+	search.on_circ = on_circ;
+	return HT_FIND(ewfd_circ_event_map, &queue->circ_map, &search);
+}
+
+/* 从时间轮和circ索引中删除event
+*/
+static inline void ewfd_event_queue_remove(ewfd_event_queue_st *queue, ewfd_op_event_st *event) {
+	ewfd_wheel_del(&queue->wheel, &event->wheel_node);
+	TOR_LIST_REMOVE(event, circ_node);
+	queue->queue_len--;
+
+	ewfd_circ_events_st *circ_events = ewfd_get_circ_events(queue, event->on_circ);
+	tor_assert(circ_events);
+	circ_events->type_num[ewfd_event_type(event)]--;
+	if (--circ_events->event_num == 0) {
+		HT_REMOVE(ewfd_circ_event_map, &queue->circ_map, circ_events);
+		ewfd_pool_free(&ewfd_circ_events_pool, circ_events);
 	}
+	free_ewfd_event(event);
 }
 
 void ewfd_framework_init(void) {
 	EWFD_LOG("ewfd_padding_init");
 
+	ewfd_trace_init();
 	init_ewfd_code_cache();
+	ewfd_init_tick_batch();
 
+	if (!ewfd_framework_tls_inited) {
+		tor_threadlocal_init(&ewfd_framework_tls);
+		ewfd_framework_tls_inited = true;
+	}
 	ewfd_framework_instance = (ewfd_framework_st *) tor_malloc_zero(sizeof(ewfd_framework_st));
 	
 	// init event queue
@@ -184,16 +263,12 @@ void start_ewfd_padding_framework(void) {
 
 void ewfd_framework_free(void) {
 	EWFD_LOG("ewfd_framework_free");
+	// 在丢弃running job之前，还要判断worker是否在读取data stream
+	ewfd_unmap_data_stream_file();
+	ewfd_rt_offload_free();
 	free_framework_ticker();
-	if (ewfd_client_conf != NULL) {
-		if (ewfd_client_conf->client_unit_confs != NULL) {
-			SMARTLIST_FOREACH(ewfd_client_conf->client_unit_confs,
-				ewfd_padding_conf_st *,
-				conf, tor_free(conf));
-			smartlist_free(ewfd_client_conf->client_unit_confs);
-		}
-		tor_free(ewfd_client_conf);
-	}
+	ewfd_client_conf_free(ewfd_client_conf);
+	ewfd_client_conf = NULL;
 
 	if (ewfd_framework_instance != NULL) {
 		// free queue
@@ -201,83 +276,161 @@ void ewfd_framework_free(void) {
 
 		tor_free(ewfd_framework_instance);
 	}
+	ewfd_dump_pool_usage();
+	for (size_t i = 0; i < ARRAY_LENGTH(ewfd_pools); i++) {
+		ewfd_pool_trim(ewfd_pools[i]);
+	}
 
 	free_ewfd_code_cache();
+	ewfd_free_tick_driver();
+	ewfd_trace_free();
 	// assert(total_ewfd_timer == 0);
-	EWFD_LOG("ewfd_framework_free total timer: %d released timer: %d", total_ewfd_timer, released_ewfd_timer);
+	EWFD_LOG("ewfd_framework_free total timer: %d released timer: %d wakeups: %lu units: %lu batches: %lu",
+		total_ewfd_timer, released_ewfd_timer, ewfd_tick_wakeups, ewfd_tick_units, ewfd_tick_batches);
+	EWFD_LOG("ewfd event queue wakeups: %lu processed: %lu late: %lu dropped: %lu budget exhausted: %lu",
+		ewfd_event_queue_stats.wakeups, ewfd_event_queue_stats.processed, ewfd_event_queue_stats.late,
+		ewfd_event_queue_stats.dropped, ewfd_event_queue_stats.budget_exhausted);
+	EWFD_LOG("ewfd unit jobs: %lu inline: %lu units: %lu discarded: %lu",
+		ewfd_unit_job_stats.jobs, ewfd_unit_job_stats.inline_jobs, ewfd_unit_job_stats.units,
+		ewfd_unit_job_stats.discarded);
+	EWFD_LOG("ewfd code cache hit: %lu miss: %lu jit: %lu load/jit time: %lu us verify reject: %lu",
+		ewfd_code_cache_stats.cache_hit, ewfd_code_cache_stats.cache_miss,
+		ewfd_code_cache_stats.compile_num, ewfd_code_cache_stats.compile_usec,
+		ewfd_code_cache_stats.verify_reject);
+	struct ebpf_jit_arena_stats jit_stats;
+	ebpf_jit_arena_get_stats(&jit_stats);
+	// code cache已经释放，剩余的programs说明有vm泄漏
+	EWFD_LOG("ewfd jit arena chunks: %lu mapped: %lu used: %lu programs: %lu compiled: %lu",
+		jit_stats.chunks, jit_stats.bytes_mapped, jit_stats.bytes_used,
+		jit_stats.programs, jit_stats.total_allocs);
+}
+
+void ewfd_dump_pool_usage(void) {
+	for (size_t i = 0; i < ARRAY_LENGTH(ewfd_pools); i++) {
+		ewfd_pool_st *pool = ewfd_pools[i];
+		EWFD_LOG("ewfd pool %s used: %u free: %u high water: %u alloc: %lu reuse: %lu trim: %lu bytes: %zu",
+			pool->name, pool->used_num, pool->free_num, pool->high_water,
+			pool->alloc_num, pool->reuse_num, pool->trim_num, ewfd_pool_get_allocation(pool));
+	}
+}
+
+size_t ewfd_framework_get_total_allocation(void) {
+	size_t alloc = 0;
+	for (size_t i = 0; i < ARRAY_LENGTH(ewfd_pools); i++) {
+		alloc += ewfd_pool_get_allocation(ewfd_pools[i]);
+	}
+	return alloc;
+}
+
+size_t ewfd_framework_handle_oom(void) {
+	size_t freed = 0;
+	for (size_t i = 0; i < ARRAY_LENGTH(ewfd_pools); i++) {
+		freed += ewfd_pool_trim(ewfd_pools[i]);
+	}
+	EWFD_LOG("ewfd framework oom, trim pools: %zu bytes", freed);
+	ewfd_dump_pool_usage();
+	return freed;
 }
 
 static void parser_client_conf(void) {
 	if (ewfd_client_conf == NULL) {
-		ewfd_client_conf = tor_malloc_zero(sizeof(ewfd_client_conf_st));
+		ewfd_client_conf = ewfd_new_demo_client_conf();
 	}
-	if (ewfd_client_conf->client_unit_confs == NULL) {
-		ewfd_client_conf->client_unit_confs = smartlist_new();
+	// 先用内置的unit，torrc中的EWFDUnit在cpuworker中编译完成后替换
+	if (get_options()->EWFDUnit != NULL) {
+		ewfd_reload_unit_confs(get_options()->EWFDUnit);
 	}
-	/* schedule unit和padding unit的uuid不能重复
-	*/
-	ewfd_padding_conf_st *padding_unit = demo_get_front_padding_unit_conf();
-	ewfd_padding_conf_st *schedule_unit = demo_get_front_schedule_unit_conf();
+	if (get_options()->EWFDDataStreamFile != NULL) {
+		ewfd_map_data_stream_file(get_options()->EWFDDataStreamFile);
+	}
+}
 
-	tor_assert(padding_unit);
-	tor_assert(schedule_unit);
+static void init_framework_ticker(void) {
+	uint64_t now_ti = monotime_absolute_msec();
 
-	smartlist_add(ewfd_client_conf->client_unit_confs, padding_unit);
-	smartlist_add(ewfd_client_conf->client_unit_confs, schedule_unit);
+	ewfd_framework_instance->packet_ticker = timer_new(on_framework_ticker, NULL);
+	ewfd_framework_instance->packet_ticker_armed_ti = UINT64_MAX;
+	ewfd_framework_instance->last_event_ti = now_ti;
 
-	ewfd_client_conf->active_schedule_slot = 0;
-	ewfd_client_conf->active_padding_slot = 0;
+	// 启动前已经加入的event
+	arm_framework_ticker(now_ti);
+}
 
-	ewfd_client_conf->need_reload = true;
+static void free_framework_ticker(void) {
+	if (ewfd_framework_instance != NULL && ewfd_framework_instance->packet_ticker != NULL) {
+		timer_free(ewfd_framework_instance->packet_ticker);
+	}
 }
 
-static void init_framework_ticker(void) {
-	static const struct timeval gap = {0, EWFD_EVENT_QUEUE_TICK_MS * 1000};
-	
-	ewfd_framework_instance->packet_ticker = periodic_timer_new(tor_libevent_get_base(), &gap, 
-		on_event_queue_tick, NULL);
+/* 下一次唤醒的时间：时间轮上最早的event和最早需要唤醒的delay circ
+* 到期时间对齐到EWFD_TICK_SLOT_MS，只在比已设置的时间更早时重新设置timer
+* 空闲时不设置timer
+*/
+static void arm_framework_ticker(uint64_t now_ti) {
+	ewfd_framework_st *framework = ewfd_framework_instance;
+	if (framework == NULL || framework->packet_ticker == NULL) {
+		return;
+	}
+
+	ewfd_event_queue_st *event_queue = (ewfd_event_queue_st *) framework->ewfd_event_queue;
+	uint64_t next_ti = MIN(ewfd_wheel_next_expire(&event_queue->wheel),
+		ewfd_padding_next_delay_wakeup());
+	if (next_ti == UINT64_MAX) { // 空闲，不需要唤醒
+		return;
+	}
 
-	ewfd_framework_instance->last_event_ti = monotime_absolute_msec();
+	if (next_ti > now_ti) {
+		next_ti = ((next_ti + EWFD_TICK_SLOT_MS - 1) / EWFD_TICK_SLOT_MS) * EWFD_TICK_SLOT_MS;
+	} else { // 有到期没处理完的event，马上唤醒
+		next_ti = now_ti;
+	}
+	if (next_ti >= framework->packet_ticker_armed_ti) {
+		return;
+	}
+
+	uint64_t delay_ms = next_ti > now_ti ? next_ti - now_ti : 0;
+	struct timeval timeout;
+	timeout.tv_sec = delay_ms * 1000 / TOR_USEC_PER_SEC;
+	timeout.tv_usec = (delay_ms * 1000) % TOR_USEC_PER_SEC;
+	timer_schedule(framework->packet_ticker, &timeout);
+	framework->packet_ticker_armed_ti = next_ti;
 }
 
-static void free_framework_ticker(void) {
-	if (ewfd_framework_instance != NULL && ewfd_framework_instance->packet_ticker != NULL) {
-		periodic_timer_free(ewfd_framework_instance->packet_ticker);
+static void on_framework_ticker(tor_timer_t *timer, void *args, const struct monotime_t *time) {
+	(void) args;
+	(void) time;
+	if (ewfd_framework_instance == NULL) {
+		return;
 	}
+	on_event_queue_tick(timer, NULL);
 }
 
 static void init_ewfd_queues(ewfd_framework_st *framework) {
 	if (framework->ewfd_event_queue == NULL) {
 		framework->ewfd_event_queue = (ewfd_event_queue_st *) tor_malloc_zero(sizeof(ewfd_event_queue_st));
-		TOR_SIMPLEQ_INIT(&framework->ewfd_event_queue->head);
-	}
-
-	if (framework->ewfd_delay_queue == NULL) {
-		framework->ewfd_delay_queue = (ewfd_delay_queue_st *) tor_malloc_zero(sizeof(ewfd_delay_queue_st));
-		TOR_SIMPLEQ_INIT(&framework->ewfd_delay_queue->head);
+		ewfd_wheel_init(&framework->ewfd_event_queue->wheel, 0);
+		HT_INIT(ewfd_circ_event_map, &framework->ewfd_event_queue->circ_map);
 	}
 }
 
 static void free_ewfd_queues(ewfd_framework_st *framework){
-	ewfd_op_event_st *event;
-	if (framework->ewfd_event_queue != NULL) {
-		while ((event = TOR_SIMPLEQ_FIRST(&framework->ewfd_event_queue->head)) != NULL) {
-			TOR_SIMPLEQ_REMOVE_HEAD(&framework->ewfd_event_queue->head, next);
-			framework->ewfd_event_queue->queue_len--;
-			tor_free(event);
+	ewfd_event_queue_st *event_queue = framework->ewfd_event_queue;
+	if (event_queue != NULL) {
+		ewfd_circ_events_st **ent, **next, *circ_events;
+		for (ent = HT_START(ewfd_circ_event_map, &event_queue->circ_map); ent; ent = next) {
+			ewfd_op_event_st *event;
+			circ_events = *ent;
+			next = HT_NEXT_RMV(ewfd_circ_event_map, &event_queue->circ_map, ent);
+			while ((event = TOR_LIST_FIRST(&circ_events->events)) != NULL) {
+				TOR_LIST_REMOVE(event, circ_node);
+				ewfd_wheel_del(&event_queue->wheel, &event->wheel_node);
+				free_ewfd_event(event);
+			}
+			ewfd_pool_free(&ewfd_circ_events_pool, circ_events);
 		}
+		HT_CLEAR(ewfd_circ_event_map, &event_queue->circ_map);
 		tor_free(framework->ewfd_event_queue);
 	}
-
-	ewfd_delay_entry_st *delay_entry;
-	if (framework->ewfd_delay_queue != NULL) {
-		while ((delay_entry = TOR_SIMPLEQ_FIRST(&framework->ewfd_delay_queue->head)) != NULL) {
-			TOR_SIMPLEQ_REMOVE_HEAD(&framework->ewfd_delay_queue->head, next);
-			tor_free(delay_entry);
-			framework->ewfd_delay_queue->queue_len--;
-		}
-		tor_free(framework->ewfd_delay_queue);
-	}
 }
 
 
@@ -295,69 +448,91 @@ static void ewfd_remove_remain_events(uintptr_t on_circ) {
 		return;
 	}
 	ewfd_event_queue_st *queue = (ewfd_event_queue_st *) ewfd_framework_instance->ewfd_event_queue;
-	{
-		int del_pkt = 0;
-		ewfd_op_event_st *cur_event = TOR_SIMPLEQ_FIRST(&queue->head);
-		ewfd_op_event_st *prev_event = NULL;
+	ewfd_circ_events_st *circ_events = ewfd_get_circ_events(queue, on_circ);
+	if (circ_events == NULL) {
+		return;
+	}
 
-		// remove outdated event
-		while (cur_event != NULL) {
-			
-			if (cur_event->on_circ == on_circ) { // delete one
-				// printf("delete event: %p eid:%d circ:%p\n", cur_event, cur_event->event_id, cur_event->on_circ);
-				ewfd_op_event_st *next_event = TOR_SIMPLEQ_NEXT(cur_event, next);
-				if (prev_event == NULL) { // is header
-					TOR_SIMPLEQ_REMOVE_HEAD(&queue->head, next);
-				} else {
-					TOR_SIMPLEQ_REMOVE_AFTER(&queue->head, prev_event, next);
-				}
-				free_ewfd_event(cur_event);
-				queue->queue_len--;
-				del_pkt++;
-				cur_event = next_event;
-			} else {
-				prev_event = cur_event;
-				cur_event = TOR_SIMPLEQ_NEXT(cur_event, next);
-			}
-		}
-		// printf("queue len: %d remove: %d\n", queue->queue_len, del_pkt);
+	// 只遍历该circ自己的event
+	int del_pkt = 0;
+	ewfd_op_event_st *cur_event;
+	HT_REMOVE(ewfd_circ_event_map, &queue->circ_map, circ_events);
+	while ((cur_event = TOR_LIST_FIRST(&circ_events->events)) != NULL) {
+		TOR_LIST_REMOVE(cur_event, circ_node);
+		ewfd_wheel_del(&queue->wheel, &cur_event->wheel_node);
+		ewfd_event_queue_stats.type_dropped[ewfd_event_type(cur_event)]++;
+		free_ewfd_event(cur_event);
+		queue->queue_len--;
+		del_pkt++;
+	}
+	ewfd_pool_free(&ewfd_circ_events_pool, circ_events);
+
+	if (del_pkt > 0) {
+		EWFD_LOG("remove events: %d", del_pkt);
+	}
+}
 
-		if (del_pkt > 0) {
-			EWFD_LOG("remove events: %d", del_pkt);
+/* worker: 派发时的快照加上本次执行已经记录的op
+*/
+static int ewfd_worker_event_num(ewfd_framework_st *framework, uintptr_t on_circ, int event_type) {
+	int num = 0;
+	const ewfd_circ_event_count_st *count = framework->event_count;
+	if (count != NULL && count->on_circ == on_circ) {
+		for (int i = 0; i < EWFD_EVENT_TYPE_NUM; i++) {
+			if (event_type < 0 || event_type == i) {
+				num += (int) count->type_num[i];
+			}
 		}
 	}
+	SMARTLIST_FOREACH_BEGIN(framework->pending_ops, ewfd_op_event_st *, event) {
+		if (event->on_circ == on_circ && (event_type < 0 || event_type == ewfd_event_type(event))) {
+			num++;
+		}
+	} SMARTLIST_FOREACH_END(event);
+	return num;
 }
 
 // pass unit test
 int ewfd_get_event_num(uintptr_t on_circ) {
-	if (ewfd_framework_instance == NULL) {
+	ewfd_framework_st *framework = ewfd_framework_current();
+	if (framework == NULL) {
 		return 0;
 	}
-	/* TODO: 改成hashmap读，单独维护每个circ每类包的数量
-	*/
-	ewfd_event_queue_st *queue = (ewfd_event_queue_st *) ewfd_framework_instance->ewfd_event_queue;
-	int remain = 0;
-
-	ewfd_op_event_st *cur_event;
-	TOR_SIMPLEQ_FOREACH(cur_event, &queue->head, next) {
-		if (cur_event->on_circ == on_circ) {
-			remain++;
-		}
+	if (framework->pending_ops != NULL) {
+		return ewfd_worker_event_num(framework, on_circ, -1);
 	}
+	ewfd_event_queue_st *queue = (ewfd_event_queue_st *) framework->ewfd_event_queue;
+	ewfd_circ_events_st *circ_events = ewfd_get_circ_events(queue, on_circ);
 
-	// printf("queue len: %d remain: %d\n", queue->queue_len, remain);
+	return circ_events ? (int) circ_events->event_num : 0;
+}
 
-	return remain;
+int ewfd_get_event_num_by_type(uintptr_t on_circ, int event_type) {
+	ewfd_framework_st *framework = ewfd_framework_current();
+	if (framework == NULL) {
+		return 0;
+	}
+	if (event_type < 0 || event_type >= EWFD_EVENT_TYPE_NUM) {
+		return ewfd_get_event_num(on_circ);
+	}
+	if (framework->pending_ops != NULL) {
+		return ewfd_worker_event_num(framework, on_circ, event_type);
+	}
+	ewfd_event_queue_st *queue = (ewfd_event_queue_st *) framework->ewfd_event_queue;
+	ewfd_circ_events_st *circ_events = ewfd_get_circ_events(queue, on_circ);
+
+	return circ_events ? (int) circ_events->type_num[event_type] : 0;
 }
 
 /* 按照时间顺序来插入包
 */
 int ewfd_add_dummy_packet(uintptr_t on_circ, uint32_t insert_ti) {
-	ewfd_op_event_st *event = alloc_ewfd_event(on_circ, insert_ti, EWFD_OP_DUMMY);
+	ewfd_framework_st *framework = ewfd_framework_current();
+	ewfd_op_event_st *event = alloc_ewfd_event(framework, on_circ, insert_ti, EWFD_OP_DUMMY);
 
 	// EWFD_TEMP_LOG("circ: %u insert dummy event: %lu", ewfd_get_circuit_id((circuit_t *)on_circ), event->insert_ti);
 
-	return ewfd_add_to_event_queue(event);
+	return ewfd_add_to_event_queue(framework, event);
 }
 
 int ewfd_add_delay_packet(uintptr_t on_circ, uint32_t insert_ti, uint32_t delay_to_ms, uint32_t pkt_num) {
@@ -365,37 +540,101 @@ int ewfd_add_delay_packet(uintptr_t on_circ, uint32_t insert_ti, uint32_t delay_
 	1. 添加一个delay event, 阻塞当前队列
 	2. 添加一个delay notify event, 唤醒当前队列
 	*/
-	ewfd_op_event_st *delay_event = alloc_ewfd_event(on_circ, insert_ti, EWFD_OP_DELAY);
+	ewfd_framework_st *framework = ewfd_framework_current();
+	ewfd_op_event_st *delay_event = alloc_ewfd_event(framework, on_circ, insert_ti, EWFD_OP_DELAY);
 	delay_event->delay_event.delay_ms = delay_to_ms;
 	delay_event->delay_event.pkt_num = pkt_num;
-	int ret = ewfd_add_to_event_queue(delay_event);
+	int ret = ewfd_add_to_event_queue(framework, delay_event);
 
-	ewfd_op_event_st *notify_event = alloc_ewfd_event(on_circ, delay_to_ms, EWFD_OP_NOTIFY);
+	ewfd_op_event_st *notify_event = alloc_ewfd_event(framework, on_circ, delay_to_ms, EWFD_OP_NOTIFY);
 	notify_event->notify_event.reason = EWFD_NOTIFY_CIRC_ACTIVE;
-	ret &= ewfd_add_to_event_queue(notify_event);
+	ret &= ewfd_add_to_event_queue(framework, notify_event);
 
 	return ret;
 }
 
 int ewfd_op_delay(uintptr_t on_circ, uint32_t insert_ti, uint32_t delay_ms, uint32_t pkt_num) {
 	// set circ policy
-	ewfd_op_event_st *delay_event = alloc_ewfd_event(on_circ, insert_ti, EWFD_OP_DELAY_GAP);
+	ewfd_framework_st *framework = ewfd_framework_current();
+	ewfd_op_event_st *delay_event = alloc_ewfd_event(framework, on_circ, insert_ti, EWFD_OP_DELAY_GAP);
 	delay_event->delay_event.delay_ms = delay_ms;
 	delay_event->delay_event.pkt_num = pkt_num;
 
-	ewfd_add_delay_trigger_event(on_circ, delay_ms);
+	// worker上不能访问circ, 提交时再挂到cmux的sleep轮上
+	if (framework->pending_ops == NULL) {
+		ewfd_add_delay_trigger_event(on_circ, delay_ms);
+	}
 
-	return ewfd_add_to_event_queue(delay_event);
+	return ewfd_add_to_event_queue(framework, delay_event);
 }
 
 // --------------------------------------------------------------
 // End ewfd ebpf api 
 // --------------------------------------------------------------
 
+ewfd_framework_st *ewfd_framework_current(void) {
+	if (ewfd_framework_tls_inited) {
+		ewfd_framework_st *framework = tor_threadlocal_get(&ewfd_framework_tls);
+		if (framework != NULL) {
+			return framework;
+		}
+	}
+	return ewfd_framework_instance;
+}
+
+void ewfd_framework_enter_worker(ewfd_framework_st *framework) {
+	tor_assert(ewfd_framework_tls_inited);
+	tor_assert(framework->ewfd_event_queue == NULL && framework->pending_ops != NULL);
+	tor_threadlocal_set(&ewfd_framework_tls, framework);
+}
+
+void ewfd_framework_leave_worker(void) {
+	tor_threadlocal_set(&ewfd_framework_tls, NULL);
+}
+
+/* 按记录的顺序入队，和在主线程直接执行unit的结果一样
+* delay gap需要的cmux sleep也在这里设置
+*/
+void ewfd_framework_commit_ops(smartlist_t *ops) {
+	ewfd_framework_st *framework = ewfd_framework_instance;
+	SMARTLIST_FOREACH_BEGIN(ops, ewfd_op_event_st *, op) {
+		if (framework != NULL && framework->ewfd_event_queue != NULL) {
+			ewfd_op_event_st *event = alloc_ewfd_event(framework, op->on_circ, op->insert_ti, op->ewfd_op);
+			memcpy(&event->delay_event, &op->delay_event, sizeof(event->delay_event));
+			if (event->ewfd_op == EWFD_OP_DELAY_GAP) {
+				ewfd_add_delay_trigger_event(event->on_circ, event->delay_event.delay_ms);
+			}
+			ewfd_add_to_event_queue(framework, event);
+		}
+		tor_free(op);
+	} SMARTLIST_FOREACH_END(op);
+	smartlist_clear(ops);
+}
+
+// 丢弃worker记录的op，circ已经释放
+void ewfd_framework_clear_ops(smartlist_t *ops) {
+	SMARTLIST_FOREACH(ops, ewfd_op_event_st *, op, tor_free(op));
+	smartlist_clear(ops);
+}
+
+void ewfd_get_circ_event_count(uintptr_t on_circ, ewfd_circ_event_count_st *count) {
+	memset(count, 0, sizeof(*count));
+	count->on_circ = on_circ;
+	if (ewfd_framework_instance == NULL) {
+		return;
+	}
+	ewfd_circ_events_st *circ_events = ewfd_get_circ_events(ewfd_framework_instance->ewfd_event_queue, on_circ);
+	if (circ_events != NULL) {
+		memcpy(count->type_num, circ_events->type_num, sizeof(count->type_num));
+	}
+}
+
 /* send [last_dummy, last_dummy + GAP) 区间的包
+* 每次唤醒最多处理EWFD_EVENT_QUEUE_BUDGET个event，剩下的留在expired链表，马上再唤醒一次
 */
-static int tick = 0;
-void on_event_queue_tick(periodic_timer_t *timer, void *data) {
+void on_event_queue_tick(tor_timer_t *timer, void *data) {
+	(void) timer;
+	(void) data;
 	tor_assert(ewfd_framework_instance);
 
 	uint64_t cur_ti = monotime_absolute_msec();
@@ -406,26 +645,18 @@ void on_event_queue_tick(periodic_timer_t *timer, void *data) {
 	}
 #endif
 
-	EWFD_LOG("[delay-event] step:on_tick cur_ti:%lu", cur_ti);
+	EWFD_TRACE(EWFD_TRACE_EVENT_TICK, 0, cur_ti, 0);
 
 	/* 每次处理，(上次处理到的时间戳， cur_ti] 之间的包
+	* 时间轮推进到cur_ti，到期的event按时间顺序放在expired链表
 	*/
 	ewfd_event_queue_st *queue = (ewfd_event_queue_st *) ewfd_framework_instance->ewfd_event_queue;
 	{
-		ewfd_op_event_st *cur_event = NULL;
+		ewfd_wheel_node_st *node = NULL;
 		int expire_event = 0;
-		
-		// 如果长时间没发包，last_tick会有很大误差，因此需要修正到 [cur_ti - MAX_GAP (500ms), cur_ti) 之间
-		if ((cur_event = TOR_SIMPLEQ_FIRST(&queue->head)) != NULL) {
-			ewfd_framework_instance->last_event_ti = MIN(cur_event->insert_ti, cur_ti);
-			// 如果堆积的包太多直接忽略, insert_ti和cur_ti相差500ms以上，说明性能过差
-			if (ewfd_framework_instance->last_event_ti + MAX_EWFD_TICK_GAP_MS < cur_ti) {
-				EWFD_LOG("WARNING: too many dummy packets in queue, drop these packets");
-				ewfd_framework_instance->last_event_ti = cur_ti - MAX_EWFD_TICK_GAP_MS;
-			}
-		}
 
-		uint64_t range_start = ewfd_framework_instance->last_event_ti;
+		// 如果堆积的包太多直接忽略, insert_ti和cur_ti相差MAX_GAP以上，说明性能过差
+		uint64_t range_start = cur_ti > MAX_EWFD_TICK_GAP_MS ? cur_ti - MAX_EWFD_TICK_GAP_MS : 0;
 		uint64_t range_end = cur_ti;
 		uint64_t last_event_ti = 0;
 
@@ -433,63 +664,62 @@ void on_event_queue_tick(periodic_timer_t *timer, void *data) {
 			printf("on_event_queue_tick cur_ti:%lu range:'%lu -> %lu'\n",  cur_ti, range_start, range_end);
 		#endif // EWFD_UNITEST_TEST_PRIVATE
 
-		// remove outdated event
-		// 删除 (-0, cur_ti - MAX_GAP (500ms)] 之间的包
-		while ((cur_event = TOR_SIMPLEQ_FIRST(&queue->head)) != NULL && 
-			cur_event->insert_ti < range_start) {
-			EWFD_LOG("[EWFD-Event] remove outdated event id: %d %lu %lu", cur_event->event_id, cur_event->insert_ti, range_start);
-			
-			ewfd_event_queue_remove_first(queue, true);
-			expire_event++;
-		}
+		ewfd_wheel_update(&queue->wheel, range_end);
+
+		ewfd_framework_instance->packet_ticker_armed_ti = UINT64_MAX;
+		ewfd_event_queue_stats.wakeups++;
 
 		// 处理（last_pkt_ti, cur_ti] 区间内的包
 		int event_num = 0; // dummy pkt num
-		while ((cur_event = TOR_SIMPLEQ_FIRST(&queue->head)) != NULL) {
-			if (cur_event->insert_ti > range_end) {
-				break;
+		int budget = EWFD_EVENT_QUEUE_BUDGET;
+		while (budget > 0 && (node = ewfd_wheel_get_expired(&queue->wheel)) != NULL) {
+			ewfd_op_event_st *cur_event = SUBTYPE_P(node, ewfd_op_event_st, wheel_node);
+
+			// remove outdated event
+			// 删除 (-0, cur_ti - MAX_GAP (500ms)] 之间的包
+			if (cur_event->insert_ti < range_start) {
+				EWFD_TRACE(EWFD_TRACE_EVENT_OUTDATED, ewfd_get_circuit_id((circuit_t *) cur_event->on_circ),
+					cur_event->event_id, cur_event->insert_ti);
+				ewfd_event_queue_stats.dropped++;
+				ewfd_event_queue_stats.type_dropped[ewfd_event_type(cur_event)]++;
+				ewfd_event_queue_remove(queue, cur_event);
+				expire_event++;
+				continue;
 			}
+
 			// 没处理完的保存在队列
+			budget--;
 			bool is_processed = handle_one_event(cur_event);
 			
-			EWFD_LOG("[delay-event] step:process_one_event circ:%d ev-id:%d range:'%lu->%lu' insert-ti:%lu remain:%d all:%d tick:%d is_processed:%d", 
-				ewfd_get_circuit_id((circuit_t *) cur_event->on_circ), cur_event->event_id,
-				range_start, range_end,
-				cur_event->insert_ti, ewfd_get_event_num(cur_event->on_circ), 
-				ewfd_framework_instance->ewfd_event_queue->queue_len, tick++, is_processed);
-			
-			// printf("is_processed: %d tick: %lu want: %lu on_circ: %p event_id: %d\n", is_processed, cur_ti, cur_event->insert_ti, cur_event->on_circ, cur_event->event_id);
+			EWFD_TRACE(EWFD_TRACE_EVENT_PROCESS, ewfd_get_circuit_id((circuit_t *) cur_event->on_circ),
+				(uint32_t) cur_event->event_id | ((uint64_t) is_processed << 32), cur_event->insert_ti);
 
 			if (is_processed) {
+				if (cur_ti > cur_event->insert_ti + EWFD_EVENT_LATE_MS) {
+					ewfd_event_queue_stats.late++;
+				}
+				ewfd_event_queue_stats.processed++;
+				ewfd_event_queue_stats.type_expired[ewfd_event_type(cur_event)]++;
 				last_event_ti = cur_event->insert_ti;
 				event_num++;
-				ewfd_event_queue_remove_first(queue, true);
+				ewfd_event_queue_remove(queue, cur_event);
 			} 
 			else {
-				// 延期事件，加到尾部
-				// 是否需要按照时间排序？
+				// 延期事件，修改ti之后重新放回时间轮
 				cur_event->insert_ti += EWFD_EVENT_QUEUE_TICK_MS * 3;
-				ewfd_event_queue_remove_first(queue, false);
-				EWFD_TEMP_LOG("[delay-event] step:readd_event circ:%d id:%d insert-ti:%lu cur_ti:%lu", 
-					ewfd_get_circuit_id((circuit_t *) cur_event->on_circ), cur_event->event_id, cur_event->insert_ti, cur_ti);
-				
-				// printf("delay event: %lu id:%d\n", cur_event->insert_ti, cur_event->event_id);
-				// modify ti and reinsert
-				ewfd_add_to_event_queue(cur_event);
+				EWFD_TRACE(EWFD_TRACE_EVENT_READD, ewfd_get_circuit_id((circuit_t *) cur_event->on_circ),
+					cur_event->event_id, cur_event->insert_ti);
+				ewfd_wheel_add(&queue->wheel, &cur_event->wheel_node, cur_event->insert_ti);
 			}
 		}
 
-		uint32_t remain = 0;
-		uint32_t expire = 0;
-		TOR_SIMPLEQ_FOREACH(cur_event, &queue->head, next) {
-			if (cur_event->insert_ti < range_end) {
-				expire++;
-			}
-			remain++;
+		if (budget == 0 && ewfd_wheel_next_expire(&queue->wheel) <= cur_ti) {
+			// 还有到期的event没有处理，留在expired链表，下一次唤醒继续
+			ewfd_event_queue_stats.budget_exhausted++;
 		}
-		if (remain > 0) {
-			EWFD_TEMP_LOG("[EWFD-Event] remain: %u expire: %u len: %u tick: %lu", 
-				remain, expire, queue->queue_len, range_start);
+
+		if (queue->queue_len > 0) {
+			EWFD_TEMP_LOG("[EWFD-Event] remain: %u tick: %lu", queue->queue_len, range_start);
 		}
 
 		// (last_ti, last_ti + EWFD_EVENT_QUEUE_TICK_MS] 区间内的包已经发送完毕
@@ -505,49 +735,54 @@ void on_event_queue_tick(periodic_timer_t *timer, void *data) {
 	* poll delay event queue
 	*/
 	ewfd_try_trigger_delay_events(cur_ti);
+
+	arm_framework_ticker(monotime_absolute_msec());
 }
 
-static int ewfd_add_to_event_queue(ewfd_op_event_st *event) {
-	if (ewfd_framework_instance->ewfd_event_queue == NULL) {
+static int ewfd_add_to_event_queue(ewfd_framework_st *framework, ewfd_op_event_st *event) {
+	// worker: 只记录, reply时在主线程入队
+	if (framework->pending_ops != NULL) {
+		smartlist_add(framework->pending_ops, event);
+		return 0;
+	}
+	if (framework->ewfd_event_queue == NULL) {
 		return -1;
 	}
 	// 初始化 event ti，防止第一个event因超时被丢
-	if (ewfd_framework_instance->last_event_ti == 0) {
-		ewfd_framework_instance->last_event_ti = event->insert_ti;
+	if (framework->last_event_ti == 0) {
+		framework->last_event_ti = event->insert_ti;
 	}
 
-	ewfd_event_queue_st *queue = (ewfd_event_queue_st *) ewfd_framework_instance->ewfd_event_queue;
+	ewfd_event_queue_st *queue = (ewfd_event_queue_st *) framework->ewfd_event_queue;
+	uint64_t now_ti = monotime_absolute_msec();
 	{
-		ewfd_op_event_st *insert_here = NULL;
-		ewfd_op_event_st *cur_event = NULL;
-		TOR_SIMPLEQ_FOREACH(cur_event, &queue->head, next) {
-			if (cur_event->insert_ti >= event->insert_ti) {
-				break;
-			}
-			insert_here = cur_event;
+		// 空闲后的第一个event，先把时间轮推进到当前时间，next_expire才准确
+		if (queue->wheel.node_num == 0) {
+			ewfd_wheel_update(&queue->wheel, now_ti);
 		}
 
-		if (insert_here == NULL) {
-			TOR_SIMPLEQ_INSERT_HEAD(&queue->head, event, next);
-		} else {
-			TOR_SIMPLEQ_INSERT_AFTER(&queue->head, insert_here, event, next);
+		ewfd_circ_events_st *circ_events = ewfd_get_circ_events(queue, event->on_circ);
+		if (circ_events == NULL) {
+			circ_events = ewfd_pool_alloc(&ewfd_circ_events_pool);
+			circ_events->on_circ = event->on_circ;
+			TOR_LIST_INIT(&circ_events->events);
+			HT_INSERT(ewfd_circ_event_map, &queue->circ_map, circ_events);
 		}
+		TOR_LIST_INSERT_HEAD(&circ_events->events, event, circ_node);
+		circ_events->event_num++;
+		circ_events->type_num[ewfd_event_type(event)]++;
+		ewfd_event_queue_stats.type_queued[ewfd_event_type(event)]++;
+
+		ewfd_wheel_add(&queue->wheel, &event->wheel_node, event->insert_ti);
 		queue->queue_len++;
 	}
+	arm_framework_ticker(now_ti);
 
 #ifdef EWFD_UNITEST_TEST_PRIVATE
 	printf("ewfd_add_to_event_queue circ-p:%p circ:%u ev-id:%d insert-ti:%lu remain:%d\n", 
 		event->on_circ,
 		ewfd_get_circuit_id((circuit_t *) event->on_circ), event->event_id,
 		event->insert_ti, queue->queue_len);
-
-	// for each dump insert_ti
-	printf("\t-> queue: ");
-	ewfd_op_event_st *debug_event = NULL;
-	TOR_SIMPLEQ_FOREACH(debug_event, &queue->head, next) {
-		printf(" %d:%lu ", debug_event->event_id, debug_event->insert_ti);
-	}
-	printf("\n");
 #else
 	// EWFD_TEMP_LOG("[delay-event] step:add_to_queue circ:%d ev-id:%d insert-ti:%lu remain:%d", 
 	// 	ewfd_get_circuit_id((circuit_t *) event->on_circ), event->event_id,
@@ -624,74 +859,22 @@ static const char* event_op_to_str(ewfd_op_event_st *event) {
 	return "";
 }
 
+/* 只唤醒到期的delay circ，按circ数量而不是所有delay circ计算
+*/
 static void ewfd_try_trigger_delay_events(uint64_t cur_ti) 
 {
-	ewfd_delay_queue_st *queue = (ewfd_delay_queue_st *) ewfd_framework_instance->ewfd_delay_queue;
-	ewfd_delay_entry_st *delay_entry = TOR_SIMPLEQ_FIRST(&queue->head);
-	ewfd_delay_entry_st *prev_entry = NULL;
-	
-	/*
-	* normal状态release 
-	*/
-	while (delay_entry != NULL) {
-		ewfd_delay_entry_st *next_entry = TOR_SIMPLEQ_NEXT(delay_entry, next);
-		bool should_release = ewfd_padding_trigger_inactive_circ((circuit_t *) delay_entry->on_circ, cur_ti);
-		
-		if (should_release) {
-			if (prev_entry == NULL) {
-				TOR_SIMPLEQ_REMOVE_HEAD(&queue->head, next);
-			} else {
-				TOR_SIMPLEQ_REMOVE_AFTER(&queue->head, prev_entry, next);
-			}
-			queue->queue_len--;
-			tor_free(delay_entry);
-		} else {
-			prev_entry = delay_entry;
-		}
-		delay_entry = next_entry;
-	}
+	ewfd_padding_wake_delay_circs(cur_ti);
 }
 
 static void ewfd_add_delay_trigger_event(uintptr_t on_circ, uint32_t gap_ms)
 {
-	ewfd_delay_queue_st *queue = (ewfd_delay_queue_st *) ewfd_framework_instance->ewfd_delay_queue;
-	bool not_exist = true;
-	ewfd_delay_entry_st *delay_entry = TOR_SIMPLEQ_FIRST(&queue->head);
-	while (delay_entry != NULL) {
-		if (delay_entry->on_circ == on_circ) {
-			not_exist = false;
-			break;
-		}
-		delay_entry = TOR_SIMPLEQ_NEXT(delay_entry, next);
-	}
-
-	if (not_exist) {
-		delay_entry = (ewfd_delay_entry_st *) tor_malloc_zero(sizeof(ewfd_delay_entry_st));
-		delay_entry->on_circ = on_circ;
-		TOR_SIMPLEQ_INSERT_HEAD(&queue->head, delay_entry, next);
-		queue->queue_len++;
-	}
-	delay_entry->event_num++;
+	(void) gap_ms;
+	ewfd_padding_add_delay_wakeup((circuit_t *) on_circ);
+	arm_framework_ticker(monotime_absolute_msec());
 }
 
 static void ewfd_remove_delay_trigger_event(uintptr_t on_circ)
 {
 	EWFD_TEMP_LOG("[delay-event] step:remove_delay_trigger_event circ:%d", ewfd_get_circuit_id((circuit_t *) on_circ));
-	ewfd_delay_queue_st *queue = (ewfd_delay_queue_st *) ewfd_framework_instance->ewfd_delay_queue;
-	ewfd_delay_entry_st *delay_entry = TOR_SIMPLEQ_FIRST(&queue->head);
-	ewfd_delay_entry_st *prev_entry = NULL;
-	while (delay_entry != NULL) {
-		if (delay_entry->on_circ == on_circ) {
-			if (prev_entry == NULL) {
-				TOR_SIMPLEQ_REMOVE_HEAD(&queue->head, next);
-			} else {
-				TOR_SIMPLEQ_REMOVE_AFTER(&queue->head, prev_entry, next);
-			}
-			queue->queue_len--;
-			tor_free(delay_entry);
-			break;
-		}
-		prev_entry = delay_entry;
-		delay_entry = TOR_SIMPLEQ_NEXT(delay_entry, next);
-	}
+	ewfd_padding_remove_delay_wakeup((circuit_t *) on_circ);
 }
@@ -9,34 +9,81 @@ Padding 框架，全局timer，padding ebpf conf 生命周期管理
 #include "lib/smartlist_core/smartlist_core.h"
 
 #include "lib/evloop/compat_libevent.h"
+#include "lib/evloop/timers.h"
 #include "core/or/or.h"
+#include "feature/ewfd/ebpf_api.h"
 #include <stdint.h>
 
 // struct ewfd_conf_cache
 
 struct ewfd_event_queue_t;
-struct ewfd_delay_queue_t;
 
-// 固定tick调用，dummy queue和padding unit
+// 派发unit job时circ上各类event的数量，worker上的ewfd_get_event_num从这里读
+typedef struct ewfd_circ_event_count_t {
+	uintptr_t on_circ;
+	uint32_t type_num[EWFD_EVENT_TYPE_NUM];
+} ewfd_circ_event_count_st;
+
+/* 每个线程一个framework实例，eBPF api通过ewfd_framework_current()访问:
+* - 主线程: ewfd_framework_instance，持有event queue和timer，只有它能把event入队
+* - cpuworker: 执行unit时在栈上创建，ewfd_event_queue为NULL，
+*   unit产生的op记录在pending_ops，由job的reply在主线程提交
+* 事件队列的timer是one-shot的，按最早到期的event设置，没有event时不唤醒
+*/
 typedef struct ewfd_framework_t {
 	struct ewfd_event_queue_t *ewfd_event_queue;
-	struct ewfd_delay_queue_t *ewfd_delay_queue;
 
 	// smartlist_t *
 	periodic_timer_t *padding_ticker; // 当前不使用
-	periodic_timer_t *packet_ticker;  // 固定tick处理
+	tor_timer_t *packet_ticker;  // 事件队列timer
+	uint64_t packet_ticker_armed_ti; // packet_ticker到期的时间，UINT64_MAX表示没有设置
 	uint64_t last_event_ti; // 上一次发送event的时间
 	uint32_t all_dummy_pkt; // 总共发送的dummy packet数量
+	uint32_t event_alloc; // 本实例分配的event数量，event_id
+
+	// worker实例
+	smartlist_t *pending_ops;
+	const ewfd_circ_event_count_st *event_count; // 当前执行的circ的event快照
 
-	// hash map，记录每个cicr的event堆积数量
-	// 见 ewfd_get_remain_events 
+	// 每个cicr的event堆积数量记录在event queue的circ_map中
+	// 见 ewfd_get_event_num
 
 } ewfd_framework_st;
 
+/* 事件队列的处理统计
+* late: 处理时已经超过EWFD_EVENT_LATE_MS的event
+* dropped: 超过MAX_EWFD_TICK_GAP_MS没有处理，直接丢弃的event
+* budget_exhausted: 一次唤醒处理的event数达到EWFD_EVENT_QUEUE_BUDGET的次数
+* type_*: 按EWFD_EVENT_TYPE_*分类，type_dropped包括过期丢弃和circ关闭时删除的event
+*/
+typedef struct ewfd_event_queue_stats_t {
+	uint64_t wakeups;
+	uint64_t processed;
+	uint64_t late;
+	uint64_t dropped;
+	uint64_t budget_exhausted;
+	uint64_t type_queued[EWFD_EVENT_TYPE_NUM];
+	uint64_t type_expired[EWFD_EVENT_TYPE_NUM];
+	uint64_t type_dropped[EWFD_EVENT_TYPE_NUM];
+} ewfd_event_queue_stats_st;
+
+extern ewfd_event_queue_stats_st ewfd_event_queue_stats;
+
 // read from local confs
 extern smartlist_t *client_unit_confs;
 extern ewfd_framework_st *ewfd_framework;
 
+// 当前线程的framework，worker线程没有enter时返回主线程的实例
+ewfd_framework_st *ewfd_framework_current(void);
+// cpuworker执行unit前后调用，framework由调用者持有
+void ewfd_framework_enter_worker(ewfd_framework_st *framework);
+void ewfd_framework_leave_worker(void);
+// 主线程: worker记录的op按顺序加入event queue，ops被清空
+void ewfd_framework_commit_ops(smartlist_t *ops);
+void ewfd_framework_clear_ops(smartlist_t *ops);
+// 主线程: circ当前的event数量，派发job时作为快照
+void ewfd_get_circ_event_count(uintptr_t on_circ, ewfd_circ_event_count_st *count);
+
 // init ewfd padding framework
 void ewfd_framework_init(void);
 void ewfd_framework_free(void);
@@ -44,6 +91,13 @@ void ewfd_framework_free(void);
 void start_ewfd_padding_framework(void);
 void ewfd_remove_circ_events(uintptr_t on_circ);
 
+// 对象池的使用情况打印到ewfd log
+void ewfd_dump_pool_usage(void);
+// 对象池已分配的字节数 (使用中+缓存)，计入MaxMemInQueues
+size_t ewfd_framework_get_total_allocation(void);
+// 内存不足时释放对象池缓存的对象，返回释放的字节数
+size_t ewfd_framework_handle_oom(void);
+
 
 #ifdef EWFD_UNITEST_TEST_PRIVATE
 // struct ewfd_event_queue_t;
@@ -51,7 +105,8 @@ void ewfd_remove_circ_events(uintptr_t on_circ);
 // ewfd_event_queue_t *ewfd_event_queue_new(void);
 // void ewfd_event_queue_free(ewfd_event_queue_t *event_queue);	
 
-extern void on_event_queue_tick(periodic_timer_t *timer, void *data);
+extern ewfd_framework_st *ewfd_framework_instance;
+extern void on_event_queue_tick(tor_timer_t *timer, void *data);
 
 #endif // EWFD_UNITEST_TEST_PRIVATE
 
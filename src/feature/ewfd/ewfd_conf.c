@@ -3,14 +3,27 @@
 #include "feature/ewfd/ewfd.h"
 #include "feature/ewfd/circuit_padding.h"
 #include "feature/ewfd/ewfd_unit.h"
+#include "feature/ewfd/ewfd_rt.h"
 #include "feature/ewfd/utils.h"
 
+#include "core/mainloop/cpuworker.h"
 #include "lib/ebpf/ewfd-defense/src/front_code.h"
+#include "lib/ebpf/ewfd-defense/src/ewfd_maps.h"
+#include "lib/ebpf/libebpf.h"
+#include "lib/encoding/confline.h"
+#include "lib/encoding/kvline.h"
+#include "lib/evloop/workqueue.h"
+#include "lib/fs/files.h"
+#include "lib/fs/mmap.h"
+#include "lib/log/log.h"
+#include "lib/time/compat_time.h"
 #include "lib/smartlist_core/smartlist_core.h"
 #include "lib/smartlist_core/smartlist_foreach.h"
 
+#include <inttypes.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/stat.h>
 
 /*
 1. init code
@@ -57,11 +70,86 @@ void init_ewfd_code_cache(void) {
 
 void free_ewfd_code_cache(void) {
 	if (ewfd_code_cache != NULL) {
-		SMARTLIST_FOREACH(ewfd_code_cache, ewfd_code_st*, code, tor_free(code));
+		SMARTLIST_FOREACH_BEGIN(ewfd_code_cache, ewfd_code_st*, code) {
+			free_ewfd_code_vm(code);
+			tor_free(code);
+		} SMARTLIST_FOREACH_END(code);
 		smartlist_free(ewfd_code_cache);
 	}
 }
 
+/* data stream文件只map一次，unit只保存自己的读取位置
+* cpuworker上的job可能正在读取旧的数据，这时新的mapping先挂起，job完成后再替换
+*/
+static tor_mmap_t *data_stream_map = NULL;
+static tor_mmap_t *pending_data_stream_map = NULL;
+static bool data_stream_swap_pending = false;
+
+static void ewfd_data_stream_swap(tor_mmap_t *map) {
+	// 先切换到新的数据再释放旧的mapping
+	if (map != NULL) {
+		ewfd_data_stream_set_shared((const uint32_t *) map->data, (uint32_t) (map->size / sizeof(uint32_t)));
+	} else {
+		ewfd_data_stream_set_shared(NULL, 0);
+	}
+	if (data_stream_map != NULL) {
+		tor_munmap_file(data_stream_map);
+	}
+	data_stream_map = map;
+}
+
+int ewfd_map_data_stream_file(const char *fname) {
+	tor_mmap_t *map = NULL;
+
+	if (fname != NULL) {
+		map = tor_mmap_file(fname);
+		if (map == NULL) {
+			log_warn(LD_CONFIG, "Unable to map EWFD data stream %s", fname);
+			return -1;
+		}
+		if (map->size == 0 || map->size % sizeof(uint32_t) != 0 || map->size / sizeof(uint32_t) > UINT32_MAX) {
+			log_warn(LD_CONFIG, "EWFD data stream %s has invalid size %zu", fname, map->size);
+			tor_munmap_file(map);
+			return -1;
+		}
+	}
+
+	if (ewfd_rt_job_in_flight()) {
+		if (pending_data_stream_map != NULL) {
+			tor_munmap_file(pending_data_stream_map);
+		}
+		pending_data_stream_map = map;
+		data_stream_swap_pending = true;
+		return 0;
+	}
+	ewfd_data_stream_swap(map);
+	return 0;
+}
+
+void ewfd_data_stream_swap_pending(void) {
+	if (!data_stream_swap_pending || ewfd_rt_job_in_flight()) {
+		return;
+	}
+	ewfd_data_stream_swap(pending_data_stream_map);
+	pending_data_stream_map = NULL;
+	data_stream_swap_pending = false;
+}
+
+void ewfd_unmap_data_stream_file(void) {
+	if (pending_data_stream_map != NULL) {
+		tor_munmap_file(pending_data_stream_map);
+		pending_data_stream_map = NULL;
+	}
+	data_stream_swap_pending = false;
+	if (ewfd_rt_job_in_flight()) {
+		// worker可能还在读取，保留mapping直到进程退出
+		ewfd_data_stream_set_shared(NULL, 0);
+		data_stream_map = NULL;
+		return;
+	}
+	ewfd_data_stream_swap(NULL);
+}
+
 static ewfd_code_st* ewfd_code_cache_get(const char *name) {
 	SMARTLIST_FOREACH_BEGIN(ewfd_code_cache, ewfd_code_st*, code) {
 		if (strcmp(code->name, name) == 0) {
@@ -106,4 +194,402 @@ ewfd_padding_conf_st* demo_get_front_padding_unit_conf(void) {
 	padding_unit->main_code = front_run;
 
 	return padding_unit;
-}
\ No newline at end of file
+}
+ewfd_client_conf_st *ewfd_new_demo_client_conf(void) {
+	ewfd_client_conf_st *conf = tor_malloc_zero(sizeof(ewfd_client_conf_st));
+	conf->client_unit_confs = smartlist_new();
+
+	/* schedule unit和padding unit的uuid不能重复
+	*/
+	ewfd_padding_conf_st *padding_unit = demo_get_front_padding_unit_conf();
+	ewfd_padding_conf_st *schedule_unit = demo_get_front_schedule_unit_conf();
+
+	tor_assert(padding_unit);
+	tor_assert(schedule_unit);
+
+	padding_unit->refcnt = 1;
+	schedule_unit->refcnt = 1;
+	smartlist_add(conf->client_unit_confs, padding_unit);
+	smartlist_add(conf->client_unit_confs, schedule_unit);
+
+	conf->active_schedule_slot = 0;
+	conf->active_padding_slot = 0;
+
+	conf->need_reload = true;
+	return conf;
+}
+
+void ewfd_padding_conf_incref(ewfd_padding_conf_st *conf) {
+	conf->refcnt++;
+}
+
+void ewfd_padding_conf_decref(ewfd_padding_conf_st *conf) {
+	if (conf == NULL) {
+		return;
+	}
+	tor_assert(conf->refcnt > 0);
+	if (--conf->refcnt > 0) {
+		return;
+	}
+	if (conf->owns_code) {
+		if (conf->init_code != NULL) {
+			free_ewfd_code_vm(conf->init_code);
+			tor_free(conf->init_code);
+		}
+		if (conf->main_code != NULL) {
+			free_ewfd_code_vm(conf->main_code);
+			tor_free(conf->main_code);
+		}
+	}
+	tor_free(conf);
+}
+
+void ewfd_client_conf_free(ewfd_client_conf_st *conf) {
+	if (conf == NULL) {
+		return;
+	}
+	if (conf->client_unit_confs != NULL) {
+		SMARTLIST_FOREACH(conf->client_unit_confs, ewfd_padding_conf_st *, c,
+			ewfd_padding_conf_decref(c));
+		smartlist_free(conf->client_unit_confs);
+	}
+	tor_free(conf);
+}
+
+/* torrc中EWFDUnit的加载
+1. 主线程解析EWFDUnit，生成ewfd_unit_spec_st
+2. cpuworker读取文件，load/verify/jit
+3. 主线程替换ewfd_client_conf，旧的conf由已有的unit持有到circ释放
+*/
+#define EWFD_ELF_MAGIC "\x7f" "ELF"
+#define EWFD_ELF_MAGIC_LEN 4
+
+typedef struct ewfd_code_src_t {
+	char *fname;
+	char *section; // ELF中的section，NULL表示第一个text section
+} ewfd_code_src_st;
+
+typedef struct ewfd_unit_spec_t {
+	ewfd_padding_conf_st *conf; // code由worker填充
+	ewfd_code_src_st main_src;
+	ewfd_code_src_st init_src;
+} ewfd_unit_spec_st;
+
+typedef struct ewfd_conf_job_t {
+	uint32_t conf_version;
+	smartlist_t *specs;
+	char *err_msg; // worker失败时设置，conf保持不变
+	int compile_num;
+	uint64_t compile_usec;
+} ewfd_conf_job_st;
+
+// 最近一次提交的版本，reload期间再次reload时丢弃旧的结果
+static uint32_t ewfd_conf_version = 0;
+
+static void ewfd_unit_spec_free(ewfd_unit_spec_st *spec) {
+	if (spec == NULL) {
+		return;
+	}
+	if (spec->conf != NULL) {
+		spec->conf->refcnt = 1;
+		ewfd_padding_conf_decref(spec->conf);
+	}
+	tor_free(spec->main_src.fname);
+	tor_free(spec->main_src.section);
+	tor_free(spec->init_src.fname);
+	tor_free(spec->init_src.section);
+	tor_free(spec);
+}
+
+static void ewfd_conf_job_free(ewfd_conf_job_st *job) {
+	if (job->specs != NULL) {
+		SMARTLIST_FOREACH(job->specs, ewfd_unit_spec_st *, spec, ewfd_unit_spec_free(spec));
+		smartlist_free(job->specs);
+	}
+	tor_free(job->err_msg);
+	tor_free(job);
+}
+
+// <file>[:<section>]
+static void ewfd_code_src_parse(ewfd_code_src_st *src, const char *value) {
+	const char *sep = strchr(value, ':');
+	tor_free(src->fname);
+	tor_free(src->section);
+	if (sep != NULL) {
+		src->fname = tor_strndup(value, sep - value);
+		src->section = tor_strdup(sep + 1);
+	} else {
+		src->fname = tor_strdup(value);
+	}
+}
+
+static ewfd_unit_spec_st *ewfd_parse_unit_line(const char *line, char **msg) {
+	config_line_t *kvs = kvline_parse(line, 0);
+	bool has_uuid = false, has_type = false, has_interval = false;
+	int ok = 1;
+
+	if (kvs == NULL) {
+		tor_asprintf(msg, "EWFDUnit \"%s\" is not a list of key=value pairs", line);
+		return NULL;
+	}
+
+	ewfd_unit_spec_st *spec = tor_malloc_zero(sizeof(ewfd_unit_spec_st));
+	spec->conf = tor_malloc_zero(sizeof(ewfd_padding_conf_st));
+	spec->conf->target_hopnum = 2;
+	spec->conf->initial_hop = EWFD_NODE_ROLE_CLIENT;
+	spec->conf->owns_code = true;
+
+	for (const config_line_t *kv = kvs; kv != NULL && ok; kv = kv->next) {
+		if (!strcmp(kv->key, "uuid")) {
+			spec->conf->unit_uuid = (uint8_t) tor_parse_long(kv->value, 10, 1, EWFD_MAX_UNIT_UUID - 1, &ok, NULL);
+			has_uuid = true;
+		} else if (!strcmp(kv->key, "type")) {
+			if (!strcmp(kv->value, "padding")) {
+				spec->conf->unit_type = EWFD_UNIT_PADDING;
+			} else if (!strcmp(kv->value, "schedule")) {
+				spec->conf->unit_type = EWFD_UNIT_SCHEDULE;
+			} else {
+				ok = 0;
+			}
+			has_type = true;
+		} else if (!strcmp(kv->key, "main")) {
+			ewfd_code_src_parse(&spec->main_src, kv->value);
+		} else if (!strcmp(kv->key, "init")) {
+			ewfd_code_src_parse(&spec->init_src, kv->value);
+		} else if (!strcmp(kv->key, "interval")) {
+			spec->conf->tick_interval = (uint32_t) tor_parse_long(kv->value, 10, 1, 60000, &ok, NULL);
+			has_interval = true;
+		} else if (!strcmp(kv->key, "hop")) {
+			spec->conf->target_hopnum = (uint8_t) tor_parse_long(kv->value, 10, 1, 8, &ok, NULL);
+		} else if (!strcmp(kv->key, "role")) {
+			if (!strcmp(kv->value, "client")) {
+				spec->conf->initial_hop = EWFD_NODE_ROLE_CLIENT;
+			} else if (!strcmp(kv->value, "or")) {
+				spec->conf->initial_hop = EWFD_NODE_ROLE_OR;
+			} else if (!strcmp(kv->value, "exit")) {
+				spec->conf->initial_hop = EWFD_NODE_ROLE_EXIT;
+			} else {
+				ok = 0;
+			}
+		} else if (!strcmp(kv->key, "jit")) {
+			spec->conf->use_jit = tor_parse_long(kv->value, 10, 0, 1, &ok, NULL) == 1;
+		} else {
+			tor_asprintf(msg, "Unknown key \"%s\" in EWFDUnit \"%s\"", kv->key, line);
+			goto err;
+		}
+		if (!ok) {
+			tor_asprintf(msg, "Bad value \"%s\" for %s in EWFDUnit \"%s\"", kv->value, kv->key, line);
+			goto err;
+		}
+	}
+
+	if (!has_uuid || !has_type || spec->main_src.fname == NULL || !strlen(spec->main_src.fname)) {
+		tor_asprintf(msg, "EWFDUnit \"%s\" needs uuid, type and main", line);
+		goto err;
+	}
+	if (!has_interval) {
+		spec->conf->tick_interval = spec->conf->unit_type == EWFD_UNIT_PADDING ?
+			DEFAULT_EWFD_PADDING_GAP_MS : DEFAULT_EWFD_SCHEDULE_GAP_MS;
+	}
+	config_free_lines(kvs);
+	return spec;
+
+err:
+	config_free_lines(kvs);
+	ewfd_unit_spec_free(spec);
+	return NULL;
+}
+
+static smartlist_t *ewfd_parse_unit_lines(const config_line_t *lines, char **msg) {
+	smartlist_t *specs = smartlist_new();
+	bool seen[EWFD_MAX_UNIT_UUID] = {0};
+
+	for (const config_line_t *cl = lines; cl != NULL; cl = cl->next) {
+		ewfd_unit_spec_st *spec = ewfd_parse_unit_line(cl->value, msg);
+		if (spec == NULL) {
+			goto err;
+		}
+		smartlist_add(specs, spec);
+		// schedule unit和padding unit的uuid不能重复
+		if (seen[spec->conf->unit_uuid]) {
+			tor_asprintf(msg, "Duplicate EWFDUnit uuid %u", spec->conf->unit_uuid);
+			goto err;
+		}
+		seen[spec->conf->unit_uuid] = true;
+	}
+	return specs;
+
+err:
+	SMARTLIST_FOREACH(specs, ewfd_unit_spec_st *, spec, ewfd_unit_spec_free(spec));
+	smartlist_free(specs);
+	return NULL;
+}
+
+int ewfd_validate_unit_lines(const config_line_t *lines, char **msg) {
+	smartlist_t *specs = ewfd_parse_unit_lines(lines, msg);
+	if (specs == NULL) {
+		return -1;
+	}
+	SMARTLIST_FOREACH(specs, ewfd_unit_spec_st *, spec, ewfd_unit_spec_free(spec));
+	smartlist_free(specs);
+	return 0;
+}
+
+/* cpuworker线程: 读取文件，load/verify，需要时jit
+* 只访问job自己的数据
+*/
+static int ewfd_load_code_file(const ewfd_code_src_st *src, int code_type, size_t ctx_size, bool use_jit,
+	ewfd_code_st **code_out, char **msg) {
+	struct stat st;
+	char *err_msg = NULL;
+	char *data = read_file_to_str(src->fname, RFTS_BIN, &st);
+	if (data == NULL) {
+		tor_asprintf(msg, "unable to read %s", src->fname);
+		return -1;
+	}
+	size_t len = (size_t) st.st_size;
+	bool is_elf = len >= EWFD_ELF_MAGIC_LEN && fast_memeq(data, EWFD_ELF_MAGIC, EWFD_ELF_MAGIC_LEN);
+
+	ewfd_code_st *code = tor_malloc_zero(sizeof(ewfd_code_st));
+	code->code_type = code_type;
+	strlcpy(code->name, src->section ? src->section : src->fname, sizeof(code->name));
+	if (!is_elf) {
+		if (src->section != NULL) {
+			tor_asprintf(msg, "%s is not an ELF file, cannot load section %s", src->fname, src->section);
+			goto err;
+		}
+		if (len == 0 || len % 8 != 0 || len > sizeof(code->code)) {
+			tor_asprintf(msg, "%s is neither an ELF file nor eBPF bytecode", src->fname);
+			goto err;
+		}
+		memcpy(code->code, data, len);
+		code->code_len = (int) len;
+	}
+
+	int res = ewfd_code_load(code, is_elf ? data : NULL, len, src->section, ctx_size, &err_msg);
+	if (res != 0) {
+		tor_asprintf(msg, "%s %s%s%s: %s", res == EWFD_CODE_VERIFY_FAILED ? "verifier rejected" : "unable to load",
+			src->fname, src->section ? ":" : "", src->section ? src->section : "", err_msg ? err_msg : "");
+		goto err;
+	}
+	if (use_jit && ebpf_compile(code->vm, &err_msg) == NULL) {
+		tor_asprintf(msg, "unable to jit %s: %s", src->fname, err_msg ? err_msg : "");
+		free_ewfd_code_vm(code);
+		goto err;
+	}
+
+	tor_free(data);
+	*code_out = code;
+	return 0;
+
+err:
+	free(err_msg);
+	tor_free(code);
+	tor_free(data);
+	return -1;
+}
+
+static workqueue_reply_t ewfd_conf_job_threadfn(void *state_, void *arg) {
+	(void) state_;
+	ewfd_conf_job_st *job = arg;
+	monotime_t start, end;
+
+	monotime_get(&start);
+	SMARTLIST_FOREACH_BEGIN(job->specs, ewfd_unit_spec_st *, spec) {
+		ewfd_padding_conf_st *conf = spec->conf;
+		if (ewfd_load_code_file(&spec->main_src, EWFD_CODE_TYPE_MAIN, sizeof(ewfd_circ_status_st),
+			conf->use_jit, &conf->main_code, &job->err_msg) < 0) {
+			break;
+		}
+		job->compile_num += conf->use_jit;
+		if (spec->init_src.fname != NULL) {
+			if (ewfd_load_code_file(&spec->init_src, EWFD_CODE_TYPE_INIT, sizeof(uint64_t),
+				conf->use_jit, &conf->init_code, &job->err_msg) < 0) {
+				break;
+			}
+			job->compile_num += conf->use_jit;
+		}
+	} SMARTLIST_FOREACH_END(spec);
+	monotime_get(&end);
+	job->compile_usec = monotime_diff_usec(&start, &end);
+
+	return WQ_RPL_REPLY;
+}
+
+// 主线程: 所有unit都加载成功才替换conf
+static void ewfd_conf_job_replyfn(void *arg) {
+	ewfd_conf_job_st *job = arg;
+
+	if (job->err_msg != NULL) {
+		log_warn(LD_CONFIG, "Unable to load EWFD units (version %u): %s. Keeping the current units.",
+			job->conf_version, job->err_msg);
+		goto done;
+	}
+	if (job->conf_version != ewfd_conf_version || ewfd_client_conf == NULL) {
+		// 已经有更新的reload，或者framework已经释放
+		log_info(LD_CONFIG, "Discarding stale EWFD units (version %u)", job->conf_version);
+		goto done;
+	}
+
+	ewfd_code_cache_stats.compile_num += job->compile_num;
+	ewfd_code_cache_stats.compile_usec += job->compile_usec;
+
+	ewfd_client_conf_st *new_conf = tor_malloc_zero(sizeof(ewfd_client_conf_st));
+	new_conf->client_unit_confs = smartlist_new();
+	SMARTLIST_FOREACH_BEGIN(job->specs, ewfd_unit_spec_st *, spec) {
+		spec->conf->refcnt = 1;
+		smartlist_add(new_conf->client_unit_confs, spec->conf);
+		spec->conf = NULL;
+	} SMARTLIST_FOREACH_END(spec);
+	new_conf->active_schedule_slot = 0;
+	new_conf->active_padding_slot = 0;
+	new_conf->need_reload = true;
+	new_conf->conf_version = job->conf_version;
+
+	// ewfd_client_conf只在主线程读取，替换指针之后新建的circ就会使用新的unit
+	ewfd_client_conf_st *old_conf = ewfd_client_conf;
+	ewfd_client_conf = new_conf;
+	ewfd_client_conf_free(old_conf);
+
+	log_notice(LD_GENERAL, "Loaded %d EWFD units (version %u) in %"PRIu64" usec",
+		smartlist_len(new_conf->client_unit_confs), new_conf->conf_version, job->compile_usec);
+
+done:
+	ewfd_conf_job_free(job);
+}
+
+int ewfd_reload_unit_confs(const config_line_t *lines) {
+	char *msg = NULL;
+
+	if (ewfd_client_conf == NULL) {
+		// framework还没有初始化，ewfd_framework_init时再加载
+		return 0;
+	}
+
+	smartlist_t *specs = ewfd_parse_unit_lines(lines, &msg);
+	if (specs == NULL) {
+		log_warn(LD_CONFIG, "%s", msg);
+		tor_free(msg);
+		return -1;
+	}
+	if (smartlist_len(specs) == 0) {
+		// 删除了所有EWFDUnit，恢复内置的front
+		smartlist_free(specs);
+		ewfd_conf_version++;
+		ewfd_client_conf_st *old_conf = ewfd_client_conf;
+		ewfd_client_conf = ewfd_new_demo_client_conf();
+		ewfd_client_conf_free(old_conf);
+		return 0;
+	}
+
+	ewfd_conf_job_st *job = tor_malloc_zero(sizeof(ewfd_conf_job_st));
+	job->conf_version = ++ewfd_conf_version;
+	job->specs = specs;
+
+	if (cpuworker_queue_work(WQ_PRI_LOW, ewfd_conf_job_threadfn, ewfd_conf_job_replyfn, job) == NULL) {
+		log_warn(LD_CONFIG, "Unable to queue EWFD unit compilation");
+		ewfd_conf_job_free(job);
+		return -1;
+	}
+	return 0;
+}
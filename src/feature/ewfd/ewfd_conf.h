@@ -2,16 +2,23 @@
 #define EWFD_CONF_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "lib/smartlist_core/smartlist_core.h"
 
-#define EWFD_EVENT_QUEUE_TICK_MS 50 // 50ms，调用一次全局事件队列
+#define EWFD_EVENT_QUEUE_TICK_MS 50 // 50ms，有delay队列时轮询的间隔，延期event推迟3倍
 #define MAX_EWFD_TICK_GAP_MS 200 // queue最多调度200ms内的event，之前的event过期丢弃
+#define EWFD_EVENT_QUEUE_BUDGET 512 // 一次唤醒最多处理的event，剩下的在下一次唤醒处理
+#define EWFD_EVENT_LATE_MS 20 // 处理时比insert_ti晚20ms以上算作late
 #define MAX_EVENT_IN_QUEUE 2000 // 2000个event，超过丢弃
 
 // padding/schedule unit默认tick间隔
 #define DEFAULT_EWFD_PADDING_GAP_MS 200 // 50ms, 
 #define DEFAULT_EWFD_SCHEDULE_GAP_MS 500 // 500ms
 
+// tick driver的时间粒度，同一个slot内到期的unit在一次唤醒中执行
+#define EWFD_TICK_SLOT_MS 5
+#define EWFD_TICK_BATCH_MAX 64 // 同类unit一次最多批量执行64个
+
 // 基于inactive/active
 // #define EWFD_USE_SIMPLE_DELAY
 // 基于拥塞控制
@@ -30,15 +37,44 @@ typedef struct ewfd_client_conf_t {
 	int active_padding_slot;
 	smartlist_t *client_unit_confs;
 	bool need_reload;
+	uint32_t conf_version; // 每次热加载+1, 内置的demo conf是0
 } ewfd_client_conf_st;
 
 extern ewfd_client_conf_st *ewfd_client_conf;
 
+struct ewfd_padding_conf_t;
+struct config_line_t;
+
+// 内置的front padding/schedule unit
+ewfd_client_conf_st *ewfd_new_demo_client_conf(void);
+void ewfd_padding_conf_incref(struct ewfd_padding_conf_t *conf);
+void ewfd_padding_conf_decref(struct ewfd_padding_conf_t *conf);
+// 释放client conf对所有unit conf的引用
+void ewfd_client_conf_free(ewfd_client_conf_st *conf);
+
+/*
+torrc/控制端口加载EWFD程序，每行一个unit:
+EWFDUnit uuid=<1-255> type=padding|schedule main=<file>[:<section>]
+	[init=<file>[:<section>]] [interval=<ms>] [hop=<n>] [role=client|or|exit] [jit=0|1]
+file是clang -target bpf编译的ELF (按section加载) 或者raw bytecode
+读取文件、verify和jit在cpuworker线程中执行，完成后在主线程替换ewfd_client_conf,
+之后新建的circ使用新的unit，已有的circ继续使用旧的unit
+*/
+int ewfd_validate_unit_lines(const struct config_line_t *lines, char **msg);
+// 返回-1表示配置错误或者无法提交到cpuworker，当前的conf保持不变
+int ewfd_reload_unit_confs(const struct config_line_t *lines);
+
 // bool parse_client_conf(void);
 
 void init_ewfd_code_cache(void);
 void free_ewfd_code_cache(void);
 
+// 用mmap的文件替换所有unit共享的data stream, 文件内容是native uint32数组
+// fname为NULL时恢复内置的数据; unit job执行期间替换推迟到job完成
+int ewfd_map_data_stream_file(const char *fname);
+void ewfd_data_stream_swap_pending(void);
+void ewfd_unmap_data_stream_file(void);
+
 /*
 TODO: 
 load from conf file
@@ -1,6 +1,6 @@
 // local log enable/dsiable
 
-#define EWFD_USE_TEMP_LOG
+// #define EWFD_USE_TEMP_LOG
 #include "feature/ewfd/debug.h"
 
 #include "feature/ewfd/ewfd_op.h"
@@ -17,6 +17,7 @@
 #include "core/or/relay.h"
 #include "core/or/circuitlist.h"
 #include "core/or/cell_queue_st.h"
+#include "core/or/circuitmux.h"
 #include "core/or/circuitmux_ewfd.h"
 #include "core/or/channel.h"
 #include "feature/stats/rephist.h"
@@ -31,29 +32,12 @@
 #include "core/or/command.h"
 #include "core/or/scheduler.h"
 
-#define EWFD_DELAY_MAGIC 0xcccccccc
-#define EWFD_DELAY_TIMEOUT 500 // 超过500ms没处理的delay包直接丢弃
-
-enum EWFD_DELAY_EVENT {
-	EWFD_DELAY_EVENT_END = 0,
-	EWFD_DELAY_EVENT_WAIT = 1,
-};
-
-typedef struct ewfd_delay_event_t {
-	uint32_t magic;
-	uint64_t trigger_ms;
-	uintptr_t on_circ;
-	uint8_t pkt_num;
-	uint8_t event;
-	bool is_trigger;
-} __attribute__((packed)) ewfd_delay_event_st;
+#define EWFD_DELAY_TIMEOUT 500 // 超过500ms没处理的delay描述符直接丢弃
 
 extern packed_cell_t* packed_cell_new(void);
 
 static void my_pad_cell_payload(uint8_t *cell_payload, size_t data_len);
 static packed_cell_t* my_copy_packed_cell(cell_t *cell, uint8_t wide_circ_ids);
-static ewfd_delay_event_st* try_get_delay_packet(packed_cell_t *cell, uint8_t wide_circ_ids);
-static packed_cell_t* find_next_real_packet(cell_queue_t *queue, packed_cell_t *cur_cell, uint8_t wide_circ_ids);
 
 /*------------------*/
 // private funcs
@@ -88,17 +72,8 @@ static packed_cell_t* my_copy_packed_cell(cell_t *cell, uint8_t wide_circ_ids) {
 	return copy;
 }
 
-static ewfd_delay_event_st* try_get_delay_packet(packed_cell_t *cell, uint8_t wide_circ_ids) {
-	// cid (u32/u16), cmd (u8), body
-	uint8_t pos = wide_circ_ids ? 5 : 3;
-	ewfd_delay_event_st *delay_event = (ewfd_delay_event_st *) (cell->body + pos);
-	if (delay_event->magic == EWFD_DELAY_MAGIC) {
-		return delay_event;
-	}
-	return NULL;
-}
-
-packed_cell_t* ewfd_craft_dummy_packet(circuit_t *circ) {
+// hopnum: origin circ上dummy的目标hop, or circ不使用
+static packed_cell_t* craft_dummy_packet_to_hop(circuit_t *circ, int hopnum) {
 	cell_direction_t cell_direction = CIRCUIT_IS_ORIGIN(circ) ? CELL_DIRECTION_OUT : CELL_DIRECTION_IN;
 	cell_t cell = {0};
 	uint8_t wide_circ_ids = 0;
@@ -117,10 +92,6 @@ packed_cell_t* ewfd_craft_dummy_packet(circuit_t *circ) {
 	my_pad_cell_payload(cell.payload, 0);
 
 	if (cell_direction == CELL_DIRECTION_OUT) {
-		ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ(circ);
-		tor_assert(ewfd_rt);
-		int slot = ewfd_rt->padding_unit_ctx.active_slot;
-		int hopnum = ewfd_rt->padding_slots[slot]->conf->target_hopnum;
 		origin_circuit_t *origin_circ = TO_ORIGIN_CIRCUIT(circ);
 		wide_circ_ids = circ->n_chan->wide_circ_ids;
 		cell.circ_id = circ->n_circ_id;
@@ -148,227 +119,194 @@ packed_cell_t* ewfd_craft_dummy_packet(circuit_t *circ) {
 	return my_copy_packed_cell(&cell, wide_circ_ids);
 }
 
-static packed_cell_t* find_next_real_packet(cell_queue_t *queue, packed_cell_t *cur_cell, uint8_t wide_circ_ids) {
-	packed_cell_t *next_cell = cur_cell;
-
-	// 如果遇到了连续的delay cell，就跳过
-	// remove current cell from queue
-	while ((next_cell = TOR_SIMPLEQ_NEXT(next_cell, next)) != NULL) {
-		if (try_get_delay_packet(next_cell, wide_circ_ids) == NULL) {
-			// remove real cell
-			TOR_SIMPLEQ_REMOVE_AFTER(&queue->head, cur_cell, next);
-			--queue->n;
-			return next_cell;
+packed_cell_t* ewfd_craft_dummy_packet(circuit_t *circ) {
+	int hopnum = 0;
+	if (CIRCUIT_IS_ORIGIN(circ)) {
+		ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ(circ);
+		if (ewfd_rt == NULL || ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot] == NULL) {
+			return NULL;
 		}
-		cur_cell = next_cell;
+		int slot = ewfd_rt->padding_unit_ctx.active_slot;
+		hopnum = ewfd_rt->padding_slots[slot]->conf->target_hopnum;
 	}
-	
-	return NULL;
+	return craft_dummy_packet_to_hop(circ, hopnum);
+}
+
+static packed_cell_t* pop_real_cell(cell_queue_t *queue) {
+	packed_cell_t *cell = TOR_SIMPLEQ_FIRST(&queue->head);
+	if (cell == NULL) {
+		return NULL;
+	}
+	TOR_SIMPLEQ_REMOVE_HEAD(&queue->head, next);
+	--queue->n;
+	ewfd_cell_queue_note_pop(queue);
+	return cell;
+}
+
+ewfd_pool_st ewfd_delay_desc_pool = EWFD_POOL_INIT("delay_desc", sizeof(ewfd_delay_desc_st));
+ewfd_pool_st ewfd_delay_queue_pool = EWFD_POOL_INIT("delay_queue", sizeof(ewfd_delay_desc_queue_st));
+
+static void remove_head_delay(ewfd_delay_desc_queue_st *delay_queue) {
+	ewfd_delay_desc_st *desc = TOR_SIMPLEQ_FIRST(&delay_queue->head);
+	TOR_SIMPLEQ_REMOVE_HEAD(&delay_queue->head, next);
+	delay_queue->n--;
+	ewfd_pool_free(&ewfd_delay_desc_pool, desc);
 }
 
 /*------------------*/
 // public funcs
 /*------------------*/
 
-/* pop，每次调用只处理一个delay event
- n_cell 队列中减少的包的数量, 0, 1, 2 (real, delay)
-[delay] 包的效果是让后面p个包延时t发送。如果队列中没有足够的包，就发送dummy包
-[t=3, p=3] 1, 2, 3, [1] [3] 4, 5, 6, 7
-
-send_state: 是否需要先切换队列
-*/
-packed_cell_t * ewfd_cell_queue_pop_simple_delay(cell_queue_t *queue, uint8_t wide_circ_ids, uint8_t *n_cell) {
-	packed_cell_t *first_cell = TOR_SIMPLEQ_FIRST(&queue->head);
-	if (first_cell == NULL) {
-		return NULL;
+void ewfd_cell_queue_add_delay(cell_queue_t *queue, circuit_t *circ, uint64_t trigger_ms, uint32_t pkt_num) {
+	tor_assert(pkt_num > 0);
+	ewfd_delay_desc_queue_st *delay_queue = queue->ewfd_delay;
+	if (delay_queue == NULL) {
+		delay_queue = ewfd_pool_alloc(&ewfd_delay_queue_pool);
+		TOR_SIMPLEQ_INIT(&delay_queue->head);
+		queue->ewfd_delay = delay_queue;
 	}
-	*n_cell = 1;
+	delay_queue->on_circ = (uintptr_t) circ;
+
+	ewfd_delay_desc_st *desc = ewfd_pool_alloc(&ewfd_delay_desc_pool);
+	desc->trigger_ms = trigger_ms;
+	desc->pkt_num = pkt_num;
+	// 在当前队列中所有real cell之后生效
+	desc->cell_seq = delay_queue->popped_seq + queue->n;
+	TOR_SIMPLEQ_INSERT_TAIL(&delay_queue->head, desc, next);
+	delay_queue->n++;
+}
 
-	uint64_t cur_ti = monotime_absolute_msec();
-	uint32_t cid = 0;
-	uint8_t cmd = 0;
+void ewfd_cell_queue_free_delay(cell_queue_t *queue) {
+	ewfd_delay_desc_queue_st *delay_queue = queue->ewfd_delay;
+	if (delay_queue == NULL) {
+		return;
+	}
+	while (!TOR_SIMPLEQ_EMPTY(&delay_queue->head)) {
+		remove_head_delay(delay_queue);
+	}
+	ewfd_pool_free(&ewfd_delay_queue_pool, delay_queue);
+	queue->ewfd_delay = NULL;
+}
 
-	// pkt detail
-	#if 1
-	int pos = 0;
+int ewfd_cell_queue_get_delay_num(const cell_queue_t *queue) {
+	return queue->ewfd_delay ? queue->ewfd_delay->n : 0;
+}
 
-	if (wide_circ_ids) {
-		pos += 4;
-		cid = ntohl(get_uint32(first_cell->body));
-	} else {
-		pos += 2;
-		cid = ntohs(get_uint16(first_cell->body));
+void ewfd_cell_queue_note_pop(cell_queue_t *queue) {
+	if (queue->ewfd_delay) {
+		queue->ewfd_delay->popped_seq++;
 	}
-	cmd = get_uint8(first_cell->body + pos);
-	#endif
+}
 
-	EWFD_TEMP_LOG("[send queue poll] circ: %u cell in queue: %p cur_ti: %lu", cid, first_cell, cur_ti);
+int ewfd_cell_queue_num_sendable(const cell_queue_t *queue) {
+	const ewfd_delay_desc_queue_st *delay_queue = queue->ewfd_delay;
+	int delay_n = delay_queue ? delay_queue->n : 0;
 
-	/* packed_cell结构：
-	* [1] u32 or u16, circ_id
-	* [2] u8 command
-	* [3] payload (real packets are encrypted)
-	* 		-> [relay_header_t] + cell_payload
-	*/
-	ewfd_delay_event_st *delay_event = try_get_delay_packet(first_cell, wide_circ_ids);
-	
-	if (delay_event == NULL) { // normal cell, is not delay event
-		TOR_SIMPLEQ_REMOVE_HEAD(&queue->head, next);
-		--queue->n;
-		EWFD_LOG("handle normal cell: %u wid: %d cmd: %s q-len: %d", cid, wide_circ_ids, cell_command_to_string(cmd), queue->n);
-		return first_cell;
-	}
-	tor_assert(delay_event->pkt_num > 0);
-	
-	/* has delay cell
-	1. 检查delay时间, [delay-1], pkt-1, pkt-2, ..., [delay-n]
-		- 如果delay < cur_ti - timeout，丢弃delay包
-		- 如果delay < cur_ti，就等待
-		- 如果delay > cur_ti，就发送pkt_num个包
-	2. 发送包, 如果包的数量不够就插入dummy包
+	if (delay_n > 0) {
+		const ewfd_delay_desc_st *desc = TOR_SIMPLEQ_FIRST(&delay_queue->head);
+		// 后面的real cell和dummy都要等这个delay
+		if (desc->cell_seq <= delay_queue->popped_seq && desc->trigger_ms > monotime_absolute_msec()) {
+			return 0;
+		}
+	}
+	return queue->n + queue->ewfd_dummy_n + delay_n;
+}
+
+/* pop，每次调用只处理一个delay描述符
+n_cell 队列中减少的real cell数量, 0 (等待或者dummy), 1
+[delay] 的效果是让后面p个包延时t发送。如果队列中没有足够的包，就发送dummy包
+[t=3, p=3] 1, 2, 3, [1] [3] 4, 5, 6, 7
+描述符不在cell队列中，只需要比较队头描述符的cell_seq，O(1)
+*/
+packed_cell_t * ewfd_cell_queue_pop_simple_delay(cell_queue_t *queue, uint8_t wide_circ_ids, uint8_t *n_cell) {
+	(void) wide_circ_ids;
+	ewfd_delay_desc_queue_st *delay_queue = queue->ewfd_delay;
+	ewfd_delay_desc_st *desc = delay_queue ? TOR_SIMPLEQ_FIRST(&delay_queue->head) : NULL;
+	*n_cell = 0;
+
+	// 队头没有生效的delay，直接发送real cell
+	if (desc == NULL || desc->cell_seq > delay_queue->popped_seq) {
+		packed_cell_t *cell = pop_real_cell(queue);
+		if (cell) {
+			*n_cell = 1;
+		}
+		return cell;
+	}
+	tor_assert(desc->pkt_num > 0);
+
+	/* 队头有delay描述符
+	1. 检查delay时间
+		- 如果trigger < cur_ti - timeout，丢弃描述符，本次照常发送
+		- 如果trigger > cur_ti，就等待
+		- 否则发送一个包
+	2. 发送包, 如果真包不够就发送dummy包
 	*/
+	uint64_t cur_ti = monotime_absolute_msec();
 	bool discard_delay = false;
 
-	// Step-1: 检查delay时间
-	if (delay_event->trigger_ms + EWFD_DELAY_TIMEOUT < cur_ti) { // 超时移除当前delay cell
-		// 出现多个delay event堆积，就会每次移除一个delay，然后发一个real包或者一个dummy包
-		EWFD_LOG("delay cell timeout: %x cur_ti: %lu trigger: %lu n-pkt: %u q-len: %d", delay_event->magic, cur_ti, 
-		delay_event->trigger_ms, delay_event->pkt_num, queue->n);
+	if (desc->trigger_ms + EWFD_DELAY_TIMEOUT < cur_ti) {
+		// 出现多个delay堆积，就会每次移除一个delay，然后发一个real包或者一个dummy包
+		EWFD_LOG("delay desc timeout cur_ti: %lu trigger: %lu n-pkt: %u q-len: %d", cur_ti,
+			desc->trigger_ms, desc->pkt_num, queue->n);
 		discard_delay = true;
-	} else if (delay_event->trigger_ms > cur_ti) { // 需要等待，触发拥塞控制，将当前circuit inactive或者移到后面
-		EWFD_LOG("delay cell wait: %x cur_ti: %lu trigger: %lu n-pkt: %u q-len: %d", delay_event->magic, cur_ti, 
-		delay_event->trigger_ms, delay_event->pkt_num, queue->n);
+	} else if (desc->trigger_ms > cur_ti) { // 需要等待
+		EWFD_LOG("delay desc wait cur_ti: %lu trigger: %lu n-pkt: %u q-len: %d", cur_ti,
+			desc->trigger_ms, desc->pkt_num, queue->n);
 		return NULL;
 	}
 
-	// Step-2: 发送真包，如果真包不够就发送dummy包
-	// get next real cell or dummy cell
-	packed_cell_t *next_cell = find_next_real_packet(queue, first_cell, wide_circ_ids);
-	if (next_cell == NULL) { // send dummy packet
-		next_cell = ewfd_craft_dummy_packet((circuit_t *) delay_event->on_circ);
-		*n_cell = 0;
+	packed_cell_t *next_cell = pop_real_cell(queue);
+	if (next_cell) {
+		*n_cell = 1;
+	} else { // send dummy packet
+		next_cell = ewfd_craft_dummy_packet((circuit_t *) delay_queue->on_circ);
+		if (next_cell) {
+			next_cell->inserted_timestamp = monotime_coarse_get_stamp();
+			rep_hist_padding_count_write(PADDING_TYPE_DROP);
+		}
 	}
-	delay_event->pkt_num--;
+	desc->pkt_num--;
 
-	EWFD_TEMP_LOG("handle delay pkt: %x trigger: %lu n-pkt: %u", delay_event->magic, delay_event->trigger_ms, delay_event->pkt_num);
+	EWFD_TEMP_LOG("handle delay desc trigger: %lu n-pkt: %u", desc->trigger_ms, desc->pkt_num);
 
-	// remove delay cell
-	if (delay_event->pkt_num == 0 || discard_delay) {
-		TOR_SIMPLEQ_REMOVE_HEAD(&queue->head, next);
-		packed_cell_free(first_cell);
-		--queue->n;
-		*n_cell += 1;
-		EWFD_TEMP_LOG("delete delay pkt circ: %u q-len: %d", cid, queue->n);
+	if (desc->pkt_num == 0 || discard_delay) {
+		remove_head_delay(delay_queue);
+		EWFD_TEMP_LOG("delete delay desc q-len: %d remain: %d", queue->n, delay_queue->n);
 	}
 
-	tor_assert(next_cell);
-
 	return next_cell;
 }
 
-static void set_drop_cell(cell_t *cell) {
-	relay_header_t rh = {0};
-	rh.command = RELAY_COMMAND_DROP;
-	rh.stream_id = 0;
-	relay_header_pack(cell->payload, &rh);
-	// add random data to dummy cell
-	my_pad_cell_payload(cell->payload, 0);
-}
-
-static void set_encrypt_drop_cell(circuit_t *circ, cell_t *cell) {
-	set_drop_cell(cell);
-
-	cell_direction_t cell_direction = CIRCUIT_IS_ORIGIN(circ) ? CELL_DIRECTION_OUT : CELL_DIRECTION_IN;
-	// encrypt
-	if (cell_direction == CELL_DIRECTION_OUT) {
-		ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ(circ);
-		tor_assert(ewfd_rt);
-		int slot = ewfd_rt->padding_unit_ctx.active_slot;
-		int hopnum = ewfd_rt->padding_slots[slot]->conf->target_hopnum;
-		origin_circuit_t *origin_circ = TO_ORIGIN_CIRCUIT(circ);
-		cell->circ_id = circ->n_circ_id;
-		crypt_path_t* target_hop = circuit_get_cpath_hop(origin_circ, hopnum);
-		relay_encrypt_cell_outbound(cell, origin_circ, target_hop);
-	} else if (cell_direction == CELL_DIRECTION_IN) {
-		or_circuit_t *or_circ = TO_OR_CIRCUIT(circ);
-		cell->circ_id = or_circ->p_circ_id;
-		relay_encrypt_cell_inbound(cell, TO_OR_CIRCUIT(circ));
-	}
-}
-
 /**
 *
 */
 bool ewfd_paddding_op_delay_impl(circuit_t *circ, uint32_t trigger_ms, uint32_t pkt_num) {
-	ewfd_delay_event_st delay_event = {0};
-	delay_event.magic = EWFD_DELAY_MAGIC;
-	delay_event.trigger_ms = trigger_ms;
-	delay_event.pkt_num = pkt_num;
-	delay_event.on_circ = (uintptr_t) circ;
-	delay_event.is_trigger = false;
-
 	channel_t *chan; /* where to send the cell */
-	cell_direction_t cell_direction;
-	streamid_t on_stream = 0;
-
-	cell_t cell = {0};
-
 	cell_queue_t *queue;
-	circuitmux_t *cmux = NULL;
-	bool is_origin = false;
 
-	cell.command = CELL_RELAY;
 	if (CIRCUIT_IS_ORIGIN(circ)) {
-		// tor_assert(cpath_layer);
-		cell.circ_id = circ->n_circ_id;
-		cell_direction = CELL_DIRECTION_OUT;
 		chan = circ->n_chan;
 		queue = &circ->n_chan_cells;
-		is_origin = true;
 	} else {
-		// tor_assert(! cpath_layer);
-		cell.circ_id = TO_OR_CIRCUIT(circ)->p_circ_id;
-		cell_direction = CELL_DIRECTION_IN;
 		chan = TO_OR_CIRCUIT(circ)->p_chan;
 		queue = &TO_OR_CIRCUIT(circ)->p_chan_cells;
 	}
-	cmux = chan->cmux;
-	memcpy(cell.payload, &delay_event, sizeof(delay_event));
-
-	EWFD_TEMP_LOG("[EWFD-Delay] want to send delay packet: %lu n-pkt: %u wd: %d q-len: %d %s: %u", delay_event.trigger_ms, 
-		delay_event.pkt_num, chan->wide_circ_ids, queue->n, is_origin ? "orgin-circ" : "or-circ", ewfd_get_circuit_id(circ));
-	// circuitmux_show_info(cmux);
+	if (chan == NULL || pkt_num == 0) {
+		return false;
+	}
 
-// 调试阶段，调用系统函数发送drop包，确保delay添加的dummy包是正确的
-#if 0 // lev-1: 系统发送函数
-	set_drop_cell(&cell);
-	crypt_path_t* target_hop = NULL;
-	if (CIRCUIT_IS_ORIGIN(circ)) {
-		ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ(circ);
-		tor_assert(ewfd_rt);
-		int slot = ewfd_rt->padding_unit_ctx.active_slot;
-		int hopnum = ewfd_rt->padding_slots[slot]->conf->target_hopnum;
-		target_hop = circuit_get_cpath_hop(TO_ORIGIN_CIRCUIT(circ), hopnum);
+	// 描述符挂在队列旁边，不占用cell，也不会被加密发送出去
+	ewfd_cell_queue_add_delay(queue, circ, trigger_ms, pkt_num);
+	// 没有real cell时描述符也要让circ在cmux上被调度
+	if (chan->cmux != NULL && circuitmux_is_circuit_attached(chan->cmux, circ)) {
+		update_circuit_on_cmux(circ, CIRCUIT_IS_ORIGIN(circ) ? CELL_DIRECTION_OUT : CELL_DIRECTION_IN);
 	}
-	
-	// relay_send_command_from_edge(0, circ, RELAY_COMMAND_DROP, NULL, 0, target_hop);
-	circuit_package_relay_cell(&cell, circ, cell_direction, target_hop, on_stream, "efwd_op.c", __LINE__);
-	return true;
-#endif 
-#if 0 // lev-2: 自己组装包，调用系统的发送
-	set_encrypt_drop_cell(circ, &cell);
-	append_cell_to_circuit_queue(circ, chan, &cell, cell_direction, on_stream);
-#endif 
-#if 0 // lev-3: 自己组装包，直接发送 （漏洞原因，没有调用自带的packed_cell alloc）
-	packed_cell_t *drop = ewfd_craft_dummy_packet(circ);
-	cell_queue_append(queue, drop);
-	update_circuit_on_cmux(circ, cell_direction);
-	scheduler_channel_has_waiting_cells(chan);
-	return true;
-#endif
 
-	// 为了避免delay_event内容被加密，所以直接加到队列
-	append_cell_to_circuit_queue(circ, chan, &cell, cell_direction, on_stream);
+	EWFD_TEMP_LOG("[EWFD-Delay] add delay desc: %u n-pkt: %u q-len: %d delay-n: %d %s: %u", trigger_ms,
+		pkt_num, queue->n, ewfd_cell_queue_get_delay_num(queue),
+		CIRCUIT_IS_ORIGIN(circ) ? "orgin-circ" : "or-circ", ewfd_get_circuit_id(circ));
+
+	scheduler_channel_has_waiting_cells(chan);
 	return true;
 }
 
@@ -381,35 +319,172 @@ bool ewfd_paddding_op_delay_notify_impl(circuit_t *circ) {
 	} else {
 		chan = TO_OR_CIRCUIT(circ)->p_chan;
 	}
+	if (chan == NULL) {
+		return false;
+	}
 
+	// 等待delay时circ的计数为0，到时间后恢复
+	if (chan->cmux != NULL && circuitmux_is_circuit_attached(chan->cmux, circ)) {
+		update_circuit_on_cmux(circ, CIRCUIT_IS_ORIGIN(circ) ? CELL_DIRECTION_OUT : CELL_DIRECTION_IN);
+	}
 	scheduler_channel_has_waiting_cells(chan);
 
 	EWFD_TEMP_LOG("active delay circ: %u", ewfd_get_circuit_id(circ));
+	return true;
 }
 
 bool ewfd_paddding_op_dummy_impl(circuit_t *circ) {
+	if (circ->marked_for_close) {
+		return false;
+	}
 	ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ(circ);
-	tor_assert(ewfd_rt);
+	if (ewfd_rt == NULL || ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot] == NULL) {
+		return false;
+	}
 	int slot = ewfd_rt->padding_unit_ctx.active_slot;
 	int hopnum = ewfd_rt->padding_slots[slot]->conf->target_hopnum;
-	crypt_path_t *target_hop = NULL;
+	channel_t *chan;
+	cell_queue_t *queue;
+	cell_direction_t cell_direction;
+
 	if (CIRCUIT_IS_ORIGIN(circ)) {
-		target_hop = circuit_get_cpath_hop(TO_ORIGIN_CIRCUIT(circ), hopnum);
-		if (target_hop == NULL) {
+		if (circuit_get_cpath_hop(TO_ORIGIN_CIRCUIT(circ), hopnum) == NULL) {
 			EWFD_LOG("ERROR: Can't find target hop for hop: %d", hopnum);
 			return false;
 		}
+		chan = circ->n_chan;
+		queue = &circ->n_chan_cells;
+		cell_direction = CELL_DIRECTION_OUT;
+	} else {
+		chan = TO_OR_CIRCUIT(circ)->p_chan;
+		queue = &TO_OR_CIRCUIT(circ)->p_chan_cells;
+		cell_direction = CELL_DIRECTION_IN;
+	}
+	if (chan == NULL) {
+		return false;
+	}
+
+	// 不在这里分配cell，cmux把dummy计数当成可发送的cell
+	queue->ewfd_dummy_n++;
+	ewfd_rt->padding_slots[slot]->queued_dummy++;
+	update_circuit_on_cmux(circ, cell_direction);
+	scheduler_channel_has_waiting_cells(chan);
+	return true;
+}
+
+void ewfd_cell_queue_drop_dummy(circuit_t *circ) {
+	channel_t *chan;
+	cell_queue_t *queue;
+	cell_direction_t cell_direction;
+
+	if (CIRCUIT_IS_ORIGIN(circ)) {
+		chan = circ->n_chan;
+		queue = &circ->n_chan_cells;
+		cell_direction = CELL_DIRECTION_OUT;
+	} else {
+		chan = TO_OR_CIRCUIT(circ)->p_chan;
+		queue = &TO_OR_CIRCUIT(circ)->p_chan_cells;
+		cell_direction = CELL_DIRECTION_IN;
+	}
+	if (queue->ewfd_dummy_n == 0) {
+		return;
+	}
+	queue->ewfd_dummy_n = 0;
+	// circuit释放时已经从cmux上detach
+	if (chan != NULL && chan->cmux != NULL && circuitmux_is_circuit_attached(chan->cmux, circ)) {
+		update_circuit_on_cmux(circ, cell_direction);
+	}
+}
+
+void ewfd_cell_queue_drop_unit_dummy(circuit_t *circ, ewfd_padding_unit_st *unit) {
+	channel_t *chan;
+	cell_queue_t *queue;
+	cell_direction_t cell_direction;
+
+	if (CIRCUIT_IS_ORIGIN(circ)) {
+		chan = circ->n_chan;
+		queue = &circ->n_chan_cells;
+		cell_direction = CELL_DIRECTION_OUT;
+	} else {
+		chan = TO_OR_CIRCUIT(circ)->p_chan;
+		queue = &TO_OR_CIRCUIT(circ)->p_chan_cells;
+		cell_direction = CELL_DIRECTION_IN;
+	}
+	uint32_t drop_n = MIN(unit->queued_dummy, queue->ewfd_dummy_n);
+	unit->queued_dummy = 0;
+	if (drop_n == 0) {
+		return;
+	}
+	queue->ewfd_dummy_n -= drop_n;
+	if (chan != NULL && chan->cmux != NULL && circuitmux_is_circuit_attached(chan->cmux, circ)) {
+		update_circuit_on_cmux(circ, cell_direction);
+	}
+}
+
+/* 找到这个dummy属于的unit, 优先当前启用的unit
+都没有计数时返回NULL (unit已经被STOP)
+*/
+static ewfd_padding_unit_st* dummy_owner_unit(ewfd_padding_runtime_st *ewfd_rt) {
+	ewfd_padding_unit_st *unit = ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot];
+	if (unit != NULL && unit->queued_dummy > 0) {
+		return unit;
+	}
+	for (int i = 0; i < MAX_EWFD_UNITS_ON_CIRC; i++) {
+		unit = ewfd_rt->padding_slots[i];
+		if (unit != NULL && unit->queued_dummy > 0) {
+			return unit;
+		}
+	}
+	return NULL;
+}
+
+packed_cell_t* ewfd_cell_queue_pop_dummy(circuit_t *circ, cell_queue_t *queue) {
+	tor_assert(queue->ewfd_dummy_n > 0);
+	queue->ewfd_dummy_n--;
+
+	// 入队之后unit被STOP或者runtime已经释放, 丢弃这个dummy
+	ewfd_padding_runtime_st *ewfd_rt = ewfd_get_runtime_on_circ(circ);
+	if (ewfd_rt == NULL) {
+		return NULL;
+	}
+	ewfd_padding_unit_st *unit = dummy_owner_unit(ewfd_rt);
+	if (unit == NULL) {
+		return NULL;
 	}
+	unit->queued_dummy--;
+
+	// 按入队时的unit选择目标hop
+	packed_cell_t *cell = craft_dummy_packet_to_hop(circ, unit->conf->target_hopnum);
+	if (cell == NULL) {
+		return NULL;
+	}
+	cell->inserted_timestamp = monotime_coarse_get_stamp();
 	rep_hist_padding_count_write(PADDING_TYPE_DROP);
-	return relay_send_command_from_edge(0, circ, RELAY_COMMAND_DROP, NULL, 0, target_hop);
+	ewfd_unit_stats_st *stats = ewfd_unit_stats_on_circ(circ);
+	if (stats != NULL) {
+		stats->dummy_cells++;
+	}
+	return cell;
 }
 
 bool ewfd_paddding_op_delay_gap_impl(circuit_t *circ, uint32_t trigger_ms, uint32_t pkt_num) {
 	return circuitmux_set_advance_delay(circ, trigger_ms, pkt_num);
 }
 
-bool ewfd_padding_trigger_inactive_circ(circuit_t *circ, uint64_t tick_ms) {
-	return circuitmux_trigger_inactive_circ(circ, tick_ms);
+void ewfd_padding_add_delay_wakeup(circuit_t *circ) {
+	circuitmux_ewfd_add_sleeper(circ);
+}
+
+void ewfd_padding_remove_delay_wakeup(circuit_t *circ) {
+	circuitmux_ewfd_remove_sleeper(circ);
+}
+
+int ewfd_padding_wake_delay_circs(uint64_t tick_ms) {
+	return circuitmux_ewfd_wake_sleepers(tick_ms);
+}
+
+uint64_t ewfd_padding_next_delay_wakeup(void) {
+	return circuitmux_ewfd_next_wake_ti();
 }
 
 /* 
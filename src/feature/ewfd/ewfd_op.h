@@ -3,14 +3,65 @@
 
 #include <stdint.h>
 #include "core/or/or.h"
+#include "ext/tor_queue.h"
+#include "feature/ewfd/ewfd_pool.h"
 
-/* 判断是否是delay包
-等待delay_us后发送n个包
-n_cell: 实际从队列删除的包的数量
+struct ewfd_padding_unit_t;
+
+/* delay描述符不再以magic cell的形式放在cell队列里，而是挂在队列旁边:
+- cell_seq: 描述符之前入队的real cell数量，pop到这个位置时生效
+- 描述符不计入queue->n，但计入cmux看到的cell数量，pop时不需要读取cell内容
+*/
+typedef struct ewfd_delay_desc_t {
+	TOR_SIMPLEQ_ENTRY(ewfd_delay_desc_t) next;
+	uint64_t trigger_ms;
+	uint64_t cell_seq;
+	uint32_t pkt_num; // 和op的参数同宽，不截断
+} ewfd_delay_desc_st;
+
+typedef struct ewfd_delay_desc_queue_t {
+	TOR_SIMPLEQ_HEAD(ewfd_delay_desc_list_t, ewfd_delay_desc_t) head;
+	uintptr_t on_circ;
+	uint64_t popped_seq; // 已经pop的real cell数量
+	int n;
+} ewfd_delay_desc_queue_st;
+
+/* 描述符和描述符队列从对象池分配，由ewfd_framework_get_total_allocation计入
+MaxMemInQueues，OOM时和event池一起trim
+*/
+extern ewfd_pool_st ewfd_delay_desc_pool;
+extern ewfd_pool_st ewfd_delay_queue_pool;
+
+// 在队列当前末尾添加一个delay描述符
+void ewfd_cell_queue_add_delay(cell_queue_t *queue, circuit_t *circ, uint64_t trigger_ms, uint32_t pkt_num);
+// 释放队列上的所有delay描述符, cell_queue_clear时调用
+void ewfd_cell_queue_free_delay(cell_queue_t *queue);
+int ewfd_cell_queue_get_delay_num(const cell_queue_t *queue);
+/* cmux看到的可发送数量: real cell + 待发送的dummy + delay描述符
+队头的delay已经生效但还没到时间时为0，由delay的NOTIFY event再更新cmux
+*/
+int ewfd_cell_queue_num_sendable(const cell_queue_t *queue);
+
+// 每次从队头取出real cell都要调用，推进描述符的生效位置
+void ewfd_cell_queue_note_pop(cell_queue_t *queue);
+
+/* 队头有delay描述符时，等待到trigger_ms后发送pkt_num个包
+n_cell: 实际从队列删除的real cell的数量 (0或1)
 */
 extern packed_cell_t* ewfd_cell_queue_pop_simple_delay(cell_queue_t *queue, uint8_t wide_circ_ids, uint8_t *n_cell);
 extern packed_cell_t* ewfd_craft_dummy_packet(circuit_t *circ);
 
+/* 取出一个待发送的dummy包，此时才组装并加密
+队列中的real cell都已发送后才调用，保证加密顺序和发送顺序一致
+dummy组装失败或者unit已经不在circ上时返回NULL，计数同样减一
+*/
+packed_cell_t* ewfd_cell_queue_pop_dummy(circuit_t *circ, cell_queue_t *queue);
+
+// 丢弃circ上还没发送的dummy并更新cmux计数, unit STOP或者runtime释放时调用
+void ewfd_cell_queue_drop_dummy(circuit_t *circ);
+// 只丢弃unit自己入队的dummy, padding unit STOP时调用
+void ewfd_cell_queue_drop_unit_dummy(circuit_t *circ, struct ewfd_padding_unit_t *unit);
+
 // extern packed_cell_t* ewfd_cell_queue_pop_advance_delay(cell_queue_t *queue, uint8_t wide_circ_ids, uint8_t *n_cell);
 
 
@@ -25,11 +76,15 @@ bool ewfd_paddding_op_delay_impl(circuit_t *circ, uint32_t trigger_ms, uint32_t
 // 唤醒被delay的circ
 bool ewfd_paddding_op_delay_notify_impl(circuit_t *circ);
 
-// 发送dummy包
+// 发送dummy包，只增加队列上的dummy计数，flush时再组装
 bool ewfd_paddding_op_dummy_impl(circuit_t *circ);
 
 bool ewfd_paddding_op_delay_gap_impl(circuit_t *circ, uint32_t trigger_ms, uint32_t pkt_num);
 
-bool ewfd_padding_trigger_inactive_circ(circuit_t *circ, uint64_t tick_ms);
+// delay circ按唤醒时间挂在cmux的时间轮上，tick时只唤醒到期的circ
+void ewfd_padding_add_delay_wakeup(circuit_t *circ);
+void ewfd_padding_remove_delay_wakeup(circuit_t *circ);
+int ewfd_padding_wake_delay_circs(uint64_t tick_ms);
+uint64_t ewfd_padding_next_delay_wakeup(void);
 
 #endif // EWFD_OP_H_
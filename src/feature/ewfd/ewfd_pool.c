@@ -0,0 +1,53 @@
+#include "feature/ewfd/ewfd_pool.h"
+#include "lib/log/util_bug.h"
+#include "lib/malloc/malloc.h"
+#include <string.h>
+
+void *ewfd_pool_alloc(ewfd_pool_st *pool) {
+	void *obj = pool->free_list;
+
+	pool->alloc_num++;
+	if (obj != NULL) {
+		pool->free_list = *(void **) obj;
+		pool->free_num--;
+		pool->reuse_num++;
+		memset(obj, 0, pool->obj_size);
+	} else {
+		tor_assert(pool->obj_size >= sizeof(void *));
+		obj = tor_malloc_zero(pool->obj_size);
+	}
+
+	pool->used_num++;
+	if (pool->used_num > pool->high_water) {
+		pool->high_water = pool->used_num;
+	}
+	return obj;
+}
+
+void ewfd_pool_free(ewfd_pool_st *pool, void *obj) {
+	if (obj == NULL) {
+		return;
+	}
+	tor_assert(pool->used_num > 0);
+	pool->used_num--;
+
+	/* 只有空闲链表为空时才malloc新对象，此时used_num就是对象总数
+	* 所以used_num + free_num不会超过high_water，缓存不需要另外检查上限 */
+	*(void **) obj = pool->free_list;
+	pool->free_list = obj;
+	pool->free_num++;
+}
+
+size_t ewfd_pool_trim(ewfd_pool_st *pool) {
+	size_t freed = (size_t) pool->free_num * pool->obj_size;
+	void *obj;
+
+	while ((obj = pool->free_list) != NULL) {
+		pool->free_list = *(void **) obj;
+		tor_free(obj);
+	}
+	pool->trim_num += pool->free_num;
+	pool->free_num = 0;
+	pool->high_water = pool->used_num;
+	return freed;
+}
@@ -0,0 +1,42 @@
+#ifndef EWFD_POOL_H_
+#define EWFD_POOL_H_
+
+/*
+定长对象池，用于ewfd event/delay entry等高频分配的小对象
+- 释放的对象挂在空闲链表上，下一次分配直接复用
+- 空闲链表为空时才分配新对象，所以使用中+缓存的对象不超过high_water
+  (上次trim以来同时使用的最大数量)
+- OOM时调用ewfd_pool_trim释放所有缓存的对象
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct ewfd_pool_t {
+	const char *name;
+	size_t obj_size;
+	void *free_list; // 空闲对象的前sizeof(void*)字节存放next指针
+	uint32_t free_num; // 空闲链表上的对象数量
+	uint32_t used_num; // 正在使用的对象数量
+	uint32_t high_water; // 上次trim以来used_num的最大值
+	uint64_t alloc_num; // 总分配次数
+	uint64_t reuse_num; // 从空闲链表复用的次数
+	uint64_t trim_num; // trim释放的对象数量
+} ewfd_pool_st;
+
+#define EWFD_POOL_INIT(pool_name, size) \
+	{ .name = (pool_name), .obj_size = (size) }
+
+/* 返回清零的对象 */
+void *ewfd_pool_alloc(ewfd_pool_st *pool);
+void ewfd_pool_free(ewfd_pool_st *pool, void *obj);
+
+/* 释放空闲链表上的全部对象，high_water重置为used_num，返回释放的字节数 */
+size_t ewfd_pool_trim(ewfd_pool_st *pool);
+
+/* 已分配 (使用中+缓存) 的字节数 */
+static inline size_t ewfd_pool_get_allocation(const ewfd_pool_st *pool) {
+	return ((size_t) pool->used_num + pool->free_num) * pool->obj_size;
+}
+
+#endif // EWFD_POOL_H_
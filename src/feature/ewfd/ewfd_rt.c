@@ -3,7 +3,12 @@
 #include "feature/ewfd/circuit_padding.h"
 #include "feature/ewfd/debug.h"
 #include "feature/ewfd/ewfd_unit.h"
+#include "feature/ewfd/ewfd_conf.h"
+#include "feature/ewfd/ewfd.h"
+#include "core/mainloop/cpuworker.h"
+#include "lib/evloop/workqueue.h"
 #include "lib/ebpf/ebpf_vm.h"
+#include "lib/time/compat_time.h"
 #include "lib/ebpf/ewfd-defense/src/ewfd_api.h"
 
 #include <assert.h>
@@ -30,28 +35,54 @@
 2. 如果用完了再次生成
 */
 
-// #define USE_C_DEBUG_CODE
+/* 默认执行内置或者EWFDUnit加载的eBPF code
+* ewfd_dev.c中C实现的unit只用于调试，由ewfd_rt_set_c_units打开
+* C unit有静态状态并且会访问circuit，只在主线程执行，不会offload到cpuworker
+*/
+static bool ewfd_use_c_units = false;
+
+void ewfd_rt_set_c_units(bool enable) {
+	ewfd_use_c_units = enable;
+}
+
+bool ewfd_rt_use_c_units(void) {
+	return ewfd_use_c_units;
+}
 
 /*
 测试阶段，一次生成3-5个padding包
 */
-void run_ewfd_schedule_vm(ewfd_padding_runtime_st *ewfd_rt) {
-	uint64_t now_ti = monotime_absolute_msec();
-	ewfd_rt->circ_status.now_ti = now_ti;
+static void prepare_ewfd_schedule_vm(ewfd_padding_runtime_st *ewfd_rt, uint64_t now_ti) {
+	ewfd_rt->circ_status.now_ti = (uint32_t) now_ti;
 	ewfd_rt->circ_status.cur_padding_unit = get_current_padding_unit_uuid(ewfd_rt);
 
-	// 根据flow状态，开启和切换算法
-	uint64_t ret = 0;
+	if (!ewfd_use_c_units) {
+		ewfd_padding_unit_st * unit = ewfd_rt->schedule_slots[ewfd_rt->schedule_unit_ctx.active_slot];
+		ewfd_rt->circ_status.ewfd_unit = (uint64_t) unit->ewfd_unit;
+	}
+}
 
-#define USE_C_DEBUG_CODE
-#ifdef USE_C_DEBUG_CODE
-	ret = ewfd_default_schedule_unit(&ewfd_rt->circ_status);
-#else
-	// run current padding unit
-	ewfd_unit_st * unit = ewfd_rt->schedule_slots[ewfd_rt->schedule_unit_ctx.active_slot];
-	ret = run_ewfd_unit(unit, &ewfd_rt->circ_status, sizeof(ewfd_circ_status_st));
-#endif // USE_C_DEBUG_CODE
-	
+static inline uint8_t ewfd_schedule_uuid_of(ewfd_padding_runtime_st *ewfd_rt) {
+	return ewfd_rt->schedule_slots[ewfd_rt->schedule_unit_ctx.active_slot]->conf->unit_uuid;
+}
+
+static inline uint8_t ewfd_padding_uuid_of(ewfd_padding_runtime_st *ewfd_rt) {
+	return ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot]->conf->unit_uuid;
+}
+
+// 批量执行的耗时平均分给每个circ
+static void ewfd_stats_batch_exec(ewfd_padding_runtime_st **rts, int num, uint8_t (*uuid_of)(ewfd_padding_runtime_st *ewfd_rt),
+		const monotime_t *start, const monotime_t *end) {
+	if (num == 0) {
+		return;
+	}
+	int64_t nsec = monotime_diff_nsec(start, end);
+	for (int i = 0; i < num; i++) {
+		ewfd_unit_stats_add_exec(uuid_of(rts[i]), nsec / num, 1);
+	}
+}
+
+static void finish_ewfd_schedule_vm(ewfd_padding_runtime_st *ewfd_rt, uint64_t ret) {
 	int op = (int) (ret >> 32);
 	int args = (int) (ret & 0xffffffff);
 
@@ -73,30 +104,111 @@ void run_ewfd_schedule_vm(ewfd_padding_runtime_st *ewfd_rt) {
 	}
 }
 
-void run_ewfd_padding_vm(ewfd_padding_runtime_st *ewfd_rt) {
-	// front 算法
+void run_ewfd_schedule_vm(ewfd_padding_runtime_st *ewfd_rt) {
+	prepare_ewfd_schedule_vm(ewfd_rt, monotime_absolute_msec());
 
-	// schedule
-	if (ewfd_rt->padding_unit_ctx.total_dummy_pkt > 1000) {
-		EWFD_LOG("exceed maxiam dummy packet\n");
-		return;
+	// 根据flow状态，开启和切换算法
+	uint64_t ret = 0;
+	monotime_t start, end;
+	monotime_get(&start);
+
+	if (ewfd_use_c_units) {
+		ret = ewfd_default_schedule_unit(&ewfd_rt->circ_status);
+	} else {
+		// run current padding unit
+		ewfd_padding_unit_st * unit = ewfd_rt->schedule_slots[ewfd_rt->schedule_unit_ctx.active_slot];
+		ret = run_ewfd_unit(unit->ewfd_unit, &ewfd_rt->circ_status, sizeof(ewfd_circ_status_st));
 	}
-	ewfd_rt->circ_status.now_ti = monotime_absolute_msec();
+	monotime_get(&end);
+	ewfd_unit_stats_add_exec(ewfd_schedule_uuid_of(ewfd_rt), monotime_diff_nsec(&start, &end), 1);
+	
+	finish_ewfd_schedule_vm(ewfd_rt, ret);
+}
 
-	uint64_t ret = 0;
+/* 按vm分组，同一个vm上的circ_status一次执行
+* vm_of返回NULL的rt不执行, ret为0
+*/
+static void run_ewfd_vm_grouped(ewfd_padding_runtime_st **rts, int num, uint64_t *rets,
+		struct ebpf_vm *(*vm_of)(ewfd_padding_runtime_st *ewfd_rt)) {
+	struct ebpf_vm *vms[EWFD_TICK_BATCH_MAX];
+	void *ctxs[EWFD_TICK_BATCH_MAX];
+	uint64_t group_rets[EWFD_TICK_BATCH_MAX];
+	int idx[EWFD_TICK_BATCH_MAX];
+	bool done[EWFD_TICK_BATCH_MAX];
+
+	tor_assert(num <= EWFD_TICK_BATCH_MAX);
+	for (int i = 0; i < num; i++) {
+		vms[i] = vm_of(rts[i]);
+		done[i] = vms[i] == NULL;
+		rets[i] = 0;
+	}
 
-// #undef USE_C_DEBUG_CODE
-#ifdef USE_C_DEBUG_CODE
-	ret = ewfd_default_padding_unit(&ewfd_rt->circ_status);
-#else
-	// EWFD_LOG("---------------------: run ebpf tick");
-	// run current padding unit
-	ewfd_padding_unit_st * unit = ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot];
-	ewfd_rt->circ_status.ewfd_unit = (uint64_t) unit->ewfd_unit;
-	ret = run_ewfd_unit(unit->ewfd_unit, &ewfd_rt->circ_status, sizeof(ewfd_circ_status_st));
+	for (int i = 0; i < num; i++) {
+		if (done[i]) {
+			continue;
+		}
+		int group_num = 0;
+		for (int j = i; j < num; j++) {
+			if (!done[j] && vms[j] == vms[i]) {
+				ctxs[group_num] = &rts[j]->circ_status;
+				idx[group_num++] = j;
+				done[j] = true;
+			}
+		}
+		run_ewfd_unit_batch(vms[i], ctxs, sizeof(ewfd_circ_status_st), group_rets, group_num);
+		for (int k = 0; k < group_num; k++) {
+			rets[idx[k]] = group_rets[k];
+		}
+	}
+}
 
-#endif // USE_C_DEBUG_CODE
+static struct ebpf_vm *ewfd_schedule_vm_of(ewfd_padding_runtime_st *ewfd_rt) {
+	ewfd_padding_unit_st *unit = ewfd_rt->schedule_slots[ewfd_rt->schedule_unit_ctx.active_slot];
+	return unit != NULL ? unit->ewfd_unit->vm : NULL;
+}
 
+void run_ewfd_schedule_vm_batch(ewfd_padding_runtime_st **rts, int num) {
+	uint64_t rets[EWFD_TICK_BATCH_MAX];
+	uint64_t now_ti = monotime_absolute_msec();
+
+	monotime_t start, end;
+
+	for (int i = 0; i < num; i++) {
+		prepare_ewfd_schedule_vm(rts[i], now_ti);
+	}
+
+	monotime_get(&start);
+	if (ewfd_use_c_units) {
+		for (int i = 0; i < num; i++) {
+			rets[i] = ewfd_default_schedule_unit(&rts[i]->circ_status);
+		}
+	} else {
+		run_ewfd_vm_grouped(rts, num, rets, ewfd_schedule_vm_of);
+	}
+	monotime_get(&end);
+	ewfd_stats_batch_exec(rts, num, ewfd_schedule_uuid_of, &start, &end);
+
+	for (int i = 0; i < num; i++) {
+		finish_ewfd_schedule_vm(rts[i], rets[i]);
+	}
+}
+
+// 超过dummy packet上限的circ不再执行
+static bool prepare_ewfd_padding_vm(ewfd_padding_runtime_st *ewfd_rt, uint64_t now_ti) {
+	if (ewfd_rt->padding_unit_ctx.total_dummy_pkt > 1000) {
+		EWFD_LOG("exceed maxiam dummy packet\n");
+		return false;
+	}
+	ewfd_rt->circ_status.now_ti = (uint32_t) now_ti;
+
+	if (!ewfd_use_c_units) {
+		ewfd_padding_unit_st * unit = ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot];
+		ewfd_rt->circ_status.ewfd_unit = (uint64_t) unit->ewfd_unit;
+	}
+	return true;
+}
+
+static void finish_ewfd_padding_vm(ewfd_padding_runtime_st *ewfd_rt, uint64_t ret) {
 	uint64_t now_ti = monotime_absolute_msec();
 	int op = (int) (ret >> 32);
 	int args = (int) (ret & 0xffffffff);
@@ -109,8 +221,319 @@ void run_ewfd_padding_vm(ewfd_padding_runtime_st *ewfd_rt) {
 
 	// 暂时只支持dummy packet
 	if (op == EWFD_OP_DUMMY_PACKET) {
-		ewfd_rt->circ_status.last_padding_ti = now_ti;
+		ewfd_rt->circ_status.last_padding_ti = (uint32_t) now_ti;
 		// ewfd_padding_op(op, ewfd_rt->on_circ, args);
 		ewfd_rt->padding_unit_ctx.total_dummy_pkt += args;
 	}
 }
+
+void run_ewfd_padding_vm(ewfd_padding_runtime_st *ewfd_rt) {
+	// front 算法
+
+	// schedule
+	if (!prepare_ewfd_padding_vm(ewfd_rt, monotime_absolute_msec())) {
+		return;
+	}
+
+	uint64_t ret = 0;
+	monotime_t start, end;
+	monotime_get(&start);
+
+	if (ewfd_use_c_units) {
+		ret = ewfd_default_padding_unit(&ewfd_rt->circ_status);
+	} else {
+		// EWFD_LOG("---------------------: run ebpf tick");
+		// run current padding unit
+		ewfd_padding_unit_st * unit = ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot];
+		ret = run_ewfd_unit(unit->ewfd_unit, &ewfd_rt->circ_status, sizeof(ewfd_circ_status_st));
+	}
+	monotime_get(&end);
+	ewfd_unit_stats_add_exec(ewfd_padding_uuid_of(ewfd_rt), monotime_diff_nsec(&start, &end), 1);
+
+	finish_ewfd_padding_vm(ewfd_rt, ret);
+}
+
+static struct ebpf_vm *ewfd_padding_vm_of(ewfd_padding_runtime_st *ewfd_rt) {
+	ewfd_padding_unit_st *unit = ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot];
+	return unit->ewfd_unit->vm;
+}
+
+void run_ewfd_padding_vm_batch(ewfd_padding_runtime_st **rts, int num) {
+	ewfd_padding_runtime_st *run_rts[EWFD_TICK_BATCH_MAX];
+	uint64_t rets[EWFD_TICK_BATCH_MAX];
+	uint64_t now_ti = monotime_absolute_msec();
+	int run_num = 0;
+
+	for (int i = 0; i < num; i++) {
+		if (prepare_ewfd_padding_vm(rts[i], now_ti)) {
+			run_rts[run_num++] = rts[i];
+		}
+	}
+
+	monotime_t start, end;
+	monotime_get(&start);
+	if (ewfd_use_c_units) {
+		for (int i = 0; i < run_num; i++) {
+			rets[i] = ewfd_default_padding_unit(&run_rts[i]->circ_status);
+		}
+	} else {
+		run_ewfd_vm_grouped(run_rts, run_num, rets, ewfd_padding_vm_of);
+	}
+	monotime_get(&end);
+	ewfd_stats_batch_exec(run_rts, run_num, ewfd_padding_uuid_of, &start, &end);
+
+	for (int i = 0; i < run_num; i++) {
+		finish_ewfd_padding_vm(run_rts[i], rets[i]);
+	}
+}
+
+/* ------------------------------------------------------------------
+* unit在cpuworker中执行
+* - worker只访问job里的数据: circ_status的副本，派发时的event计数，unit和conf的引用
+*   unit产生的op记录在每个entry的ops里 (见ewfd_framework_enter_worker)
+* - 只offload eBPF unit，C实现的dev unit有静态状态，只在主线程执行
+* - 同一时刻只有一个job在执行，job执行期间主线程不编译也不替换vm (见ewfd_rt_job_in_flight)
+* - reply在主线程回写unit的输出，提交op，重新设置ticker
+* - job执行期间rt被释放: entry的rt置NULL，结果丢弃; unit推迟到job结束再释放
+*/
+typedef struct ewfd_unit_job_entry_t {
+	ewfd_padding_runtime_st *ewfd_rt; // NULL: rt已经释放
+	ewfd_rt_done_fn_t done_fn;
+	uint8_t tick_type;
+	uint8_t unit_uuid;
+	bool should_run; // prepare失败的rt不执行，只调用done_fn
+	ewfd_padding_conf_st *conf; // 持有引用
+	struct ewfd_unit_t *ewfd_unit; // 释放推迟到job结束
+	ewfd_circ_status_st status;
+	ewfd_circ_event_count_st event_count;
+	smartlist_t *ops;
+	uint64_t ret;
+	int64_t exec_nsec;
+} ewfd_unit_job_entry_st;
+
+typedef struct ewfd_unit_job_t {
+	smartlist_t *entries;
+	smartlist_t *deferred_units; // 执行期间释放的unit
+} ewfd_unit_job_st;
+
+ewfd_unit_job_stats_st ewfd_unit_job_stats;
+
+static bool ewfd_offload_enabled = false;
+static ewfd_unit_job_st *ewfd_running_job = NULL;
+static ewfd_unit_job_st *ewfd_queued_job = NULL;
+
+static ewfd_unit_job_st *ewfd_unit_job_new(void) {
+	ewfd_unit_job_st *job = tor_malloc_zero(sizeof(ewfd_unit_job_st));
+	job->entries = smartlist_new();
+	job->deferred_units = smartlist_new();
+	return job;
+}
+
+static void ewfd_unit_job_free(ewfd_unit_job_st *job) {
+	SMARTLIST_FOREACH_BEGIN(job->entries, ewfd_unit_job_entry_st *, entry) {
+		ewfd_padding_conf_decref(entry->conf);
+		ewfd_framework_clear_ops(entry->ops);
+		smartlist_free(entry->ops);
+		tor_free(entry);
+	} SMARTLIST_FOREACH_END(entry);
+	smartlist_free(job->entries);
+	SMARTLIST_FOREACH(job->deferred_units, struct ewfd_unit_t *, unit, free_ewfd_unit(unit));
+	smartlist_free(job->deferred_units);
+	tor_free(job);
+}
+
+// 主线程: 和同步执行一样准备circ_status，然后复制给worker
+static bool ewfd_unit_job_prepare(ewfd_unit_job_entry_st *entry, uint64_t now_ti) {
+	ewfd_padding_runtime_st *ewfd_rt = entry->ewfd_rt;
+	ewfd_padding_unit_st *unit;
+
+	if (entry->tick_type == EWFD_TICK_SCHEDULE) {
+		unit = ewfd_rt->schedule_slots[ewfd_rt->schedule_unit_ctx.active_slot];
+		if (unit == NULL) {
+			return false;
+		}
+		prepare_ewfd_schedule_vm(ewfd_rt, now_ti);
+	} else {
+		unit = ewfd_rt->padding_slots[ewfd_rt->padding_unit_ctx.active_slot];
+		if (unit == NULL || !prepare_ewfd_padding_vm(ewfd_rt, now_ti)) {
+			return false;
+		}
+	}
+
+	entry->unit_uuid = unit->conf->unit_uuid;
+	entry->conf = unit->conf;
+	ewfd_padding_conf_incref(entry->conf);
+	entry->ewfd_unit = unit->ewfd_unit;
+	memcpy(&entry->status, &ewfd_rt->circ_status, sizeof(ewfd_circ_status_st));
+	ewfd_get_circ_event_count(entry->status.on_circ, &entry->event_count);
+	return true;
+}
+
+// cpuworker线程，不能访问entry->ewfd_rt
+static workqueue_reply_t ewfd_unit_job_threadfn(void *state_, void *arg) {
+	(void) state_;
+	ewfd_unit_job_st *job = arg;
+	ewfd_framework_st worker;
+	monotime_t start, end;
+
+	memset(&worker, 0, sizeof(worker));
+	SMARTLIST_FOREACH_BEGIN(job->entries, ewfd_unit_job_entry_st *, entry) {
+		if (!entry->should_run) {
+			continue;
+		}
+		worker.pending_ops = entry->ops;
+		worker.event_count = &entry->event_count;
+		ewfd_framework_enter_worker(&worker);
+		monotime_get(&start);
+		entry->ret = run_ewfd_unit(entry->ewfd_unit, &entry->status, sizeof(ewfd_circ_status_st));
+		monotime_get(&end);
+		entry->exec_nsec = monotime_diff_nsec(&start, &end);
+	} SMARTLIST_FOREACH_END(entry);
+	ewfd_framework_leave_worker();
+
+	return WQ_RPL_REPLY;
+}
+
+static void ewfd_unit_job_finish(ewfd_unit_job_st *job) {
+	SMARTLIST_FOREACH_BEGIN(job->entries, ewfd_unit_job_entry_st *, entry) {
+		ewfd_padding_runtime_st *ewfd_rt = entry->ewfd_rt;
+		if (entry->should_run) {
+			ewfd_unit_job_stats.units++;
+			ewfd_unit_stats_add_exec(entry->unit_uuid, entry->exec_nsec, 1);
+		}
+		if (ewfd_rt == NULL) {
+			ewfd_unit_job_stats.discarded++;
+			continue;
+		}
+		if (entry->should_run) {
+			ewfd_framework_commit_ops(entry->ops);
+			// unit只会修改这几个字段
+			ewfd_rt->circ_status.padding_start_ti = entry->status.padding_start_ti;
+			ewfd_rt->circ_status.last_padding_ti = entry->status.last_padding_ti;
+			ewfd_rt->circ_status.next_tick = entry->status.next_tick;
+			if (entry->tick_type == EWFD_TICK_SCHEDULE) {
+				finish_ewfd_schedule_vm(ewfd_rt, entry->ret);
+			} else {
+				finish_ewfd_padding_vm(ewfd_rt, entry->ret);
+			}
+		}
+		entry->done_fn(ewfd_rt);
+	} SMARTLIST_FOREACH_END(entry);
+}
+
+static void ewfd_unit_job_dispatch(ewfd_unit_job_st *job);
+
+static void ewfd_unit_job_replyfn(void *arg) {
+	ewfd_unit_job_st *job = arg;
+
+	if (job != ewfd_running_job) { // framework已经释放
+		ewfd_unit_job_free(job);
+		return;
+	}
+	// finish期间释放的rt和unit仍然要经过running job
+	ewfd_unit_job_finish(job);
+	ewfd_running_job = NULL;
+	ewfd_unit_job_free(job);
+	// worker已经不再使用vm和data stream
+	ewfd_code_compile_pending();
+	ewfd_data_stream_swap_pending();
+
+	if (ewfd_queued_job != NULL) {
+		job = ewfd_queued_job;
+		ewfd_queued_job = NULL;
+		ewfd_unit_job_dispatch(job);
+	}
+}
+
+static void ewfd_unit_job_dispatch(ewfd_unit_job_st *job) {
+	uint64_t now_ti = monotime_absolute_msec();
+
+	SMARTLIST_FOREACH_BEGIN(job->entries, ewfd_unit_job_entry_st *, entry) {
+		entry->should_run = entry->ewfd_rt != NULL && ewfd_unit_job_prepare(entry, now_ti);
+	} SMARTLIST_FOREACH_END(entry);
+
+	ewfd_running_job = job;
+	ewfd_unit_job_stats.jobs++;
+	if (cpuworker_queue_work(WQ_PRI_MED, ewfd_unit_job_threadfn, ewfd_unit_job_replyfn, job) == NULL) {
+		ewfd_unit_job_stats.inline_jobs++;
+		ewfd_unit_job_threadfn(NULL, job);
+		ewfd_unit_job_replyfn(job);
+	}
+}
+
+bool ewfd_rt_job_in_flight(void) {
+	return ewfd_running_job != NULL;
+}
+
+bool ewfd_rt_set_offload(bool enable) {
+	ewfd_offload_enabled = enable;
+	return !enable || !ewfd_use_c_units;
+}
+
+bool ewfd_rt_offload_batch(uint8_t tick_type, ewfd_padding_runtime_st **rts, int num, ewfd_rt_done_fn_t done_fn) {
+	// 关闭之后已经派发的job还在执行，后面的rt继续排队，避免和worker同时执行unit
+	if ((!ewfd_offload_enabled || ewfd_use_c_units) && ewfd_running_job == NULL) {
+		return false;
+	}
+	if (num == 0) {
+		return true;
+	}
+
+	ewfd_unit_job_st *job;
+	if (ewfd_running_job == NULL) {
+		job = ewfd_unit_job_new();
+	} else {
+		if (ewfd_queued_job == NULL) {
+			ewfd_queued_job = ewfd_unit_job_new();
+		}
+		job = ewfd_queued_job;
+	}
+
+	for (int i = 0; i < num; i++) {
+		ewfd_unit_job_entry_st *entry = tor_malloc_zero(sizeof(ewfd_unit_job_entry_st));
+		entry->ewfd_rt = rts[i];
+		entry->done_fn = done_fn;
+		entry->tick_type = tick_type;
+		entry->ops = smartlist_new();
+		smartlist_add(job->entries, entry);
+	}
+
+	if (job != ewfd_queued_job) {
+		ewfd_unit_job_dispatch(job);
+	}
+	return true;
+}
+
+void ewfd_rt_forget_runtime(ewfd_padding_runtime_st *ewfd_rt) {
+	ewfd_unit_job_st *jobs[] = {ewfd_running_job, ewfd_queued_job};
+	for (size_t i = 0; i < ARRAY_LENGTH(jobs); i++) {
+		if (jobs[i] == NULL) {
+			continue;
+		}
+		SMARTLIST_FOREACH(jobs[i]->entries, ewfd_unit_job_entry_st *, entry,
+			if (entry->ewfd_rt == ewfd_rt) entry->ewfd_rt = NULL);
+	}
+}
+
+void ewfd_rt_free_unit(struct ewfd_unit_t *ewfd_unit) {
+	if (ewfd_running_job != NULL && ewfd_unit != NULL) {
+		smartlist_add(ewfd_running_job->deferred_units, ewfd_unit);
+		return;
+	}
+	free_ewfd_unit(ewfd_unit);
+}
+
+/* 排队的job直接丢弃
+* 正在执行的job交给reply释放，worker可能还在使用其中的unit
+*/
+void ewfd_rt_offload_free(void) {
+	if (ewfd_queued_job != NULL) {
+		ewfd_unit_job_free(ewfd_queued_job);
+		ewfd_queued_job = NULL;
+	}
+	if (ewfd_running_job != NULL) {
+		SMARTLIST_FOREACH(ewfd_running_job->entries, ewfd_unit_job_entry_st *, entry,
+			entry->ewfd_rt = NULL);
+		ewfd_running_job = NULL;
+	}
+}
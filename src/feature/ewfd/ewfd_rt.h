@@ -6,4 +6,40 @@
 void run_ewfd_schedule_vm(ewfd_padding_runtime_st *ewfd_rt);
 void run_ewfd_padding_vm(ewfd_padding_runtime_st *ewfd_rt);
 
+// 同一次tick中到期的多个circ一起执行, num <= EWFD_TICK_BATCH_MAX
+void run_ewfd_schedule_vm_batch(ewfd_padding_runtime_st **rts, int num);
+void run_ewfd_padding_vm_batch(ewfd_padding_runtime_st **rts, int num);
+
+// 调试时使用ewfd_dev.c中C实现的unit代替eBPF code, 默认关闭
+void ewfd_rt_set_c_units(bool enable);
+bool ewfd_rt_use_c_units(void);
+
+/* EWFDOffloadUnits: 到期的unit交给cpuworker执行，主线程只负责event入队
+* 同一时刻最多一个job在worker中执行，job执行期间到期的rt放进下一个job
+*/
+typedef void (*ewfd_rt_done_fn_t)(ewfd_padding_runtime_st *ewfd_rt);
+
+typedef struct ewfd_unit_job_stats_t {
+	uint64_t jobs; // 派发的job
+	uint64_t inline_jobs; // 没有cpuworker，在主线程执行的job
+	uint64_t units; // job中执行的unit次数
+	uint64_t discarded; // 执行期间rt被释放，丢弃的结果
+} ewfd_unit_job_stats_st;
+
+extern ewfd_unit_job_stats_st ewfd_unit_job_stats;
+
+// 打开offload但是使用C unit时返回false, unit仍然在主线程执行
+bool ewfd_rt_set_offload(bool enable);
+// 有job在worker中执行时，主线程不能编译或者替换unit使用的vm
+bool ewfd_rt_job_in_flight(void);
+/* 返回false时由调用者在主线程执行，否则job完成后在主线程对每个rt调用done_fn
+* tick_type: EWFD_TICK_SCHEDULE/EWFD_TICK_PADDING
+*/
+bool ewfd_rt_offload_batch(uint8_t tick_type, ewfd_padding_runtime_st **rts, int num, ewfd_rt_done_fn_t done_fn);
+// rt释放前调用，job中的结果不再回写
+void ewfd_rt_forget_runtime(ewfd_padding_runtime_st *ewfd_rt);
+// unit可能正在worker中执行，job完成后再释放
+void ewfd_rt_free_unit(struct ewfd_unit_t *ewfd_unit);
+void ewfd_rt_offload_free(void);
+
 #endif
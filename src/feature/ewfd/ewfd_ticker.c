@@ -1,6 +1,8 @@
 #include "feature/ewfd/ewfd_ticker.h"
-#include "ext/timeouts/timeout.h"
+#include "feature/ewfd/ewfd_conf.h"
 #include "lib/defs/time.h"
+#include "lib/malloc/malloc.h"
+#include "lib/time/compat_time.h"
 #include <bits/types/struct_timeval.h>
 #include "feature/ewfd/circuit_padding.h"
 
@@ -9,41 +11,178 @@
 
 int total_ewfd_timer = 0;
 int released_ewfd_timer = 0;
+uint64_t ewfd_tick_wakeups = 0;
+uint64_t ewfd_tick_units = 0;
+uint64_t ewfd_tick_batches = 0;
 
-void ewfd_init_ticker(tor_timer_t **ticker, timer_cb_fn_t cb, void *arg) {
-	if (*ticker == NULL) {
-		*ticker = timer_new(cb, arg);
+static ewfd_tick_batch_fn_t tick_batch_fns[EWFD_TICK_TYPE_NUM];
+
+/* 全局tick driver，第一次schedule时创建
+*/
+typedef struct ewfd_tick_driver_t {
+	tor_timer_t *timer;
+	uint64_t armed_ti; // timer到期的绝对时间，UINT64_MAX表示没有设置
+	ewfd_wheel_st wheels[EWFD_TICK_TYPE_NUM];
+} ewfd_tick_driver_st;
+
+static ewfd_tick_driver_st *tick_driver = NULL;
+
+static void on_ewfd_tick_driver(tor_timer_t *timer, void *args, const struct monotime_t *time);
+
+static ewfd_tick_driver_st *get_tick_driver(void) {
+	if (tick_driver == NULL) {
+		uint64_t now_ti = monotime_absolute_msec();
+		tick_driver = tor_malloc_zero(sizeof(ewfd_tick_driver_st));
+		tick_driver->timer = timer_new(on_ewfd_tick_driver, NULL);
+		tick_driver->armed_ti = UINT64_MAX;
+		for (int i = 0; i < EWFD_TICK_TYPE_NUM; i++) {
+			ewfd_wheel_init(&tick_driver->wheels[i], now_ti);
+		}
+	}
+	return tick_driver;
+}
+
+/* 按最早到期的unit设置timer，到期时间对齐到EWFD_TICK_SLOT_MS
+*/
+static void arm_tick_driver(ewfd_tick_driver_st *driver, uint64_t now_ti) {
+	uint64_t next_ti = UINT64_MAX;
+	for (int i = 0; i < EWFD_TICK_TYPE_NUM; i++) {
+		uint64_t ti = ewfd_wheel_next_expire(&driver->wheels[i]);
+		if (ti < next_ti) {
+			next_ti = ti;
+		}
+	}
+	if (next_ti == UINT64_MAX) {
+		return;
+	}
+
+	next_ti = ((next_ti + EWFD_TICK_SLOT_MS - 1) / EWFD_TICK_SLOT_MS) * EWFD_TICK_SLOT_MS;
+	if (next_ti >= driver->armed_ti) {
+		return;
+	}
+
+	uint64_t delay_ms = next_ti > now_ti ? next_ti - now_ti : 0;
+	struct timeval timeout;
+	timeout.tv_sec = delay_ms * 1000 / TOR_USEC_PER_SEC;
+	timeout.tv_usec = (delay_ms * 1000) % TOR_USEC_PER_SEC;
+	timer_schedule(driver->timer, &timeout);
+	driver->armed_ti = next_ti;
+}
+
+/* batch fn中重新schedule的ticker到期时间在now之后，不会再次进入expired
+*/
+static void run_tick_batches(ewfd_wheel_st *wheel, ewfd_tick_batch_fn_t fn) {
+	ewfd_ticker_st *batch[EWFD_TICK_BATCH_MAX];
+	ewfd_wheel_node_st *node;
+	int num = 0;
+
+	do {
+		num = 0;
+		while (num < EWFD_TICK_BATCH_MAX && (node = ewfd_wheel_get_expired(wheel)) != NULL) {
+			batch[num++] = SUBTYPE_P(node, ewfd_ticker_st, node);
+		}
+		if (num > 0) {
+			ewfd_tick_units += num;
+			ewfd_tick_batches++;
+			fn(batch, num);
+		}
+	} while (num == EWFD_TICK_BATCH_MAX);
+}
+
+static void on_ewfd_tick_driver(tor_timer_t *timer, void *args, const struct monotime_t *time) {
+	(void) timer;
+	(void) args;
+	(void) time;
+	ewfd_tick_driver_st *driver = tick_driver;
+	if (driver == NULL) {
+		return;
+	}
+
+	uint64_t now_ti = monotime_absolute_msec();
+	driver->armed_ti = UINT64_MAX;
+	ewfd_tick_wakeups++;
+
+	// 先执行所有到期的padding unit，再执行schedule unit
+	// 每次只取一个节点，回调中删除其他ticker也是安全的
+	for (int i = 0; i < EWFD_TICK_TYPE_NUM; i++) {
+		ewfd_wheel_st *wheel = &driver->wheels[i];
+		ewfd_wheel_node_st *node;
+		ewfd_wheel_update(wheel, now_ti);
+		if (tick_batch_fns[i] != NULL) {
+			run_tick_batches(wheel, tick_batch_fns[i]);
+			continue;
+		}
+		while ((node = ewfd_wheel_get_expired(wheel)) != NULL) {
+			ewfd_ticker_st *ticker = SUBTYPE_P(node, ewfd_ticker_st, node);
+			ewfd_tick_units++;
+			ticker->cb(ticker->arg);
+		}
+	}
+
+	arm_tick_driver(driver, monotime_absolute_msec());
+}
+
+void ewfd_set_tick_batch_fn(uint8_t tick_type, ewfd_tick_batch_fn_t fn) {
+	tor_assert(tick_type < EWFD_TICK_TYPE_NUM);
+	tick_batch_fns[tick_type] = fn;
+}
+
+void ewfd_init_ticker(ewfd_ticker_st *ticker, uint8_t tick_type, ewfd_tick_fn_t cb, void *arg) {
+	tor_assert(tick_type < EWFD_TICK_TYPE_NUM);
+	if (ticker->cb == NULL) {
 		total_ewfd_timer++;
-		ewfd_padding_runtime_st *ewfd_rt = (ewfd_padding_runtime_st *) arg;
-		EWFD_TEMP_LOG("init_ticker: %d--------- circ: %u", total_ewfd_timer, ewfd_get_circuit_id(ewfd_rt->on_circ));
+		EWFD_TEMP_LOG("init_ticker: %d--------- type: %u", total_ewfd_timer, tick_type);
 	} else { // set timer again if disabled
-		timer_disable(*ticker);
-		timer_set_cb(*ticker, cb, arg);
+		ewfd_remove_ticker(ticker);
 		EWFD_TEMP_LOG("init_ticker---------reuse");
 	}
+	ticker->cb = cb;
+	ticker->arg = arg;
+	ticker->tick_type = tick_type;
 }
 
-void ewfd_remove_ticker(tor_timer_t **ticker) {
+void ewfd_remove_ticker(ewfd_ticker_st *ticker) {
 	// ticker is not released here, can resue it latter
-	if (*ticker != NULL) {
-		timer_disable(*ticker);
-		// fix bug: *ticker = NULL;
+	if (!ewfd_wheel_node_pending(&ticker->node)) {
+		return;
 	}
+	if (tick_driver == NULL) { // driver已经释放
+		ticker->node.pending = NULL;
+		return;
+	}
+	ewfd_wheel_del(&tick_driver->wheels[ticker->tick_type], &ticker->node);
 }
 
-void ewfd_schedule_ticker(tor_timer_t *ticker, uint64_t next_ti_ms) {
-	struct timeval timeout;
-	timeout.tv_sec = next_ti_ms * 1000 / TOR_USEC_PER_SEC;
-	timeout.tv_usec = (next_ti_ms * 1000) % TOR_USEC_PER_SEC;
-	timer_schedule(ticker, &timeout);
+void ewfd_schedule_ticker(ewfd_ticker_st *ticker, uint64_t next_ti_ms) {
+	tor_assert(ticker->cb);
+	ewfd_tick_driver_st *driver = get_tick_driver();
+	uint64_t now_ti = monotime_absolute_msec();
+
+	ewfd_remove_ticker(ticker);
+	ewfd_wheel_add(&driver->wheels[ticker->tick_type], &ticker->node, now_ti + next_ti_ms);
+	arm_tick_driver(driver, now_ti);
 }
 
-void ewfd_free_ticker(tor_timer_t **ticker) {
-	if (*ticker != NULL) {
-		timer_free(*ticker);
+void ewfd_free_ticker(ewfd_ticker_st *ticker) {
+	if (ticker->cb != NULL) {
+		ewfd_remove_ticker(ticker);
+		ticker->cb = NULL;
+		ticker->arg = NULL;
 		released_ewfd_timer++;
 		EWFD_TEMP_LOG("free_ticker---------remain: %d", released_ewfd_timer);
 	} else {
 		EWFD_TEMP_LOG("free_ticker---------null");
 	}
-}
\ No newline at end of file
+}
+
+void ewfd_free_tick_driver(void) {
+	if (tick_driver == NULL) {
+		return;
+	}
+	// 还挂在轮上的ticker属于circ，只把它们从轮上摘下来
+	for (int i = 0; i < EWFD_TICK_TYPE_NUM; i++) {
+		ewfd_wheel_clear(&tick_driver->wheels[i]);
+	}
+	timer_free(tick_driver->timer);
+	tor_free(tick_driver);
+}
@@ -1,20 +1,57 @@
 #ifndef EWFD_TICKER_H_
 #define EWFD_TICKER_H_
 
+/*
+所有circ的padding/schedule unit共用一个tick driver:
+- 一个libevent timer，按最早到期的unit设置
+- 到期时间按EWFD_TICK_SLOT_MS对齐，同一个slot内到期的unit一次处理
+- padding和schedule unit分开放在两个时间轮上，同类unit连续执行
+*/
+
 #include "lib/evloop/timers.h"
+#include "feature/ewfd/ewfd_wheel.h"
+#include <stdbool.h>
 #include <stdint.h>
 
+enum {
+	EWFD_TICK_PADDING = 0,
+	EWFD_TICK_SCHEDULE = 1,
+	EWFD_TICK_TYPE_NUM,
+};
+
+typedef void (*ewfd_tick_fn_t)(void *arg);
+
+typedef struct ewfd_ticker_t {
+	ewfd_wheel_node_st node;
+	ewfd_tick_fn_t cb;
+	void *arg;
+	uint8_t tick_type;
+} ewfd_ticker_st;
+
+/* 同一次唤醒中到期的同类ticker，每次最多EWFD_TICK_BATCH_MAX个一起交给batch fn
+* 这些ticker已经从轮上摘下，batch fn中不能释放其他ticker
+*/
+typedef void (*ewfd_tick_batch_fn_t)(ewfd_ticker_st **tickers, int num);
+
 extern int total_ewfd_timer;
 extern int released_ewfd_timer;
+extern uint64_t ewfd_tick_wakeups; // driver被唤醒的次数
+extern uint64_t ewfd_tick_units; // driver执行的unit次数
+extern uint64_t ewfd_tick_batches; // batch fn调用次数
+
+// 设置之后该类ticker的cb不再被driver调用
+void ewfd_set_tick_batch_fn(uint8_t tick_type, ewfd_tick_batch_fn_t fn);
+
+void ewfd_init_ticker(ewfd_ticker_st *ticker, uint8_t tick_type, ewfd_tick_fn_t cb, void *arg);
 
-void ewfd_init_ticker(tor_timer_t **ticker, timer_cb_fn_t cb, void *arg);
 
+void ewfd_remove_ticker(ewfd_ticker_st *ticker);
 
-void ewfd_remove_ticker(tor_timer_t **ticker);
+void ewfd_schedule_ticker(ewfd_ticker_st *ticker, uint64_t next_ti_ms);
 
-void ewfd_schedule_ticker(tor_timer_t *ticker, uint64_t next_ti_ms);
+void ewfd_free_ticker(ewfd_ticker_st *ticker);
 
-void ewfd_free_ticker(tor_timer_t **ticker);
+void ewfd_free_tick_driver(void);
 
 
 #endif // EWFD_TICKER_H_
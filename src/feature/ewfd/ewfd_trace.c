@@ -0,0 +1,219 @@
+#include "feature/ewfd/ewfd_trace.h"
+
+#include "core/or/or.h"
+#include "lib/cc/ctassert.h"
+#include "app/config/config.h"
+#include "lib/fs/files.h"
+#include "lib/lock/compat_mutex.h"
+#include "lib/malloc/malloc.h"
+#include "lib/thread/threads.h"
+#include "lib/time/compat_time.h"
+#include "lib/string/printf.h"
+#include "lib/log/util_bug.h"
+
+#include <string.h>
+
+CTASSERT((EWFD_TRACE_RING_SIZE & (EWFD_TRACE_RING_SIZE - 1)) == 0);
+
+/* dump文件格式 (本机字节序):
+* header: magic[8] version(u32) rec_size(u32) ring_num(u32) reserved(u32)
+* 每个ring: thread_idx(u32) rec_num(u32) 然后是从旧到新的rec_num条记录
+*/
+typedef struct ewfd_trace_file_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;
+	uint32_t ring_num;
+	uint32_t reserved;
+} ewfd_trace_file_header_st;
+
+typedef struct ewfd_trace_ring_header_t {
+	uint32_t thread_idx;
+	uint32_t rec_num;
+} ewfd_trace_ring_header_st;
+
+/* head用原子操作读写: 所属线程写完记录之后更新head，dump从其他线程读取 */
+typedef struct ewfd_trace_ring_t {
+	atomic_counter_t head; // 写入的记录总数，只有所属线程修改
+	uint16_t thread_idx;
+	ewfd_trace_rec_st recs[EWFD_TRACE_RING_SIZE];
+} ewfd_trace_ring_st;
+
+/* 线程局部的ring引用，每个线程分配一次，不释放
+* gen和ewfd_trace_gen不同时说明ring已经被ewfd_trace_free释放 */
+typedef struct ewfd_trace_thread_t {
+	ewfd_trace_ring_st *ring;
+	uint32_t gen;
+} ewfd_trace_thread_st;
+
+bool ewfd_trace_enabled = false;
+
+/* 线程局部变量、锁和计数器在第一次init时创建，之后一直保留
+* 其他线程随时可能调用ewfd_trace_record，不能在free时销毁 */
+static bool ewfd_trace_initialized = false;
+static tor_threadlocal_t ewfd_trace_thread_key;
+// 所有线程的ring，只在创建ring、dump和free的时候加锁
+static smartlist_t *ewfd_trace_rings = NULL;
+static tor_mutex_t ewfd_trace_lock;
+// ewfd_trace_enabled的原子副本，和ewfd_trace_writers一起决定free什么时候可以释放ring
+static atomic_counter_t ewfd_trace_active;
+// 正在ewfd_trace_record中的线程数量
+static atomic_counter_t ewfd_trace_writers;
+static uint32_t ewfd_trace_gen = 0;
+
+void ewfd_trace_init(void) {
+	if (ewfd_trace_rings != NULL) {
+		return;
+	}
+	if (!ewfd_trace_initialized) {
+		tor_threadlocal_init(&ewfd_trace_thread_key);
+		tor_mutex_init(&ewfd_trace_lock);
+		atomic_counter_init(&ewfd_trace_active);
+		atomic_counter_init(&ewfd_trace_writers);
+		ewfd_trace_initialized = true;
+	}
+	ewfd_trace_rings = smartlist_new();
+	ewfd_trace_enabled = true;
+	atomic_counter_exchange(&ewfd_trace_active, 1);
+}
+
+static void ewfd_trace_ring_free(ewfd_trace_ring_st *ring) {
+	atomic_counter_destroy(&ring->head);
+	tor_free(ring);
+}
+
+void ewfd_trace_free(void) {
+	if (ewfd_trace_rings == NULL) {
+		return;
+	}
+	ewfd_trace_enabled = false;
+	atomic_counter_exchange(&ewfd_trace_active, 0);
+	// 之后进入ewfd_trace_record的线程看到active为0直接返回，只需要等已经在写的线程
+	// 每个线程最多再写一条记录，直接自旋
+	while (atomic_counter_get(&ewfd_trace_writers) > 0) {
+	}
+
+	tor_mutex_acquire(&ewfd_trace_lock);
+	SMARTLIST_FOREACH(ewfd_trace_rings, ewfd_trace_ring_st *, ring, ewfd_trace_ring_free(ring));
+	smartlist_free(ewfd_trace_rings);
+	ewfd_trace_rings = NULL;
+	ewfd_trace_gen++;
+	tor_mutex_release(&ewfd_trace_lock);
+}
+
+static ewfd_trace_ring_st *new_thread_ring(ewfd_trace_thread_st *thread) {
+	ewfd_trace_ring_st *ring = tor_malloc_zero(sizeof(ewfd_trace_ring_st));
+	atomic_counter_init(&ring->head);
+	tor_mutex_acquire(&ewfd_trace_lock);
+	ring->thread_idx = (uint16_t) smartlist_len(ewfd_trace_rings);
+	smartlist_add(ewfd_trace_rings, ring);
+	tor_mutex_release(&ewfd_trace_lock);
+	thread->ring = ring;
+	thread->gen = ewfd_trace_gen;
+	return ring;
+}
+
+void ewfd_trace_record(uint16_t op, uint32_t circ_id, uint64_t a0, uint64_t a1) {
+	atomic_counter_add(&ewfd_trace_writers, 1);
+	if (PREDICT_UNLIKELY(atomic_counter_get(&ewfd_trace_active) == 0)) {
+		atomic_counter_sub(&ewfd_trace_writers, 1);
+		return;
+	}
+
+	ewfd_trace_thread_st *thread = tor_threadlocal_get(&ewfd_trace_thread_key);
+	if (PREDICT_UNLIKELY(thread == NULL)) {
+		thread = tor_malloc_zero(sizeof(ewfd_trace_thread_st));
+		tor_threadlocal_set(&ewfd_trace_thread_key, thread);
+	}
+	ewfd_trace_ring_st *ring = thread->ring;
+	if (PREDICT_UNLIKELY(ring == NULL || thread->gen != ewfd_trace_gen)) {
+		ring = new_thread_ring(thread);
+	}
+
+	size_t head = atomic_counter_get(&ring->head);
+	ewfd_trace_rec_st *rec = &ring->recs[head & (EWFD_TRACE_RING_SIZE - 1)];
+	rec->ts_us = monotime_absolute_usec();
+	rec->circ_id = circ_id;
+	rec->op = op;
+	rec->thread_idx = ring->thread_idx;
+	rec->args[0] = a0;
+	rec->args[1] = a1;
+	// 记录写完之后再发布新的head
+	atomic_counter_exchange(&ring->head, head + 1);
+	atomic_counter_sub(&ewfd_trace_writers, 1);
+}
+
+int ewfd_trace_dump(const char *fname) {
+	if (ewfd_trace_rings == NULL) {
+		return -1;
+	}
+
+	tor_mutex_acquire(&ewfd_trace_lock);
+	int ring_num = smartlist_len(ewfd_trace_rings);
+	size_t len = sizeof(ewfd_trace_file_header_st) + ring_num *
+		(sizeof(ewfd_trace_ring_header_st) + sizeof(ewfd_trace_rec_st) * EWFD_TRACE_RING_SIZE);
+	char *buf = tor_malloc_zero(len);
+	char *pos = buf;
+	int total = 0;
+
+	ewfd_trace_file_header_st header = {0};
+	memcpy(header.magic, EWFD_TRACE_MAGIC, sizeof(header.magic));
+	header.version = EWFD_TRACE_VERSION;
+	header.rec_size = sizeof(ewfd_trace_rec_st);
+	header.ring_num = ring_num;
+	memcpy(pos, &header, sizeof(header));
+	pos += sizeof(header);
+
+	// 其他线程可能在写入，最多读到几条正在覆盖的记录
+	SMARTLIST_FOREACH_BEGIN(ewfd_trace_rings, ewfd_trace_ring_st *, ring) {
+		size_t head = atomic_counter_get(&ring->head);
+		size_t start = head > EWFD_TRACE_RING_SIZE ? head - EWFD_TRACE_RING_SIZE : 0;
+		ewfd_trace_ring_header_st ring_header = {
+			.thread_idx = ring->thread_idx,
+			.rec_num = (uint32_t) (head - start),
+		};
+		memcpy(pos, &ring_header, sizeof(ring_header));
+		pos += sizeof(ring_header);
+		for (size_t i = start; i < head; i++) {
+			memcpy(pos, &ring->recs[i & (EWFD_TRACE_RING_SIZE - 1)], sizeof(ewfd_trace_rec_st));
+			pos += sizeof(ewfd_trace_rec_st);
+		}
+		total += ring_header.rec_num;
+	} SMARTLIST_FOREACH_END(ring);
+	tor_mutex_release(&ewfd_trace_lock);
+
+	int ret = write_bytes_to_file(fname, buf, pos - buf, 1);
+	tor_free(buf);
+	return ret < 0 ? -1 : total;
+}
+
+char *ewfd_trace_dump_default(void) {
+	char *fname = get_datadir_fname("ewfd-trace");
+	int n = ewfd_trace_dump(fname);
+	if (n < 0) {
+		log_warn(LD_FS, "Unable to dump EWFD trace to %s", fname);
+		tor_free(fname);
+		return NULL;
+	}
+	log_notice(LD_GENERAL, "Dumped %d EWFD trace records to %s", n, fname);
+	return fname;
+}
+
+char *ewfd_trace_get_summary(void) {
+	char *answer = NULL;
+	int ring_num = 0;
+	uint64_t rec_num = 0;
+
+	if (ewfd_trace_rings != NULL) {
+		tor_mutex_acquire(&ewfd_trace_lock);
+		ring_num = smartlist_len(ewfd_trace_rings);
+		SMARTLIST_FOREACH(ewfd_trace_rings, ewfd_trace_ring_st *, ring, {
+			size_t head = atomic_counter_get(&ring->head);
+			rec_num += head > EWFD_TRACE_RING_SIZE ? EWFD_TRACE_RING_SIZE : head;
+		});
+		tor_mutex_release(&ewfd_trace_lock);
+	}
+	tor_asprintf(&answer, "enabled=%d rings=%d records=%"PRIu64,
+		ewfd_trace_enabled ? 1 : 0, ring_num, rec_num);
+	return answer;
+}
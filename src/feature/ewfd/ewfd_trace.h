@@ -0,0 +1,69 @@
+#ifndef EWFD_TRACE_H_
+#define EWFD_TRACE_H_
+
+/*
+热路径上的二进制trace，替代EWFD_LOG的字符串log:
+- 每个线程一个定长环形缓冲区，只有本线程写入，不加锁
+- 记录是定长的 (时间戳, circ id, op, 2个参数)，写满后覆盖最旧的记录
+- SIGUSR1或者控制端口命令 DUMPEWFDTRACE 时dump到文件
+- GETINFO ewfd/trace 只返回当前的ring和记录数量，不写文件
+- 离线解码: scripts/ewfd/decode_ewfd_trace.py
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EWFD_TRACE_MAGIC "EWFDTRC1"
+#define EWFD_TRACE_VERSION 1
+#define EWFD_TRACE_RING_SIZE 8192 // 每个线程的记录数量，必须是2的幂
+
+/* 新增op只能追加到末尾，解码脚本按数值解析 */
+enum ewfd_trace_op {
+	EWFD_TRACE_NONE = 0,
+	EWFD_TRACE_SEND_CELL = 1, // a0: relay command
+	EWFD_TRACE_RECV_CELL = 2, // a0: relay command, a1: stream id
+	EWFD_TRACE_APPEND_CELL = 3, // a0: cell command, a1: queue len
+	EWFD_TRACE_EVENT_TICK = 4, // a0: cur_ti
+	EWFD_TRACE_EVENT_PROCESS = 5, // a0: event id | is_processed << 32, a1: insert_ti
+	EWFD_TRACE_EVENT_READD = 6, // a0: event id, a1: insert_ti
+	EWFD_TRACE_EVENT_OUTDATED = 7, // a0: event id, a1: insert_ti
+	EWFD_TRACE_CMUX_PICK_NONE = 8, // a0: cmux id
+	EWFD_TRACE_ADVANCE_DELAY = 9, // a0: delay state, a1: gap finish ti
+	EWFD_TRACE_DELAY_TRIGGER = 10, // a0: delay state, a1: remain real pkt
+	EWFD_TRACE_SEND_DUMMY = 11, // a0: dummy pkt sent by the delay item
+	EWFD_TRACE_SCHEDULE_TICK = 12, // a0: want ti (ms), a1: next tick (ms)
+	EWFD_TRACE_PADDING_TICK = 13, // a0: want ti (ms), a1: next tick (ms)
+	EWFD_TRACE_OP_NUM,
+};
+
+typedef struct ewfd_trace_rec_t {
+	uint64_t ts_us;
+	uint32_t circ_id;
+	uint16_t op;
+	uint16_t thread_idx;
+	uint64_t args[2];
+} ewfd_trace_rec_st;
+
+extern bool ewfd_trace_enabled;
+
+void ewfd_trace_init(void);
+/* 等所有线程退出ewfd_trace_record之后再释放ring
+* 其他线程之后的记录直接丢弃，直到再次ewfd_trace_init */
+void ewfd_trace_free(void);
+
+void ewfd_trace_record(uint16_t op, uint32_t circ_id, uint64_t a0, uint64_t a1);
+
+#define EWFD_TRACE(op, circ_id, a0, a1) \
+	do { \
+		if (ewfd_trace_enabled) \
+			ewfd_trace_record((op), (circ_id), (uint64_t) (a0), (uint64_t) (a1)); \
+	} while (0)
+
+/* 所有线程的记录按线程写到文件，返回写入的记录数，失败返回-1 */
+int ewfd_trace_dump(const char *fname);
+// dump到DataDirectory/ewfd-trace, 返回的文件名需要调用者释放
+char *ewfd_trace_dump_default(void);
+// GETINFO ewfd/trace: "enabled=<0|1> rings=<N> records=<N>", 需要调用者释放
+char *ewfd_trace_get_summary(void);
+
+#endif // EWFD_TRACE_H_
@@ -3,17 +3,24 @@
 #include "core/or/or.h"
 #include "feature/ewfd/circuit_padding.h"
 #include "feature/ewfd/debug.h"
+#include "feature/ewfd/ewfd_rt.h"
+#include "lib/cc/ctassert.h"
+#include "lib/container/smartlist.h"
 #include "lib/ebpf/ebpf_vm.h"
 #include "lib/ebpf/libebpf.h"
 #include "lib/ebpf/ewfd-defense/src/ewfd_api.h"
 #include "lib/log/util_bug.h"
 #include "lib/malloc/malloc.h"
+#include "lib/string/printf.h"
+#include "lib/time/compat_time.h"
 #include "feature/ewfd/ewfd_op.h"
+#include "feature/ewfd/ebpf_api.h"
 
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // extern int ebpf_exec(const struct ebpf_vm* vm, void* mem, size_t mem_len,
 // uint64_t* bpf_return_value);
@@ -26,51 +33,50 @@ dummy_packet:
 static long helper_ebpf_helper_log_print_id = 1;
 // helper for efwd
 static long helper_test_ewfd_add_dummy_packet_id = 6;
+static long helper_ewfd_get_event_num_id = 8;
+
+// 和bpf/headers/ewfd.h的布局一致, 见ewfd_register_ctx_handles
+CTASSERT(sizeof(ewfd_circ_status_st) == 56);
+CTASSERT(offsetof(ewfd_circ_status_st, ewfd_unit) == EWFD_CTX_UNIT_OFF);
+CTASSERT(offsetof(ewfd_circ_status_st, on_circ) == EWFD_CTX_CIRC_OFF);
+CTASSERT(offsetof(ewfd_circ_status_st, next_tick) == 52);
+
+ewfd_code_cache_stats_st ewfd_code_cache_stats;
+
+// cpuworker执行unit期间需要jit的code, job结束后在主线程编译
+static smartlist_t *ewfd_jit_pending_codes = NULL;
 
 static void add_ewfd_tor_helpers(struct ebpf_vm *vm);
-static uint64_t helper_ebpf_log_print(const char *fmt, uint32_t fmt_size, ...) __attribute__((format(printf, 1, 3)));
+static struct ebpf_vm *ewfd_code_get_vm(ewfd_code_st *code, size_t ctx_size, bool use_jit);
+static uint64_t helper_ebpf_log_print(const char *fmt, uint32_t fmt_size, ...);
 static uint64_t helper_ewfd_add_dummy_packet(uint64_t ptr, uint64_t tick);
+static uint64_t helper_ewfd_get_event_num(uint64_t ptr, uint64_t event_type);
 
 ewfd_unit_st *init_ewfd_unit(struct ewfd_padding_conf_t *conf) {
-	ewfd_unit_st *unit = ewfd_unit_new();
-	char *err_msg = NULL;
-	int res = 0;
-
-	add_ewfd_tor_helpers(unit->vm);
+	tor_assert(conf->main_code);
 
-#define EBPF_VM_ERR(res) \
-	if (res != 0) { \
-		EWFD_LOG("failed to load ewfd code: %s", err_msg); \
-		free(err_msg); \
-		return NULL; \
+	// 每个circ只创建自己的maps，vm从code cache中获取
+	struct ebpf_vm *main_vm = ewfd_code_get_vm(conf->main_code, sizeof(ewfd_circ_status_st), conf->use_jit);
+	if (main_vm == NULL) {
+		return NULL;
 	}
+	ewfd_unit_st *unit = ewfd_unit_new_shared(main_vm);
 
 	if (conf->init_code != NULL) {
-		res = ebpf_load(unit->vm, conf->init_code->code, conf->init_code->code_len,
-			&err_msg);
-		EBPF_VM_ERR(res);
-
-		if (conf->use_jit) {
-			ebpf_compile(unit->vm, &err_msg);
+		struct ebpf_vm *init_vm = ewfd_code_get_vm(conf->init_code, sizeof(uint64_t), conf->use_jit);
+		if (init_vm == NULL) {
+			free_ewfd_unit(unit);
+			return NULL;
 		}
-		
+
 		// init ewfd maps
 		uint64_t ret_val = 0;
-		res = ebpf_run_code(unit->vm, unit, sizeof(uint64_t), &ret_val);
-		EBPF_VM_ERR(res);
-
-		// load ewfd algorithm code
-		ebpf_unload_code(unit->vm);
-	}
-
-	tor_assert(conf->main_code);
-
-	res = ebpf_load(unit->vm, conf->main_code->code, conf->main_code->code_len,
-				&err_msg);
-	EBPF_VM_ERR(res);
-
-	if (conf->use_jit) {
-		ebpf_compile(unit->vm, &err_msg);
+		int res = ebpf_run_code(init_vm, unit, sizeof(uint64_t), &ret_val);
+		if (res != 0) {
+			EWFD_LOG("failed to run ewfd init code: %s", conf->init_code->name);
+			free_ewfd_unit(unit);
+			return NULL;
+		}
 	}
 
 	return unit;
@@ -91,25 +97,205 @@ uint64_t run_ewfd_unit(ewfd_unit_st *ewfd_unit, void *ewfd_ctx, size_t len) {
 	return ret_val;
 }
 
+void run_ewfd_unit_batch(struct ebpf_vm *vm, void **ewfd_ctxs, size_t len, uint64_t *ret_vals, size_t num) {
+	int res = ebpf_exec_batch(vm, ewfd_ctxs, len, ret_vals, num);
+	if (res != 0) {
+		EWFD_LOG("[ewfd-unit] Error: ebpf_exec_batch failed %d", res);
+	}
+}
+
+/* 创建vm并load code, 然后按照ctx_size做静态检查
+* elf为NULL时load code->code中的bytecode, 否则load elf中的section
+* 只修改code本身，可以在cpuworker线程中调用；失败时释放vm
+*/
+int ewfd_code_load(ewfd_code_st *code, const void *elf, size_t elf_len, const char *section, size_t ctx_size, char **err_msg) {
+	int res;
+
+	tor_assert(code->vm == NULL);
+	code->vm = ebpf_create();
+	ewfd_register_unit_helpers(code->vm);
+	add_ewfd_tor_helpers(code->vm);
+	ewfd_register_ctx_handles(code->vm, code->code_type == EWFD_CODE_TYPE_INIT);
+
+	if (elf != NULL) {
+		res = ebpf_load_elf_section(code->vm, elf, elf_len, section, err_msg);
+	} else {
+		res = ebpf_load(code->vm, code->code, code->code_len, err_msg);
+	}
+	if (res != 0) {
+		free_ewfd_code_vm(code);
+		return EWFD_CODE_LOAD_FAILED;
+	}
+
+	if (ebpf_verify(code->vm, ctx_size, code->verify_flags, err_msg) != 0) {
+		free_ewfd_code_vm(code);
+		return EWFD_CODE_VERIFY_FAILED;
+	}
+	return 0;
+}
+
+/* 第一次使用code时load (和jit)，之后所有unit共享同一个vm
+* helper通过ctx中的ewfd_unit找到每个circ的maps，vm本身没有per-circ状态
+* load之后按照ctx_size做静态检查，通过检查的code运行时不再做bounds check
+*/
+static struct ebpf_vm *ewfd_code_get_vm(ewfd_code_st *code, size_t ctx_size, bool use_jit) {
+	char *err_msg = NULL;
+	monotime_t start, end;
+
+	if (code->vm != NULL && (!use_jit || code->vm->jitted != NULL)) {
+		ewfd_code_cache_stats.cache_hit++;
+		return code->vm;
+	}
+
+	monotime_get(&start);
+	bool shared = code->vm != NULL;
+	if (!shared) {
+		ewfd_code_cache_stats.cache_miss++;
+		int res = ewfd_code_load(code, NULL, 0, NULL, ctx_size, &err_msg);
+		if (res == EWFD_CODE_LOAD_FAILED) {
+			EWFD_LOG("failed to load ewfd code %s: %s", code->name, err_msg);
+			free(err_msg);
+			return NULL;
+		} else if (res == EWFD_CODE_VERIFY_FAILED) {
+			log_warn(LD_GENERAL, "Rejecting EWFD program %s: %s", code->name, err_msg);
+			ewfd_code_cache_stats.verify_reject++;
+			free(err_msg);
+			return NULL;
+		}
+	} else {
+		ewfd_code_cache_stats.cache_hit++;
+	}
+
+	// 之前以解释方式加载过的code，需要jit时再编译
+	// worker可能正在解释执行同一个vm，推迟到job结束，在此之前以解释方式执行
+	if (use_jit && shared && ewfd_rt_job_in_flight()) {
+		if (ewfd_jit_pending_codes == NULL) {
+			ewfd_jit_pending_codes = smartlist_new();
+		}
+		if (!smartlist_contains(ewfd_jit_pending_codes, code)) {
+			smartlist_add(ewfd_jit_pending_codes, code);
+		}
+	} else if (use_jit) {
+		if (ebpf_compile(code->vm, &err_msg) == NULL) {
+			EWFD_LOG("failed to jit ewfd code %s: %s", code->name, err_msg);
+			free(err_msg);
+		} else {
+			ewfd_code_cache_stats.compile_num++;
+		}
+	}
+	monotime_get(&end);
+	ewfd_code_cache_stats.compile_usec += monotime_diff_usec(&start, &end);
+
+	return code->vm;
+}
+
+void ewfd_code_compile_pending(void) {
+	char *err_msg = NULL;
+
+	if (ewfd_jit_pending_codes == NULL) {
+		return;
+	}
+	SMARTLIST_FOREACH_BEGIN(ewfd_jit_pending_codes, ewfd_code_st *, code) {
+		if (ebpf_compile(code->vm, &err_msg) == NULL) {
+			EWFD_LOG("failed to jit ewfd code %s: %s", code->name, err_msg);
+			free(err_msg);
+			err_msg = NULL;
+		} else {
+			ewfd_code_cache_stats.compile_num++;
+		}
+	} SMARTLIST_FOREACH_END(code);
+	smartlist_free(ewfd_jit_pending_codes);
+	ewfd_jit_pending_codes = NULL;
+}
+
+void free_ewfd_code_vm(ewfd_code_st *code) {
+	if (ewfd_jit_pending_codes != NULL) {
+		smartlist_remove(ewfd_jit_pending_codes, code);
+		if (smartlist_len(ewfd_jit_pending_codes) == 0) {
+			smartlist_free(ewfd_jit_pending_codes);
+			ewfd_jit_pending_codes = NULL;
+		}
+	}
+	if (code->vm != NULL) {
+		ebpf_destroy(code->vm);
+		code->vm = NULL;
+	}
+}
+
 static void add_ewfd_tor_helpers(struct ebpf_vm *vm) {
+	static const uint8_t log_print_args[] = {EBPF_ARG_PTR_TO_MEM, EBPF_ARG_SCALAR};
+	static const uint8_t circ_args[] = {EBPF_ARG_HANDLE_OF(EWFD_HANDLE_CIRC), EBPF_ARG_SCALAR};
+
 	ebpf_register(vm, helper_ebpf_helper_log_print_id, "ebpf_log_print",  helper_ebpf_log_print);
 	ebpf_register(vm, helper_test_ewfd_add_dummy_packet_id, "ewfd_add_dummy_packet", helper_ewfd_add_dummy_packet);
+	ebpf_register(vm, helper_ewfd_get_event_num_id, "ewfd_get_event_num", helper_ewfd_get_event_num);
+	// 程序传入的circ只能是ctx中的on_circ
+	ebpf_register_args(vm, helper_ebpf_helper_log_print_id, log_print_args, sizeof(log_print_args));
+	ebpf_register_args(vm, helper_test_ewfd_add_dummy_packet_id, circ_args, sizeof(circ_args));
+	ebpf_register_args(vm, helper_ewfd_get_event_num_id, circ_args, sizeof(circ_args));
 }
 
 static uint64_t helper_ewfd_add_dummy_packet(uint64_t ptr, uint64_t tick) {
 	return ewfd_add_dummy_packet((uintptr_t) ptr, (uint32_t) tick);
 }
 
+// event_type >= EWFD_EVENT_TYPE_NUM 时返回全部event数量
+static uint64_t helper_ewfd_get_event_num(uint64_t ptr, uint64_t event_type) {
+	if (event_type >= EWFD_EVENT_TYPE_NUM) {
+		return ewfd_get_event_num((uintptr_t) ptr);
+	}
+	return ewfd_get_event_num_by_type((uintptr_t) ptr, (int) event_type);
+}
+
+
+/* fmt在程序的栈或ctx中，verifier只保证前fmt_size个字节可读
+* 拷贝后截断，只接受整数的转换，并且最多3个（r3-r5），%s/%n等会解引用参数的格式直接丢弃
+*/
+#define EBPF_LOG_MAX_ARGS 3
+
+static bool ebpf_log_fmt_is_safe(const char *fmt) {
+	int num_args = 0;
+	for (const char *p = fmt; *p; p++) {
+		if (*p != '%') {
+			continue;
+		}
+		p++;
+		if (*p == '%') {
+			continue;
+		}
+		p += strspn(p, "-+ #.0123456789");
+		p += strspn(p, "hl");
+		if (*p == '\0' || strchr("diuxXc", *p) == NULL || ++num_args > EBPF_LOG_MAX_ARGS) {
+			return false;
+		}
+	}
+	return true;
+}
 
+// fmt不是字面量也没有结尾的0, 不能加format属性
+DISABLE_GCC_WARNING("-Wsuggest-attribute=format")
 static uint64_t helper_ebpf_log_print(const char *fmt, uint32_t fmt_size, ...) {
-	char my_log[128] = {0};
-	
+	char my_fmt[128];
+	char my_log[128];
+
+	if (fmt_size == 0) {
+		return 0;
+	}
+	fmt_size = MIN(fmt_size, sizeof(my_fmt) - 1);
+	memcpy(my_fmt, fmt, fmt_size);
+	my_fmt[fmt_size] = '\0';
+	if (!ebpf_log_fmt_is_safe(my_fmt)) {
+		EWFD_LOG("[ebpf] rejected log format");
+		return (uint64_t) -1;
+	}
+
 	va_list args;
-	va_start(args, fmt);
-	vsprintf(my_log, fmt, args);
+	va_start(args, fmt_size);
+	tor_vsnprintf(my_log, sizeof(my_log), my_fmt, args);
 	va_end(args);
 
 	EWFD_LOG("[ebpf] %s", my_log);
 	
 	return 0;
-}
\ No newline at end of file
+}
+ENABLE_GCC_WARNING("-Wsuggest-attribute=format")
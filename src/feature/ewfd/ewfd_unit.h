@@ -12,22 +12,49 @@ enum EWFD_CODE_TYPE {
 
 #define MAX_EBPF_CODE 2048
 
+struct ebpf_vm;
+
 /*
-TODO: code cache
+code cache: 每份code只load/jit一次，vm在所有circ的unit之间共享
+每个circ只创建自己的maps (ewfd_unit_st)
 */
 typedef struct ewfd_code_t {
 	int code_type;
 	int code_len;
 	char name[32];
+	struct ebpf_vm *vm; // 已加载的vm, 第一次使用时创建
+	uint32_t verify_flags; // 传给ebpf_verify, 只有内置的code可以有循环
 	uint64_t code[MAX_EBPF_CODE];
 } ewfd_code_st;
 
+typedef struct ewfd_code_cache_stats_t {
+	uint64_t cache_hit; // 直接复用已加载的vm
+	uint64_t cache_miss; // 第一次load code
+	uint64_t compile_num; // jit次数
+	uint64_t compile_usec; // load + jit 总耗时
+	uint64_t verify_reject; // 没有通过verifier的code
+} ewfd_code_cache_stats_st;
+
+extern ewfd_code_cache_stats_st ewfd_code_cache_stats;
+
 struct ewfd_unit_t;
 struct ewfd_padding_conf_t;
 
+enum {
+	EWFD_CODE_LOAD_FAILED = -1,
+	EWFD_CODE_VERIFY_FAILED = -2,
+};
+
+int ewfd_code_load(ewfd_code_st *code, const void *elf, size_t elf_len, const char *section, size_t ctx_size, char **err_msg);
+void free_ewfd_code_vm(ewfd_code_st *code);
+// 编译cpuworker执行期间推迟的jit, job结束后在主线程调用
+void ewfd_code_compile_pending(void);
+
 struct ewfd_unit_t *init_ewfd_unit(struct ewfd_padding_conf_t *conf);
 // bool ewfd_unit_set_code(ewfd_code_st *ewfd_code);
 void free_ewfd_unit(struct ewfd_unit_t *ewfd_unit);
 uint64_t run_ewfd_unit(struct ewfd_unit_t *ewfd_unit, void *ewfd_ctx, size_t len);
+// 共享同一个vm的多个ctx一次执行，失败的ctx返回0
+void run_ewfd_unit_batch(struct ebpf_vm *vm, void **ewfd_ctxs, size_t len, uint64_t *ret_vals, size_t num);
 
 #endif // ewfd_unit_H_
@@ -0,0 +1,211 @@
+#include "feature/ewfd/ewfd_wheel.h"
+#include "lib/log/util_bug.h"
+
+/* 第lvl层一个slot覆盖的时间 64^lvl ms */
+#define WHEEL_LEVEL_SHIFT(lvl) (EWFD_WHEEL_BITS * (lvl))
+#define WHEEL_MAX_DELTA (1ULL << WHEEL_LEVEL_SHIFT(EWFD_WHEEL_LEVELS))
+
+static inline int wheel_slot_of(uint64_t ti, int lvl) {
+	return (int) ((ti >> WHEEL_LEVEL_SHIFT(lvl)) & EWFD_WHEEL_MASK);
+}
+
+void ewfd_wheel_init(ewfd_wheel_st *wheel, uint64_t start_ti) {
+	wheel->cur_ti = start_ti;
+	wheel->node_num = 0;
+	for (int lvl = 0; lvl < EWFD_WHEEL_LEVELS; lvl++) {
+		wheel->pending[lvl] = 0;
+		for (int slot = 0; slot < EWFD_WHEEL_SLOTS; slot++) {
+			TOR_TAILQ_INIT(&wheel->slots[lvl][slot]);
+		}
+	}
+	TOR_TAILQ_INIT(&wheel->expired);
+}
+
+/* 按距离cur_ti的时间选择层，slot按照绝对时间计算，这样cascade时不用重新计算偏移
+*/
+static void wheel_place(ewfd_wheel_st *wheel, ewfd_wheel_node_st *node) {
+	struct ewfd_wheel_list_t *list;
+
+	if (node->expire_ti < wheel->cur_ti) {
+		list = &wheel->expired;
+	} else {
+		uint64_t delta = node->expire_ti - wheel->cur_ti;
+		uint64_t expire_ti = node->expire_ti;
+		int lvl = 0;
+
+		if (delta >= WHEEL_MAX_DELTA) {
+			// 超出轮的范围，先放在最高层，cascade时再重新放置
+			expire_ti = wheel->cur_ti + WHEEL_MAX_DELTA - 1;
+			lvl = EWFD_WHEEL_LEVELS - 1;
+		} else {
+			while ((delta >> WHEEL_LEVEL_SHIFT(lvl + 1)) != 0) {
+				lvl++;
+			}
+		}
+
+		int slot = wheel_slot_of(expire_ti, lvl);
+		list = &wheel->slots[lvl][slot];
+		wheel->pending[lvl] |= (1ULL << slot);
+	}
+
+	TOR_TAILQ_INSERT_TAIL(list, node, next);
+	node->pending = list;
+}
+
+void ewfd_wheel_add(ewfd_wheel_st *wheel, ewfd_wheel_node_st *node, uint64_t expire_ti) {
+	tor_assert(node->pending == NULL);
+	node->expire_ti = expire_ti;
+	wheel_place(wheel, node);
+	wheel->node_num++;
+}
+
+void ewfd_wheel_del(ewfd_wheel_st *wheel, ewfd_wheel_node_st *node) {
+	struct ewfd_wheel_list_t *list = node->pending;
+	if (list == NULL) {
+		return;
+	}
+
+	TOR_TAILQ_REMOVE(list, node, next);
+	node->pending = NULL;
+	wheel->node_num--;
+
+	if (list != &wheel->expired && TOR_TAILQ_EMPTY(list)) {
+		ptrdiff_t idx = list - &wheel->slots[0][0];
+		int lvl = (int) (idx / EWFD_WHEEL_SLOTS);
+		int slot = (int) (idx % EWFD_WHEEL_SLOTS);
+		wheel->pending[lvl] &= ~(1ULL << slot);
+	}
+}
+
+static void wheel_clear_list(struct ewfd_wheel_list_t *list) {
+	ewfd_wheel_node_st *node;
+	while ((node = TOR_TAILQ_FIRST(list)) != NULL) {
+		TOR_TAILQ_REMOVE(list, node, next);
+		node->pending = NULL;
+	}
+}
+
+void ewfd_wheel_clear(ewfd_wheel_st *wheel) {
+	for (int lvl = 0; lvl < EWFD_WHEEL_LEVELS; lvl++) {
+		for (int slot = 0; slot < EWFD_WHEEL_SLOTS; slot++) {
+			wheel_clear_list(&wheel->slots[lvl][slot]);
+		}
+		wheel->pending[lvl] = 0;
+	}
+	wheel_clear_list(&wheel->expired);
+	wheel->node_num = 0;
+}
+
+/* 把整个slot搬走，重新放置到低层或者expired链表
+*/
+static void wheel_move_slot(ewfd_wheel_st *wheel, int lvl, int slot) {
+	struct ewfd_wheel_list_t todo;
+	ewfd_wheel_node_st *node;
+
+	// 先摘下整个slot, 超出范围的节点可能会被放回同一个slot
+	TOR_TAILQ_INIT(&todo);
+	while ((node = TOR_TAILQ_FIRST(&wheel->slots[lvl][slot])) != NULL) {
+		TOR_TAILQ_REMOVE(&wheel->slots[lvl][slot], node, next);
+		TOR_TAILQ_INSERT_TAIL(&todo, node, next);
+	}
+	wheel->pending[lvl] &= ~(1ULL << slot);
+
+	while ((node = TOR_TAILQ_FIRST(&todo)) != NULL) {
+		TOR_TAILQ_REMOVE(&todo, node, next);
+		wheel_place(wheel, node);
+	}
+}
+
+/* cur_ti 到达第lvl层的边界时，把该层对应的slot展开到下层
+*/
+static void wheel_cascade(ewfd_wheel_st *wheel) {
+	uint64_t ti = wheel->cur_ti;
+	for (int lvl = EWFD_WHEEL_LEVELS - 1; lvl > 0; lvl--) {
+		if ((ti & ((1ULL << WHEEL_LEVEL_SHIFT(lvl)) - 1)) != 0) {
+			continue;
+		}
+		int slot = wheel_slot_of(ti, lvl);
+		if (wheel->pending[lvl] & (1ULL << slot)) {
+			wheel_move_slot(wheel, lvl, slot);
+		}
+	}
+}
+
+void ewfd_wheel_update(ewfd_wheel_st *wheel, uint64_t now_ti) {
+	while (wheel->cur_ti <= now_ti) {
+		wheel_cascade(wheel);
+
+		// 跳过连续为空的低层: 低k层都空时，直接跳到第k层的下一个边界
+		int lvl = 0;
+		while (lvl < EWFD_WHEEL_LEVELS && wheel->pending[lvl] == 0) {
+			lvl++;
+		}
+		if (lvl == EWFD_WHEEL_LEVELS) { // 轮上没有节点
+			wheel->cur_ti = now_ti + 1;
+			break;
+		}
+		if (lvl > 0) {
+			uint64_t mask = (1ULL << WHEEL_LEVEL_SHIFT(lvl)) - 1;
+			uint64_t next_ti = (wheel->cur_ti | mask) + 1;
+			wheel->cur_ti = next_ti < now_ti + 1 ? next_ti : now_ti + 1;
+			continue;
+		}
+
+		int slot = wheel_slot_of(wheel->cur_ti, 0);
+		if (wheel->pending[0] & (1ULL << slot)) {
+			// level-0 的slot到期，cur_ti加一之后这些节点会被放到expired
+			wheel->cur_ti++;
+			wheel_move_slot(wheel, 0, slot);
+		} else {
+			wheel->cur_ti++;
+		}
+	}
+}
+
+uint64_t ewfd_wheel_next_expire(const ewfd_wheel_st *wheel) {
+	if (!TOR_TAILQ_EMPTY(&wheel->expired)) {
+		return wheel->cur_ti > 0 ? wheel->cur_ti - 1 : 0;
+	}
+
+	uint64_t next_ti = UINT64_MAX;
+	for (int lvl = 0; lvl < EWFD_WHEEL_LEVELS; lvl++) {
+		uint64_t pending = wheel->pending[lvl];
+		if (pending == 0) {
+			continue;
+		}
+		int shift = WHEEL_LEVEL_SHIFT(lvl);
+		int pos = wheel_slot_of(wheel->cur_ti, lvl);
+		// 从当前slot开始，找到第一个非空的slot
+		int k = 0;
+		while (k < EWFD_WHEEL_SLOTS && !(pending & (1ULL << ((pos + k) & EWFD_WHEEL_MASK)))) {
+			k++;
+		}
+
+		uint64_t slot_ti;
+		if (lvl == 0) {
+			slot_ti = wheel->cur_ti + k;
+		} else if (k == 0 && (wheel->cur_ti & ((1ULL << shift) - 1)) == 0) {
+			// 当前slot还没有cascade
+			slot_ti = wheel->cur_ti;
+		} else {
+			if (k == 0) {
+				k = EWFD_WHEEL_SLOTS;
+			}
+			slot_ti = ((wheel->cur_ti >> shift) + k) << shift;
+		}
+		if (slot_ti < next_ti) {
+			next_ti = slot_ti;
+		}
+	}
+	return next_ti;
+}
+
+ewfd_wheel_node_st *ewfd_wheel_get_expired(ewfd_wheel_st *wheel) {
+	ewfd_wheel_node_st *node = TOR_TAILQ_FIRST(&wheel->expired);
+	if (node != NULL) {
+		TOR_TAILQ_REMOVE(&wheel->expired, node, next);
+		node->pending = NULL;
+		wheel->node_num--;
+	}
+	return node;
+}
@@ -0,0 +1,59 @@
+#ifndef EWFD_WHEEL_H_
+#define EWFD_WHEEL_H_
+
+/*
+分层时间轮 (hierarchical timing wheel)，用于ewfd全局事件队列
+- 插入/删除 O(1)，按ms粒度推进
+- level-0 每个slot 1ms，level-n 每个slot 64^n ms，共覆盖 2^30 ms
+- 到期的节点按时间顺序挂到expired链表，由调用方逐个取出
+*/
+
+#include "ext/tor_queue.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EWFD_WHEEL_BITS 6
+#define EWFD_WHEEL_SLOTS (1 << EWFD_WHEEL_BITS)
+#define EWFD_WHEEL_MASK (EWFD_WHEEL_SLOTS - 1)
+#define EWFD_WHEEL_LEVELS 5
+
+/* 嵌入到需要定时的结构体里面，用SUBTYPE_P取回外层结构 */
+typedef struct ewfd_wheel_node_t {
+	TOR_TAILQ_ENTRY(ewfd_wheel_node_t) next;
+	struct ewfd_wheel_list_t *pending; // 所在的slot或者expired链表，NULL表示不在轮上
+	uint64_t expire_ti;
+} ewfd_wheel_node_st;
+
+TOR_TAILQ_HEAD(ewfd_wheel_list_t, ewfd_wheel_node_t);
+
+typedef struct ewfd_wheel_t {
+	uint64_t cur_ti; // 下一个要处理的ms，之前的slot都已经到期
+	uint32_t node_num; // slot + expired 中的节点总数
+	uint64_t pending[EWFD_WHEEL_LEVELS]; // 每层非空slot的bitmap
+	struct ewfd_wheel_list_t slots[EWFD_WHEEL_LEVELS][EWFD_WHEEL_SLOTS];
+	struct ewfd_wheel_list_t expired;
+} ewfd_wheel_st;
+
+void ewfd_wheel_init(ewfd_wheel_st *wheel, uint64_t start_ti);
+
+/* expire_ti < cur_ti 的节点直接放到expired链表 */
+void ewfd_wheel_add(ewfd_wheel_st *wheel, ewfd_wheel_node_st *node, uint64_t expire_ti);
+void ewfd_wheel_del(ewfd_wheel_st *wheel, ewfd_wheel_node_st *node);
+/* 摘下所有节点，不释放节点内存 */
+void ewfd_wheel_clear(ewfd_wheel_st *wheel);
+
+/* 推进到now_ti，(cur_ti, now_ti] 内到期的节点移到expired链表 */
+void ewfd_wheel_update(ewfd_wheel_st *wheel, uint64_t now_ti);
+ewfd_wheel_node_st *ewfd_wheel_get_expired(ewfd_wheel_st *wheel);
+
+/* 下一次需要调用update的时间 (不晚于最早节点的到期时间)，轮为空时返回UINT64_MAX
+* 高层的节点返回cascade的时间，到时再推进一次即可
+*/
+uint64_t ewfd_wheel_next_expire(const ewfd_wheel_st *wheel);
+
+static inline bool ewfd_wheel_node_pending(const ewfd_wheel_node_st *node) {
+	return node->pending != NULL;
+}
+
+#endif // EWFD_WHEEL_H_
@@ -11,6 +11,7 @@
 #include "orconfig.h"
 
 #include "core/or/or.h"
+#include "core/or/cell_pool.h"
 #include "core/or/relay.h"
 
 #include "lib/malloc/malloc.h"
@@ -20,6 +21,10 @@
 
 #include "feature/relay/relay_metrics.h"
 #include "feature/stats/rephist.h"
+#include "feature/ewfd/ewfd.h"
+#include "feature/ewfd/ewfd_ticker.h"
+#include "feature/ewfd/circuit_padding.h"
+#include "lib/ebpf/libebpf.h"
 
 #include <event2/dns.h>
 
@@ -31,6 +36,17 @@ static void fill_socket_values(void);
 static void fill_onionskins_values(void);
 static void fill_oom_values(void);
 static void fill_tcp_exhaustion_values(void);
+static void fill_ewfd_timer_values(void);
+static void fill_ewfd_tick_values(void);
+static void fill_ewfd_event_values(void);
+static void fill_ewfd_event_type_values(void);
+static void fill_ewfd_cell_values(void);
+static void fill_ewfd_overhead_values(void);
+static void fill_ewfd_exec_time_values(void);
+static void fill_ewfd_active_unit_values(void);
+static void fill_ewfd_jit_bytes_values(void);
+static void fill_cell_pool_object_values(void);
+static void fill_cell_pool_byte_values(void);
 
 /** The base metrics that is a static array of metrics added to the metrics
  * store.
@@ -87,6 +103,83 @@ static const relay_metrics_entry_t base_metrics[] =
     .help = "Total number of times we ran out of TCP ports",
     .fill_fn = fill_tcp_exhaustion_values,
   },
+  {
+    .key = RELAY_METRICS_NUM_EWFD_TIMERS,
+    .type = METRICS_TYPE_COUNTER,
+    .name = METRICS_NAME(relay_ewfd_timer_total),
+    .help = "Total number of EWFD unit tickers allocated and released",
+    .fill_fn = fill_ewfd_timer_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_EWFD_TICKS,
+    .type = METRICS_TYPE_COUNTER,
+    .name = METRICS_NAME(relay_ewfd_tick_total),
+    .help = "Total number of EWFD tick driver wakeups and units run",
+    .fill_fn = fill_ewfd_tick_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_EWFD_EVENTS,
+    .type = METRICS_TYPE_COUNTER,
+    .name = METRICS_NAME(relay_ewfd_event_total),
+    .help = "Total number of EWFD framework events by outcome",
+    .fill_fn = fill_ewfd_event_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_EWFD_EVENT_TYPES,
+    .type = METRICS_TYPE_COUNTER,
+    .name = METRICS_NAME(relay_ewfd_event_type_total),
+    .help = "Total number of EWFD framework events by type and outcome",
+    .fill_fn = fill_ewfd_event_type_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_EWFD_CELLS,
+    .type = METRICS_TYPE_COUNTER,
+    .name = METRICS_NAME(relay_ewfd_cell_total),
+    .help = "Total number of cells sent on circuits with an EWFD unit",
+    .fill_fn = fill_ewfd_cell_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_EWFD_OVERHEAD,
+    .type = METRICS_TYPE_GAUGE,
+    .name = METRICS_NAME(relay_ewfd_overhead_permille),
+    .help = "Dummy cells per thousand real cells sent by EWFD unit",
+    .fill_fn = fill_ewfd_overhead_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_EWFD_EXEC_TIME,
+    .type = METRICS_TYPE_COUNTER,
+    .name = METRICS_NAME(relay_ewfd_unit_exec_usec),
+    .help = "Execution time of the EWFD units in microseconds",
+    .fill_fn = fill_ewfd_exec_time_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_EWFD_ACTIVE_UNITS,
+    .type = METRICS_TYPE_GAUGE,
+    .name = METRICS_NAME(relay_ewfd_active_units),
+    .help = "Number of EWFD units attached to circuits",
+    .fill_fn = fill_ewfd_active_unit_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_EWFD_JIT_BYTES,
+    .type = METRICS_TYPE_GAUGE,
+    .name = METRICS_NAME(relay_ewfd_jit_bytes),
+    .help = "Bytes of executable memory mapped and used by the EWFD JIT",
+    .fill_fn = fill_ewfd_jit_bytes_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_CELL_POOL_OBJECTS,
+    .type = METRICS_TYPE_GAUGE,
+    .name = METRICS_NAME(relay_load_cell_pool_objects),
+    .help = "Number of cells in use and free in the cell pools",
+    .fill_fn = fill_cell_pool_object_values,
+  },
+  {
+    .key = RELAY_METRICS_NUM_CELL_POOL_BYTES,
+    .type = METRICS_TYPE_GAUGE,
+    .name = METRICS_NAME(relay_load_cell_pool_bytes),
+    .help = "Bytes held by the cell pools, and by their empty slabs",
+    .fill_fn = fill_cell_pool_byte_values,
+  },
 };
 static const size_t num_base_metrics = ARRAY_LENGTH(base_metrics);
 
@@ -126,6 +219,349 @@ fill_tcp_exhaustion_values(void)
   metrics_store_entry_update(sentry, rep_hist_get_n_tcp_exhaustion());
 }
 
+/** Fill function for the RELAY_METRICS_NUM_EWFD_TIMERS metrics. */
+static void
+fill_ewfd_timer_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_EWFD_TIMERS];
+
+  sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                             rentry->help);
+  metrics_store_entry_add_label(sentry,
+                                metrics_format_label("state", "allocated"));
+  metrics_store_entry_update(sentry, total_ewfd_timer);
+
+  sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                             rentry->help);
+  metrics_store_entry_add_label(sentry,
+                                metrics_format_label("state", "released"));
+  metrics_store_entry_update(sentry, released_ewfd_timer);
+}
+
+/** Fill function for the RELAY_METRICS_NUM_EWFD_TICKS metrics. */
+static void
+fill_ewfd_tick_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_EWFD_TICKS];
+
+  sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                             rentry->help);
+  metrics_store_entry_add_label(sentry,
+                                metrics_format_label("kind", "wakeup"));
+  metrics_store_entry_update(sentry, ewfd_tick_wakeups);
+
+  sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                             rentry->help);
+  metrics_store_entry_add_label(sentry,
+                                metrics_format_label("kind", "unit"));
+  metrics_store_entry_update(sentry, ewfd_tick_units);
+}
+
+/** Fill function for the RELAY_METRICS_NUM_EWFD_EVENTS metrics. */
+static void
+fill_ewfd_event_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_EWFD_EVENTS];
+  const struct {
+    const char *name;
+    uint64_t value;
+  } outcomes[] = {
+    { "processed", ewfd_event_queue_stats.processed },
+    { "late", ewfd_event_queue_stats.late },
+    { "dropped", ewfd_event_queue_stats.dropped },
+    { "budget_exhausted", ewfd_event_queue_stats.budget_exhausted },
+  };
+
+  for (size_t i = 0; i < ARRAY_LENGTH(outcomes); i++) {
+    sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry,
+                          metrics_format_label("outcome", outcomes[i].name));
+    metrics_store_entry_update(sentry, outcomes[i].value);
+  }
+}
+
+/** Return a newly allocated "unit" label for the EWFD unit <b>uuid</b>. */
+static char *
+ewfd_unit_label(int uuid)
+{
+  char buf[8];
+  tor_snprintf(buf, sizeof(buf), "%d", uuid);
+  return tor_strdup(metrics_format_label("unit", buf));
+}
+
+/** Return true iff the EWFD unit <b>uuid</b> has ever been used. */
+static bool
+ewfd_unit_is_used(int uuid)
+{
+  const ewfd_unit_stats_st *stats = &ewfd_unit_stats[uuid];
+  return stats->active_units != 0 || stats->exec_num != 0 ||
+         stats->real_cells != 0 || stats->dummy_cells != 0;
+}
+
+/** Fill function for the RELAY_METRICS_NUM_EWFD_EVENT_TYPES metrics. */
+static void
+fill_ewfd_event_type_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_EWFD_EVENT_TYPES];
+  static const char *types[EWFD_EVENT_TYPE_NUM] = {
+    [EWFD_EVENT_TYPE_DUMMY] = "dummy",
+    [EWFD_EVENT_TYPE_DELAY] = "delay",
+    [EWFD_EVENT_TYPE_NOTIFY] = "notify",
+  };
+
+  for (int t = 0; t < EWFD_EVENT_TYPE_NUM; t++) {
+    const struct {
+      const char *name;
+      uint64_t value;
+    } outcomes[] = {
+      { "queued", ewfd_event_queue_stats.type_queued[t] },
+      { "expired", ewfd_event_queue_stats.type_expired[t] },
+      { "dropped", ewfd_event_queue_stats.type_dropped[t] },
+    };
+    char *type_label = tor_strdup(metrics_format_label("type", types[t]));
+    for (size_t i = 0; i < ARRAY_LENGTH(outcomes); i++) {
+      sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                                 rentry->help);
+      metrics_store_entry_add_label(sentry, type_label);
+      metrics_store_entry_add_label(sentry,
+                          metrics_format_label("outcome", outcomes[i].name));
+      metrics_store_entry_update(sentry, outcomes[i].value);
+    }
+    tor_free(type_label);
+  }
+}
+
+/** Fill function for the RELAY_METRICS_NUM_EWFD_CELLS metrics. */
+static void
+fill_ewfd_cell_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_EWFD_CELLS];
+
+  for (int uuid = 0; uuid < EWFD_MAX_UNIT_UUID; uuid++) {
+    if (!ewfd_unit_is_used(uuid)) {
+      continue;
+    }
+    char *unit_label = ewfd_unit_label(uuid);
+    sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry, unit_label);
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("kind", "real"));
+    metrics_store_entry_update(sentry, ewfd_unit_stats[uuid].real_cells);
+
+    sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry, unit_label);
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("kind", "dummy"));
+    metrics_store_entry_update(sentry, ewfd_unit_stats[uuid].dummy_cells);
+    tor_free(unit_label);
+  }
+}
+
+/** Fill function for the RELAY_METRICS_NUM_EWFD_OVERHEAD metrics. The store
+ * only holds integers so the ratio is reported in permille. */
+static void
+fill_ewfd_overhead_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_EWFD_OVERHEAD];
+
+  for (int uuid = 0; uuid < EWFD_MAX_UNIT_UUID; uuid++) {
+    const ewfd_unit_stats_st *stats = &ewfd_unit_stats[uuid];
+    if (!ewfd_unit_is_used(uuid)) {
+      continue;
+    }
+    char *unit_label = ewfd_unit_label(uuid);
+    sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry, unit_label);
+    metrics_store_entry_update(sentry, stats->real_cells ?
+                        (int64_t) (stats->dummy_cells * 1000 /
+                                   stats->real_cells) : 0);
+    tor_free(unit_label);
+  }
+}
+
+/** Fill function for the RELAY_METRICS_NUM_EWFD_EXEC_TIME metrics.
+ *
+ * The metrics store has no histogram type, so this is laid out the way
+ * Prometheus lays out histograms: cumulative _bucket counters with an "le"
+ * label, plus _sum and _count. */
+static void
+fill_ewfd_exec_time_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_EWFD_EXEC_TIME];
+  char *bucket_name = NULL, *sum_name = NULL, *count_name = NULL;
+
+  tor_asprintf(&bucket_name, "%s_bucket", rentry->name);
+  tor_asprintf(&sum_name, "%s_sum", rentry->name);
+  tor_asprintf(&count_name, "%s_count", rentry->name);
+
+  for (int uuid = 0; uuid < EWFD_MAX_UNIT_UUID; uuid++) {
+    const ewfd_unit_stats_st *stats = &ewfd_unit_stats[uuid];
+    if (stats->exec_num == 0) {
+      continue;
+    }
+    char *unit_label = ewfd_unit_label(uuid);
+    uint64_t cumulative = 0;
+    for (int b = 0; b < EWFD_EXEC_HIST_BUCKETS; b++) {
+      char le[16];
+      if (b < EWFD_EXEC_HIST_BUCKETS - 1) {
+        tor_snprintf(le, sizeof(le), "%u", ewfd_exec_hist_bounds_usec[b]);
+      } else {
+        strlcpy(le, "+Inf", sizeof(le));
+      }
+      cumulative += stats->exec_hist[b];
+      sentry = metrics_store_add(the_store, rentry->type, bucket_name,
+                                 rentry->help);
+      metrics_store_entry_add_label(sentry, unit_label);
+      metrics_store_entry_add_label(sentry, metrics_format_label("le", le));
+      metrics_store_entry_update(sentry, cumulative);
+    }
+
+    sentry = metrics_store_add(the_store, rentry->type, sum_name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry, unit_label);
+    metrics_store_entry_update(sentry, stats->exec_nsec / 1000);
+
+    sentry = metrics_store_add(the_store, rentry->type, count_name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry, unit_label);
+    metrics_store_entry_update(sentry, stats->exec_num);
+    tor_free(unit_label);
+  }
+
+  tor_free(bucket_name);
+  tor_free(sum_name);
+  tor_free(count_name);
+}
+
+/** Fill function for the RELAY_METRICS_NUM_EWFD_ACTIVE_UNITS metrics. */
+static void
+fill_ewfd_active_unit_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_EWFD_ACTIVE_UNITS];
+
+  for (int uuid = 0; uuid < EWFD_MAX_UNIT_UUID; uuid++) {
+    if (!ewfd_unit_is_used(uuid)) {
+      continue;
+    }
+    char *unit_label = ewfd_unit_label(uuid);
+    sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry, unit_label);
+    metrics_store_entry_update(sentry, ewfd_unit_stats[uuid].active_units);
+    tor_free(unit_label);
+  }
+}
+
+/** Fill function for the RELAY_METRICS_NUM_EWFD_JIT_BYTES metrics. */
+static void
+fill_ewfd_jit_bytes_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_EWFD_JIT_BYTES];
+  struct ebpf_jit_arena_stats stats;
+
+  ebpf_jit_arena_get_stats(&stats);
+
+  sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                             rentry->help);
+  metrics_store_entry_add_label(sentry,
+                                metrics_format_label("kind", "mapped"));
+  metrics_store_entry_update(sentry, stats.bytes_mapped);
+
+  sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                             rentry->help);
+  metrics_store_entry_add_label(sentry,
+                                metrics_format_label("kind", "used"));
+  metrics_store_entry_update(sentry, stats.bytes_used);
+}
+
+/** Fill function for the RELAY_METRICS_NUM_CELL_POOL_OBJECTS metrics. */
+static void
+fill_cell_pool_object_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_CELL_POOL_OBJECTS];
+  cell_pool_stats_t stats[2];
+  const char *pools[2] = { "packed_cell", "var_cell" };
+
+  cell_pools_get_stats(&stats[0], &stats[1]);
+
+  for (size_t i = 0; i < ARRAY_LENGTH(pools); i++) {
+    sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("pool", pools[i]));
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("state", "used"));
+    metrics_store_entry_update(sentry, stats[i].n_used);
+
+    sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("pool", pools[i]));
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("state", "free"));
+    metrics_store_entry_update(sentry, stats[i].n_free);
+  }
+}
+
+/** Fill function for the RELAY_METRICS_NUM_CELL_POOL_BYTES metrics. */
+static void
+fill_cell_pool_byte_values(void)
+{
+  metrics_store_entry_t *sentry;
+  const relay_metrics_entry_t *rentry =
+    &base_metrics[RELAY_METRICS_NUM_CELL_POOL_BYTES];
+  cell_pool_stats_t stats[2];
+  const char *pools[2] = { "packed_cell", "var_cell" };
+
+  cell_pools_get_stats(&stats[0], &stats[1]);
+
+  for (size_t i = 0; i < ARRAY_LENGTH(pools); i++) {
+    size_t slab_bytes = stats[i].n_slabs ?
+      stats[i].bytes_allocated / stats[i].n_slabs : 0;
+
+    sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("pool", pools[i]));
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("kind", "allocated"));
+    metrics_store_entry_update(sentry, stats[i].bytes_allocated);
+
+    sentry = metrics_store_add(the_store, rentry->type, rentry->name,
+                               rentry->help);
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("pool", pools[i]));
+    metrics_store_entry_add_label(sentry,
+                                  metrics_format_label("kind", "cached"));
+    metrics_store_entry_update(sentry,
+                               stats[i].n_empty_slabs * slab_bytes);
+  }
+}
+
 /* NOTE: Disable the record type label until libevent is fixed. */
 #if 0
 /** Helper array containing mapping for the name of the different DNS records
@@ -29,6 +29,28 @@ typedef enum {
   RELAY_METRICS_NUM_DNS_ERRORS = 5,
   /** Number of TCP exhaustion reached. */
   RELAY_METRICS_NUM_TCP_EXHAUSTION = 6,
+  /** Number of EWFD unit tickers allocated and released. */
+  RELAY_METRICS_NUM_EWFD_TIMERS = 7,
+  /** Number of EWFD tick driver wakeups and units run by it. */
+  RELAY_METRICS_NUM_EWFD_TICKS = 8,
+  /** Number of EWFD framework events processed, late and dropped. */
+  RELAY_METRICS_NUM_EWFD_EVENTS = 9,
+  /** Number of EWFD framework events by type and outcome. */
+  RELAY_METRICS_NUM_EWFD_EVENT_TYPES = 10,
+  /** Number of real and dummy cells sent on circuits by EWFD unit. */
+  RELAY_METRICS_NUM_EWFD_CELLS = 11,
+  /** Dummy to real cell ratio by EWFD unit, in permille. */
+  RELAY_METRICS_NUM_EWFD_OVERHEAD = 12,
+  /** Execution time histogram of the EWFD units. */
+  RELAY_METRICS_NUM_EWFD_EXEC_TIME = 13,
+  /** Number of EWFD units attached to circuits. */
+  RELAY_METRICS_NUM_EWFD_ACTIVE_UNITS = 14,
+  /** Bytes of executable memory mapped and used by the EWFD JIT. */
+  RELAY_METRICS_NUM_EWFD_JIT_BYTES = 15,
+  /** Objects in use and free in the cell pools. */
+  RELAY_METRICS_NUM_CELL_POOL_OBJECTS = 16,
+  /** Bytes held by the cell pools. */
+  RELAY_METRICS_NUM_CELL_POOL_BYTES = 17,
 } relay_metrics_key_t;
 
 /** The metadata of a relay metric. */
@@ -174,6 +174,11 @@
  * taken.  This can generate slightly better code with some CPUs.
  */
 #define PREDICT_UNLIKELY(exp) __builtin_expect(!!(exp), 0)
+/** Macro: Hints the CPU to start loading the cache line at <b>addr</b>,
+ * which we are about to write.  It has no effect on the program's result,
+ * and expands to nothing but an evaluation of <b>addr</b> on compilers
+ * without the builtin. */
+#define PREFETCH_FOR_WRITE(addr) __builtin_prefetch((addr), 1)
 #else /* !(defined(__GNUC__) && __GNUC__ >= 3) */
 #define ATTR_NORETURN
 #define ATTR_CONST
@@ -183,6 +188,7 @@
 #define ATTR_WUR
 #define PREDICT_LIKELY(exp) (exp)
 #define PREDICT_UNLIKELY(exp) (exp)
+#define PREFETCH_FOR_WRITE(addr) ((void)(addr))
 #endif /* defined(__GNUC__) && __GNUC__ >= 3 */
 
 /** Expands to a syntactically valid empty statement.  */
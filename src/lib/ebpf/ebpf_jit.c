@@ -50,7 +50,7 @@ ebpf_translate_null(struct ebpf_vm* vm, uint8_t* buffer, size_t* size, char** er
 ebpf_jit_fn
 ebpf_compile(struct ebpf_vm* vm, char** errmsg)
 {
-    void* jitted = NULL;
+    struct ebpf_jit_code* jit_code = NULL;
     uint8_t* buffer = NULL;
     size_t jitted_size;
 
@@ -67,31 +67,26 @@ ebpf_compile(struct ebpf_vm* vm, char** errmsg)
 
     jitted_size = 65536;
     buffer = calloc(jitted_size, 1);
-
-    if (ebpf_translate(vm, buffer, &jitted_size, errmsg) < 0) {
-        goto out;
+    if (buffer == NULL) {
+        *errmsg = ebpf_error("out of memory");
+        return NULL;
     }
 
-    jitted = mmap(0, jitted_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (jitted == MAP_FAILED) {
-        *errmsg = ebpf_error("internal ebpf error: mmap failed: %s\n", strerror(errno));
+    if (ebpf_translate(vm, buffer, &jitted_size, errmsg) < 0) {
         goto out;
     }
 
-    memcpy(jitted, buffer, jitted_size);
-
-    if (mprotect(jitted, jitted_size, PROT_READ | PROT_EXEC) < 0) {
-        *errmsg = ebpf_error("internal ebpf error: mprotect failed: %s\n", strerror(errno));
+    /* Pack the program into the shared W^X arena instead of mapping it alone. */
+    jit_code = ebpf_jit_arena_alloc(buffer, jitted_size, errmsg);
+    if (jit_code == NULL) {
         goto out;
     }
 
-    vm->jitted = jitted;
+    vm->jit_code = jit_code;
+    vm->jitted = ebpf_jit_code_fn(jit_code);
     vm->jitted_size = jitted_size;
 
 out:
     free(buffer);
-    if (jitted && vm->jitted == NULL) {
-        munmap(jitted, jitted_size);
-    }
     return vm->jitted;
 }
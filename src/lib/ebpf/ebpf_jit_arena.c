@@ -0,0 +1,278 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Shared executable arena for JIT output.
+ *
+ * Compiled programs are packed into large chunks instead of one mmap (and
+ * one mprotect) per program. Every chunk is a memfd mapped twice: a
+ * read/exec view that programs run from, and a read/write view at an
+ * unrelated address that appends copy code through. Both views live as long
+ * as the chunk, so appending costs a memcpy and no syscalls. No mapping is
+ * ever writable and executable, and appending never changes the protection
+ * of pages other threads may be executing.
+ *
+ * Allocation is a bump pointer in the newest chunk. Each program is
+ * reference counted; a chunk is unmapped once its last program is released,
+ * and the newest chunk is rewound instead. When memfd_create() is not
+ * available (old kernels) every program falls back to its own mapping
+ * flipped from RW to RX, as before. The seccomp sandbox allows neither
+ * memfd_create() nor an executable mprotect(), so there the JIT fails and
+ * callers keep interpreting.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "ebpf_vm.h"
+
+#define EBPF_JIT_ARENA_CHUNK_SIZE (256 * 1024)
+#define EBPF_JIT_ARENA_ALIGN 64 /* one cache line, programs never share a line */
+
+struct ebpf_jit_chunk
+{
+	int fd;        /* backing memfd, -1 for a single-program fallback mapping */
+	uint8_t* rx;   /* exec view */
+	uint8_t* rw;   /* write view of the same pages, NULL for the fallback */
+	size_t size;
+	size_t used;   /* bump pointer */
+	int live;      /* programs still referenced in this chunk */
+	struct ebpf_jit_chunk* next;
+};
+
+struct ebpf_jit_code
+{
+	ebpf_jit_fn fn;
+	size_t size;
+	int refcnt;
+	struct ebpf_jit_chunk* chunk;
+};
+
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ebpf_jit_chunk* arena_chunks = NULL; /* newest first */
+static bool arena_use_memfd = true;
+static struct ebpf_jit_arena_stats arena_stats;
+
+static size_t
+round_up(size_t n, size_t align)
+{
+	return (n + align - 1) / align * align;
+}
+
+static void
+chunk_unmap(struct ebpf_jit_chunk* chunk)
+{
+	if (chunk->fd >= 0) {
+		close(chunk->fd);
+	}
+	munmap(chunk->rx, chunk->size);
+	if (chunk->rw != NULL) {
+		munmap(chunk->rw, chunk->size);
+	}
+	arena_stats.chunks--;
+	arena_stats.bytes_mapped -= chunk->size;
+	free(chunk);
+}
+
+/* Map a memfd chunk of <size> bytes. Returns NULL and disables the memfd
+ * path if the kernel does not let us. */
+static struct ebpf_jit_chunk*
+chunk_new_shared(size_t size)
+{
+	int fd = memfd_create("ebpf-jit", MFD_CLOEXEC);
+	if (fd < 0) {
+		arena_use_memfd = false;
+		return NULL;
+	}
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		arena_use_memfd = false;
+		return NULL;
+	}
+
+	void* rx = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+	if (rx == MAP_FAILED) {
+		close(fd);
+		arena_use_memfd = false;
+		return NULL;
+	}
+	void* rw = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (rw == MAP_FAILED) {
+		munmap(rx, size);
+		close(fd);
+		arena_use_memfd = false;
+		return NULL;
+	}
+
+	struct ebpf_jit_chunk* chunk = calloc(1, sizeof(*chunk));
+	if (chunk == NULL) {
+		munmap(rw, size);
+		munmap(rx, size);
+		close(fd);
+		return NULL;
+	}
+	chunk->fd = fd;
+	chunk->rx = rx;
+	chunk->rw = rw;
+	chunk->size = size;
+	return chunk;
+}
+
+/* Fallback: a private mapping holding a single program, RW while copying and
+ * RX afterwards. */
+static struct ebpf_jit_chunk*
+chunk_new_private(const uint8_t* code, size_t code_size, char** errmsg)
+{
+	size_t size = round_up(code_size, (size_t)sysconf(_SC_PAGESIZE));
+	void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		*errmsg = ebpf_error("internal ebpf error: mmap failed: %s\n", strerror(errno));
+		return NULL;
+	}
+	memcpy(mem, code, code_size);
+	if (mprotect(mem, size, PROT_READ | PROT_EXEC) < 0) {
+		*errmsg = ebpf_error("internal ebpf error: mprotect failed: %s\n", strerror(errno));
+		munmap(mem, size);
+		return NULL;
+	}
+
+	struct ebpf_jit_chunk* chunk = calloc(1, sizeof(*chunk));
+	if (chunk == NULL) {
+		*errmsg = ebpf_error("out of memory");
+		munmap(mem, size);
+		return NULL;
+	}
+	chunk->fd = -1;
+	chunk->rx = mem;
+	chunk->size = size;
+	chunk->used = size;
+	return chunk;
+}
+
+struct ebpf_jit_code*
+ebpf_jit_arena_alloc(const uint8_t* code, size_t code_size, char** errmsg)
+{
+	struct ebpf_jit_code* jc = calloc(1, sizeof(*jc));
+	if (jc == NULL) {
+		*errmsg = ebpf_error("out of memory");
+		return NULL;
+	}
+	size_t size = round_up(code_size, EBPF_JIT_ARENA_ALIGN);
+
+	pthread_mutex_lock(&arena_lock);
+	struct ebpf_jit_chunk* chunk = arena_chunks;
+	size_t offset = 0;
+	if (chunk == NULL || chunk->fd < 0 || chunk->size - chunk->used < size) {
+		chunk = NULL;
+		if (arena_use_memfd) {
+			chunk = chunk_new_shared(round_up(size > EBPF_JIT_ARENA_CHUNK_SIZE ? size : EBPF_JIT_ARENA_CHUNK_SIZE,
+				(size_t)sysconf(_SC_PAGESIZE)));
+		}
+		if (chunk == NULL) {
+			chunk = chunk_new_private(code, code_size, errmsg);
+			if (chunk == NULL) {
+				pthread_mutex_unlock(&arena_lock);
+				free(jc);
+				return NULL;
+			}
+		}
+		chunk->next = arena_chunks;
+		arena_chunks = chunk;
+		arena_stats.chunks++;
+		arena_stats.bytes_mapped += chunk->size;
+	}
+
+	if (chunk->fd >= 0) {
+		offset = chunk->used;
+		memcpy(chunk->rw + offset, code, code_size);
+		chunk->used += size;
+		__builtin___clear_cache((char*)chunk->rx + offset, (char*)chunk->rx + offset + code_size);
+	} else {
+		size = chunk->size;
+	}
+
+	chunk->live++;
+	arena_stats.programs++;
+	arena_stats.bytes_used += size;
+	arena_stats.total_allocs++;
+	pthread_mutex_unlock(&arena_lock);
+
+	jc->fn = (ebpf_jit_fn)(void*)(chunk->rx + offset);
+	jc->size = size;
+	jc->refcnt = 1;
+	jc->chunk = chunk;
+	return jc;
+}
+
+ebpf_jit_fn
+ebpf_jit_code_fn(const struct ebpf_jit_code* jc)
+{
+	return jc->fn;
+}
+
+struct ebpf_jit_code*
+ebpf_jit_code_ref(struct ebpf_jit_code* jc)
+{
+	pthread_mutex_lock(&arena_lock);
+	jc->refcnt++;
+	pthread_mutex_unlock(&arena_lock);
+	return jc;
+}
+
+void
+ebpf_jit_code_unref(struct ebpf_jit_code* jc)
+{
+	if (jc == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&arena_lock);
+	if (--jc->refcnt > 0) {
+		pthread_mutex_unlock(&arena_lock);
+		return;
+	}
+
+	struct ebpf_jit_chunk* chunk = jc->chunk;
+	arena_stats.programs--;
+	arena_stats.bytes_used -= jc->size;
+	if (--chunk->live == 0) {
+		if (chunk == arena_chunks && chunk->fd >= 0) {
+			/* Newest chunk: nothing runs from it any more, start over. */
+			chunk->used = 0;
+		} else {
+			struct ebpf_jit_chunk** pos = &arena_chunks;
+			while (*pos != chunk) {
+				pos = &(*pos)->next;
+			}
+			*pos = chunk->next;
+			chunk_unmap(chunk);
+		}
+	}
+	pthread_mutex_unlock(&arena_lock);
+	free(jc);
+}
+
+void
+ebpf_jit_arena_get_stats(struct ebpf_jit_arena_stats* stats)
+{
+	pthread_mutex_lock(&arena_lock);
+	*stats = arena_stats;
+	pthread_mutex_unlock(&arena_lock);
+}
@@ -118,10 +118,331 @@ ebpf_set_register_offset(int x)
     }
 }
 
+/* x86 jcc opcode (second byte) for an eBPF conditional jump, -1 if none */
+static int
+jcc_code(uint8_t opcode)
+{
+    switch (opcode & EBPF_JMP_OP_MASK) {
+    case EBPF_MODE_JEQ:
+        return 0x84;
+    case EBPF_MODE_JGT:
+        return 0x87;
+    case EBPF_MODE_JGE:
+        return 0x83;
+    case EBPF_MODE_JNE:
+        return 0x85;
+    case EBPF_MODE_JSGT:
+        return 0x8f;
+    case EBPF_MODE_JSGE:
+        return 0x8d;
+    case EBPF_MODE_JLT:
+        return 0x82;
+    case EBPF_MODE_JLE:
+        return 0x86;
+    case EBPF_MODE_JSLT:
+        return 0x8c;
+    case EBPF_MODE_JSLE:
+        return 0x8e;
+    default:
+        return -1;
+    }
+}
+
+/*
+ * Compare against an immediate before a conditional jump. "test r, r" sets
+ * the same flags as "cmp r, 0" and is 4 bytes shorter, which covers the null
+ * check after every map lookup helper.
+ */
+static void
+emit_jmp_cmp_imm32(struct jit_state* state, bool optimize, int dst, int32_t imm)
+{
+    if (optimize && imm == 0) {
+        emit_alu64(state, 0x85, dst, dst);
+    } else {
+        emit_cmp_imm32(state, dst, imm);
+    }
+}
+
+static void
+emit_jmp_cmp32_imm32(struct jit_state* state, bool optimize, int dst, int32_t imm)
+{
+    if (optimize && imm == 0) {
+        emit_alu32(state, 0x85, dst, dst);
+    } else {
+        emit_cmp32_imm32(state, dst, imm);
+    }
+}
+
+/*
+ * Return true if eBPF register <reg> is overwritten before being read on the
+ * straight-line path starting at <pc>. Any jump ends the scan and counts as
+ * a read, so the answer is conservative.
+ */
+static bool
+reg_dead_at(const struct ebpf_vm* vm, uint32_t pc, int reg)
+{
+    for (int n = 0; n < 16 && pc < vm->num_insts; n++, pc++) {
+        const struct ebpf_inst* inst = &vm->insts[pc];
+        switch (inst->opcode & EBPF_CLS_MASK) {
+        case EBPF_CLS_ALU:
+        case EBPF_CLS_ALU64:
+            if ((inst->opcode & EBPF_SRC_REG) && inst->src == reg) {
+                return false;
+            }
+            if (inst->dst == reg) {
+                /* mov is the only ALU op that does not read dst */
+                return (inst->opcode & EBPF_JMP_OP_MASK) == 0xb0;
+            }
+            break;
+        case EBPF_CLS_LDX:
+            if (inst->src == reg) {
+                return false;
+            }
+            if (inst->dst == reg) {
+                return true;
+            }
+            break;
+        case EBPF_CLS_LD:
+            if (inst->dst == reg) {
+                return true;
+            }
+            pc++; /* second half of lddw */
+            break;
+        case EBPF_CLS_ST:
+            if (inst->dst == reg) {
+                return false;
+            }
+            break;
+        case EBPF_CLS_STX:
+            if (inst->dst == reg || inst->src == reg) {
+                return false;
+            }
+            break;
+        default:
+            if (inst->opcode == EBPF_OP_CALL) {
+                /* helpers read r1-r5 and clobber r0-r5 */
+                if (reg >= 1 && reg <= 5) {
+                    return false;
+                }
+                if (reg == 0) {
+                    return true;
+                }
+                break;
+            }
+            if (inst->opcode == EBPF_OP_EXIT) {
+                return reg != 0;
+            }
+            return false;
+        }
+    }
+    return false;
+}
+
+/* Mark every instruction some jump lands on. */
+static bool*
+find_jump_targets(const struct ebpf_vm* vm)
+{
+    bool* targets = calloc(vm->num_insts + 1, sizeof(bool));
+    if (targets == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < vm->num_insts; i++) {
+        const struct ebpf_inst* inst = &vm->insts[i];
+        uint8_t cls = inst->opcode & EBPF_CLS_MASK;
+        if (inst->opcode == EBPF_OP_LDDW) {
+            i++;
+        } else if ((cls == EBPF_CLS_JMP || cls == EBPF_CLS_JMP32) && inst->opcode != EBPF_OP_CALL &&
+                   inst->opcode != EBPF_OP_EXIT) {
+            int32_t target = (int32_t)i + inst->offset + 1;
+            if (target >= 0 && target <= vm->num_insts) {
+                targets[target] = true;
+            }
+        }
+    }
+    return targets;
+}
+
+/*
+ * Load-compare-branch superinstruction:
+ *     ldxw/ldxdw rA, [rB + off]; jcc rA, imm
+ * becomes "cmp [rB + off], imm; jcc" when rA is dead on both edges and
+ * nothing jumps to the branch itself. A 32-bit load is zero-extended, so
+ * against a 64-bit compare it can only be fused for non-negative immediates
+ * and unsigned conditions.
+ */
+static bool
+fuse_load_cmp_branch(struct ebpf_vm* vm, struct jit_state* state, uint32_t pc, const bool* targets)
+{
+    if (targets == NULL || pc + 1 >= vm->num_insts || targets[pc + 1]) {
+        return false;
+    }
+    const struct ebpf_inst* load = &vm->insts[pc];
+    const struct ebpf_inst* jmp = &vm->insts[pc + 1];
+    if (load->opcode != EBPF_OP_LDXW && load->opcode != EBPF_OP_LDXDW) {
+        return false;
+    }
+    uint8_t cls = jmp->opcode & EBPF_CLS_MASK;
+    if ((cls != EBPF_CLS_JMP && cls != EBPF_CLS_JMP32) || (jmp->opcode & EBPF_SRC_REG) || jmp->dst != load->dst) {
+        return false;
+    }
+    int cc = jcc_code(jmp->opcode);
+    if (cc < 0) {
+        return false;
+    }
+
+    bool wide = load->opcode == EBPF_OP_LDXDW && cls == EBPF_CLS_JMP;
+    if (load->opcode == EBPF_OP_LDXW && cls == EBPF_CLS_JMP) {
+        bool is_signed = cc == 0x8f || cc == 0x8d || cc == 0x8c || cc == 0x8e;
+        if (jmp->imm < 0 || is_signed) {
+            return false;
+        }
+    }
+
+    uint32_t target_pc = pc + 1 + jmp->offset + 1;
+    if (!reg_dead_at(vm, pc + 2, load->dst) || !reg_dead_at(vm, target_pc, load->dst)) {
+        return false;
+    }
+
+    int base = map_register(load->src);
+    state->pc_locs[pc + 1] = state->offset;
+    /* cmp r/m, imm32 */
+    emit_basic_rex(state, wide, 0, base);
+    emit1(state, 0x81);
+    emit_modrm_and_displacement(state, 7, base, load->offset);
+    emit4(state, jmp->imm);
+    emit_jcc(state, cc, target_pc);
+    return true;
+}
+
+/* Record a jump inside an inline helper body, patched by translate_inline_helper(). */
+static void
+emit_inline_jump_offset(struct jit_state* state, struct jump* fixup, uint32_t target)
+{
+    fixup->offset_loc = state->offset;
+    fixup->target_pc = target;
+    emit4(state, 0);
+}
+
+/*
+ * Splice the body registered with ebpf_register_inline() in place of a call.
+ * Bodies only touch r0-r5, which a call clobbers anyway, and only jump
+ * forward; EXIT ends the body.
+ */
+static void
+translate_inline_helper(struct jit_state* state, const struct ebpf_inline_helper* helper)
+{
+    uint32_t locs[EBPF_MAX_INLINE_INSTS];
+    struct jump fixups[EBPF_MAX_INLINE_INSTS];
+    int num_fixups = 0;
+    uint32_t last = helper->num_insts - 1;
+
+    for (uint32_t i = 0; i < helper->num_insts; i++) {
+        struct ebpf_inst inst = helper->insts[i];
+        int dst = map_register(inst.dst);
+        int src = map_register(inst.src);
+        uint32_t target = i + inst.offset + 1;
+        locs[i] = state->offset;
+
+        switch (inst.opcode) {
+        case EBPF_OP_ADD64_IMM:
+            emit_alu64_imm32(state, 0x81, 0, dst, inst.imm);
+            break;
+        case EBPF_OP_ADD64_REG:
+            emit_alu64(state, 0x01, src, dst);
+            break;
+        case EBPF_OP_SUB64_IMM:
+            emit_alu64_imm32(state, 0x81, 5, dst, inst.imm);
+            break;
+        case EBPF_OP_SUB64_REG:
+            emit_alu64(state, 0x29, src, dst);
+            break;
+        case EBPF_OP_AND64_IMM:
+            emit_alu64_imm32(state, 0x81, 4, dst, inst.imm);
+            break;
+        case EBPF_OP_AND64_REG:
+            emit_alu64(state, 0x21, src, dst);
+            break;
+        case EBPF_OP_OR64_IMM:
+            emit_alu64_imm32(state, 0x81, 1, dst, inst.imm);
+            break;
+        case EBPF_OP_OR64_REG:
+            emit_alu64(state, 0x09, src, dst);
+            break;
+        case EBPF_OP_LSH64_IMM:
+            emit_alu64_imm8(state, 0xc1, 4, dst, inst.imm);
+            break;
+        case EBPF_OP_RSH64_IMM:
+            emit_alu64_imm8(state, 0xc1, 5, dst, inst.imm);
+            break;
+        case EBPF_OP_MOV64_IMM:
+            emit_load_imm(state, dst, inst.imm);
+            break;
+        case EBPF_OP_MOV64_REG:
+            emit_mov(state, src, dst);
+            break;
+        case EBPF_OP_LDXW:
+            emit_load(state, S32, src, dst, inst.offset);
+            break;
+        case EBPF_OP_LDXH:
+            emit_load(state, S16, src, dst, inst.offset);
+            break;
+        case EBPF_OP_LDXB:
+            emit_load(state, S8, src, dst, inst.offset);
+            break;
+        case EBPF_OP_LDXDW:
+            emit_load(state, S64, src, dst, inst.offset);
+            break;
+        case EBPF_OP_STXW:
+            emit_store(state, S32, src, dst, inst.offset);
+            break;
+        case EBPF_OP_STXH:
+            emit_store(state, S16, src, dst, inst.offset);
+            break;
+        case EBPF_OP_STXB:
+            emit_store(state, S8, src, dst, inst.offset);
+            break;
+        case EBPF_OP_STXDW:
+            emit_store(state, S64, src, dst, inst.offset);
+            break;
+        case EBPF_OP_JA:
+            emit1(state, 0xe9);
+            emit_inline_jump_offset(state, &fixups[num_fixups++], target);
+            break;
+        case EBPF_OP_EXIT:
+            if (i != last) {
+                emit1(state, 0xe9);
+                emit_inline_jump_offset(state, &fixups[num_fixups++], last);
+            }
+            break;
+        default:
+            /* conditional jumps, ebpf_register_inline() rejected everything else */
+            if (inst.opcode & EBPF_SRC_REG) {
+                emit_cmp(state, src, dst);
+            } else {
+                emit_jmp_cmp_imm32(state, true, dst, inst.imm);
+            }
+            emit1(state, 0x0f);
+            emit1(state, jcc_code(inst.opcode));
+            emit_inline_jump_offset(state, &fixups[num_fixups++], target);
+            break;
+        }
+    }
+
+    for (int i = 0; i < num_fixups; i++) {
+        if (fixups[i].offset_loc + sizeof(uint32_t) > state->size) {
+            break; /* buffer overflow, reported by ebpf_translate_x86_64() */
+        }
+        uint32_t rel = locs[fixups[i].target_pc] - (fixups[i].offset_loc + sizeof(uint32_t));
+        memcpy(&state->buf[fixups[i].offset_loc], &rel, sizeof(uint32_t));
+    }
+}
+
 static int
 translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
 {
     int i;
+    bool optimize = vm->jit_optimize;
+    bool* jump_targets = optimize ? find_jump_targets(vm) : NULL;
 
     /* Save platform non-volatile registers */
     for (i = 0; i < _countof(platform_nonvolatile_registers); i++) {
@@ -143,6 +464,11 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
         struct ebpf_inst inst = ebpf_fetch_instruction(vm, i);
         state->pc_locs[i] = state->offset;
 
+        if (optimize && fuse_load_cmp_branch(vm, state, i, jump_targets)) {
+            i++;
+            continue;
+        }
+
         int dst = map_register(inst.dst);
         int src = map_register(inst.src);
         uint32_t target_pc = i + inst.offset + 1;
@@ -309,7 +635,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jmp(state, target_pc);
             break;
         case EBPF_OP_JEQ_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x84, target_pc);
             break;
         case EBPF_OP_JEQ_REG:
@@ -317,7 +643,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x84, target_pc);
             break;
         case EBPF_OP_JGT_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x87, target_pc);
             break;
         case EBPF_OP_JGT_REG:
@@ -325,7 +651,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x87, target_pc);
             break;
         case EBPF_OP_JGE_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x83, target_pc);
             break;
         case EBPF_OP_JGE_REG:
@@ -333,7 +659,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x83, target_pc);
             break;
         case EBPF_OP_JLT_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x82, target_pc);
             break;
         case EBPF_OP_JLT_REG:
@@ -341,7 +667,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x82, target_pc);
             break;
         case EBPF_OP_JLE_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x86, target_pc);
             break;
         case EBPF_OP_JLE_REG:
@@ -357,7 +683,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x85, target_pc);
             break;
         case EBPF_OP_JNE_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x85, target_pc);
             break;
         case EBPF_OP_JNE_REG:
@@ -365,7 +691,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x85, target_pc);
             break;
         case EBPF_OP_JSGT_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x8f, target_pc);
             break;
         case EBPF_OP_JSGT_REG:
@@ -373,7 +699,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x8f, target_pc);
             break;
         case EBPF_OP_JSGE_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x8d, target_pc);
             break;
         case EBPF_OP_JSGE_REG:
@@ -381,7 +707,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x8d, target_pc);
             break;
         case EBPF_OP_JSLT_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x8c, target_pc);
             break;
         case EBPF_OP_JSLT_REG:
@@ -389,7 +715,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x8c, target_pc);
             break;
         case EBPF_OP_JSLE_IMM:
-            emit_cmp_imm32(state, dst, inst.imm);
+            emit_jmp_cmp_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x8e, target_pc);
             break;
         case EBPF_OP_JSLE_REG:
@@ -397,7 +723,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x8e, target_pc);
             break;
         case EBPF_OP_JEQ32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x84, target_pc);
             break;
         case EBPF_OP_JEQ32_REG:
@@ -405,7 +731,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x84, target_pc);
             break;
         case EBPF_OP_JGT32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x87, target_pc);
             break;
         case EBPF_OP_JGT32_REG:
@@ -413,7 +739,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x87, target_pc);
             break;
         case EBPF_OP_JGE32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x83, target_pc);
             break;
         case EBPF_OP_JGE32_REG:
@@ -421,7 +747,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x83, target_pc);
             break;
         case EBPF_OP_JLT32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x82, target_pc);
             break;
         case EBPF_OP_JLT32_REG:
@@ -429,7 +755,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x82, target_pc);
             break;
         case EBPF_OP_JLE32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x86, target_pc);
             break;
         case EBPF_OP_JLE32_REG:
@@ -445,7 +771,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x85, target_pc);
             break;
         case EBPF_OP_JNE32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x85, target_pc);
             break;
         case EBPF_OP_JNE32_REG:
@@ -453,7 +779,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x85, target_pc);
             break;
         case EBPF_OP_JSGT32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x8f, target_pc);
             break;
         case EBPF_OP_JSGT32_REG:
@@ -461,7 +787,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x8f, target_pc);
             break;
         case EBPF_OP_JSGE32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x8d, target_pc);
             break;
         case EBPF_OP_JSGE32_REG:
@@ -469,7 +795,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x8d, target_pc);
             break;
         case EBPF_OP_JSLT32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x8c, target_pc);
             break;
         case EBPF_OP_JSLT32_REG:
@@ -477,7 +803,7 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x8c, target_pc);
             break;
         case EBPF_OP_JSLE32_IMM:
-            emit_cmp32_imm32(state, dst, inst.imm);
+            emit_jmp_cmp32_imm32(state, optimize, dst, inst.imm);
             emit_jcc(state, 0x8e, target_pc);
             break;
         case EBPF_OP_JSLE32_REG:
@@ -485,6 +811,11 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
             emit_jcc(state, 0x8e, target_pc);
             break;
         case EBPF_OP_CALL:
+            if (optimize && vm->ext_func_inlines[inst.imm].insts != NULL &&
+                inst.imm != vm->unwind_stack_extension_index) {
+                translate_inline_helper(state, &vm->ext_func_inlines[inst.imm]);
+                break;
+            }
             /* We reserve RCX for shifts */
             emit_mov(state, RCX_ALT, RCX);
             emit_call(state, vm->ext_funcs[inst.imm]);
@@ -547,9 +878,11 @@ translate(struct ebpf_vm* vm, struct jit_state* state, char** errmsg)
 
         default:
             *errmsg = ebpf_error("Unknown instruction at PC %d: opcode %02x", i, inst.opcode);
+            free(jump_targets);
             return -1;
         }
     }
+    free(jump_targets);
 
     /* Epilogue */
     state->exit_loc = state->offset;
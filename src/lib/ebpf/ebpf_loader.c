@@ -0,0 +1,294 @@
+/*
+ * Copyright 2015 Big Switch Networks, Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ELF loader for clang -target bpf objects.
+ *
+ * Only relocatable objects are accepted. Calls to helpers declared as extern
+ * functions (R_BPF_64_32 relocations) are resolved by name against the
+ * functions registered with ebpf_register(); helpers declared with a fixed
+ * id need no relocation at all.
+ *
+ * There is no support for global data: 64-bit immediate loads of globals,
+ * .rodata, .data, .bss or maps (R_BPF_64_64 relocations) are rejected.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <elf.h>
+#include "ebpf_inst.h"
+#include "ebpf_vm.h"
+
+#define MAX_SECTIONS 64
+
+#ifndef EM_BPF
+#define EM_BPF 247
+#endif
+
+#ifndef R_BPF_64_64
+#define R_BPF_64_64 1
+#endif
+
+#ifndef R_BPF_64_32
+#define R_BPF_64_32 10
+#endif
+
+struct bounds
+{
+	const void* base;
+	uint64_t size;
+};
+
+struct section
+{
+	const Elf64_Shdr* shdr;
+	const void* data;
+	uint64_t size;
+};
+
+static const void*
+bounds_check(const struct bounds* bounds, uint64_t offset, uint64_t size)
+{
+	if (offset + size > bounds->size || offset + size < offset) {
+		return NULL;
+	}
+	return (const char*)bounds->base + offset;
+}
+
+/* Return the nul-terminated string at <b>offset</b> in <b>strtab</b>. */
+static const char*
+section_string(const struct section* strtab, uint64_t offset)
+{
+	if (strtab->data == NULL || offset >= strtab->size) {
+		return NULL;
+	}
+	const char* str = (const char*)strtab->data + offset;
+	if (memchr(str, '\0', strtab->size - offset) == NULL) {
+		return NULL;
+	}
+	return str;
+}
+
+int
+ebpf_load_elf(struct ebpf_vm* vm, const void* elf, size_t elf_len, char** errmsg)
+{
+	return ebpf_load_elf_section(vm, elf, elf_len, NULL, errmsg);
+}
+
+int
+ebpf_load_elf_section(struct ebpf_vm* vm, const void* elf, size_t elf_len, const char* section_name, char** errmsg)
+{
+	struct bounds b = {.base = elf, .size = elf_len};
+	struct section sections[MAX_SECTIONS];
+	void* text_copy = NULL;
+	int i;
+
+	*errmsg = NULL;
+
+	const Elf64_Ehdr* ehdr = bounds_check(&b, 0, sizeof(*ehdr));
+	if (!ehdr) {
+		*errmsg = ebpf_error("not enough data for ELF header");
+		goto error;
+	}
+	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG)) {
+		*errmsg = ebpf_error("wrong magic");
+		goto error;
+	}
+	if (ehdr->e_ident[EI_CLASS] != ELFCLASS64) {
+		*errmsg = ebpf_error("wrong class");
+		goto error;
+	}
+	if (ehdr->e_ident[EI_DATA] != ELFDATA2LSB) {
+		*errmsg = ebpf_error("wrong byte order");
+		goto error;
+	}
+	if (ehdr->e_ident[EI_VERSION] != 1) {
+		*errmsg = ebpf_error("wrong version");
+		goto error;
+	}
+	if (ehdr->e_ident[EI_OSABI] != ELFOSABI_NONE) {
+		*errmsg = ebpf_error("wrong OS ABI");
+		goto error;
+	}
+	if (ehdr->e_type != ET_REL) {
+		*errmsg = ebpf_error("wrong type, expected relocatable");
+		goto error;
+	}
+	if (ehdr->e_machine != EM_NONE && ehdr->e_machine != EM_BPF) {
+		*errmsg = ebpf_error("wrong machine, expected none or BPF, got %d", ehdr->e_machine);
+		goto error;
+	}
+	if (ehdr->e_shnum > MAX_SECTIONS) {
+		*errmsg = ebpf_error("too many sections");
+		goto error;
+	}
+	if (ehdr->e_shnum > 0 && ehdr->e_shentsize < sizeof(Elf64_Shdr)) {
+		*errmsg = ebpf_error("bad section header size");
+		goto error;
+	}
+
+	/* Parse section headers into an array */
+	for (i = 0; i < ehdr->e_shnum; i++) {
+		const Elf64_Shdr* shdr = bounds_check(&b, ehdr->e_shoff + (uint64_t)i * ehdr->e_shentsize, sizeof(*shdr));
+		if (!shdr) {
+			*errmsg = ebpf_error("bad section header offset or size");
+			goto error;
+		}
+
+		const void* data = NULL;
+		if (shdr->sh_type != SHT_NOBITS) {
+			data = bounds_check(&b, shdr->sh_offset, shdr->sh_size);
+			if (!data) {
+				*errmsg = ebpf_error("bad section offset or size");
+				goto error;
+			}
+		}
+
+		sections[i].shdr = shdr;
+		sections[i].data = data;
+		sections[i].size = shdr->sh_size;
+	}
+
+	/* Find the requested text section, or the first one */
+	const struct section* shstrtab = NULL;
+	if (ehdr->e_shstrndx != SHN_UNDEF && ehdr->e_shstrndx < ehdr->e_shnum) {
+		shstrtab = &sections[ehdr->e_shstrndx];
+	}
+	int text_shndx = 0;
+	for (i = 0; i < ehdr->e_shnum; i++) {
+		const Elf64_Shdr* shdr = sections[i].shdr;
+		if (shdr->sh_type != SHT_PROGBITS || shdr->sh_flags != (SHF_ALLOC | SHF_EXECINSTR) || sections[i].size == 0) {
+			continue;
+		}
+		if (section_name != NULL) {
+			const char* name = shstrtab ? section_string(shstrtab, shdr->sh_name) : NULL;
+			if (name == NULL || strcmp(name, section_name) != 0) {
+				continue;
+			}
+		}
+		text_shndx = i;
+		break;
+	}
+
+	if (!text_shndx) {
+		if (section_name != NULL) {
+			*errmsg = ebpf_error("text section %s not found", section_name);
+		} else {
+			*errmsg = ebpf_error("text section not found");
+		}
+		goto error;
+	}
+
+	const struct section* text = &sections[text_shndx];
+	if (text->size > UINT32_MAX) {
+		*errmsg = ebpf_error("text section too large");
+		goto error;
+	}
+
+	/* May need to modify text for relocations, so make a copy */
+	text_copy = malloc(text->size);
+	if (!text_copy) {
+		*errmsg = ebpf_error("failed to allocate memory");
+		goto error;
+	}
+	memcpy(text_copy, text->data, text->size);
+
+	/* Process each relocation section that applies to the text */
+	for (i = 0; i < ehdr->e_shnum; i++) {
+		const struct section* rel = &sections[i];
+		if (rel->shdr->sh_type != SHT_REL || rel->shdr->sh_info != (Elf64_Word)text_shndx) {
+			continue;
+		}
+
+		const Elf64_Rel* rs = rel->data;
+
+		if (rel->shdr->sh_link >= ehdr->e_shnum) {
+			*errmsg = ebpf_error("bad symbol table section index");
+			goto error;
+		}
+
+		const struct section* symtab = &sections[rel->shdr->sh_link];
+		if (symtab->shdr->sh_type != SHT_SYMTAB) {
+			*errmsg = ebpf_error("bad symbol table section type");
+			goto error;
+		}
+		const Elf64_Sym* syms = symtab->data;
+		uint64_t num_syms = symtab->size / sizeof(syms[0]);
+
+		if (symtab->shdr->sh_link >= ehdr->e_shnum) {
+			*errmsg = ebpf_error("bad string table section index");
+			goto error;
+		}
+
+		const struct section* strtab = &sections[symtab->shdr->sh_link];
+		if (strtab->shdr->sh_type != SHT_STRTAB) {
+			*errmsg = ebpf_error("bad string table section type");
+			goto error;
+		}
+
+		for (uint64_t j = 0; j < rel->size / sizeof(Elf64_Rel); j++) {
+			const Elf64_Rel* r = &rs[j];
+
+			if (ELF64_R_TYPE(r->r_info) == R_BPF_64_64) {
+				*errmsg = ebpf_error("unsupported R_BPF_64_64 relocation: global variables, .rodata and maps are not supported");
+				goto error;
+			}
+			if (ELF64_R_TYPE(r->r_info) != R_BPF_64_32) {
+				*errmsg = ebpf_error("bad relocation type %u", (unsigned)ELF64_R_TYPE(r->r_info));
+				goto error;
+			}
+
+			uint32_t sym_idx = ELF64_R_SYM(r->r_info);
+			if (sym_idx >= num_syms) {
+				*errmsg = ebpf_error("bad symbol index");
+				goto error;
+			}
+
+			const char* sym_name = section_string(strtab, syms[sym_idx].st_name);
+			if (sym_name == NULL) {
+				*errmsg = ebpf_error("bad symbol name");
+				goto error;
+			}
+
+			if (r->r_offset % sizeof(struct ebpf_inst) != 0 || text->size < sizeof(struct ebpf_inst) ||
+				r->r_offset > text->size - sizeof(struct ebpf_inst)) {
+				*errmsg = ebpf_error("bad relocation offset");
+				goto error;
+			}
+
+			unsigned int imm = ebpf_lookup_registered_function(vm, sym_name);
+			if (imm == (unsigned int)-1) {
+				*errmsg = ebpf_error("function '%s' not found", sym_name);
+				goto error;
+			}
+
+			struct ebpf_inst* inst = (struct ebpf_inst*)((char*)text_copy + r->r_offset);
+			inst->imm = imm;
+		}
+	}
+
+	int rv = ebpf_load(vm, text_copy, (uint32_t)text->size, errmsg);
+	free(text_copy);
+	return rv;
+
+error:
+	free(text_copy);
+	return -1;
+}
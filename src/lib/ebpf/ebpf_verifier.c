@@ -0,0 +1,876 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Load-time static verifier.
+ *
+ * The program is abstractly interpreted over its control flow graph. Every
+ * register (and every 8-byte stack slot holding a spilled register) is tracked
+ * as one of: uninitialized, scalar with a signed [min, max] range, opaque handle
+ * loaded from the context (min == max == kind), pointer to the context (r1 on
+ * entry) or pointer to the stack frame (r10), the latter two with a [min, max]
+ * offset range. States are joined at jump targets and widened after a few
+ * visits, so the analysis always terminates.
+ *
+ * A verified program only dereferences ctx/stack pointers whose whole offset
+ * range is in bounds, only passes helpers the argument types they declared
+ * (handles the host stored in the ctx, never forged values), never reads an
+ * uninitialized register and never falls off the end of the code. The interpreter can then skip its runtime bounds
+ * checks for every call whose mem_len is at least the verified ctx size.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "ebpf_inst.h"
+#include "ebpf_vm.h"
+
+#define NUM_REGS 11
+#define STACK_SLOTS (EBPF_STACK_SIZE / 8)
+
+/* Number of times a jump target is joined before its ranges are widened. */
+#define WIDEN_AFTER_VISITS 8
+
+/* Offsets outside of this range can never be a valid ctx/stack access. */
+#define MAX_PTR_OFFSET ((int64_t)1 << 32)
+
+enum reg_type
+{
+	REG_NOT_INIT = 0,
+	REG_SCALAR,
+	REG_HANDLE,
+	REG_PTR_CTX,
+	REG_PTR_STACK,
+};
+
+struct reg_state
+{
+	uint8_t type;
+	/* Value range for scalars, offset range for pointers. */
+	int64_t min;
+	int64_t max;
+};
+
+struct verifier_state
+{
+	struct reg_state regs[NUM_REGS];
+	/* Spilled registers, REG_NOT_INIT means the slot holds no tracked value. */
+	struct reg_state stack[STACK_SLOTS];
+};
+
+struct verifier_env
+{
+	const struct ebpf_vm* vm;
+	const struct ebpf_inst* insts;
+	uint32_t num_insts;
+	size_t ctx_size;
+	uint32_t flags;
+	/* Jump targets own a state, other instructions are walked linearly. */
+	int32_t* target_idx;
+	struct verifier_state* states;
+	uint16_t* visits;
+	bool* queued;
+	uint32_t* worklist;
+	uint32_t worklist_len;
+	char** errmsg;
+};
+
+static const char* reg_type_str[] = {
+	[REG_NOT_INIT] = "uninit",
+	[REG_SCALAR] = "scalar",
+	[REG_HANDLE] = "handle",
+	[REG_PTR_CTX] = "ctx",
+	[REG_PTR_STACK] = "stack",
+};
+
+static void
+mark_unknown(struct reg_state* reg)
+{
+	reg->type = REG_SCALAR;
+	reg->min = INT64_MIN;
+	reg->max = INT64_MAX;
+}
+
+static void
+mark_const(struct reg_state* reg, int64_t val)
+{
+	reg->type = REG_SCALAR;
+	reg->min = val;
+	reg->max = val;
+}
+
+static void
+mark_range(struct reg_state* reg, int64_t min, int64_t max)
+{
+	reg->type = REG_SCALAR;
+	reg->min = min;
+	reg->max = max;
+}
+
+static bool
+is_jump(uint8_t opcode)
+{
+	uint8_t cls = opcode & EBPF_CLS_MASK;
+	if (cls != EBPF_CLS_JMP && cls != EBPF_CLS_JMP32) {
+		return false;
+	}
+	return opcode != EBPF_OP_CALL && opcode != EBPF_OP_EXIT;
+}
+
+static int
+mem_size(uint8_t opcode)
+{
+	switch (opcode & 0x18) {
+		case EBPF_SIZE_B:
+			return 1;
+		case EBPF_SIZE_H:
+			return 2;
+		case EBPF_SIZE_W:
+			return 4;
+		default:
+			return 8;
+	}
+}
+
+/* Join src into dst, returns true if dst changed. */
+static bool
+join_reg(struct reg_state* dst, const struct reg_state* src, bool widen)
+{
+	struct reg_state old = *dst;
+
+	if (dst->type == REG_NOT_INIT || src->type == REG_NOT_INIT) {
+		dst->type = REG_NOT_INIT;
+		dst->min = dst->max = 0;
+	} else if (dst->type != src->type) {
+		mark_unknown(dst);
+	} else {
+		if (src->min < dst->min) {
+			dst->min = widen ? INT64_MIN : src->min;
+		}
+		if (src->max > dst->max) {
+			dst->max = widen ? INT64_MAX : src->max;
+		}
+	}
+	return memcmp(&old, dst, sizeof(old)) != 0;
+}
+
+static bool
+join_state(struct verifier_state* dst, const struct verifier_state* src, bool widen)
+{
+	bool changed = false;
+	for (int i = 0; i < NUM_REGS; i++) {
+		changed |= join_reg(&dst->regs[i], &src->regs[i], widen);
+	}
+	for (int i = 0; i < STACK_SLOTS; i++) {
+		changed |= join_reg(&dst->stack[i], &src->stack[i], widen);
+	}
+	return changed;
+}
+
+static void
+push_target(struct verifier_env* env, uint32_t pc, const struct verifier_state* state)
+{
+	int32_t idx = env->target_idx[pc];
+	struct verifier_state* target = &env->states[idx];
+
+	if (env->visits[idx] == 0) {
+		*target = *state;
+	} else if (!join_state(target, state, env->visits[idx] >= WIDEN_AFTER_VISITS)) {
+		return;
+	}
+	if (env->visits[idx] < UINT16_MAX) {
+		env->visits[idx]++;
+	}
+	if (!env->queued[idx]) {
+		env->queued[idx] = true;
+		env->worklist[env->worklist_len++] = pc;
+	}
+}
+
+static bool
+check_reg_init(struct verifier_env* env, const struct verifier_state* state, int regno, uint32_t pc)
+{
+	if (state->regs[regno].type == REG_NOT_INIT) {
+		*env->errmsg = ebpf_error("R%d read before init at PC %u", regno, pc);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Check a memory access through ptr + off of the given size, returns the
+ * accessed stack slot range through lo_out (relative to the frame top).
+ */
+static bool
+check_mem_access(
+	struct verifier_env* env, const struct reg_state* ptr, int regno, int16_t off, int size, const char* type, uint32_t pc,
+	int64_t* lo_out)
+{
+	if (ptr->type == REG_NOT_INIT) {
+		*env->errmsg = ebpf_error("R%d read before init at PC %u", regno, pc);
+		return false;
+	}
+	if (ptr->type == REG_SCALAR || ptr->type == REG_HANDLE) {
+		*env->errmsg = ebpf_error("invalid memory %s through %s R%d at PC %u", type, reg_type_str[ptr->type], regno, pc);
+		return false;
+	}
+	if (ptr->min < -MAX_PTR_OFFSET || ptr->max > MAX_PTR_OFFSET) {
+		*env->errmsg = ebpf_error("unbounded %s pointer R%d used for memory %s at PC %u", reg_type_str[ptr->type], regno, type, pc);
+		return false;
+	}
+
+	int64_t lo = ptr->min + off;
+	int64_t hi = ptr->max + off + size;
+	if (ptr->type == REG_PTR_CTX) {
+		if (lo < 0 || hi > (int64_t)env->ctx_size) {
+			*env->errmsg = ebpf_error(
+				"out of bounds ctx %s at PC %u: offset [%" PRId64 ", %" PRId64 ") ctx size %zu", type, pc, lo, hi, env->ctx_size);
+			return false;
+		}
+	} else {
+		if (lo < -EBPF_STACK_SIZE || hi > 0) {
+			*env->errmsg = ebpf_error(
+				"out of bounds stack %s at PC %u: offset [%" PRId64 ", %" PRId64 ") stack size %d", type, pc, lo, hi, EBPF_STACK_SIZE);
+			return false;
+		}
+	}
+	*lo_out = lo;
+	return true;
+}
+
+/* Index of the ctx handle overlapping [lo, hi), or -1. */
+static int
+find_ctx_handle(const struct verifier_env* env, int64_t lo, int64_t hi)
+{
+	for (uint32_t i = 0; i < env->vm->num_ctx_handles; i++) {
+		int64_t off = env->vm->ctx_handles[i].offset;
+		if (off != EBPF_CTX_SELF && lo < off + 8 && off < hi) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void
+do_load(const struct verifier_env* env, struct verifier_state* state, const struct ebpf_inst* inst, const struct reg_state* ptr, int64_t lo)
+{
+	struct reg_state* dst = &state->regs[inst->dst];
+	int size = mem_size(inst->opcode);
+
+	/* Only a full load of a handle field yields the handle, anything else reads its bits as a scalar. */
+	if (ptr->type == REG_PTR_CTX && ptr->min == ptr->max && size == 8) {
+		int idx = find_ctx_handle(env, lo, lo + 8);
+		if (idx >= 0 && env->vm->ctx_handles[idx].offset == lo) {
+			dst->type = REG_HANDLE;
+			dst->min = dst->max = env->vm->ctx_handles[idx].kind;
+			return;
+		}
+	}
+
+	if (ptr->type == REG_PTR_STACK && ptr->min == ptr->max && size == 8 && (lo % 8) == 0) {
+		const struct reg_state* slot = &state->stack[(lo + EBPF_STACK_SIZE) / 8];
+		if (slot->type != REG_NOT_INIT) {
+			*dst = *slot;
+			return;
+		}
+	}
+	if (size == 8) {
+		mark_unknown(dst);
+	} else {
+		mark_range(dst, 0, (int64_t)((1ULL << (size * 8)) - 1));
+	}
+}
+
+static void
+do_store(struct verifier_state* state, const struct ebpf_inst* inst, const struct reg_state* ptr, int64_t lo)
+{
+	int size = mem_size(inst->opcode);
+
+	if (ptr->type != REG_PTR_STACK) {
+		return;
+	}
+	if (ptr->min == ptr->max && size == 8 && (lo % 8) == 0) {
+		struct reg_state* slot = &state->stack[(lo + EBPF_STACK_SIZE) / 8];
+		if ((inst->opcode & EBPF_CLS_MASK) == EBPF_CLS_STX) {
+			*slot = state->regs[inst->src];
+		} else {
+			mark_const(slot, inst->imm);
+		}
+		return;
+	}
+
+	/* Partial or variable offset write, the touched slots no longer hold a spilled register. */
+	int64_t hi = ptr->max - ptr->min + lo + size;
+	for (int64_t pos = lo - (((lo % 8) + 8) % 8); pos < hi; pos += 8) {
+		if (pos >= -EBPF_STACK_SIZE && pos < 0) {
+			mark_unknown(&state->stack[(pos + EBPF_STACK_SIZE) / 8]);
+		}
+	}
+}
+
+/* Scalar [a] op [b] for the range preserving operations, false if unknown.
+ * Shifts by more than max_shift bits are unknown. */
+static bool
+scalar_op(uint8_t op, const struct reg_state* a, const struct reg_state* b, int max_shift, struct reg_state* out)
+{
+	int64_t lo, hi;
+
+	switch (op) {
+		case 0x00: /* add */
+			if (__builtin_add_overflow(a->min, b->min, &lo) || __builtin_add_overflow(a->max, b->max, &hi)) {
+				return false;
+			}
+			break;
+		case 0x10: /* sub */
+			if (__builtin_sub_overflow(a->min, b->max, &lo) || __builtin_sub_overflow(a->max, b->min, &hi)) {
+				return false;
+			}
+			break;
+		case 0x20: /* mul */
+			if (a->min < 0 || b->min < 0 || __builtin_mul_overflow(a->min, b->min, &lo) ||
+				__builtin_mul_overflow(a->max, b->max, &hi)) {
+				return false;
+			}
+			break;
+		case 0x50: /* and */
+			if (b->min == b->max && b->min >= 0) {
+				lo = 0;
+				hi = b->min;
+			} else if (a->min >= 0 && b->min >= 0) {
+				lo = 0;
+				hi = a->max < b->max ? a->max : b->max;
+			} else {
+				return false;
+			}
+			break;
+		case 0x70: /* rsh */
+			if (a->min < 0 || b->min != b->max || b->min < 0 || b->min > max_shift) {
+				return false;
+			}
+			lo = a->min >> b->min;
+			hi = a->max >> b->min;
+			break;
+		case 0x60: /* lsh */
+			if (a->min < 0 || b->min != b->max || b->min < 0 || b->min > max_shift || b->min > 62 ||
+				a->max > (INT64_MAX >> b->min)) {
+				return false;
+			}
+			lo = a->min << b->min;
+			hi = a->max << b->min;
+			break;
+		case 0x30: /* div */
+			if (a->min < 0 || b->min <= 0) {
+				return false;
+			}
+			lo = a->min / b->max;
+			hi = a->max / b->min;
+			break;
+		case 0x90: /* mod */
+			if (a->min < 0 || b->min <= 0) {
+				return false;
+			}
+			lo = 0;
+			hi = b->max - 1 < a->max ? b->max - 1 : a->max;
+			break;
+		case 0xb0: /* mov */
+			lo = b->min;
+			hi = b->max;
+			break;
+		default:
+			return false;
+	}
+	mark_range(out, lo, hi);
+	return true;
+}
+
+/* The range of the low 32 bits of a scalar, zero extended. */
+static void
+narrow_u32(struct reg_state* reg)
+{
+	if (reg->min < 0 || reg->max > UINT32_MAX) {
+		mark_range(reg, 0, UINT32_MAX);
+	}
+}
+
+static bool
+do_alu(struct verifier_env* env, struct verifier_state* state, const struct ebpf_inst* inst, uint32_t pc)
+{
+	uint8_t cls = inst->opcode & EBPF_CLS_MASK;
+	uint8_t op = inst->opcode & EBPF_ALU_OP_MASK;
+	bool is64 = cls == EBPF_CLS_ALU64;
+	struct reg_state* dst = &state->regs[inst->dst];
+	struct reg_state src;
+
+	if (inst->opcode & EBPF_SRC_REG) {
+		if (op != 0xd0 && !check_reg_init(env, state, inst->src, pc)) {
+			return false;
+		}
+		src = state->regs[inst->src];
+	} else if (is64) {
+		mark_const(&src, inst->imm);
+	} else {
+		mark_const(&src, (uint32_t)inst->imm);
+	}
+
+	if (op != 0xb0 && !check_reg_init(env, state, inst->dst, pc)) {
+		return false;
+	}
+
+	if (op == 0xb0 && is64) {
+		*dst = src;
+		return true;
+	}
+
+	/* Pointer arithmetic: only ptr +/- scalar keeps the pointer type. */
+	if (is64 && (op == 0x00 || op == 0x10) && (dst->type >= REG_PTR_CTX || src.type >= REG_PTR_CTX)) {
+		if (dst->type >= REG_PTR_CTX && src.type == REG_SCALAR) {
+			struct reg_state res;
+			if (!scalar_op(op, dst, &src, 63, &res)) {
+				mark_range(&res, INT64_MIN, INT64_MAX);
+			}
+			res.type = dst->type;
+			*dst = res;
+		} else if (op == 0x00 && dst->type == REG_SCALAR && src.type >= REG_PTR_CTX) {
+			struct reg_state res;
+			if (!scalar_op(op, dst, &src, 63, &res)) {
+				mark_range(&res, INT64_MIN, INT64_MAX);
+			}
+			res.type = src.type;
+			*dst = res;
+		} else {
+			mark_unknown(dst);
+		}
+		return true;
+	}
+
+	if (dst->type != REG_SCALAR && op != 0xb0) {
+		mark_unknown(dst);
+	}
+	if (src.type != REG_SCALAR) {
+		mark_unknown(&src);
+	}
+
+	/* 32-bit ops only see the low halves of their operands. */
+	struct reg_state a = *dst;
+	if (!is64) {
+		narrow_u32(&a);
+		narrow_u32(&src);
+	}
+
+	struct reg_state res;
+	if (op == 0xd0 || !scalar_op(op, &a, &src, is64 ? 63 : 31, &res)) {
+		mark_unknown(&res);
+	}
+	if (!is64) {
+		/* 32-bit ops zero extend, anything outside of u32 wrapped around */
+		if (op == 0xb0 && src.min >= 0 && src.max <= UINT32_MAX) {
+			res = src;
+		} else if (res.min < 0 || res.max > UINT32_MAX) {
+			mark_range(&res, 0, UINT32_MAX);
+		}
+	}
+	*dst = res;
+	return true;
+}
+
+/*
+ * Narrow the range of a scalar register compared against a constant.
+ * Returns false if the branch can not be taken with this state.
+ */
+static bool
+refine_cond(struct reg_state* reg, uint8_t mode, int64_t k, bool is_unsigned, bool taken)
+{
+	int64_t min = reg->min, max = reg->max;
+
+	if (reg->type != REG_SCALAR) {
+		return true;
+	}
+	/* Unsigned compares only map onto the signed range for non negative values. */
+	if (is_unsigned && (min < 0 || k < 0)) {
+		return true;
+	}
+
+	if (!taken) {
+		switch (mode) {
+			case EBPF_MODE_JEQ:
+				mode = EBPF_MODE_JNE;
+				break;
+			case EBPF_MODE_JNE:
+				mode = EBPF_MODE_JEQ;
+				break;
+			case EBPF_MODE_JGT:
+			case EBPF_MODE_JSGT:
+				mode = EBPF_MODE_JLE;
+				break;
+			case EBPF_MODE_JGE:
+			case EBPF_MODE_JSGE:
+				mode = EBPF_MODE_JLT;
+				break;
+			case EBPF_MODE_JLT:
+			case EBPF_MODE_JSLT:
+				mode = EBPF_MODE_JGE;
+				break;
+			case EBPF_MODE_JLE:
+			case EBPF_MODE_JSLE:
+				mode = EBPF_MODE_JGT;
+				break;
+			default:
+				return true;
+		}
+	}
+
+	switch (mode) {
+		case EBPF_MODE_JEQ:
+			if (k < min || k > max) {
+				return false;
+			}
+			min = max = k;
+			break;
+		case EBPF_MODE_JNE:
+			if (min == max && min == k) {
+				return false;
+			}
+			if (min == k) {
+				min++;
+			} else if (max == k) {
+				max--;
+			}
+			break;
+		case EBPF_MODE_JGT:
+		case EBPF_MODE_JSGT:
+			if (k == INT64_MAX) {
+				return false;
+			}
+			if (min < k + 1) {
+				min = k + 1;
+			}
+			break;
+		case EBPF_MODE_JGE:
+		case EBPF_MODE_JSGE:
+			if (min < k) {
+				min = k;
+			}
+			break;
+		case EBPF_MODE_JLT:
+		case EBPF_MODE_JSLT:
+			if (k == INT64_MIN) {
+				return false;
+			}
+			if (max > k - 1) {
+				max = k - 1;
+			}
+			break;
+		case EBPF_MODE_JLE:
+		case EBPF_MODE_JSLE:
+			if (max > k) {
+				max = k;
+			}
+			break;
+		default:
+			return true;
+	}
+	if (min > max) {
+		return false;
+	}
+	reg->min = min;
+	reg->max = max;
+	return true;
+}
+
+static bool
+do_jump(struct verifier_env* env, struct verifier_state* state, const struct ebpf_inst* inst, uint32_t pc, bool* fallthrough)
+{
+	uint8_t mode = inst->opcode & EBPF_JMP_OP_MASK;
+	uint32_t target = pc + 1 + inst->offset;
+
+	if ((int32_t)target <= (int32_t)pc && !(env->flags & EBPF_VERIFY_ALLOW_BACK_EDGES)) {
+		*env->errmsg = ebpf_error("back-edge from PC %u to PC %u, loops are not allowed", pc, target);
+		return false;
+	}
+
+	if (inst->opcode == EBPF_OP_JA) {
+		push_target(env, target, state);
+		*fallthrough = false;
+		return true;
+	}
+
+	if (!check_reg_init(env, state, inst->dst, pc)) {
+		return false;
+	}
+	if ((inst->opcode & EBPF_SRC_REG) && !check_reg_init(env, state, inst->src, pc)) {
+		return false;
+	}
+
+	/* Only compares against a known constant narrow the register range. */
+	bool has_const = true;
+	int64_t k;
+	if (inst->opcode & EBPF_SRC_REG) {
+		const struct reg_state* src = &state->regs[inst->src];
+		has_const = src->type == REG_SCALAR && src->min == src->max;
+		k = src->min;
+	} else {
+		k = inst->imm;
+	}
+
+	struct verifier_state taken = *state;
+	bool can_take = true, can_fall = true;
+	bool is_unsigned = mode == EBPF_MODE_JGT || mode == EBPF_MODE_JGE || mode == EBPF_MODE_JLT || mode == EBPF_MODE_JLE;
+	struct reg_state* dst = &state->regs[inst->dst];
+
+	if ((inst->opcode & EBPF_CLS_MASK) == EBPF_CLS_JMP32) {
+		/* 32-bit compares are only refined when both sides fit in the positive s32 range. */
+		has_const = has_const && k >= 0 && k <= INT32_MAX && dst->min >= 0 && dst->max <= INT32_MAX;
+	}
+	if (has_const && mode != EBPF_MODE_JSET) {
+		can_take = refine_cond(&taken.regs[inst->dst], mode, k, is_unsigned, true);
+		can_fall = refine_cond(dst, mode, k, is_unsigned, false);
+	}
+
+	if (can_take) {
+		push_target(env, target, &taken);
+	}
+	*fallthrough = can_fall;
+	return true;
+}
+
+/* r1-r5 must match the argument types the helper was registered with. */
+static bool
+check_helper_call(struct verifier_env* env, const struct verifier_state* state, const struct ebpf_inst* inst, uint32_t pc)
+{
+	const char* name = env->vm->ext_func_names[inst->imm];
+	const struct ebpf_helper_args* args = &env->vm->ext_func_args[inst->imm];
+	int64_t lo;
+
+	if (!args->registered) {
+		*env->errmsg = ebpf_error("call to helper %s without argument types at PC %u", name, pc);
+		return false;
+	}
+	for (int i = 0; i < EBPF_MAX_HELPER_ARGS; i++) {
+		const struct reg_state* reg = &state->regs[i + 1];
+		uint8_t type = args->types[i];
+
+		if (type == EBPF_ARG_NONE) {
+			continue;
+		}
+		if (reg->type == REG_NOT_INIT) {
+			*env->errmsg = ebpf_error("R%d read before init at PC %u", i + 1, pc);
+			return false;
+		}
+		if (type == EBPF_ARG_SCALAR) {
+			if (reg->type != REG_SCALAR) {
+				*env->errmsg = ebpf_error("R%d passed to %s must be a scalar, got %s at PC %u", i + 1, name, reg_type_str[reg->type], pc);
+				return false;
+			}
+		} else if (type == EBPF_ARG_PTR_TO_MEM) {
+			/* ebpf_register_args() made sure the size follows. */
+			const struct reg_state* size = &state->regs[i + 2];
+			if (size->type != REG_SCALAR || size->min < 0 || size->max > INT32_MAX) {
+				*env->errmsg = ebpf_error("R%d passed to %s must be a bounded size at PC %u", i + 2, name, pc);
+				return false;
+			}
+			if (!check_mem_access(env, reg, i + 1, 0, (int)size->max, "helper access", pc, &lo)) {
+				return false;
+			}
+		} else {
+			uint8_t kind = type - EBPF_ARG_HANDLE;
+			if (reg->type != REG_HANDLE || reg->min != kind || reg->max != kind) {
+				*env->errmsg = ebpf_error("R%d passed to %s must be a handle of kind %u, got %s at PC %u", i + 1, name, kind, reg_type_str[reg->type], pc);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool
+verify_block(struct verifier_env* env, uint32_t pc)
+{
+	struct verifier_state state = env->states[env->target_idx[pc]];
+
+	while (1) {
+		const struct ebpf_inst* inst = &env->insts[pc];
+		uint8_t cls = inst->opcode & EBPF_CLS_MASK;
+		uint32_t next_pc = pc + 1;
+		int64_t lo;
+
+		if (inst->opcode == EBPF_OP_LDDW) {
+			mark_const(&state.regs[inst->dst], (int64_t)((uint64_t)(uint32_t)inst->imm | ((uint64_t)env->insts[pc + 1].imm << 32)));
+			next_pc = pc + 2;
+		} else if (cls == EBPF_CLS_ALU || cls == EBPF_CLS_ALU64) {
+			if (!do_alu(env, &state, inst, pc)) {
+				return false;
+			}
+		} else if (cls == EBPF_CLS_LDX) {
+			const struct reg_state ptr = state.regs[inst->src];
+			if (!check_mem_access(env, &ptr, inst->src, inst->offset, mem_size(inst->opcode), "load", pc, &lo)) {
+				return false;
+			}
+			do_load(env, &state, inst, &ptr, lo);
+		} else if (cls == EBPF_CLS_ST || cls == EBPF_CLS_STX) {
+			const struct reg_state ptr = state.regs[inst->dst];
+			if (cls == EBPF_CLS_STX && !check_reg_init(env, &state, inst->src, pc)) {
+				return false;
+			}
+			if (!check_mem_access(env, &ptr, inst->dst, inst->offset, mem_size(inst->opcode), "store", pc, &lo)) {
+				return false;
+			}
+			if (ptr.type == REG_PTR_CTX && find_ctx_handle(env, lo, ptr.max - ptr.min + lo + mem_size(inst->opcode)) >= 0) {
+				*env->errmsg = ebpf_error("store to ctx handle at PC %u", pc);
+				return false;
+			}
+			do_store(&state, inst, &ptr, lo);
+		} else if (inst->opcode == EBPF_OP_CALL) {
+			if (!check_helper_call(env, &state, inst, pc)) {
+				return false;
+			}
+			/* r1-r5 are clobbered and r0 is the result. */
+			for (int i = 1; i <= 5; i++) {
+				state.regs[i].type = REG_NOT_INIT;
+			}
+			mark_unknown(&state.regs[0]);
+		} else if (inst->opcode == EBPF_OP_EXIT) {
+			return check_reg_init(env, &state, 0, pc);
+		} else if (is_jump(inst->opcode)) {
+			bool fallthrough = true;
+			if (!do_jump(env, &state, inst, pc, &fallthrough)) {
+				return false;
+			}
+			if (!fallthrough) {
+				return true;
+			}
+		}
+
+		if (next_pc >= env->num_insts) {
+			*env->errmsg = ebpf_error("PC %u falls off the end of the program", pc);
+			return false;
+		}
+		if (env->target_idx[next_pc] >= 0) {
+			push_target(env, next_pc, &state);
+			return true;
+		}
+		pc = next_pc;
+	}
+}
+
+/* A ctx that is itself a handle can not be dereferenced. */
+static void
+mark_ctx_self(const struct ebpf_vm* vm, struct reg_state* reg)
+{
+	for (uint32_t i = 0; i < vm->num_ctx_handles; i++) {
+		if (vm->ctx_handles[i].offset == EBPF_CTX_SELF) {
+			reg->type = REG_HANDLE;
+			reg->min = reg->max = vm->ctx_handles[i].kind;
+		}
+	}
+}
+
+int
+ebpf_verify(struct ebpf_vm* vm, size_t ctx_size, uint32_t flags, char** errmsg)
+{
+	struct verifier_env env;
+	uint32_t num_targets = 0;
+	int ret = -1;
+
+	*errmsg = NULL;
+	if (vm->insts == NULL || vm->num_insts == 0) {
+		*errmsg = ebpf_error("no code loaded");
+		return -1;
+	}
+
+	memset(&env, 0, sizeof(env));
+	env.vm = vm;
+	env.insts = vm->insts;
+	env.num_insts = vm->num_insts;
+	env.ctx_size = ctx_size;
+	env.flags = flags;
+	env.errmsg = errmsg;
+
+	/* pc 0, jump targets and fallthroughs after conditional jumps start a block */
+	env.target_idx = malloc(env.num_insts * sizeof(*env.target_idx));
+	if (env.target_idx == NULL) {
+		*errmsg = ebpf_error("out of memory");
+		return -1;
+	}
+	for (uint32_t i = 0; i < env.num_insts; i++) {
+		env.target_idx[i] = -1;
+	}
+	env.target_idx[0] = num_targets++;
+	for (uint32_t i = 0; i < env.num_insts; i++) {
+		const struct ebpf_inst* inst = &env.insts[i];
+		if (inst->opcode == EBPF_OP_LDDW) {
+			i++;
+			continue;
+		}
+		if (!is_jump(inst->opcode)) {
+			continue;
+		}
+		uint32_t target = i + 1 + inst->offset;
+		if (env.target_idx[target] < 0) {
+			env.target_idx[target] = num_targets++;
+		}
+		if (inst->opcode != EBPF_OP_JA && i + 1 < env.num_insts && env.target_idx[i + 1] < 0) {
+			env.target_idx[i + 1] = num_targets++;
+		}
+	}
+
+	env.states = calloc(num_targets, sizeof(*env.states));
+	env.visits = calloc(num_targets, sizeof(*env.visits));
+	env.queued = calloc(num_targets, sizeof(*env.queued));
+	env.worklist = calloc(num_targets, sizeof(*env.worklist));
+	if (env.states == NULL || env.visits == NULL || env.queued == NULL || env.worklist == NULL) {
+		*errmsg = ebpf_error("out of memory");
+		goto out;
+	}
+
+	struct verifier_state entry;
+	memset(&entry, 0, sizeof(entry));
+	if (ctx_size > 0) {
+		entry.regs[1].type = REG_PTR_CTX;
+	} else {
+		mark_unknown(&entry.regs[1]);
+	}
+	mark_ctx_self(vm, &entry.regs[1]);
+	mark_unknown(&entry.regs[2]);
+	entry.regs[10].type = REG_PTR_STACK;
+	push_target(&env, 0, &entry);
+
+	while (env.worklist_len > 0) {
+		uint32_t pc = env.worklist[--env.worklist_len];
+		env.queued[env.target_idx[pc]] = false;
+		if (!verify_block(&env, pc)) {
+			goto out;
+		}
+	}
+
+	vm->verified = true;
+	vm->verified_ctx_size = ctx_size;
+	ret = 0;
+
+out:
+	free(env.target_idx);
+	free(env.states);
+	free(env.visits);
+	free(env.queued);
+	free(env.worklist);
+	return ret;
+}
+
+bool
+ebpf_is_verified(const struct ebpf_vm* vm)
+{
+	return vm->verified;
+}
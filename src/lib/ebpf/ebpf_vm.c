@@ -69,7 +69,20 @@ ebpf_create(void)
 		return NULL;
 	}
 
+	vm->ext_func_inlines = calloc(MAX_EXT_FUNCS, sizeof(*vm->ext_func_inlines));
+	if (vm->ext_func_inlines == NULL) {
+		ebpf_destroy(vm);
+		return NULL;
+	}
+
+	vm->ext_func_args = calloc(MAX_EXT_FUNCS, sizeof(*vm->ext_func_args));
+	if (vm->ext_func_args == NULL) {
+		ebpf_destroy(vm);
+		return NULL;
+	}
+
 	vm->bounds_check_enabled = true;
+	vm->jit_optimize = true;
 	vm->error_printf = fprintf;
 
 #if defined(__x86_64__) || defined(_M_X64)
@@ -89,6 +102,8 @@ ebpf_destroy(struct ebpf_vm* vm)
 	ebpf_unload_code(vm);
 	free(vm->ext_funcs);
 	free(vm->ext_func_names);
+	free(vm->ext_func_inlines);
+	free(vm->ext_func_args);
 	free(vm);
 }
 
@@ -101,10 +116,128 @@ ebpf_register(struct ebpf_vm* vm, unsigned int idx, const char* name, void* fn)
 
 	vm->ext_funcs[idx] = (ext_func)fn;
 	vm->ext_func_names[idx] = name;
+	vm->ext_func_inlines[idx].insts = NULL;
+	vm->ext_func_inlines[idx].num_insts = 0;
+	memset(&vm->ext_func_args[idx], 0, sizeof(vm->ext_func_args[idx]));
+
+	return 0;
+}
+
+int
+ebpf_register_args(struct ebpf_vm* vm, unsigned int idx, const uint8_t* args, uint32_t num_args)
+{
+	if (idx >= MAX_EXT_FUNCS || vm->ext_funcs[idx] == NULL || num_args > EBPF_MAX_HELPER_ARGS) {
+		return -1;
+	}
+	// 指针参数后面必须是它的长度
+	for (uint32_t i = 0; i < num_args; i++) {
+		if (args[i] == EBPF_ARG_PTR_TO_MEM && (i + 1 >= num_args || args[i + 1] != EBPF_ARG_SCALAR)) {
+			return -1;
+		}
+	}
 
+	struct ebpf_helper_args* types = &vm->ext_func_args[idx];
+	memset(types, 0, sizeof(*types));
+	memcpy(types->types, args, num_args);
+	types->registered = true;
 	return 0;
 }
 
+int
+ebpf_register_ctx_handle(struct ebpf_vm* vm, int32_t offset, uint8_t kind)
+{
+	if (offset < EBPF_CTX_SELF || kind > UINT8_MAX - EBPF_ARG_HANDLE) {
+		return -1;
+	}
+	for (uint32_t i = 0; i < vm->num_ctx_handles; i++) {
+		if (vm->ctx_handles[i].offset == offset) {
+			vm->ctx_handles[i].kind = kind;
+			return 0;
+		}
+	}
+	if (vm->num_ctx_handles == EBPF_MAX_CTX_HANDLES) {
+		return -1;
+	}
+	vm->ctx_handles[vm->num_ctx_handles].offset = offset;
+	vm->ctx_handles[vm->num_ctx_handles].kind = kind;
+	vm->num_ctx_handles++;
+	return 0;
+}
+
+int
+ebpf_register_inline(struct ebpf_vm* vm, unsigned int idx, const struct ebpf_inst* insts, uint32_t num_insts)
+{
+	if (idx >= MAX_EXT_FUNCS || vm->ext_funcs[idx] == NULL) {
+		return -1;
+	}
+	if (num_insts == 0 || num_insts > EBPF_MAX_INLINE_INSTS || insts[num_insts - 1].opcode != EBPF_OP_EXIT) {
+		return -1;
+	}
+
+	// 只允许r0-r5和前向跳转，不能call和访问栈，JIT不需要为内联体保存寄存器
+	for (uint32_t i = 0; i < num_insts; i++) {
+		struct ebpf_inst inst = insts[i];
+		if (inst.dst > 5 || inst.src > 5) {
+			return -1;
+		}
+		switch (inst.opcode) {
+		case EBPF_OP_ADD64_IMM:
+		case EBPF_OP_ADD64_REG:
+		case EBPF_OP_SUB64_IMM:
+		case EBPF_OP_SUB64_REG:
+		case EBPF_OP_AND64_IMM:
+		case EBPF_OP_AND64_REG:
+		case EBPF_OP_OR64_IMM:
+		case EBPF_OP_OR64_REG:
+		case EBPF_OP_LSH64_IMM:
+		case EBPF_OP_RSH64_IMM:
+		case EBPF_OP_MOV64_IMM:
+		case EBPF_OP_MOV64_REG:
+		case EBPF_OP_LDXW:
+		case EBPF_OP_LDXH:
+		case EBPF_OP_LDXB:
+		case EBPF_OP_LDXDW:
+		case EBPF_OP_STXW:
+		case EBPF_OP_STXH:
+		case EBPF_OP_STXB:
+		case EBPF_OP_STXDW:
+		case EBPF_OP_EXIT:
+			break;
+		case EBPF_OP_JA:
+		case EBPF_OP_JEQ_IMM:
+		case EBPF_OP_JEQ_REG:
+		case EBPF_OP_JNE_IMM:
+		case EBPF_OP_JNE_REG:
+		case EBPF_OP_JGT_IMM:
+		case EBPF_OP_JGT_REG:
+		case EBPF_OP_JGE_IMM:
+		case EBPF_OP_JGE_REG:
+		case EBPF_OP_JLT_IMM:
+		case EBPF_OP_JLT_REG:
+		case EBPF_OP_JLE_IMM:
+		case EBPF_OP_JLE_REG:
+			if (inst.offset < 0 || i + 1 + inst.offset >= num_insts) {
+				return -1;
+			}
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	vm->ext_func_inlines[idx].insts = insts;
+	vm->ext_func_inlines[idx].num_insts = num_insts;
+	return 0;
+}
+
+bool
+ebpf_toggle_jit_optimize(struct ebpf_vm* vm, bool enable)
+{
+	bool old = vm->jit_optimize;
+	vm->jit_optimize = enable;
+	return old;
+}
+
 int
 ebpf_set_unwind_function_index(struct ebpf_vm* vm, unsigned int idx)
 {
@@ -169,7 +302,8 @@ void
 ebpf_unload_code(struct ebpf_vm* vm)
 {
 	if (vm->jitted) {
-		munmap(vm->jitted, vm->jitted_size);
+		ebpf_jit_code_unref(vm->jit_code);
+		vm->jit_code = NULL;
 		vm->jitted = NULL;
 		vm->jitted_size = 0;
 	}
@@ -178,6 +312,8 @@ ebpf_unload_code(struct ebpf_vm* vm)
 		vm->insts = NULL;
 		vm->num_insts = 0;
 	}
+	vm->verified = false;
+	vm->verified_ctx_size = 0;
 }
 
 static uint32_t
@@ -252,6 +388,8 @@ ebpf_exec(const struct ebpf_vm* vm, void* mem, size_t mem_len, uint64_t* bpf_ret
 	uint64_t* reg;
 	uint64_t _reg[16];
 	uint64_t stack[(EBPF_STACK_SIZE + 7) / 8];
+	/* Verified code only touches ctx/stack in bounds, as long as the ctx is big enough. */
+	const bool check_bounds = vm->bounds_check_enabled && !(vm->verified && mem_len >= vm->verified_ctx_size);
 
 	if (!insts) {
 		/* Code must be loaded before we can execute */
@@ -472,19 +610,17 @@ ebpf_exec(const struct ebpf_vm* vm, void* mem, size_t mem_len, uint64_t* bpf_ret
 				break;
 
 				/*
-				 * HACK runtime bounds check
-				 *
-				 * Needed since we don't have a verifier yet.
+				 * Runtime bounds check, skipped for code accepted by ebpf_verify().
 				 */
 #define BOUNDS_CHECK_LOAD(size)                                                                                 \
 	do {                                                                                                        \
-		if (!bounds_check(vm, (char*)reg[inst.src] + inst.offset, size, "load", cur_pc, mem, mem_len, stack)) { \
+		if (check_bounds && !bounds_check(vm, (char*)reg[inst.src] + inst.offset, size, "load", cur_pc, mem, mem_len, stack)) { \
 			return -1;                                                                                          \
 		}                                                                                                       \
 	} while (0)
 #define BOUNDS_CHECK_STORE(size)                                                                                 \
 	do {                                                                                                         \
-		if (!bounds_check(vm, (char*)reg[inst.dst] + inst.offset, size, "store", cur_pc, mem, mem_len, stack)) { \
+		if (check_bounds && !bounds_check(vm, (char*)reg[inst.dst] + inst.offset, size, "store", cur_pc, mem, mem_len, stack)) { \
 			return -1;                                                                                           \
 		}                                                                                                        \
 	} while (0)
@@ -782,6 +918,32 @@ ebpf_exec(const struct ebpf_vm* vm, void* mem, size_t mem_len, uint64_t* bpf_ret
 	}
 }
 
+int
+ebpf_exec_batch(const struct ebpf_vm* vm, void** mems, size_t mem_len, uint64_t* bpf_return_values, size_t num)
+{
+	int ret = 0;
+
+	if (!vm->insts) {
+		return -1;
+	}
+
+	if (vm->jitted) {
+		const ebpf_jit_fn fn = vm->jitted;
+		for (size_t i = 0; i < num; i++) {
+			bpf_return_values[i] = fn(mems[i], mem_len);
+		}
+		return 0;
+	}
+
+	for (size_t i = 0; i < num; i++) {
+		if (ebpf_exec(vm, mems[i], mem_len, &bpf_return_values[i]) != 0) {
+			bpf_return_values[i] = 0;
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
 static bool
 validate(const struct ebpf_vm* vm, const struct ebpf_inst* insts, uint32_t num_insts, char** errmsg)
 {
@@ -24,15 +24,46 @@
 struct ebpf_inst;
 typedef uint64_t (*ext_func)(uint64_t arg0, uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4);
 
+#define EBPF_MAX_INLINE_INSTS 64
+
+/* eBPF body the JIT splices in place of a call, see ebpf_register_inline() */
+struct ebpf_inline_helper
+{
+    const struct ebpf_inst* insts;
+    uint32_t num_insts;
+};
+
+/* Argument types of an external function, see ebpf_register_args() */
+struct ebpf_helper_args
+{
+    bool registered;
+    uint8_t types[EBPF_MAX_HELPER_ARGS];
+};
+
+/* Opaque handle stored in the ctx, see ebpf_register_ctx_handle() */
+struct ebpf_ctx_handle
+{
+    int32_t offset;
+    uint8_t kind;
+};
+
 struct ebpf_vm
 {
     struct ebpf_inst* insts;
     uint16_t num_insts;
     ebpf_jit_fn jitted;
     size_t jitted_size;
+    struct ebpf_jit_code* jit_code; /* slot in the shared JIT arena backing jitted */
     ext_func* ext_funcs;
     const char** ext_func_names;
+    struct ebpf_inline_helper* ext_func_inlines;
+    struct ebpf_helper_args* ext_func_args;
+    struct ebpf_ctx_handle ctx_handles[EBPF_MAX_CTX_HANDLES];
+    uint32_t num_ctx_handles;
     bool bounds_check_enabled;
+    bool jit_optimize;        /* helper inlining and peephole fusion in the JIT */
+    bool verified;            /* set by ebpf_verify(), cleared on unload */
+    size_t verified_ctx_size; /* ctx size the program was verified against */
     int (*error_printf)(FILE* stream, const char* format, ...);
     int (*translate)(struct ebpf_vm* vm, uint8_t* buffer, size_t* size, char** errmsg);
     int unwind_stack_extension_index;
@@ -50,6 +81,17 @@ ebpf_translate_x86_64(struct ebpf_vm* vm, uint8_t* buffer, size_t* size, char**
 int
 ebpf_translate_null(struct ebpf_vm* vm, uint8_t* buffer, size_t* size, char** errmsg);
 
+/* Shared executable arena for JIT output, see ebpf_jit_arena.c. */
+struct ebpf_jit_code;
+struct ebpf_jit_code*
+ebpf_jit_arena_alloc(const uint8_t* code, size_t code_size, char** errmsg);
+ebpf_jit_fn
+ebpf_jit_code_fn(const struct ebpf_jit_code* jc);
+struct ebpf_jit_code*
+ebpf_jit_code_ref(struct ebpf_jit_code* jc);
+void
+ebpf_jit_code_unref(struct ebpf_jit_code* jc);
+
 char*
 ebpf_error(const char* fmt, ...);
 unsigned int
@@ -4,6 +4,9 @@
 
 #define SCHEDULE_TI 500
 #define FRONT_DATA_STREAM_ID 1
+// 循环必须有固定上界, verifier不接受回边
+#define FRONT_MAX_DROP 16
+#define FRONT_MAX_SEND 5
 
 
 SEC("ewfd/default")
@@ -21,45 +24,51 @@ uint64_t ewfd_init(void *ewfd_unit) {
 
 SEC("ewfd/front/padding/tick")
 uint64_t ewfd_tick(struct ewfd_circ_status_t *ewfd_status) {
-	log_print("[ebpf] ewfd_front_tick: %d\n", __LINE__);
 	uint64_t ret = (uint64_t) 1 << 32;
 
 	uint64_t ewfd_unit = ewfd_status->ewfd_unit;
-
-	// tor_assert(timeline_default);
-	uint32_t now_ti = ewfd_status->now_ti;
-	uint32_t start_ti = ewfd_status->padding_start_ti;
 	uint32_t next_ti = ewfd_data_stream_fetch(ewfd_unit, FRONT_DATA_STREAM_ID);
 
-	log_print("[padding-unit] next-ti: %d\n", next_ti);
-
 	if (next_ti == (uint32_t) -1) {
-		log_print("load more data: %u\n", now_ti);
 		ewfd_data_stream_load_more(ewfd_unit, FRONT_DATA_STREAM_ID);
-		ewfd_status->padding_start_ti = now_ti;
+		ewfd_status->padding_start_ti = ewfd_status->now_ti;
 		return 0;
 	}
 
 	int t = 0;
-	uint32_t send_ti = start_ti + next_ti;
-
-	log_print("[padding-unit] start-ti: %u send-ti: %u", start_ti, send_ti);
-
-	// remove out of date packet
-	while (send_ti < now_ti) {
+	uint32_t send_ti = ewfd_status->padding_start_ti + next_ti;
+
+	// remove out of date packet, 每个tick最多丢弃FRONT_MAX_DROP个, 剩下的下个tick继续
+	#pragma unroll
+	for (int i = 0; i < FRONT_MAX_DROP; i++) {
+		if (send_ti >= ewfd_status->now_ti) {
+			goto send;
+		}
 		ewfd_data_stream_dequeue(ewfd_unit, FRONT_DATA_STREAM_ID);
-		send_ti = start_ti + ewfd_data_stream_fetch(ewfd_unit, FRONT_DATA_STREAM_ID);
+		next_ti = ewfd_data_stream_fetch(ewfd_unit, FRONT_DATA_STREAM_ID);
+		if (next_ti == (uint32_t) -1) {
+			return 0;
+		}
+		send_ti = ewfd_status->padding_start_ti + next_ti;
 	}
+	return 0;
 
-	while (send_ti < now_ti + SCHEDULE_TI && t < 5) {
+send:
+	#pragma unroll
+	for (int i = 0; i < FRONT_MAX_SEND; i++) {
+		if (send_ti >= ewfd_status->now_ti + SCHEDULE_TI) {
+			break;
+		}
 		ewfd_add_dummy_packet((void *) ewfd_status->on_circ, send_ti);
-		ewfd_data_stream_dequeue(ewfd_unit, FRONT_DATA_STREAM_ID);
-		send_ti = now_ti + ewfd_data_stream_fetch(ewfd_unit, FRONT_DATA_STREAM_ID);
 		t++;
+		ewfd_data_stream_dequeue(ewfd_unit, FRONT_DATA_STREAM_ID);
+		next_ti = ewfd_data_stream_fetch(ewfd_unit, FRONT_DATA_STREAM_ID);
+		if (next_ti == (uint32_t) -1) { // 数据流耗尽, 下个tick重新load
+			break;
+		}
+		send_ti = ewfd_status->now_ti + next_ti;
 	}
-	log_print("want to add padding packet: %d %u\n", t, send_ti);
 	return ret | t;
-	// return status->send_cell_cnt + (uint64_t) status->recv_cell_cnt;
 }
 
 /*
@@ -35,7 +35,9 @@ typedef struct ewfd_circ_status_t {
 
 	// __OUT 
 	uint32_t next_tick;
-} __attribute__((packed, aligned(4))) ewfd_circ_status_st;
+} __attribute__((aligned(8))) ewfd_circ_status_st; // 自然对齐, 共56字节
+
+// ewfd_unit和on_circ是handle, 只能用一次8字节load读出后原样传给helper
 
 // helpers
 
@@ -50,6 +52,8 @@ static long (*ebpf_log_print)(const char *fmt, uint32_t fmt_size, ...) = (void *
 // helpers for ewfd packet/schedule
 static int (*ewfd_add_dummy_packet)(void *circut, uint32_t send_ti) = (void *) 6;
 static int (*ewfd_op_delay)(void *circut, uint32_t insert_ti, uint32_t delay_ms, uint32_t n_pkt) = (void *) 7;
+// event_type: 0 dummy, 1 delay, 2 notify, others: all events
+static int (*ewfd_get_event_num)(void *circut, uint32_t event_type) = (void *) 8;
 
 
 // helpers for data stream
@@ -63,5 +67,10 @@ static void (*ewfd_histogram_init)(uint64_t ewfd_unit, uint32_t map_idx, uint32_
 static uint32_t (*ewfd_histogram_get)(uint64_t ewfd_unit, uint32_t map_idx, uint8_t index) = (void *) 22;
 static bool (*ewfd_histogram_set)(uint64_t ewfd_unit, uint32_t map_idx, uint8_t index, uint32_t token) = (void *) 23;
 
+// helpers for array, 下标越界时get返回0
+static bool (*ewfd_array_init)(uint64_t ewfd_unit, uint32_t map_idx, uint32_t max_entries) = (void *) 24;
+static uint64_t (*ewfd_array_get)(uint64_t ewfd_unit, uint32_t map_idx, uint32_t key) = (void *) 25;
+static bool (*ewfd_array_set)(uint64_t ewfd_unit, uint32_t map_idx, uint32_t key, uint64_t val) = (void *) 26;
+
 static void (*ewfd_set_var)(uint64_t ewfd_unit, uint8_t tag, uint32_t val) = (void *) 30;
 static uint32_t (*ewfd_load_var)(uint64_t ewfd_unit, uint8_t tag) = (void *) 31;
\ No newline at end of file
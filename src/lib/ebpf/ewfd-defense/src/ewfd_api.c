@@ -12,12 +12,26 @@
 struct ewfd_unit_t *ewfd_unit_new(void) {
 	struct ewfd_unit_t * unit = (struct ewfd_unit_t *) calloc(1, sizeof(struct ewfd_unit_t));
 	unit->vm = ebpf_create();
-	ewfd_register_datastream_helpers(unit->vm);
-	ewfd_register_histrogram_helpers(unit->vm);
+	unit->own_vm = true;
+	ewfd_register_unit_helpers(unit->vm);
 	
 	return unit;
 }
 
+struct ewfd_unit_t *ewfd_unit_new_shared(struct ebpf_vm *vm) {
+	struct ewfd_unit_t * unit = (struct ewfd_unit_t *) calloc(1, sizeof(struct ewfd_unit_t));
+	unit->vm = vm;
+	unit->own_vm = false;
+
+	return unit;
+}
+
+void ewfd_register_unit_helpers(struct ebpf_vm *vm) {
+	ewfd_register_datastream_helpers(vm);
+	ewfd_register_histrogram_helpers(vm);
+	ewfd_register_array_helpers(vm);
+}
+
 void ewfd_unit_clear(struct ewfd_unit_t *ctx) {
 	// printf("ewfd clear units----------------\n");
 	// clear maps
@@ -33,9 +47,10 @@ void ewfd_unit_clear(struct ewfd_unit_t *ctx) {
 		}
 		free(ctx->map_table.fd_table);
 	}
-	if (ctx->vm != NULL) {
+	if (ctx->vm != NULL && ctx->own_vm) {
 		ebpf_destroy(ctx->vm);
 	}
+	ctx->vm = NULL;
 }
 
 
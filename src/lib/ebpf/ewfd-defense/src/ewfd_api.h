@@ -4,6 +4,7 @@
 #include "ewfd_maps.h"
 #include "ewfd_helper.h"
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -14,12 +15,16 @@ eWFD接口：
 struct ebpf_vm;
 typedef struct ewfd_unit_t {
 	struct ebpf_vm *vm;
+	bool own_vm; // false: vm是多个unit共享的，不在unit中释放
 	int times;
 	uint32_t total_ti;
 	ewfd_map_fdtable_st map_table;
 } ewfd_unit_st;
 
 struct ewfd_unit_t *ewfd_unit_new(void);
+// 使用外部已加载的vm，unit只维护自己的maps
+struct ewfd_unit_t *ewfd_unit_new_shared(struct ebpf_vm *vm);
+void ewfd_register_unit_helpers(struct ebpf_vm *vm);
 void ewfd_unit_clear(struct ewfd_unit_t *unit);
 int ebpf_run_code(struct ebpf_vm *vm, void *mem, size_t mem_len, uint64_t *ret_val);
 
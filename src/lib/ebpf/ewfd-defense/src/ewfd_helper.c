@@ -1,6 +1,7 @@
 #include "ewfd_helper.h"
 #include "../../libebpf.h"
 #include "../../ebpf_vm.h"
+#include "../../ebpf_inst.h"
 #include "ewfd_api.h"
 
 #include <assert.h>
@@ -31,6 +32,11 @@ static long helper_ewfd_histogram_init_id = 21;
 static long helper_ewfd_histogram_get_id = 22;
 static long helper_ewfd_histogram_set_id = 23;
 
+// helper for array
+static long helper_ewfd_array_init_id = 24;
+static long helper_ewfd_array_get_id = 25;
+static long helper_ewfd_array_set_id = 26;
+
 static int test_ewfd_add_dummy_packet(void *ctx, uint32_t start_ti) {
 	printf("[DROP] at %u\n", start_ti);
 }
@@ -43,20 +49,137 @@ static long ebpf_log_print(const char *fmt, uint32_t fmt_size, ...) {
 	return 0;
 }
 
+/*
+* JIT内联版本的array/histogram helper，和ewfd_maps.c中的C实现等价:
+* r1: unit, r2: map_idx, r3: key/index, r4: value
+* map_type是enum，按uint32读取
+*/
+#define UNIT_MAX_FDS_OFF offsetof(struct ewfd_unit_t, map_table.max_fds)
+#define UNIT_FD_TABLE_OFF offsetof(struct ewfd_unit_t, map_table.fd_table)
+#define MAP_TYPE_OFF offsetof(struct ewfd_map_t, map_type)
+#define MAP_MAX_ENTRIES_OFF offsetof(struct ewfd_map_t, max_entries)
+
+// ewfd_map_table_get(), 之后 r0 = 0, r1 = map, r5 = max_entries, 失败时跳到exit_pc
+#define EWFD_INLINE_MAP_TABLE_GET(map_type, exit_pc) \
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 2, .imm = 32}, \
+	{.opcode = EBPF_OP_RSH64_IMM, .dst = 2, .imm = 32}, \
+	{.opcode = EBPF_OP_MOV64_IMM, .dst = 0, .imm = 0}, \
+	{.opcode = EBPF_OP_LDXW, .dst = 5, .src = 1, .offset = UNIT_MAX_FDS_OFF}, \
+	{.opcode = EBPF_OP_JGE_REG, .dst = 2, .src = 5, .offset = (exit_pc) - 5}, \
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = UNIT_FD_TABLE_OFF}, \
+	{.opcode = EBPF_OP_JEQ_IMM, .dst = 1, .imm = 0, .offset = (exit_pc) - 7}, \
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 2, .imm = 3}, \
+	{.opcode = EBPF_OP_ADD64_REG, .dst = 1, .src = 2}, \
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = 0}, \
+	{.opcode = EBPF_OP_JEQ_IMM, .dst = 1, .imm = 0, .offset = (exit_pc) - 11}, \
+	{.opcode = EBPF_OP_LDXW, .dst = 5, .src = 1, .offset = MAP_TYPE_OFF}, \
+	{.opcode = EBPF_OP_JNE_IMM, .dst = 5, .imm = (map_type), .offset = (exit_pc) - 13}, \
+	{.opcode = EBPF_OP_LDXW, .dst = 5, .src = 1, .offset = MAP_MAX_ENTRIES_OFF}
+
+static const struct ebpf_inst inline_ewfd_histogram_get[] = {
+	EWFD_INLINE_MAP_TABLE_GET(EWFD_MAP_HISTOGRAM, 20),
+	{.opcode = EBPF_OP_AND64_IMM, .dst = 3, .imm = 0xff},
+	{.opcode = EBPF_OP_JGE_REG, .dst = 3, .src = 5, .offset = 20 - 16},
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = offsetof(ewfd_histogram_map_st, bins)},
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 3, .imm = 2},
+	{.opcode = EBPF_OP_ADD64_REG, .dst = 1, .src = 3},
+	{.opcode = EBPF_OP_LDXW, .dst = 0, .src = 1, .offset = 0},
+	{.opcode = EBPF_OP_EXIT}, // 20
+};
+
+static const struct ebpf_inst inline_ewfd_histogram_set[] = {
+	EWFD_INLINE_MAP_TABLE_GET(EWFD_MAP_HISTOGRAM, 21),
+	{.opcode = EBPF_OP_AND64_IMM, .dst = 3, .imm = 0xff},
+	{.opcode = EBPF_OP_JGE_REG, .dst = 3, .src = 5, .offset = 21 - 16},
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = offsetof(ewfd_histogram_map_st, bins)},
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 3, .imm = 2},
+	{.opcode = EBPF_OP_ADD64_REG, .dst = 1, .src = 3},
+	{.opcode = EBPF_OP_STXW, .dst = 1, .src = 4, .offset = 0},
+	{.opcode = EBPF_OP_MOV64_IMM, .dst = 0, .imm = 1},
+	{.opcode = EBPF_OP_EXIT}, // 21
+};
+
+static const struct ebpf_inst inline_ewfd_array_get[] = {
+	EWFD_INLINE_MAP_TABLE_GET(EWFD_MAP_ARRAY, 21),
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 3, .imm = 32},
+	{.opcode = EBPF_OP_RSH64_IMM, .dst = 3, .imm = 32},
+	{.opcode = EBPF_OP_JGE_REG, .dst = 3, .src = 5, .offset = 21 - 17},
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = offsetof(ewfd_array_map_st, values)},
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 3, .imm = 3},
+	{.opcode = EBPF_OP_ADD64_REG, .dst = 1, .src = 3},
+	{.opcode = EBPF_OP_LDXDW, .dst = 0, .src = 1, .offset = 0},
+	{.opcode = EBPF_OP_EXIT}, // 21
+};
+
+static const struct ebpf_inst inline_ewfd_array_set[] = {
+	EWFD_INLINE_MAP_TABLE_GET(EWFD_MAP_ARRAY, 22),
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 3, .imm = 32},
+	{.opcode = EBPF_OP_RSH64_IMM, .dst = 3, .imm = 32},
+	{.opcode = EBPF_OP_JGE_REG, .dst = 3, .src = 5, .offset = 22 - 17},
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = offsetof(ewfd_array_map_st, values)},
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 3, .imm = 3},
+	{.opcode = EBPF_OP_ADD64_REG, .dst = 1, .src = 3},
+	{.opcode = EBPF_OP_STXDW, .dst = 1, .src = 4, .offset = 0},
+	{.opcode = EBPF_OP_MOV64_IMM, .dst = 0, .imm = 1},
+	{.opcode = EBPF_OP_EXIT}, // 22
+};
+
+#define REGISTER_INLINE(vm, id, body) \
+	ebpf_register_inline(vm, id, body, sizeof(body) / sizeof(body[0]))
+
+// 参数类型, verifier按这些类型检查每个call
+#define EWFD_ARG_UNIT EBPF_ARG_HANDLE_OF(EWFD_HANDLE_UNIT)
+#define EWFD_ARG_CIRC EBPF_ARG_HANDLE_OF(EWFD_HANDLE_CIRC)
+#define REGISTER_ARGS(vm, id, ...) do { \
+	static const uint8_t args_[] = {__VA_ARGS__}; \
+	ebpf_register_args(vm, id, args_, sizeof(args_)); \
+} while (0)
+
+void ewfd_register_ctx_handles(struct ebpf_vm *vm, bool is_init) {
+	if (is_init) {
+		ebpf_register_ctx_handle(vm, EBPF_CTX_SELF, EWFD_HANDLE_UNIT);
+	} else {
+		ebpf_register_ctx_handle(vm, EWFD_CTX_UNIT_OFF, EWFD_HANDLE_UNIT);
+		ebpf_register_ctx_handle(vm, EWFD_CTX_CIRC_OFF, EWFD_HANDLE_CIRC);
+	}
+}
+
 void ewfd_register_datastream_helpers(struct ebpf_vm *vm) {
 	ebpf_register(vm, helper_ewfd_data_stream_init_id, "ebpf_data_stream_init", ebpf_data_stream_init);
 	ebpf_register(vm, helper_ewfd_data_stream_load_more_id, "ewfd_data_stream_load_more", ewfd_data_stream_load_more);
 	ebpf_register(vm, helper_ewfd_data_stream_fetch_id, "ewfd_data_stream_fetch", ewfd_data_stream_fetch);
 	ebpf_register(vm, helper_ewfd_data_stream_dequeue_id, "ewfd_data_stream_dequeue", ewfd_data_stream_dequeue);
+	REGISTER_ARGS(vm, helper_ewfd_data_stream_init_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR, EBPF_ARG_NONE);
+	REGISTER_ARGS(vm, helper_ewfd_data_stream_load_more_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR);
+	REGISTER_ARGS(vm, helper_ewfd_data_stream_fetch_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR);
+	REGISTER_ARGS(vm, helper_ewfd_data_stream_dequeue_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR);
 }
 
 void ewfd_register_histrogram_helpers(struct ebpf_vm *vm) {
 	ebpf_register(vm, helper_ewfd_histogram_init_id, "ewfd_histogram_init", ewfd_histogram_init);
 	ebpf_register(vm, helper_ewfd_histogram_get_id, "ewfd_histogram_get", ewfd_histogram_get);
 	ebpf_register(vm, helper_ewfd_histogram_set_id, "ewfd_histogram_set", ewfd_histogram_set);
+	REGISTER_ARGS(vm, helper_ewfd_histogram_init_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR);
+	REGISTER_ARGS(vm, helper_ewfd_histogram_get_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR);
+	REGISTER_ARGS(vm, helper_ewfd_histogram_set_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR);
+	REGISTER_INLINE(vm, helper_ewfd_histogram_get_id, inline_ewfd_histogram_get);
+	REGISTER_INLINE(vm, helper_ewfd_histogram_set_id, inline_ewfd_histogram_set);
+}
+
+void ewfd_register_array_helpers(struct ebpf_vm *vm) {
+	ebpf_register(vm, helper_ewfd_array_init_id, "ewfd_array_init", ewfd_array_init);
+	ebpf_register(vm, helper_ewfd_array_get_id, "ewfd_array_get", ewfd_array_get);
+	ebpf_register(vm, helper_ewfd_array_set_id, "ewfd_array_set", ewfd_array_set);
+	REGISTER_ARGS(vm, helper_ewfd_array_init_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR);
+	REGISTER_ARGS(vm, helper_ewfd_array_get_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR);
+	REGISTER_ARGS(vm, helper_ewfd_array_set_id, EWFD_ARG_UNIT, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR, EBPF_ARG_SCALAR);
+	REGISTER_INLINE(vm, helper_ewfd_array_get_id, inline_ewfd_array_get);
+	REGISTER_INLINE(vm, helper_ewfd_array_set_id, inline_ewfd_array_set);
 }
 
 void ewfd_register_tor_test_helpers(struct ebpf_vm *vm) {
 	ebpf_register(vm, helper_ewfd_log_print_id, "ebpf_log_print", ebpf_log_print);
 	ebpf_register(vm, helper_test_ewfd_add_dummy_packet_id, "test_ewfd_add_dummy_packet", test_ewfd_add_dummy_packet);
+	REGISTER_ARGS(vm, helper_ewfd_log_print_id, EBPF_ARG_PTR_TO_MEM, EBPF_ARG_SCALAR);
+	REGISTER_ARGS(vm, helper_test_ewfd_add_dummy_packet_id, EWFD_ARG_CIRC, EBPF_ARG_SCALAR);
 }
\ No newline at end of file
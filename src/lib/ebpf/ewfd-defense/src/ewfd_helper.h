@@ -1,12 +1,29 @@
 #ifndef _EWFD_HELPER_H_
 #define _EWFD_HELPER_H_
 
+#include <stdbool.h>
+
 struct ebpf_vm;
 
+// ctx中只能原样传给helper的handle, 程序不能解引用或伪造
+enum ewfd_handle_kind {
+	EWFD_HANDLE_UNIT = 0, // struct ewfd_unit_t *
+	EWFD_HANDLE_CIRC,     // circuit_t *
+};
+
+// handle在ctx中的偏移, 和bpf/headers/ewfd.h中的ewfd_circ_status_t一致
+#define EWFD_CTX_UNIT_OFF 0
+#define EWFD_CTX_CIRC_OFF 24
+
+// init程序的ctx就是unit, 其余程序的ctx是ewfd_circ_status_t
+void ewfd_register_ctx_handles(struct ebpf_vm *vm, bool is_init);
+
 void ewfd_register_datastream_helpers(struct ebpf_vm *vm);
 
 void ewfd_register_histrogram_helpers(struct ebpf_vm *vm);
 
+void ewfd_register_array_helpers(struct ebpf_vm *vm);
+
 // test algorithims here
 void ewfd_register_tor_test_helpers(struct ebpf_vm *vm);
 
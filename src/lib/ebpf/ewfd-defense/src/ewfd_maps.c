@@ -8,33 +8,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include "hashmap.h"
 
 #define MAX_DATA_STREAM_SIZE 256
 
 // hash map
-// ring buffer
-typedef struct ewfd_array_map_t {
-	struct ewfd_map_t map;
-	uint32_t *buffer;
-} ewfd_array_map_st;
-
-typedef struct ewfd_ringbuffer_t {
+// data stream
+/* data stream的游标，数据在shared_stream中，不拷贝
+* load_more之后最多有MAX_DATA_STREAM_SIZE个数据可以读取，读到stream结尾时从头开始
+*/
+typedef struct ewfd_data_stream_map_t {
 	struct ewfd_map_t map;
-	uint32_t *buffer;
-	int head;
-	int tail;
-	int max_size;
-	int size;
-} ewfd_ringbuffer_st;
+	const ewfd_data_stream_st *stream;
+	uint32_t pos; // 下一个读取的位置
+	uint32_t size; // 已经load还没有dequeue的数量
+} ewfd_data_stream_map_st;
 
 typedef struct ewfd_hashmap_t {
 	struct ewfd_map_t map;
 	struct hashmap *hashmap;
 } ewfd_hashmap_st;
 
-static void _ewfd_data_stream_enqueue(ewfd_ringbuffer_st *rbuf, uint32_t data);
-
 ewfd_map_st* ewfd_map_create(struct ewfd_unit_t *unit, uint32_t map_idx, enum ewfd_map_type map_type) {
 	// printf("ebpf_data_stream_init: %p \n", unit);
 	if (unit->map_table.fd_table == NULL) {
@@ -42,18 +37,28 @@ ewfd_map_st* ewfd_map_create(struct ewfd_unit_t *unit, uint32_t map_idx, enum ew
 		unit->map_table.fd_table = (ewfd_map_st **) calloc(1, sizeof(ewfd_map_st *) * unit->map_table.max_fds);
 	}
 	if (unit->map_table.max_fds <= map_idx) {
-		unit->map_table.max_fds *= 2;
+		uint32_t old_fds = unit->map_table.max_fds;
+		while (unit->map_table.max_fds <= map_idx) {
+			unit->map_table.max_fds *= 2;
+		}
 		unit->map_table.fd_table = (ewfd_map_st **) realloc(unit->map_table.fd_table, sizeof(ewfd_map_st *) * unit->map_table.max_fds);
+		memset(unit->map_table.fd_table + old_fds, 0, sizeof(ewfd_map_st *) * (unit->map_table.max_fds - old_fds));
 	}
 
-	if (map_type == EWFD_MAP_RINGBUFFER) {
-		unit->map_table.fd_table[map_idx] = (ewfd_map_st *) calloc(1, sizeof(ewfd_ringbuffer_st));
-		unit->map_table.fd_table[map_idx]->map_type = EWFD_MAP_RINGBUFFER;
+	if (map_type == EWFD_MAP_DATASTREAM) {
+		unit->map_table.fd_table[map_idx] = (ewfd_map_st *) calloc(1, sizeof(ewfd_data_stream_map_st));
+		unit->map_table.fd_table[map_idx]->map_type = EWFD_MAP_DATASTREAM;
 	} else if (map_type == EWFD_MAP_HASHMAP) {
 		ewfd_hashmap_st *map = (ewfd_hashmap_st *) calloc(1, sizeof(ewfd_hashmap_st));
 		map->hashmap = NULL;
 		unit->map_table.fd_table[map_idx] = (ewfd_map_st *) map;
 		unit->map_table.fd_table[map_idx]->map_type = EWFD_MAP_HASHMAP;
+	} else if (map_type == EWFD_MAP_ARRAY) {
+		unit->map_table.fd_table[map_idx] = (ewfd_map_st *) calloc(1, sizeof(ewfd_array_map_st));
+		unit->map_table.fd_table[map_idx]->map_type = EWFD_MAP_ARRAY;
+	} else if (map_type == EWFD_MAP_HISTOGRAM) {
+		unit->map_table.fd_table[map_idx] = (ewfd_map_st *) calloc(1, sizeof(ewfd_histogram_map_st));
+		unit->map_table.fd_table[map_idx]->map_type = EWFD_MAP_HISTOGRAM;
 	}
 
 	return unit->map_table.fd_table[map_idx];
@@ -61,7 +66,7 @@ ewfd_map_st* ewfd_map_create(struct ewfd_unit_t *unit, uint32_t map_idx, enum ew
 
 
 ewfd_map_st* ewfd_map_get(struct ewfd_unit_t *unit, uint32_t map_idx) {
-	if (unit->map_table.fd_table != NULL && unit->map_table.fd_table[map_idx] != NULL) {
+	if (unit->map_table.fd_table != NULL && map_idx < unit->map_table.max_fds && unit->map_table.fd_table[map_idx] != NULL) {
 		return unit->map_table.fd_table[map_idx];
 	}
 	return NULL;
@@ -71,12 +76,13 @@ void ewfd_map_free(ewfd_map_st *map) {
 	if (map == NULL) {
 		return;
 	}
-	if (map->map_type == EWFD_MAP_RINGBUFFER) {
-		ewfd_ringbuffer_st *rbuf = (ewfd_ringbuffer_st *) map;
-		free(rbuf->buffer);
-	} else if (map->map_type == EWFD_MAP_HASHMAP) {
+	if (map->map_type == EWFD_MAP_HASHMAP) {
 		ewfd_hashmap_st *hmap = (ewfd_hashmap_st *) map;
 		hashmap_free(hmap->hashmap);
+	} else if (map->map_type == EWFD_MAP_ARRAY) {
+		free(((ewfd_array_map_st *) map)->values);
+	} else if (map->map_type == EWFD_MAP_HISTOGRAM) {
+		free(((ewfd_histogram_map_st *) map)->bins);
 	}
 	free(map);
 	// printf("%d -> free map %p\n", __LINE__, map);
@@ -89,7 +95,7 @@ static int load_data_by_tag(const char *tag, int **arr, int len) {
 }
 
 
-static int front_data_stream[] = {
+static const uint32_t front_data_stream[] = {
 	31, 93, 140, 180, 182, 206, 235, 236, 273, 296, 316, 321, 338, 349, 359, 391, 397, 412, 431, 439, 
 	454, 474, 477, 496, 502, 514, 521, 536, 542, 549, 557, 565, 566, 579, 585, 586, 592, 597, 605, 607, 
 	609, 620, 620, 640, 642, 643, 645, 653, 671, 696, 702, 703, 704, 710, 712, 716, 732, 737, 747, 752, 
@@ -102,118 +108,159 @@ static int front_data_stream[] = {
 	2080, 2113, 2141, 2152, 2176, 2180, 2242, 2323, 2385, 2425, 2513, 2519, 2547, 2602, 2615, 2662, 2919, 3097, 3180, 3654,
 };
 
+static ewfd_data_stream_st shared_stream = {
+	.data = front_data_stream,
+	.len = sizeof(front_data_stream) / sizeof(front_data_stream[0]),
+};
+
+void ewfd_data_stream_set_shared(const uint32_t *data, uint32_t len) {
+	if (data == NULL || len == 0) {
+		data = front_data_stream;
+		len = sizeof(front_data_stream) / sizeof(front_data_stream[0]);
+	}
+	shared_stream.data = data;
+	shared_stream.len = len;
+}
+
+const ewfd_data_stream_st *ewfd_data_stream_get_shared(void) {
+	return &shared_stream;
+}
+
 /*
-Get data from ring buffer
+Get data from the shared data stream
 https://elixir.bootlin.com/linux/latest/source/kernel/bpf/arraymap.c#L82
 https://github.com/CBackyx/eBPF-map/blob/master/hash_tab.c#L13
 https://github.com/CBackyx/eBPF-map/blob/master/hash_tab.c#L580
+
+data_stream_file是eBPF程序中的地址，raw code没有重定位，暂时不使用
 */
 int ebpf_data_stream_init(struct ewfd_unit_t *unit, uint32_t map_idx, const char *data_stream_file) {
-	int *arr;
-	int len = 0;
-	// struct ewfd_unit_t *unit = (struct ewfd_unit_t *) ctx;
-	ewfd_ringbuffer_st *rb = (ewfd_ringbuffer_st *) ewfd_map_get(unit, map_idx);
-	if (rb == NULL) {
-		rb = (ewfd_ringbuffer_st *) ewfd_map_create(unit, map_idx, EWFD_MAP_RINGBUFFER);
-	}
-	int max_size = MAX_DATA_STREAM_SIZE;
-
-	rb->buffer = (uint32_t *) malloc(max_size * sizeof(uint32_t));
-	rb->head = 0;
-	rb->tail = 0;
-	rb->max_size = max_size;
-	rb->size = 0;
-
-	int data_stream_fd = 1;
-	int pkt = ewfd_data_stream_load_more(unit, data_stream_fd);
-	// printf("%d -> pkt load: %d\n", __LINE__, pkt);
-	return 0;
-}
-
-static inline int _ewfd_data_stream_is_empty(ewfd_ringbuffer_st *rb) {
-	return rb->size == 0;
-}
+	(void) data_stream_file;
+	ewfd_data_stream_map_st *ds = (ewfd_data_stream_map_st *) ewfd_map_get(unit, map_idx);
+	if (ds == NULL) {
+		ds = (ewfd_data_stream_map_st *) ewfd_map_create(unit, map_idx, EWFD_MAP_DATASTREAM);
+	}
 
-static inline int _ewfd_data_stream_is_full(ewfd_ringbuffer_st *rb) {
-	return (rb->size == rb->max_size);
-}
+	ds->stream = &shared_stream;
+	ds->pos = 0;
+	ds->size = 0;
 
-static void _ewfd_data_stream_enqueue(ewfd_ringbuffer_st *rb, uint32_t data) {
-	if (_ewfd_data_stream_is_full(rb)) {
-		return;
-	}
-	rb->buffer[rb->head] = data;
-	rb->head = (rb->head + 1) % rb->max_size;
-	rb->size++;
+	ewfd_data_stream_load_more(unit, map_idx);
+	return 0;
 }
 
 int ewfd_data_stream_load_more(struct ewfd_unit_t *unit, uint32_t data_stream_fd) {
-	ewfd_ringbuffer_st *rbuf = (ewfd_ringbuffer_st *) ewfd_map_get(unit, data_stream_fd);
-	if (rbuf == NULL) {
+	ewfd_data_stream_map_st *ds = (ewfd_data_stream_map_st *) ewfd_map_get(unit, data_stream_fd);
+	if (ds == NULL) {
 		return -1;
 	}
 
-	int pkt = 5;
-	pkt = sizeof(front_data_stream) / sizeof(int);
-	for(int i = 0; i < pkt; i++) {
-		_ewfd_data_stream_enqueue(rbuf, front_data_stream[i]);
+	uint32_t pkt = ds->stream->len;
+	if (pkt > MAX_DATA_STREAM_SIZE - ds->size) {
+		pkt = MAX_DATA_STREAM_SIZE - ds->size;
 	}
+	ds->size += pkt;
 	return pkt;
 }
 
 uint32_t ewfd_data_stream_fetch(struct ewfd_unit_t *unit, uint32_t data_stream_fd) {
-	ewfd_ringbuffer_st *rb = (ewfd_ringbuffer_st *) ewfd_map_get(unit, data_stream_fd);
-	if (rb->size == 0) {
+	ewfd_data_stream_map_st *ds = (ewfd_data_stream_map_st *) ewfd_map_get(unit, data_stream_fd);
+	if (ds == NULL || ds->size == 0) {
 		return -1;
 	}
-	uint32_t data = rb->buffer[rb->tail];
-	return data;
+	// shared stream可能被替换为更短的数据
+	return ds->stream->data[ds->pos % ds->stream->len];
 }
 
 int ewfd_data_stream_dequeue(struct ewfd_unit_t *unit, uint32_t data_stream_fd) {
-	ewfd_ringbuffer_st *rb = (ewfd_ringbuffer_st *) ewfd_map_get(unit, data_stream_fd);
-	if (rb->size == 0) {
+	ewfd_data_stream_map_st *ds = (ewfd_data_stream_map_st *) ewfd_map_get(unit, data_stream_fd);
+	if (ds == NULL || ds->size == 0) {
 		return -1;
 	}
-	uint32_t data = rb->buffer[rb->tail];
-	rb->tail = (rb->tail + 1) % rb->max_size;
-	rb->size--;
+	uint32_t data = ds->stream->data[ds->pos % ds->stream->len];
+	ds->pos = (ds->pos + 1) % ds->stream->len;
+	ds->size--;
 	return data;
 }
 
 
 // --------------------------------------------
-// eBPF hash map
-// https://github.com/tidwall/hashmap.c/tree/master
+// array map
+// 按下标直接访问，下标越界时get返回0
 // --------------------------------------------
-typedef struct hist_item_t {
-	uint8_t key;
-	uint32_t val;
-} __attribute__((packed)) hist_item_st;
+bool ewfd_array_init(struct ewfd_unit_t *unit, uint32_t map_idx, uint32_t max_entries) {
+	if (max_entries == 0) {
+		return false;
+	}
+	ewfd_array_map_st *array = (ewfd_array_map_st *) ewfd_map_table_get(&unit->map_table, map_idx, EWFD_MAP_ARRAY);
+	if (array == NULL) {
+		if (ewfd_map_get(unit, map_idx) != NULL) { // 已经被其他类型的map占用
+			return false;
+		}
+		array = (ewfd_array_map_st *) ewfd_map_create(unit, map_idx, EWFD_MAP_ARRAY);
+	}
+	if (array->values == NULL) {
+		array->values = (uint64_t *) calloc(max_entries, sizeof(uint64_t));
+		array->map.key_size = sizeof(uint32_t);
+		array->map.value_size = sizeof(uint64_t);
+		array->map.max_entries = max_entries;
+	}
+	return true;
+}
+
+uint64_t ewfd_array_get(struct ewfd_unit_t *unit, uint32_t map_idx, uint32_t key) {
+	ewfd_array_map_st *array = (ewfd_array_map_st *) ewfd_map_table_get(&unit->map_table, map_idx, EWFD_MAP_ARRAY);
+	if (array == NULL) {
+		return 0;
+	}
+	return ewfd_array_map_get(array, key);
+}
 
+bool ewfd_array_set(struct ewfd_unit_t *unit, uint32_t map_idx, uint32_t key, uint64_t val) {
+	ewfd_array_map_st *array = (ewfd_array_map_st *) ewfd_map_table_get(&unit->map_table, map_idx, EWFD_MAP_ARRAY);
+	if (array == NULL) {
+		return false;
+	}
+	return ewfd_array_map_set(array, key, val);
+}
+
+// --------------------------------------------
+// histogram map
+// 下标是uint8，直接寻址
+// --------------------------------------------
 void ewfd_histogram_init(struct ewfd_unit_t *unit, uint32_t map_idx, uint32_t key_sz, uint32_t val_sz, uint32_t max_entries) {
-	ewfd_hashmap_st *map = (ewfd_hashmap_st *) ewfd_map_get(unit, map_idx);
-	if (map == NULL) {
-		map = (ewfd_hashmap_st *) ewfd_map_create(unit, map_idx, EWFD_MAP_HASHMAP);
+	(void) key_sz;
+	(void) val_sz;
+	ewfd_histogram_map_st *hist = (ewfd_histogram_map_st *) ewfd_map_table_get(&unit->map_table, map_idx, EWFD_MAP_HISTOGRAM);
+	if (hist == NULL) {
+		if (ewfd_map_get(unit, map_idx) != NULL) {
+			return;
+		}
+		hist = (ewfd_histogram_map_st *) ewfd_map_create(unit, map_idx, EWFD_MAP_HISTOGRAM);
 	}
-	if (map->hashmap == NULL) {
-		map->hashmap = hashmap_new(key_sz, key_sz + val_sz, max_entries, 0, 0, hashmap_xxhash3, hashmap_default_compare, NULL, NULL);
+	if (hist->bins == NULL) {
+		if (max_entries == 0 || max_entries > EWFD_HISTOGRAM_MAX_BINS) {
+			max_entries = EWFD_HISTOGRAM_MAX_BINS;
+		}
+		hist->bins = (uint32_t *) calloc(max_entries, sizeof(uint32_t));
+		hist->map.key_size = sizeof(uint8_t);
+		hist->map.value_size = sizeof(uint32_t);
+		hist->map.max_entries = max_entries;
 	}
 }
 
 uint32_t ewfd_histogram_get(struct ewfd_unit_t *unit, uint32_t map_idx, uint8_t index) {
-	ewfd_hashmap_st *map = (ewfd_hashmap_st *) ewfd_map_get(unit, map_idx);
-	if (map == NULL) {
+	ewfd_histogram_map_st *hist = (ewfd_histogram_map_st *) ewfd_map_table_get(&unit->map_table, map_idx, EWFD_MAP_HISTOGRAM);
+	if (hist == NULL) {
 		return 0;
 	}
-	hist_item_st *item = (hist_item_st *) hashmap_get(map->hashmap, &index);
-	return item == NULL ? 0 : item->val;
+	return ewfd_histogram_map_get(hist, index);
 }
 
 bool ewfd_histogram_set(struct ewfd_unit_t *unit, uint32_t map_idx, uint8_t index, uint32_t token) {
-	ewfd_hashmap_st *map = (ewfd_hashmap_st *) ewfd_map_get(unit, map_idx);
-	if (map == NULL) {
-		return 0;
+	ewfd_histogram_map_st *hist = (ewfd_histogram_map_st *) ewfd_map_table_get(&unit->map_table, map_idx, EWFD_MAP_HISTOGRAM);
+	if (hist == NULL) {
+		return false;
 	}
-	return hashmap_set_by_kv(map->hashmap, &index, &token) != NULL;
+	return ewfd_histogram_map_set(hist, index, token);
 }
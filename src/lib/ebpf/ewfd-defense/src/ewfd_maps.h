@@ -3,18 +3,25 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /*
 ewfd maps:
-- histogram array map
-- datastream ringbuffer
+- hashmap: 通用的key/value
+- datastream: 所有unit共享一份只读数据，unit中只有游标
+- array: 定长的uint64数组，按下标直接访问
+- histogram: uint8下标的uint32数组，每个tick采样不需要hash
 */
 
 enum ewfd_map_type {
 	EWFD_MAP_HASHMAP,
-	EWFD_MAP_RINGBUFFER,
+	EWFD_MAP_DATASTREAM,
+	EWFD_MAP_ARRAY,
+	EWFD_MAP_HISTOGRAM,
 };
 
+#define EWFD_HISTOGRAM_MAX_BINS 256 // 下标是uint8
+
 // typedef struct ewfd_map_op_t {
 // 	// int (*map_create)();
 // 	int (*map_clear)(void *ctx, uint32_t map_fd);
@@ -35,21 +42,83 @@ typedef struct ewfd_map_fdtable_t {
 	ewfd_map_st **fd_table;
 } ewfd_map_fdtable_st;
 
+// https://elixir.bootlin.com/linux/latest/source/kernel/bpf/arraymap.c
+typedef struct ewfd_array_map_t {
+	struct ewfd_map_t map;
+	uint64_t *values; // max_entries个
+} ewfd_array_map_st;
+
+typedef struct ewfd_histogram_map_t {
+	struct ewfd_map_t map;
+	uint32_t *bins; // max_entries个, max_entries <= EWFD_HISTOGRAM_MAX_BINS
+} ewfd_histogram_map_st;
+
+/* 直接寻址的inline helper，下标越界时get返回0，set返回false
+*/
+static inline ewfd_map_st *ewfd_map_table_get(const ewfd_map_fdtable_st *table, uint32_t map_idx, enum ewfd_map_type map_type) {
+	if (map_idx >= table->max_fds || table->fd_table == NULL) {
+		return NULL;
+	}
+	ewfd_map_st *map = table->fd_table[map_idx];
+	return (map != NULL && map->map_type == map_type) ? map : NULL;
+}
+
+static inline uint64_t ewfd_array_map_get(const ewfd_array_map_st *array, uint32_t key) {
+	return key < array->map.max_entries ? array->values[key] : 0;
+}
+
+static inline bool ewfd_array_map_set(ewfd_array_map_st *array, uint32_t key, uint64_t val) {
+	if (key >= array->map.max_entries) {
+		return false;
+	}
+	array->values[key] = val;
+	return true;
+}
+
+static inline uint32_t ewfd_histogram_map_get(const ewfd_histogram_map_st *hist, uint8_t index) {
+	return index < hist->map.max_entries ? hist->bins[index] : 0;
+}
+
+static inline bool ewfd_histogram_map_set(ewfd_histogram_map_st *hist, uint8_t index, uint32_t token) {
+	if (index >= hist->map.max_entries) {
+		return false;
+	}
+	hist->bins[index] = token;
+	return true;
+}
+
+
+/* 只读的data stream，可以是内置数据或者mmap的文件(native uint32数组)
+*/
+typedef struct ewfd_data_stream_t {
+	const uint32_t *data;
+	uint32_t len;
+} ewfd_data_stream_st;
 
 struct ewfd_unit_t;
 
+// 设置所有unit共享的data stream, data由调用者持有，在使用它的unit释放之前不能释放
+// data == NULL 时恢复为内置的front数据
+void ewfd_data_stream_set_shared(const uint32_t *data, uint32_t len);
+const ewfd_data_stream_st *ewfd_data_stream_get_shared(void);
+
 // map operations
 ewfd_map_st* ewfd_map_create(struct ewfd_unit_t *unit, uint32_t map_idx, enum ewfd_map_type map_type);
 ewfd_map_st* ewfd_map_get(struct ewfd_unit_t *unit, uint32_t map_idx);
 void ewfd_map_free(ewfd_map_st *map);
 
-// ringbuffer based data stream operations
+// shared data stream operations, 每个unit有自己的读取位置
 int ebpf_data_stream_init(struct ewfd_unit_t *unit, uint32_t map_idx, const char *data_stream_file);
 int ewfd_data_stream_load_more(struct ewfd_unit_t *unit, uint32_t data_stream_fd);
 uint32_t ewfd_data_stream_fetch(struct ewfd_unit_t *unit, uint32_t data_stream_fd);
 int ewfd_data_stream_dequeue(struct ewfd_unit_t *unit, uint32_t data_stream_fd);
 
-// hashmap based histogram operations
+// array operations
+bool ewfd_array_init(struct ewfd_unit_t *unit, uint32_t map_idx, uint32_t max_entries);
+uint64_t ewfd_array_get(struct ewfd_unit_t *unit, uint32_t map_idx, uint32_t key);
+bool ewfd_array_set(struct ewfd_unit_t *unit, uint32_t map_idx, uint32_t key, uint64_t val);
+
+// histogram operations, key_sz/val_sz只是为了兼容之前的接口，下标固定是uint8，值是uint32
 void ewfd_histogram_init(struct ewfd_unit_t *unit, uint32_t map_idx, uint32_t key_sz, uint32_t val_sz, uint32_t max_entries);
 uint32_t ewfd_histogram_get(struct ewfd_unit_t *unit, uint32_t map_idx, uint8_t index);
 bool ewfd_histogram_set(struct ewfd_unit_t *unit, uint32_t map_idx, uint8_t index, uint32_t token);
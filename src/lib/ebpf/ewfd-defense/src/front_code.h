@@ -17,64 +17,117 @@ const unsigned char ewfd_front_padding_init[] = ""
 
 
 const unsigned char ewfd_front_padding_tick[] = ""
-"\xbf\x18\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\x74\x5f\x74\x69\x00\x00\x00\x00\x63\x6b\x3a\x20\x7b"
-"\x1a\xe0\xff\x00\x00\x00\x00\x18\x01\x00\x00\x77\x66\x64\x5f\x00\x00\x00\x00\x66\x72\x6f\x6e\x7b\x1a"
-"\xd8\xff\x00\x00\x00\x00\x18\x01\x00\x00\x5b\x65\x62\x70\x00\x00\x00\x00\x66\x5d\x20\x65\x7b\x1a\xd0"
-"\xff\x00\x00\x00\x00\xb7\x01\x00\x00\x25\x64\x0a\x00\x63\x1a\xe8\xff\x00\x00\x00\x00\xbf\xa1\x00\x00"
-"\x00\x00\x00\x00\x07\x01\x00\x00\xd0\xff\xff\xff\xb7\x02\x00\x00\x1c\x00\x00\x00\xb7\x03\x00\x00\x18"
-"\x00\x00\x00\x85\x00\x00\x00\x01\x00\x00\x00\x61\x87\x04\x00\x00\x00\x00\x00\x67\x07\x00\x00\x20\x00"
-"\x00\x00\x61\x81\x00\x00\x00\x00\x00\x00\x4f\x17\x00\x00\x00\x00\x00\x00\x61\x86\x08\x00\x00\x00\x00"
-"\x00\x61\x81\x14\x00\x00\x00\x00\x00\x7b\x1a\xc8\xff\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00"
-"\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbf\x09\x00\x00\x00\x00\x00\x00\xb7"
-"\x01\x00\x00\x25\x64\x0a\x00\x63\x1a\xe8\xff\x00\x00\x00\x00\x18\x01\x00\x00\x65\x78\x74\x2d\x00\x00"
-"\x00\x00\x74\x69\x3a\x20\x7b\x1a\xe0\xff\x00\x00\x00\x00\x18\x01\x00\x00\x2d\x75\x6e\x69\x00\x00\x00"
-"\x00\x74\x5d\x20\x6e\x7b\x1a\xd8\xff\x00\x00\x00\x00\x18\x01\x00\x00\x5b\x70\x61\x64\x00\x00\x00\x00"
-"\x64\x69\x6e\x67\x7b\x1a\xd0\xff\x00\x00\x00\x00\xbf\xa1\x00\x00\x00\x00\x00\x00\x07\x01\x00\x00\xd0"
-"\xff\xff\xff\xb7\x02\x00\x00\x1c\x00\x00\x00\xbf\x93\x00\x00\x00\x00\x00\x00\x85\x00\x00\x00\x01\x00"
-"\x00\x00\xbf\x91\x00\x00\x00\x00\x00\x00\x67\x01\x00\x00\x20\x00\x00\x00\x77\x01\x00\x00\x20\x00\x00"
-"\x00\x18\x02\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x5d\x21\x14\x00\x00\x00\x00\x00"
-"\xb7\x01\x00\x00\x25\x75\x0a\x00\x63\x1a\xe0\xff\x00\x00\x00\x00\x18\x01\x00\x00\x65\x20\x64\x61\x00"
-"\x00\x00\x00\x74\x61\x3a\x20\x7b\x1a\xd8\xff\x00\x00\x00\x00\x18\x01\x00\x00\x6c\x6f\x61\x64\x00\x00"
-"\x00\x00\x20\x6d\x6f\x72\x7b\x1a\xd0\xff\x00\x00\x00\x00\xbf\xa1\x00\x00\x00\x00\x00\x00\x07\x01\x00"
-"\x00\xd0\xff\xff\xff\xb7\x02\x00\x00\x14\x00\x00\x00\x79\xa6\xc8\xff\x00\x00\x00\x00\xbf\x63\x00\x00"
-"\x00\x00\x00\x00\x85\x00\x00\x00\x01\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01"
-"\x00\x00\x00\x85\x00\x00\x00\x0c\x00\x00\x00\x63\x68\x08\x00\x00\x00\x00\x00\xb7\x08\x00\x00\x00\x00"
-"\x00\x00\x05\x00\x6d\x00\x00\x00\x00\x00\x7b\x8a\xc0\xff\x00\x00\x00\x00\x18\x01\x00\x00\x2d\x74\x69"
-"\x3a\x00\x00\x00\x00\x20\x25\x75\x00\x7b\x1a\xf0\xff\x00\x00\x00\x00\x18\x01\x00\x00\x20\x25\x75\x20"
-"\x00\x00\x00\x00\x73\x65\x6e\x64\x7b\x1a\xe8\xff\x00\x00\x00\x00\x18\x01\x00\x00\x74\x61\x72\x74\x00"
-"\x00\x00\x00\x2d\x74\x69\x3a\x7b\x1a\xe0\xff\x00\x00\x00\x00\x18\x01\x00\x00\x2d\x75\x6e\x69\x00\x00"
-"\x00\x00\x74\x5d\x20\x73\x7b\x1a\xd8\xff\x00\x00\x00\x00\x18\x01\x00\x00\x5b\x70\x61\x64\x00\x00\x00"
-"\x00\x64\x69\x6e\x67\x7b\x1a\xd0\xff\x00\x00\x00\x00\x0f\x69\x00\x00\x00\x00\x00\x00\xbf\xa1\x00\x00"
-"\x00\x00\x00\x00\x07\x01\x00\x00\xd0\xff\xff\xff\xb7\x02\x00\x00\x28\x00\x00\x00\xbf\x63\x00\x00\x00"
-"\x00\x00\x00\xbf\x94\x00\x00\x00\x00\x00\x00\x85\x00\x00\x00\x01\x00\x00\x00\xbf\x91\x00\x00\x00\x00"
-"\x00\x00\x67\x01\x00\x00\x20\x00\x00\x00\x77\x01\x00\x00\x20\x00\x00\x00\x79\xa8\xc8\xff\x00\x00\x00"
-"\x00\xbf\x82\x00\x00\x00\x00\x00\x00\x3d\x21\x0d\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00"
+"\xbf\x16\x00\x00\x00\x00\x00\x00\x79\x67\x00\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7"
+"\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01"
+"\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x5d\x18\x07\x00\x00\x00\x00\x00\xbf\x71\x00"
+"\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0c\x00\x00\x00\x61\x61\x14\x00"
+"\x00\x00\x00\x00\x63\x16\x08\x00\x00\x00\x00\x00\xb7\x00\x00\x00\x00\x00\x00\x00\x95\x00\x00\x00\x00"
+"\x00\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00"
+"\x00\x00\x3d\x19\xdf\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00"
+"\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00"
+"\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00"
+"\x00\x00\x00\x00\x00\x00\x00\x1d\x18\x39\x01\x00\x00\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89"
+"\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\xd1\x00\x00\x00\x00\x00\xbf\x71\x00"
+"\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00"
+"\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00"
+"\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x18\x2b\x01\x00\x00"
+"\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00"
+"\x00\x3d\x19\xc3\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00"
+"\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85"
+"\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00"
+"\x00\x00\x00\x00\x00\x00\x1d\x18\x1d\x01\x00\x00\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00"
+"\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\xb5\x00\x00\x00\x00\x00\xbf\x71\x00\x00"
+"\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00"
+"\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00"
+"\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x18\x0f\x01\x00\x00\x00"
+"\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00"
+"\x3d\x19\xa7\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85"
+"\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00"
+"\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00"
+"\x00\x00\x00\x00\x00\x1d\x18\x01\x01\x00\x00\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00"
+"\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\x99\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00"
+"\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00"
+"\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00"
+"\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x18\xf3\x00\x00\x00\x00\x00"
+"\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d"
+"\x19\x8b\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00"
+"\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00"
+"\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00"
+"\x00\x00\x00\x00\x1d\x18\xe5\x00\x00\x00\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00"
+"\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\x7d\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00"
+"\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00"
+"\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00"
+"\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x18\xd7\x00\x00\x00\x00\x00\x61"
+"\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19"
+"\x6f\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00"
+"\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00"
+"\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00"
+"\x00\x00\x00\x1d\x18\xc9\x00\x00\x00\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00"
+"\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\x61\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00"
+"\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00"
+"\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18"
+"\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x18\xbb\x00\x00\x00\x00\x00\x61\x69"
+"\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\x53"
+"\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00"
+"\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d"
+"\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00"
+"\x00\x00\x1d\x18\xad\x00\x00\x00\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00"
+"\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\x45\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00"
 "\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7"
-"\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbf\x09\x00\x00\x00\x00\x00\x00\x0f\x69"
-"\x00\x00\x00\x00\x00\x00\xbf\x91\x00\x00\x00\x00\x00\x00\x67\x01\x00\x00\x20\x00\x00\x00\x77\x01\x00"
-"\x00\x20\x00\x00\x00\xbf\x82\x00\x00\x00\x00\x00\x00\x2d\x12\xf3\xff\x00\x00\x00\x00\xbf\x91\x00\x00"
-"\x00\x00\x00\x00\x67\x01\x00\x00\x20\x00\x00\x00\x77\x01\x00\x00\x20\x00\x00\x00\xbf\x82\x00\x00\x00"
-"\x00\x00\x00\x07\x02\x00\x00\xf4\x01\x00\x00\x7b\x2a\xb8\xff\x00\x00\x00\x00\x67\x02\x00\x00\x20\x00"
-"\x00\x00\x77\x02\x00\x00\x20\x00\x00\x00\xb7\x08\x00\x00\x00\x00\x00\x00\x3d\x21\x1e\x00\x00\x00\x00"
-"\x00\xb7\x06\x00\x00\x00\x00\x00\x00\xb7\x08\x00\x00\x00\x00\x00\x00\x79\xa1\xc0\xff\x00\x00\x00\x00"
-"\x61\x12\x18\x00\x00\x00\x00\x00\x61\x11\x1c\x00\x00\x00\x00\x00\x67\x01\x00\x00\x20\x00\x00\x00\x4f"
-"\x21\x00\x00\x00\x00\x00\x00\xbf\x92\x00\x00\x00\x00\x00\x00\x85\x00\x00\x00\x06\x00\x00\x00\xbf\x71"
-"\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00"
-"\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbf\x09\x00\x00"
-"\x00\x00\x00\x00\x79\xa1\xc8\xff\x00\x00\x00\x00\x0f\x19\x00\x00\x00\x00\x00\x00\x07\x08\x00\x00\x01"
-"\x00\x00\x00\x67\x06\x00\x00\x20\x00\x00\x00\x77\x06\x00\x00\x20\x00\x00\x00\x25\x06\x08\x00\x03\x00"
-"\x00\x00\xbf\x91\x00\x00\x00\x00\x00\x00\x67\x01\x00\x00\x20\x00\x00\x00\x77\x01\x00\x00\x20\x00\x00"
-"\x00\x79\xa2\xb8\xff\x00\x00\x00\x00\x67\x02\x00\x00\x20\x00\x00\x00\x77\x02\x00\x00\x20\x00\x00\x00"
-"\xbf\x86\x00\x00\x00\x00\x00\x00\x2d\x12\xe4\xff\x00\x00\x00\x00\xb7\x01\x00\x00\x00\x00\x00\x00\x73"
-"\x1a\xf2\xff\x00\x00\x00\x00\xb7\x01\x00\x00\x75\x0a\x00\x00\x6b\x1a\xf0\xff\x00\x00\x00\x00\x18\x01"
-"\x00\x00\x65\x74\x3a\x20\x00\x00\x00\x00\x25\x64\x20\x25\x7b\x1a\xe8\xff\x00\x00\x00\x00\x18\x01\x00"
-"\x00\x69\x6e\x67\x20\x00\x00\x00\x00\x70\x61\x63\x6b\x7b\x1a\xe0\xff\x00\x00\x00\x00\x18\x01\x00\x00"
-"\x61\x64\x64\x20\x00\x00\x00\x00\x70\x61\x64\x64\x7b\x1a\xd8\xff\x00\x00\x00\x00\x18\x01\x00\x00\x77"
-"\x61\x6e\x74\x00\x00\x00\x00\x20\x74\x6f\x20\x7b\x1a\xd0\xff\x00\x00\x00\x00\xbf\xa1\x00\x00\x00\x00"
-"\x00\x00\x07\x01\x00\x00\xd0\xff\xff\xff\xb7\x02\x00\x00\x23\x00\x00\x00\xbf\x83\x00\x00\x00\x00\x00"
-"\x00\xbf\x94\x00\x00\x00\x00\x00\x00\x85\x00\x00\x00\x01\x00\x00\x00\x67\x08\x00\x00\x20\x00\x00\x00"
-"\x77\x08\x00\x00\x20\x00\x00\x00\x18\x01\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01\x00\x00\x00\x4f"
-"\x18\x00\x00\x00\x00\x00\x00\xbf\x80\x00\x00\x00\x00\x00\x00\x95\x00\x00\x00\x00\x00\x00\x00"
+"\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01"
+"\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x18\x9f\x00\x00\x00\x00\x00\x61\x69\x08"
+"\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\x37\x00"
+"\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e"
+"\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00"
+"\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00"
+"\x00\x1d\x18\x91\x00\x00\x00\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00"
+"\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\x29\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7"
+"\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02"
+"\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00"
+"\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x18\x83\x00\x00\x00\x00\x00\x61\x69\x08\x00"
+"\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x3d\x19\x1b\x00\x00"
+"\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00"
+"\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00"
+"\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00"
+"\x1d\x18\x75\x00\x00\x00\x00\x00\x61\x69\x08\x00\x00\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x61"
+"\x61\x14\x00\x00\x00\x00\x00\x3d\x19\x0d\x00\x00\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02"
+"\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00"
+"\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x08\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00"
+"\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x18\x67\x00\x00\x00\x00\x00\x61\x69\x08\x00\x00"
+"\x00\x00\x00\x0c\x89\x00\x00\x00\x00\x00\x00\x05\x00\x64\x00\x00\x00\x00\x00\xb7\x08\x00\x00\x00\x00"
+"\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x04\x01\x00\x00\xf4\x01\x00\x00\x3d\x19\x5c\x00\x00\x00\x00"
+"\x00\x79\x61\x18\x00\x00\x00\x00\x00\xbf\x92\x00\x00\x00\x00\x00\x00\x85\x00\x00\x00\x06\x00\x00\x00"
+"\x07\x08\x00\x00\x01\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85"
+"\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00\x85\x00"
+"\x00\x00\x0d\x00\x00\x00\xbc\x00\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00\x00\x00"
+"\x00\x00\x00\x00\x00\x1d\x10\x4e\x00\x00\x00\x00\x00\x61\x69\x14\x00\x00\x00\x00\x00\x0c\x09\x00\x00"
+"\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x04\x01\x00\x00\xf4\x01\x00\x00\x3d\x19\x49\x00\x00"
+"\x00\x00\x00\x79\x61\x18\x00\x00\x00\x00\x00\xbf\x92\x00\x00\x00\x00\x00\x00\x85\x00\x00\x00\x06\x00"
+"\x00\x00\x07\x08\x00\x00\x01\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00"
+"\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00\x00\x00"
+"\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x00\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff\xff\x00"
+"\x00\x00\x00\x00\x00\x00\x00\x1d\x10\x3b\x00\x00\x00\x00\x00\x61\x69\x14\x00\x00\x00\x00\x00\x0c\x09"
+"\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x04\x01\x00\x00\xf4\x01\x00\x00\x3d\x19\x36"
+"\x00\x00\x00\x00\x00\x79\x61\x18\x00\x00\x00\x00\x00\xbf\x92\x00\x00\x00\x00\x00\x00\x85\x00\x00\x00"
+"\x06\x00\x00\x00\x07\x08\x00\x00\x01\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01"
+"\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x01\x00"
+"\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x00\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff\xff\xff"
+"\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x10\x28\x00\x00\x00\x00\x00\x61\x69\x14\x00\x00\x00\x00\x00"
+"\x0c\x09\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x04\x01\x00\x00\xf4\x01\x00\x00\x3d"
+"\x19\x23\x00\x00\x00\x00\x00\x79\x61\x18\x00\x00\x00\x00\x00\xbf\x92\x00\x00\x00\x00\x00\x00\x85\x00"
+"\x00\x00\x06\x00\x00\x00\x07\x08\x00\x00\x01\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00"
+"\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00"
+"\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x00\x00\x00\x00\x00\x00\x00\x18\x01\x00\x00\xff"
+"\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x10\x15\x00\x00\x00\x00\x00\x61\x69\x14\x00\x00\x00"
+"\x00\x00\x0c\x09\x00\x00\x00\x00\x00\x00\x61\x61\x14\x00\x00\x00\x00\x00\x04\x01\x00\x00\xf4\x01\x00"
+"\x00\x3d\x19\x10\x00\x00\x00\x00\x00\x79\x61\x18\x00\x00\x00\x00\x00\xbf\x92\x00\x00\x00\x00\x00\x00"
+"\x85\x00\x00\x00\x06\x00\x00\x00\x07\x08\x00\x00\x01\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7"
+"\x02\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0e\x00\x00\x00\xbf\x71\x00\x00\x00\x00\x00\x00\xb7\x02"
+"\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x0d\x00\x00\x00\xbc\x00\x00\x00\x00\x00\x00\x00\x18\x01\x00"
+"\x00\xff\xff\xff\xff\x00\x00\x00\x00\x00\x00\x00\x00\x1d\x10\x02\x00\x00\x00\x00\x00\x61\x69\x14\x00"
+"\x00\x00\x00\x00\x0c\x09\x00\x00\x00\x00\x00\x00\x18\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01"
+"\x00\x00\x00\x4f\x80\x00\x00\x00\x00\x00\x00\x95\x00\x00\x00\x00\x00\x00\x00\xb7\x00\x00\x00\x00\x00"
+"\x00\x00\x95\x00\x00\x00\x00\x00\x00\x00"
 "";
 
 
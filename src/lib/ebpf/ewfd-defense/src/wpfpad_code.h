@@ -7,12 +7,10 @@ const unsigned char ewfd_wpf_pad_padding_init[] = ""
 
 
 const unsigned char ewfd_wpf_pad_padding_tick[] = ""
-"\xbf\x16\x00\x00\x00\x00\x00\x00\x61\x61\x04\x00\x00\x00\x00\x00\x67\x01\x00\x00\x20\x00\x00\x00\x61"
-"\x62\x00\x00\x00\x00\x00\x00\x4f\x21\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x00\x00\x00\x00\xb7\x03"
-"\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x16\x00\x00\x00\x61\x62\x00\x00\x00\x00\x00\x00\x61\x61\x04"
-"\x00\x00\x00\x00\x00\x67\x01\x00\x00\x20\x00\x00\x00\x4f\x21\x00\x00\x00\x00\x00\x00\x07\x00\x00\x00"
-"\x01\x00\x00\x00\xb7\x02\x00\x00\x00\x00\x00\x00\xb7\x03\x00\x00\x01\x00\x00\x00\xbf\x04\x00\x00\x00"
-"\x00\x00\x00\x85\x00\x00\x00\x17\x00\x00\x00\xb7\x00\x00\x00\x00\x00\x00\x00\x95\x00\x00\x00\x00\x00"
-"\x00\x00"
+"\xbf\x16\x00\x00\x00\x00\x00\x00\x79\x61\x00\x00\x00\x00\x00\x00\xb7\x02\x00\x00\x00\x00\x00\x00\xb7"
+"\x03\x00\x00\x01\x00\x00\x00\x85\x00\x00\x00\x16\x00\x00\x00\x79\x61\x00\x00\x00\x00\x00\x00\x07\x00"
+"\x00\x00\x01\x00\x00\x00\xb7\x02\x00\x00\x00\x00\x00\x00\xb7\x03\x00\x00\x01\x00\x00\x00\xbf\x04\x00"
+"\x00\x00\x00\x00\x00\x85\x00\x00\x00\x17\x00\x00\x00\xb7\x00\x00\x00\x00\x00\x00\x00\x95\x00\x00\x00"
+"\x00\x00\x00\x00"
 "";
 
@@ -1,16 +1,19 @@
 #include "ewfd_test.h"
 #include "../../libebpf.h"
 #include "../../ebpf_vm.h"
+#include "../../ebpf_inst.h"
 #include "front_code.h"
 #include "wpfpad_code.h"
 #include "ewfd_api.h"
 #include "ewfd_helper.h"
+#include "ewfd_maps.h"
 
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <stdbool.h>
 
@@ -114,4 +117,273 @@ int ewfd_run_wpfpad_unit(struct ewfd_unit_t *ctx, void *status, size_t status_le
 
 	printf("ret_val: %ld op: %d arg: %d\n", ret_val, op, arg);
 	return res;
-}
\ No newline at end of file
+}
+/* 所有内置的ewfd程序都必须能通过verifier，越界/未初始化的程序在load时被拒绝
+*/
+#define EWFD_CIRC_STATUS_SIZE 56 // sizeof(ewfd_circ_status_st) in bpf/headers/ewfd.h
+
+static int verify_code(const unsigned char *code, size_t code_len, size_t ctx_size, uint32_t flags) {
+	struct ebpf_vm *vm = ebpf_create();
+	char *errmsg = NULL;
+	int res;
+
+	ewfd_register_unit_helpers(vm);
+	ewfd_register_tor_test_helpers(vm);
+	ewfd_register_ctx_handles(vm, ctx_size == sizeof(uint64_t)); // init程序的ctx是unit本身
+	res = ebpf_load(vm, code, code_len, &errmsg);
+	assert(res == 0);
+	res = ebpf_verify(vm, ctx_size, flags, &errmsg);
+	if (res != 0) {
+		printf("verify failed: %s\n", errmsg);
+		free(errmsg);
+	} else {
+		bool verified = ebpf_is_verified(vm);
+		assert(verified);
+	}
+	ebpf_destroy(vm);
+	return res;
+}
+
+int test_ewfd_verifier(void) {
+	int res;
+
+	printf("ewfd verify units----------------\n");
+
+	res = verify_code(ewfd_front_padding_init, sizeof(ewfd_front_padding_init) - 1, sizeof(uint64_t), 0);
+	assert(res == 0);
+	res = verify_code(ewfd_front_padding_tick, sizeof(ewfd_front_padding_tick) - 1, EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res == 0);
+	res = verify_code(ewfd_front_schedule_1, sizeof(ewfd_front_schedule_1) - 1, EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res == 0);
+	res = verify_code(ewfd_wpf_pad_padding_init, sizeof(ewfd_wpf_pad_padding_init) - 1, sizeof(uint64_t), 0);
+	assert(res == 0);
+	res = verify_code(ewfd_wpf_pad_padding_tick, sizeof(ewfd_wpf_pad_padding_tick) - 1, EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res == 0);
+
+	// r0 = *(u32 *)(r1 + 56); exit
+	const struct ebpf_inst ctx_oob[] = {
+		{.opcode = EBPF_OP_LDXW, .dst = 0, .src = 1, .offset = EWFD_CIRC_STATUS_SIZE},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) ctx_oob, sizeof(ctx_oob), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// r2 = *(u64 *)(r1 + 0); r0 = *(u32 *)(r2 + 0); exit
+	const struct ebpf_inst scalar_deref[] = {
+		{.opcode = EBPF_OP_LDXDW, .dst = 2, .src = 1},
+		{.opcode = EBPF_OP_LDXW, .dst = 0, .src = 2},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) scalar_deref, sizeof(scalar_deref), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// r0 未初始化
+	const struct ebpf_inst uninit_ret[] = {
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 3, .imm = 1},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) uninit_ret, sizeof(uninit_ret), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// r2 = *(u8 *)(r1 + 0); r2 &= 7; r1 += r2; r0 = *(u32 *)(r1 + 48); exit
+	// 偏移范围 [48, 59) 超过了ctx
+	const struct ebpf_inst var_oob[] = {
+		{.opcode = EBPF_OP_LDXB, .dst = 2, .src = 1},
+		{.opcode = EBPF_OP_AND64_IMM, .dst = 2, .imm = 7},
+		{.opcode = EBPF_OP_ADD64_REG, .dst = 1, .src = 2},
+		{.opcode = EBPF_OP_LDXW, .dst = 0, .src = 1, .offset = 48},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) var_oob, sizeof(var_oob), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+	// 同样的程序，偏移 [40, 51) 在ctx内
+	const struct ebpf_inst var_ok[] = {
+		{.opcode = EBPF_OP_LDXB, .dst = 2, .src = 1},
+		{.opcode = EBPF_OP_AND64_IMM, .dst = 2, .imm = 7},
+		{.opcode = EBPF_OP_ADD64_REG, .dst = 1, .src = 2},
+		{.opcode = EBPF_OP_LDXW, .dst = 0, .src = 1, .offset = 40},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) var_ok, sizeof(var_ok), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res == 0);
+
+	// 有界循环: for (r0 = 0; r0 < 8; r0++) *(u8 *)(r10 - 8 + r0) = 0
+	const struct ebpf_inst loop[] = {
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 0, .imm = 0},
+		{.opcode = EBPF_OP_MOV64_REG, .dst = 2, .src = 10},
+		{.opcode = EBPF_OP_ADD64_REG, .dst = 2, .src = 0},
+		{.opcode = EBPF_OP_STB, .dst = 2, .offset = -8, .imm = 0},
+		{.opcode = EBPF_OP_ADD64_IMM, .dst = 0, .imm = 1},
+		{.opcode = EBPF_OP_JLT_IMM, .dst = 0, .offset = -5, .imm = 8},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	// 默认拒绝回边
+	res = verify_code((const unsigned char *) loop, sizeof(loop), EWFD_CIRC_STATUS_SIZE, EBPF_VERIFY_ALLOW_BACK_EDGES);
+	assert(res == 0);
+	res = verify_code((const unsigned char *) loop, sizeof(loop), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// r2 = *(u32 *)(r1 + 0); r2 += 1 << 32; w2 >>= 1; r2 -= 1 << 31; r1 += r2; r0 = *(u8 *)(r1 + 0); exit
+	// alu32先截断dst: w2 >>= 1 的结果在 [0, 2^31)，减去 2^31 后为负，指针越界
+	const struct ebpf_inst alu32_rsh[] = {
+		{.opcode = EBPF_OP_LDXW, .dst = 2, .src = 1},
+		{.opcode = EBPF_OP_LDDW, .dst = 3, .imm = 0},
+		{.imm = 1},
+		{.opcode = EBPF_OP_ADD64_REG, .dst = 2, .src = 3},
+		{.opcode = EBPF_OP_RSH_IMM, .dst = 2, .imm = 1},
+		{.opcode = EBPF_OP_LDDW, .dst = 3, .imm = (int32_t) 0x80000000},
+		{.imm = 0},
+		{.opcode = EBPF_OP_SUB64_REG, .dst = 2, .src = 3},
+		{.opcode = EBPF_OP_ADD64_REG, .dst = 1, .src = 2},
+		{.opcode = EBPF_OP_LDXB, .dst = 0, .src = 1},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) alu32_rsh, sizeof(alu32_rsh), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// helper只接受ctx中的handle: r1 = *(u64 *)(r1 + 0); r2 = 1; call fetch; exit
+	const struct ebpf_inst handle_ok[] = {
+		{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = EWFD_CTX_UNIT_OFF},
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 1},
+		{.opcode = EBPF_OP_CALL, .imm = 13},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) handle_ok, sizeof(handle_ok), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res == 0);
+
+	// 伪造的指针: r1 = 0x1234
+	const struct ebpf_inst forged_const[] = {
+		{.opcode = EBPF_OP_LDDW, .dst = 1, .imm = 0x1234},
+		{.imm = 0},
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 1},
+		{.opcode = EBPF_OP_CALL, .imm = 13},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) forged_const, sizeof(forged_const), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// 修改过的handle: r1 += 8
+	const struct ebpf_inst forged_add[] = {
+		{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = EWFD_CTX_UNIT_OFF},
+		{.opcode = EBPF_OP_ADD64_IMM, .dst = 1, .imm = 8},
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 1},
+		{.opcode = EBPF_OP_CALL, .imm = 13},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) forged_add, sizeof(forged_add), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// 只读了handle的低32位
+	const struct ebpf_inst forged_half[] = {
+		{.opcode = EBPF_OP_LDXW, .dst = 1, .src = 1, .offset = EWFD_CTX_UNIT_OFF},
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 1},
+		{.opcode = EBPF_OP_CALL, .imm = 13},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) forged_half, sizeof(forged_half), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// circ的handle不能当作unit: r1 = *(u64 *)(r1 + 24); call fetch
+	const struct ebpf_inst wrong_kind[] = {
+		{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = EWFD_CTX_CIRC_OFF},
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 1},
+		{.opcode = EBPF_OP_CALL, .imm = 13},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) wrong_kind, sizeof(wrong_kind), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// 覆盖ctx中的handle: *(u64 *)(r1 + 24) = 0x1234
+	const struct ebpf_inst store_handle[] = {
+		{.opcode = EBPF_OP_STDW, .dst = 1, .offset = EWFD_CTX_CIRC_OFF, .imm = 0x1234},
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 0, .imm = 0},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) store_handle, sizeof(store_handle), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// handle不能解引用: r1 = *(u64 *)(r1 + 0); r0 = *(u64 *)(r1 + 0)
+	const struct ebpf_inst deref_handle[] = {
+		{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 1, .offset = EWFD_CTX_UNIT_OFF},
+		{.opcode = EBPF_OP_LDXDW, .dst = 0, .src = 1},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) deref_handle, sizeof(deref_handle), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	// init程序的ctx本身就是unit，不能换成别的值
+	const struct ebpf_inst init_self[] = {
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 1},
+		{.opcode = EBPF_OP_CALL, .imm = 13},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) init_self, sizeof(init_self), sizeof(uint64_t), 0);
+	assert(res == 0);
+	res = verify_code((const unsigned char *) forged_const, sizeof(forged_const), sizeof(uint64_t), 0);
+	assert(res != 0);
+
+	// log_print的fmt必须在栈或ctx内: fmt = r10 - 8, 长度16越界
+	const struct ebpf_inst fmt_oob[] = {
+		{.opcode = EBPF_OP_STDW, .dst = 10, .offset = -8, .imm = 0},
+		{.opcode = EBPF_OP_MOV64_REG, .dst = 1, .src = 10},
+		{.opcode = EBPF_OP_ADD64_IMM, .dst = 1, .imm = -8},
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 16},
+		{.opcode = EBPF_OP_CALL, .imm = 1},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	res = verify_code((const unsigned char *) fmt_oob, sizeof(fmt_oob), EWFD_CIRC_STATUS_SIZE, 0);
+	assert(res != 0);
+
+	return 0;
+}
+
+/* 数据流耗尽时front tick必须返回: 过期的包每个tick最多丢弃16个,
+ * fetch返回-1时停止, 下个tick重新load
+*/
+#define EWFD_STATUS_START_TI 2 // padding_start_ti, 以uint32_t为单位
+#define EWFD_STATUS_NOW_TI 5   // now_ti
+
+static uint64_t run_front_tick(struct ewfd_unit_t *unit, uint32_t *status) {
+	uint64_t ret_val = 0;
+	int res = ebpf_run_code(unit->vm, status, EWFD_CIRC_STATUS_SIZE, &ret_val);
+	assert(res == 0);
+	return ret_val;
+}
+
+int test_ewfd_front_drain(void) {
+	static const uint32_t stream[] = {
+		1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20,
+	};
+	uint32_t status[EWFD_CIRC_STATUS_SIZE / sizeof(uint32_t)] = {0};
+	uint64_t ret_val;
+	int res;
+
+	ewfd_data_stream_set_shared(stream, sizeof(stream) / sizeof(stream[0]));
+	struct ewfd_unit_t *unit = ewfd_unit_new();
+	uint64_t unit_ptr = (uint64_t) unit;
+	memcpy(status, &unit_ptr, sizeof(unit_ptr));
+
+	res = ewfd_init_front_unit(unit, status, sizeof(status));
+	assert(res == 0);
+
+	// 所有包都已过期: 第一个tick丢弃16个, 第二个tick丢完剩下的4个
+	status[EWFD_STATUS_START_TI] = 0;
+	status[EWFD_STATUS_NOW_TI] = 10000;
+	ret_val = run_front_tick(unit, status);
+	assert(ret_val == 0);
+	ret_val = run_front_tick(unit, status);
+	assert(ret_val == 0);
+
+	// 数据流为空, 重新load并把start设为now
+	ret_val = run_front_tick(unit, status);
+	assert(ret_val == 0);
+	assert(status[EWFD_STATUS_START_TI] == 10000);
+
+	// 每个tick最多发送5个dummy
+	ret_val = run_front_tick(unit, status);
+	assert(ret_val == (((uint64_t) 1 << 32) | 5));
+
+	ewfd_unit_clear(unit);
+	ewfd_data_stream_set_shared(NULL, 0);
+	return 0;
+}
@@ -16,4 +16,9 @@ int ewfd_run_front_unit(struct ewfd_unit_t *unit, void *status, size_t status_le
 int ewfd_init_wpfpad_unit(struct ewfd_unit_t *unit, void *status, size_t status_len);
 int ewfd_run_wpfpad_unit(struct ewfd_unit_t *unit, void *status, size_t status_len);
 
+// verify all builtin ewfd programs, reject invalid ones
+int test_ewfd_verifier(void);
+// front tick must stop when the data stream drains
+int test_ewfd_front_drain(void);
+
 #endif /* _EWFD_TEST_H_ */
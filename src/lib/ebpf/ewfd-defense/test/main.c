@@ -1,7 +1,9 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "libebpf.h"
 #include "ebpf_code.h"
@@ -122,19 +124,361 @@ error:
 }
 
 #include "map_test.h"
+#include "ebpf_inst.h"
+#include "ebpf_vm.h"
+
+/* 比较每个ctx单独执行和ebpf_exec_batch的吞吐
+*/
+static void bench_ewfd_exec_batch(bool jit) {
+	// if (now_ti - last_padding_ti >= 100) return (1 << 32) | 1; else return 0;
+	const struct ebpf_inst tick_code[] = {
+		{.opcode = EBPF_OP_LDXW, .dst = 2, .src = 1, .offset = 20},
+		{.opcode = EBPF_OP_LDXW, .dst = 3, .src = 1, .offset = 12},
+		{.opcode = EBPF_OP_SUB64_REG, .dst = 2, .src = 3},
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 0, .imm = 0},
+		{.opcode = EBPF_OP_JLT_IMM, .dst = 2, .offset = 3, .imm = 100},
+		{.opcode = EBPF_OP_MOV64_IMM, .dst = 0, .imm = 1},
+		{.opcode = EBPF_OP_LSH64_IMM, .dst = 0, .imm = 32},
+		{.opcode = EBPF_OP_OR64_IMM, .dst = 0, .imm = 1},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	const int ctx_num = 1024;
+	const int rounds = 1000;
+	uint64_t status[ctx_num][7]; // sizeof(ewfd_circ_status_st) == 56
+	void *ctxs[ctx_num];
+	uint64_t rets[ctx_num];
+	uint64_t ret_val = 0;
+
+	struct ebpf_vm *vm = ebpf_create();
+	int res = ebpf_load(vm, tick_code, sizeof(tick_code), &errmsg);
+	assert(res == 0);
+	res = ebpf_verify(vm, sizeof(status[0]), 0, &errmsg);
+	assert(res == 0);
+	if (jit) {
+		ebpf_jit_fn fn = ebpf_compile(vm, &errmsg);
+		assert(fn != NULL);
+	}
+	for (int i = 0; i < ctx_num; i++) {
+		ewfd_circ_status_st *st = (ewfd_circ_status_st *) status[i];
+		st->last_padding_ti = i % 100;
+		st->now_ti = 150;
+		ctxs[i] = status[i];
+	}
+
+	printf("%s, %d circuits per tick\n", jit ? "jit" : "interpreter", ctx_num);
+	BENCH_RUN_N("per-call", rounds, {
+		for (int c = 0; c < ctx_num; c++) {
+			ebpf_run_code(vm, ctxs[c], sizeof(status[0]), &ret_val);
+			rets[c] = ret_val;
+		}
+	});
+	BENCH_RUN_N("batch", rounds, {
+		ebpf_exec_batch(vm, ctxs, sizeof(status[0]), rets, ctx_num);
+	});
+	for (int c = 0; c < ctx_num; c++) {
+		assert(rets[c] == (c % 100 <= 50 ? ((1ULL << 32) | 1) : 0));
+	}
+	ebpf_destroy(vm);
+}
+
+/* 调用array/histogram helper的程序，ctx: {unit, index, value}
+* 返回 hist_get | array_get << 16 | hist_set_ok << 32 | array_set_ok << 33 | (index >= 100) << 40
+*/
+static const struct ebpf_inst helper_heavy_code[] = {
+	{.opcode = EBPF_OP_MOV64_REG, .dst = 6, .src = 1},
+	// r7 = ewfd_histogram_set(unit, 0, index, value)
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 6, .offset = 0},
+	{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 0},
+	{.opcode = EBPF_OP_LDXW, .dst = 3, .src = 6, .offset = 8},
+	{.opcode = EBPF_OP_LDXW, .dst = 4, .src = 6, .offset = 12},
+	{.opcode = EBPF_OP_CALL, .imm = 23},
+	{.opcode = EBPF_OP_MOV64_REG, .dst = 7, .src = 0},
+	// r8 = ewfd_array_set(unit, 1, index, value)
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 6, .offset = 0},
+	{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 1},
+	{.opcode = EBPF_OP_LDXW, .dst = 3, .src = 6, .offset = 8},
+	{.opcode = EBPF_OP_LDXW, .dst = 4, .src = 6, .offset = 12},
+	{.opcode = EBPF_OP_CALL, .imm = 26},
+	{.opcode = EBPF_OP_MOV64_REG, .dst = 8, .src = 0},
+	// r9 = ewfd_histogram_get(unit, 0, index) & 0xffff
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 6, .offset = 0},
+	{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 0},
+	{.opcode = EBPF_OP_LDXW, .dst = 3, .src = 6, .offset = 8},
+	{.opcode = EBPF_OP_CALL, .imm = 22},
+	{.opcode = EBPF_OP_AND64_IMM, .dst = 0, .imm = 0xffff},
+	{.opcode = EBPF_OP_MOV64_REG, .dst = 9, .src = 0},
+	// r0 = ewfd_array_get(unit, 1, index) & 0xffff
+	{.opcode = EBPF_OP_LDXDW, .dst = 1, .src = 6, .offset = 0},
+	{.opcode = EBPF_OP_MOV64_IMM, .dst = 2, .imm = 1},
+	{.opcode = EBPF_OP_LDXW, .dst = 3, .src = 6, .offset = 8},
+	{.opcode = EBPF_OP_CALL, .imm = 25},
+	{.opcode = EBPF_OP_AND64_IMM, .dst = 0, .imm = 0xffff},
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 0, .imm = 16},
+	{.opcode = EBPF_OP_OR64_REG, .dst = 0, .src = 9},
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 7, .imm = 32},
+	{.opcode = EBPF_OP_OR64_REG, .dst = 0, .src = 7},
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 8, .imm = 33},
+	{.opcode = EBPF_OP_OR64_REG, .dst = 0, .src = 8},
+	// load-compare-branch, r2在两条路径上都是dead
+	{.opcode = EBPF_OP_LDXW, .dst = 2, .src = 6, .offset = 8},
+	{.opcode = EBPF_OP_JLT_IMM, .dst = 2, .imm = 100, .offset = 3},
+	{.opcode = EBPF_OP_MOV64_IMM, .dst = 1, .imm = 1},
+	{.opcode = EBPF_OP_LSH64_IMM, .dst = 1, .imm = 40},
+	{.opcode = EBPF_OP_OR64_REG, .dst = 0, .src = 1},
+	{.opcode = EBPF_OP_EXIT},
+};
+
+struct helper_heavy_ctx {
+	uint64_t unit;
+	uint32_t index;
+	uint32_t value;
+};
+
+enum jit_mode { RUN_INTERP, RUN_JIT, RUN_JIT_OPT };
+
+static struct ebpf_vm *new_helper_heavy_vm(enum jit_mode mode) {
+	struct ewfd_unit_t *tmp = ewfd_unit_new(); // 只用来注册helper
+	struct ebpf_vm *vm = tmp->vm;
+	tmp->own_vm = false;
+	ewfd_unit_clear(tmp);
+	free(tmp);
+
+	int res = ebpf_load(vm, helper_heavy_code, sizeof(helper_heavy_code), &errmsg);
+	assert(res == 0);
+	if (mode != RUN_INTERP) {
+		ebpf_toggle_jit_optimize(vm, mode == RUN_JIT_OPT);
+		ebpf_jit_fn fn = ebpf_compile(vm, &errmsg);
+		assert(fn != NULL);
+	}
+	return vm;
+}
+
+/* 内联helper和fusion之后，JIT的结果和解释器一致
+*/
+static void test_jit_inline_helpers(void) {
+	struct ebpf_vm *vms[3];
+	struct ewfd_unit_t *units[3];
+	const struct helper_heavy_ctx cases[] = {
+		{.index = 5, .value = 7},
+		{.index = 99, .value = 0x12345},
+		{.index = 100, .value = 3},      // histogram越界，array越界
+		{.index = 0x105, .value = 11},   // histogram下标截断为uint8
+		{.index = 15, .value = 0xffff},
+		{.index = 16, .value = 1},
+	};
+
+	bool ok;
+	int res;
+
+	vms[0] = new_helper_heavy_vm(RUN_INTERP);
+	// 内联体必须以EXIT结束，只能用r0-r5
+	res = ebpf_register_inline(vms[0], 22, helper_heavy_code, 2);
+	assert(res == -1);
+	res = ebpf_register_inline(vms[0], 22, helper_heavy_code + 30, 6);
+	assert(res == -1);
+	vms[1] = new_helper_heavy_vm(RUN_JIT);
+	vms[2] = new_helper_heavy_vm(RUN_JIT_OPT);
+
+	for (int u = 0; u < 3; u++) {
+		units[u] = ewfd_unit_new_shared(NULL);
+	}
+	// unit 0: 正常的map, unit 1: 类型不匹配, unit 2: 没有map
+	ewfd_histogram_init(units[0], 0, 1, 4, 100);
+	ok = ewfd_array_init(units[0], 1, 16);
+	assert(ok);
+	ok = ewfd_array_init(units[1], 0, 16);
+	assert(ok);
+	ewfd_histogram_init(units[1], 1, 1, 4, 100);
+
+	for (int u = 0; u < 3; u++) {
+		for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+			uint64_t rets[3];
+			for (int m = 0; m < 3; m++) {
+				struct helper_heavy_ctx ctx = cases[c];
+				ctx.unit = (uint64_t) units[u];
+				if (m == RUN_INTERP) {
+					res = ebpf_exec(vms[m], &ctx, sizeof(ctx), &rets[m]);
+					assert(res == 0);
+				} else {
+					rets[m] = ebpf_compile(vms[m], &errmsg)(&ctx, sizeof(ctx));
+				}
+			}
+			assert(rets[0] == rets[1] && rets[0] == rets[2]);
+			if (u == 0 && cases[c].index == 5) {
+				assert(rets[0] == (7 | 7 << 16 | 1ULL << 32 | 1ULL << 33));
+			}
+		}
+	}
+	assert(units[0]->map_table.fd_table[0] != NULL);
+
+	for (int u = 0; u < 3; u++) {
+		ewfd_unit_clear(units[u]);
+		free(units[u]);
+	}
+	for (int m = 0; m < 3; m++) {
+		ebpf_destroy(vms[m]);
+	}
+}
+
+/* helper密集的程序: 解释器 / 未优化JIT / 优化JIT
+*/
+static void bench_jit_inline_helpers(void) {
+	const char *names[] = {"interpreter", "jit", "jit-opt"};
+	const int rounds = 1000000;
+	struct ewfd_unit_t *unit = ewfd_unit_new_shared(NULL);
+	struct helper_heavy_ctx ctx = {.index = 5, .value = 7};
+	uint64_t ret = 0;
+
+	ewfd_histogram_init(unit, 0, 1, 4, 100);
+	ewfd_array_init(unit, 1, 16);
+	ctx.unit = (uint64_t) unit;
+
+	for (int m = RUN_INTERP; m <= RUN_JIT_OPT; m++) {
+		struct ebpf_vm *vm = new_helper_heavy_vm(m);
+		BENCH_RUN_N(names[m], rounds, {
+			ctx.index = i & 127;
+			ebpf_run_code(vm, &ctx, sizeof(ctx), &ret);
+		});
+		if (m != RUN_INTERP) {
+			printf("%-14s %zu bytes of code\n", "", vm->jitted_size);
+		}
+		ebpf_destroy(vm);
+	}
+
+	ewfd_unit_clear(unit);
+	free(unit);
+}
+
+/* JIT chunk映射为read/exec和read/write两个view，没有同时可写可执行的mapping
+*/
+static void check_jit_maps_not_wx(void) {
+	char line[512];
+	int rx = 0, rw = 0;
+	FILE *f = fopen("/proc/self/maps", "r");
+	if (f == NULL) {
+		return;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char perms[5] = {0};
+		if (strstr(line, "ebpf-jit") == NULL) {
+			continue;
+		}
+		int res = sscanf(line, "%*s %4s", perms);
+		assert(res == 1);
+		assert(perms[1] != 'w' || perms[2] != 'x');
+		if (perms[2] == 'x') {
+			rx++;
+		} else {
+			rw++;
+		}
+	}
+	fclose(f);
+	assert(rx == rw);
+	printf("jit arena: %d exec mappings, %d write mappings\n", rx, rw);
+}
+
+/* 多个程序共享同一个JIT chunk，全部释放后计数归零
+*/
+static void test_jit_arena(void) {
+	// r0 = r1 + i; exit
+	struct ebpf_inst code[] = {
+		{.opcode = EBPF_OP_MOV64_REG, .dst = 0, .src = 1},
+		{.opcode = EBPF_OP_ADD64_IMM, .dst = 0, .imm = 0},
+		{.opcode = EBPF_OP_EXIT},
+	};
+	const int prog_num = 16;
+	struct ebpf_vm *vms[prog_num];
+	ebpf_jit_fn fns[prog_num];
+	struct ebpf_jit_arena_stats before, st;
+
+	ebpf_jit_arena_get_stats(&before);
+	for (int i = 0; i < prog_num; i++) {
+		code[1].imm = i;
+		vms[i] = ebpf_create();
+		int res = ebpf_load(vms[i], code, sizeof(code), &errmsg);
+		assert(res == 0);
+		fns[i] = ebpf_compile(vms[i], &errmsg);
+		assert(fns[i] != NULL);
+		// 重复compile返回同一份代码
+		ebpf_jit_fn fn = ebpf_compile(vms[i], &errmsg);
+		assert(fn == fns[i]);
+	}
+
+	ebpf_jit_arena_get_stats(&st);
+	printf("jit arena: %lu chunks, %lu/%lu bytes, %lu programs\n",
+		st.chunks, st.bytes_used, st.bytes_mapped, st.programs);
+	assert(st.programs == before.programs + prog_num);
+	assert(st.total_allocs == before.total_allocs + prog_num);
+	assert(st.bytes_used <= st.bytes_mapped);
+	// 小程序应当打包进同一个chunk，而不是每个程序一个mapping
+	assert(st.chunks <= before.chunks + 1);
+	check_jit_maps_not_wx();
+
+	// 释放一半后剩下的程序依然可以执行
+	for (int i = 0; i < prog_num; i += 2) {
+		ebpf_destroy(vms[i]);
+	}
+	for (int i = 1; i < prog_num; i += 2) {
+		uint64_t ret = fns[i]((void *) 100, 0);
+		assert(ret == (uint64_t) (100 + i));
+		ret = 0;
+		int res = ebpf_exec(vms[i], (void *) 100, 0, &ret);
+		assert(res == 0 && ret == (uint64_t) (100 + i));
+	}
+	for (int i = 1; i < prog_num; i += 2) {
+		ebpf_destroy(vms[i]);
+	}
+
+	ebpf_jit_arena_get_stats(&st);
+	assert(st.programs == before.programs);
+	assert(st.bytes_used == before.bytes_used);
+}
+
 int main(int agrc, char *argv[]) {
 	printf("hello ebpf\n");
 
 	printf("\n/-------------------------------------------------\n");
 	printf("test basic ringbuffer ewfd extension\n");
 	printf("/-------------------------------------------------\n");
-	assert(run_ebpf_code(TEST_BPF_CODE, TEST_BPF_SIZE, &m, sizeof(struct mem)) == 0);
-	assert(test_ewfd_code() == 0);
+	int res = run_ebpf_code(TEST_BPF_CODE, TEST_BPF_SIZE, &m, sizeof(struct mem));
+	assert(res == 0);
+	res = test_ewfd_code();
+	assert(res == 0);
+
+	printf("\n/-------------------------------------------------\n");
+	printf("test ewfd verifier\n");
+	printf("/-------------------------------------------------\n");
+	res = test_ewfd_verifier();
+	assert(res == 0);
+	res = test_ewfd_front_drain();
+	assert(res == 0);
 
 	printf("\n/-------------------------------------------------\n");
 	printf("test basic hashmap\n");
 	printf("/-------------------------------------------------\n");
 	test_basic_hashmap();
 
+	printf("\n/-------------------------------------------------\n");
+	printf("test array/histogram maps\n");
+	printf("/-------------------------------------------------\n");
+	test_array_maps();
+
+	printf("\n/-------------------------------------------------\n");
+	printf("test jit arena\n");
+	printf("/-------------------------------------------------\n");
+	test_jit_arena();
+
+	printf("\n/-------------------------------------------------\n");
+	printf("test jit helper inlining\n");
+	printf("/-------------------------------------------------\n");
+	test_jit_inline_helpers();
+	bench_jit_inline_helpers();
+
+	printf("\n/-------------------------------------------------\n");
+	printf("bench ewfd batch exec\n");
+	printf("/-------------------------------------------------\n");
+	bench_ewfd_exec_batch(false);
+	bench_ewfd_exec_batch(true);
+
 	return 0;
 }
@@ -3,6 +3,7 @@
 
 // #include "lib/ebpf/ewfd-defense/src/hashmap.h"
 #include "hashmap.h"
+#include "ewfd_api.h"
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -163,4 +164,58 @@ static void prof_ewfd_hashmap_api(void) {
 	efwd_free_hashmap(map);
 }
 
+/* array/histogram map: 直接寻址，越界访问返回0
+*/
+static void test_array_maps(void) {
+	struct ewfd_unit_t *unit = ewfd_unit_new_shared(NULL);
+	const uint32_t hist_idx = 2, array_idx = 9;
+	int N = 1000000;
+
+	bool ok;
+
+	ewfd_histogram_init(unit, hist_idx, sizeof(uint8_t), sizeof(uint32_t), 16);
+	ok = ewfd_histogram_set(unit, hist_idx, 1, 7);
+	assert(ok);
+	assert(ewfd_histogram_get(unit, hist_idx, 1) == 7);
+	ok = ewfd_histogram_set(unit, hist_idx, 16, 1);
+	assert(!ok);
+	assert(ewfd_histogram_get(unit, hist_idx, 200) == 0);
+
+	// fd table需要扩展多次
+	ok = ewfd_array_init(unit, array_idx, 4);
+	assert(ok);
+	ok = ewfd_array_init(unit, hist_idx, 4);
+	assert(!ok);
+	ok = ewfd_array_set(unit, array_idx, 3, UINT64_MAX);
+	assert(ok);
+	assert(ewfd_array_get(unit, array_idx, 3) == UINT64_MAX);
+	ok = ewfd_array_set(unit, array_idx, 4, 1);
+	assert(!ok);
+	assert(ewfd_array_get(unit, array_idx, 4) == 0);
+	assert(ewfd_histogram_get(unit, array_idx, 1) == 0);
+	assert(ewfd_array_get(unit, 100, 1) == 0);
+
+	// 和hashmap实现的histogram比较
+	struct hashmap *map = ewfd_create_hashmap(sizeof(uint8_t), sizeof(struct hist_item), 16);
+	for (uint8_t i = 0; i < 16; i++) {
+		uint32_t token = i;
+		ewfd_hashmap_set(map, &i, &token);
+		ewfd_histogram_set(unit, hist_idx, i, token);
+	}
+	volatile uint32_t sum = 0;
+	BENCH_RUN_N("hist-hashmap", N, {
+		uint8_t key = i & 15;
+		const struct hist_item *it = (const struct hist_item *) ewfd_hashmap_lookup(map, &key);
+		sum += it->token;
+	});
+	BENCH_RUN_N("hist-array", N, {
+		sum += ewfd_histogram_get(unit, hist_idx, i & 15);
+	});
+	(void) sum;
+
+	efwd_free_hashmap(map);
+	ewfd_unit_clear(unit);
+	free(unit);
+}
+
 #endif // EWFD_MAP_TEST_H_
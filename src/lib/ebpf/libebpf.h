@@ -45,6 +45,8 @@ extern "C" {
  */
 struct ebpf_vm;
 
+struct ebpf_inst;
+
 /**
  * @brief Opaque type for a ebpf JIT compiled function.
  */
@@ -96,6 +98,85 @@ void ebpf_set_error_print(struct ebpf_vm* vm, int (*error_printf)(FILE* stream,
  */
 int ebpf_register(struct ebpf_vm* vm, unsigned int index, const char* name, void* fn);
 
+/**
+ * @brief Give a registered external function an eBPF body for the JIT.
+ * When optimization is enabled the x86_64 JIT splices the body in place of
+ * the call instead of calling the function; the interpreter and the other
+ * JITs keep calling it, so both must compute the same result.
+ *
+ * The body reads its arguments from r1-r5 and returns in r0. It may only use
+ * r0-r5, 64-bit ALU, loads/stores and forward unsigned jumps, and must end
+ * with EXIT. It is not copied and must outlive the VM.
+ *
+ * @param[in] vm The VM the function is registered on.
+ * @param[in] index The index of the function.
+ * @param[in] insts The body.
+ * @param[in] num_insts The number of instructions in the body.
+ * @retval 0 Success.
+ * @retval -1 The function is not registered or the body is not allowed.
+ */
+int ebpf_register_inline(struct ebpf_vm* vm, unsigned int index, const struct ebpf_inst* insts, uint32_t num_insts);
+
+/**
+ * @brief Argument types of an external function, checked by ebpf_verify().
+ */
+enum ebpf_arg_type
+{
+    EBPF_ARG_NONE = 0,   /* not checked, e.g. unused or variadic arguments */
+    EBPF_ARG_SCALAR,     /* any initialized scalar, never a pointer or a handle */
+    EBPF_ARG_PTR_TO_MEM, /* ctx or stack pointer the function only reads, the next argument is its size */
+    EBPF_ARG_HANDLE,     /* EBPF_ARG_HANDLE + kind, see EBPF_ARG_HANDLE_OF() */
+};
+
+/* A handle of the given kind, see ebpf_register_ctx_handle(). */
+#define EBPF_ARG_HANDLE_OF(kind) ((uint8_t)(EBPF_ARG_HANDLE + (kind)))
+#define EBPF_MAX_HELPER_ARGS 5
+#define EBPF_MAX_CTX_HANDLES 8
+
+/**
+ * @brief Declare the argument types of a registered external function.
+ * ebpf_verify() rejects every call to a function without argument types, and
+ * every call whose r1-r5 do not match them.
+ *
+ * @param[in] vm The VM the function is registered on.
+ * @param[in] index The index of the function.
+ * @param[in] args One enum ebpf_arg_type (or EBPF_ARG_HANDLE_OF()) per argument.
+ * @param[in] num_args The number of arguments, at most EBPF_MAX_HELPER_ARGS.
+ * @retval 0 Success.
+ * @retval -1 The function is not registered or the types are invalid.
+ */
+int ebpf_register_args(struct ebpf_vm* vm, unsigned int index, const uint8_t* args, uint32_t num_args);
+
+/* Offset of ebpf_register_ctx_handle() for a ctx that is itself a handle. */
+#define EBPF_CTX_SELF (-1)
+
+/**
+ * @brief Declare an opaque handle stored in the context.
+ * An 8-byte load of exactly this ctx field yields a handle of the given kind,
+ * which the program can only pass to EBPF_ARG_HANDLE_OF(kind) arguments: it
+ * can not be dereferenced, and a handle changed by any ALU operation is a plain
+ * scalar again. Stores to the field are rejected. With EBPF_CTX_SELF, r1 on
+ * entry is the handle instead of a ctx pointer.
+ *
+ * The host must fill the field with a valid object before every run.
+ *
+ * @param[in] vm The VM to declare the handle on.
+ * @param[in] offset The ctx offset of the 8-byte field, or EBPF_CTX_SELF.
+ * @param[in] kind The kind of the handle.
+ * @retval 0 Success.
+ * @retval -1 Too many handles or an invalid offset or kind.
+ */
+int ebpf_register_ctx_handle(struct ebpf_vm* vm, int32_t offset, uint8_t kind);
+
+/**
+ * @brief Enable / disable JIT optimizations (helper inlining, peephole fusion). Enabled by default.
+ *
+ * @param[in] vm The VM to enable / disable optimizations on.
+ * @param[in] enable Enable optimizations if true, disable if false.
+ * @retval true Optimizations were previously enabled.
+ */
+bool ebpf_toggle_jit_optimize(struct ebpf_vm* vm, bool enable);
+
 /**
  * @brief Load code into a VM.
  * This must be done before calling ebpf_exec or ebpf_compile and after
@@ -154,6 +235,60 @@ void ebpf_unload_code(struct ebpf_vm* vm);
  */
 int ebpf_load_elf(struct ebpf_vm* vm, const void* elf, size_t elf_len, char** errmsg);
 
+/**
+ * @brief Load one text section from an ELF file.
+ *
+ * Same as ebpf_load_elf(), but loads the executable section called
+ * 'section_name' (e.g. "ewfd/front/padding/tick"), so an object holding
+ * several programs can be loaded one program at a time. A NULL
+ * 'section_name' selects the first executable section.
+ *
+ * @param[in] vm The VM to load the code into.
+ * @param[in] elf A pointer to a copy of an ELF file in memory.
+ * @param[in] elf_len The size of the ELF file.
+ * @param[in] section_name The name of the section to load, or NULL.
+ * @param[out] errmsg The error message, if any. This should be freed by the caller.
+ * @retval 0 Success.
+ * @retval -1 Failure.
+ */
+int ebpf_load_elf_section(struct ebpf_vm* vm, const void* elf, size_t elf_len, const char* section_name, char** errmsg);
+
+/**
+ * @brief Accept backward jumps in ebpf_verify(). Without it any loop is
+ * rejected, since the verifier does not prove that loops terminate.
+ */
+#define EBPF_VERIFY_ALLOW_BACK_EDGES 0x1
+
+/**
+ * @brief Statically verify the code loaded into a VM.
+ *
+ * Walks every path of the program tracking register types and value ranges,
+ * and checks that each memory access stays within the first ctx_size bytes of
+ * the context (r1 on entry) or within the stack, that no register is read
+ * before it is written, that every call matches the argument types of its
+ * function (see ebpf_register_args()) and that no path falls off the end of
+ * the code.
+ *
+ * On success the interpreter skips its runtime bounds checks for every
+ * ebpf_exec() call whose mem_len is at least ctx_size.
+ *
+ * @param[in] vm The VM holding the loaded code.
+ * @param[in] ctx_size Number of context bytes the program may access.
+ * @param[in] flags EBPF_VERIFY_* flags.
+ * @param[out] errmsg The reason the program was rejected. This should be freed by the caller.
+ * @retval 0 The program is verified.
+ * @retval -1 The program was rejected.
+ */
+int ebpf_verify(struct ebpf_vm* vm, size_t ctx_size, uint32_t flags, char** errmsg);
+
+/**
+ * @brief Check whether the loaded code passed ebpf_verify().
+ *
+ * @param[in] vm The VM to check.
+ * @retval true The code is verified.
+ */
+bool ebpf_is_verified(const struct ebpf_vm* vm);
+
 /**
  * @brief Execute a BPF program in the VM using the interpreter.
  *
@@ -169,6 +304,23 @@ int ebpf_load_elf(struct ebpf_vm* vm, const void* elf, size_t elf_len, char** er
  */
 int ebpf_exec(const struct ebpf_vm* vm, void* mem, size_t mem_len, uint64_t* bpf_return_value);
 
+/**
+ * @brief Execute a BPF program over an array of contexts.
+ *
+ * Runs the JIT-compiled code in a tight loop if the program was compiled,
+ * otherwise runs the interpreter once per context. All contexts must have
+ * the same length.
+ *
+ * @param[in] vm The VM to execute the program in.
+ * @param[in] mems The contexts to pass to the program, one per run.
+ * @param[in] mem_len The length of each context.
+ * @param[out] bpf_return_values The value of r0 for each run, 0 if that run failed.
+ * @param[in] num The number of contexts.
+ * @retval 0 Success.
+ * @retval -1 At least one run failed.
+ */
+int ebpf_exec_batch(const struct ebpf_vm* vm, void** mems, size_t mem_len, uint64_t* bpf_return_values, size_t num);
+
 /**
  * @brief Compile a BPF program in the VM to native code.
  *
@@ -181,6 +333,25 @@ int ebpf_exec(const struct ebpf_vm* vm, void* mem, size_t mem_len, uint64_t* bpf
  */
 ebpf_jit_fn ebpf_compile(struct ebpf_vm* vm, char** errmsg);
 
+/**
+ * @brief Usage of the executable arena shared by all compiled programs.
+ */
+struct ebpf_jit_arena_stats
+{
+    uint64_t chunks;       /* mapped chunks */
+    uint64_t bytes_mapped; /* executable bytes mapped */
+    uint64_t bytes_used;   /* bytes held by live programs, padding included */
+    uint64_t programs;     /* live compiled programs */
+    uint64_t total_allocs; /* programs compiled since start */
+};
+
+/**
+ * @brief Read the JIT arena usage counters.
+ *
+ * @param[out] stats The counters.
+ */
+void ebpf_jit_arena_get_stats(struct ebpf_jit_arena_stats* stats);
+
 /*
  * Translate the eBPF byte code to x64 machine code, store in buffer, and
  * write the resulting count of bytes to size.
@@ -25,6 +25,13 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+#if defined(HAVE_WRITEV) && defined(HAVE_SYS_UIO_H) && !defined(_WIN32)
+#include <sys/uio.h>
+#define USE_WRITEV
+#endif
 
 #ifdef PARANOIA
 /** Helper: If PARANOIA is defined, assert that the buffer in local variable
@@ -34,6 +41,21 @@
 #define check() STMT_NIL
 #endif /* defined(PARANOIA) */
 
+#ifdef USE_WRITEV
+/** Largest number of chunks we hand to a single writev() call. */
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define BUF_FLUSH_MAX_IOV IOV_MAX
+#elif defined(IOV_MAX)
+#define BUF_FLUSH_MAX_IOV 1024
+#else
+/* The smallest IOV_MAX POSIX allows. */
+#define BUF_FLUSH_MAX_IOV 16
+#endif
+#endif /* defined(USE_WRITEV) */
+
+/** Write syscalls made, and bytes written, by buf_flush_to_socket(). */
+static buf_flush_stats_t socket_flush_stats;
+
 /** Read up to <b>at_most</b> bytes from the file descriptor <b>fd</b> into
  * <b>chunk</b> (which must be on <b>buf</b>). If we get an EOF, set
  * *<b>reached_eof</b> to 1. Uses <b>tor_socket_recv()</b> iff <b>is_socket</b>
@@ -173,14 +195,63 @@ flush_chunk(tor_socket_t fd, buf_t *buf, chunk_t *chunk, size_t sz,
   }
 }
 
+#ifdef USE_WRITEV
+/** Helper for buf_flush_to_socket(): try to write the first <b>sz</b> bytes
+ * of <b>buf</b>, which may span up to BUF_FLUSH_MAX_IOV chunks, onto file
+ * descriptor <b>fd</b> with one writev() call.  Set *<b>attempted_out</b>
+ * to the number of bytes we tried to write.  Return the number of bytes
+ * written on success, 0 on blocking, -1 on failure.
+ */
+static int
+flush_chunks_vectored(int fd, buf_t *buf, size_t sz, size_t *attempted_out)
+{
+  struct iovec iov[BUF_FLUSH_MAX_IOV];
+  const chunk_t *chunk;
+  size_t attempted = 0;
+  int n_iov = 0;
+  ssize_t write_result;
+
+  for (chunk = buf->head; chunk && attempted < sz && n_iov < BUF_FLUSH_MAX_IOV;
+       chunk = chunk->next) {
+    size_t len = chunk->datalen;
+    if (len > sz - attempted)
+      len = sz - attempted;
+    if (!len)
+      continue;
+    iov[n_iov].iov_base = chunk->data;
+    iov[n_iov].iov_len = len;
+    ++n_iov;
+    attempted += len;
+  }
+  *attempted_out = attempted;
+
+  write_result = writev(fd, iov, n_iov);
+
+  if (write_result < 0) {
+    if (!ERRNO_IS_EAGAIN(errno)) /* it's a real error */
+      return -1;
+    log_debug(LD_NET,"writev() would block, returning.");
+    return 0;
+  } else {
+    buf_drain(buf, write_result);
+    tor_assert(write_result <= BUF_MAX_LEN);
+    return (int)write_result;
+  }
+}
+#endif /* defined(USE_WRITEV) */
+
 /** Write data from <b>buf</b> to the file descriptor <b>fd</b>.  Write at most
  * <b>sz</b> bytes, and remove the written bytes
  * from the buffer.  Return the number of bytes written on success,
  * -1 on failure.  Return 0 if write() would block.
+ *
+ * Where writev() is available, gather as many chunks as we can into each
+ * call; otherwise write one chunk per call.  If <b>stats</b> is provided,
+ * count our calls and the bytes they wrote there.
  */
 static int
 buf_flush_to_fd(buf_t *buf, int fd, size_t sz,
-                bool is_socket)
+                bool is_socket, buf_flush_stats_t *stats)
 {
   /* XXXX It's stupid to overload the return values for these functions:
    * "error status" and "number of bytes flushed" are not mutually exclusive.
@@ -196,13 +267,23 @@ buf_flush_to_fd(buf_t *buf, int fd, size_t sz,
   while (sz) {
     size_t flushlen0;
     tor_assert(buf->head);
+#ifdef USE_WRITEV
+    (void) is_socket;
+    r = flush_chunks_vectored(fd, buf, sz, &flushlen0);
+#else
     if (buf->head->datalen >= sz)
       flushlen0 = sz;
     else
       flushlen0 = buf->head->datalen;
 
     r = flush_chunk(fd, buf, buf->head, flushlen0, is_socket);
+#endif /* defined(USE_WRITEV) */
     check();
+    if (stats) {
+      ++stats->n_syscalls;
+      if (r > 0)
+        stats->n_bytes += r;
+    }
     if (r < 0)
       return r;
     flushed += r;
@@ -223,7 +304,7 @@ buf_flush_to_fd(buf_t *buf, int fd, size_t sz,
 int
 buf_flush_to_socket(buf_t *buf, tor_socket_t s, size_t sz)
 {
-  return buf_flush_to_fd(buf, s, sz, true);
+  return buf_flush_to_fd(buf, s, sz, true, &socket_flush_stats);
 }
 
 /** Read from socket <b>s</b>, writing onto end of <b>buf</b>.  Read at most
@@ -248,7 +329,7 @@ buf_read_from_socket(buf_t *buf, tor_socket_t s, size_t at_most,
 int
 buf_flush_to_pipe(buf_t *buf, int fd, size_t sz)
 {
-  return buf_flush_to_fd(buf, fd, sz, false);
+  return buf_flush_to_fd(buf, fd, sz, false, NULL);
 }
 
 /** Read from pipe <b>fd</b>, writing onto end of <b>buf</b>.  Read at most
@@ -263,3 +344,11 @@ buf_read_from_pipe(buf_t *buf, int fd, size_t at_most,
 {
   return buf_read_from_fd(buf, fd, at_most, reached_eof, socket_error, false);
 }
+
+/** Set *<b>out</b> to the number of write syscalls buf_flush_to_socket() has
+ * made so far, and the number of bytes they wrote. */
+void
+buf_flush_get_socket_stats(buf_flush_stats_t *out)
+{
+  *out = socket_flush_stats;
+}
@@ -14,6 +14,7 @@
 #define TOR_BUFFERS_NET_H
 
 #include <stddef.h>
+#include "lib/cc/torint.h"
 #include "lib/net/socket.h"
 
 struct buf_t;
@@ -29,4 +30,15 @@ int buf_read_from_pipe(struct buf_t *buf, int fd, size_t at_most,
 
 int buf_flush_to_pipe(struct buf_t *buf, int fd, size_t sz);
 
+/** Counters kept by buf_flush_to_socket(). */
+typedef struct buf_flush_stats_t {
+  /** Number of write syscalls, including ones that would have blocked or
+   * failed. */
+  uint64_t n_syscalls;
+  /** Number of bytes those syscalls wrote. */
+  uint64_t n_bytes;
+} buf_flush_stats_t;
+
+void buf_flush_get_socket_stats(buf_flush_stats_t *out);
+
 #endif /* !defined(TOR_BUFFERS_NET_H) */
@@ -24,6 +24,7 @@
 #include <openssl/obj_mac.h>
 #endif /* defined(ENABLE_OPENSSL) */
 
+#include "core/or/channel.h"
 #include "core/or/circuitlist.h"
 #include "app/config/config.h"
 #include "app/main/subsysmgr.h"
@@ -36,6 +37,7 @@
 #include "lib/compress/compress.h"
 
 #include "core/or/cell_st.h"
+#include "core/or/circuit_st.h"
 #include "core/or/or_circuit_st.h"
 
 #include "lib/crypt_ops/digestset.h"
@@ -44,6 +46,8 @@
 #include "feature/dirparse/microdesc_parse.h"
 #include "feature/nodelist/microdesc.h"
 
+#include "feature/ewfd/ewfd_wheel.h"
+
 #if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_PROCESS_CPUTIME_ID)
 static uint64_t nanostart;
 static inline uint64_t
@@ -423,6 +427,50 @@ bench_cell_aes(void)
 
   crypto_cipher_free(c);
   tor_free(b);
+
+  /* Cells for n_circs circuits arriving in runs of run_len cells per
+   * circuit, crypted one by one and with relay_crypt_payloads(). */
+  const int n_circs = 64, batch = 64;
+  const int run_lens[] = { 1, 4, 16, 64 };
+  crypto_cipher_t **circ_ciphers = tor_calloc(n_circs, sizeof(*circ_ciphers));
+  crypto_cipher_t *ciphers[64];
+  uint8_t *payloads[64];
+  uint8_t *cells = tor_malloc(batch * CELL_PAYLOAD_SIZE);
+
+  crypto_rand((char *) cells, batch * CELL_PAYLOAD_SIZE);
+  for (i = 0; i < n_circs; ++i) {
+    crypto_rand(key, sizeof(key));
+    circ_ciphers[i] = crypto_cipher_new(key);
+  }
+  for (i = 0; i < batch; ++i)
+    payloads[i] = cells + i * CELL_PAYLOAD_SIZE;
+
+  for (unsigned r = 0; r < ARRAY_LENGTH(run_lens); ++r) {
+    int j;
+    for (i = 0; i < batch; ++i)
+      ciphers[i] = circ_ciphers[(i / run_lens[r]) % n_circs];
+
+    start = perftime();
+    for (j = 0; j < iters / batch; ++j) {
+      for (i = 0; i < batch; ++i)
+        relay_crypt_one_payload(ciphers[i], payloads[i]);
+    }
+    end = perftime();
+    printf("%d cells per circuit, per cell: %.2f ns per cell\n", run_lens[r],
+           NANOCOUNT(start, end, iters / batch * batch));
+
+    start = perftime();
+    for (j = 0; j < iters / batch; ++j)
+      relay_crypt_payloads(ciphers, payloads, batch);
+    end = perftime();
+    printf("%d cells per circuit, batched:  %.2f ns per cell\n", run_lens[r],
+           NANOCOUNT(start, end, iters / batch * batch));
+  }
+
+  for (i = 0; i < n_circs; ++i)
+    crypto_cipher_free(circ_ciphers[i]);
+  tor_free(circ_ciphers);
+  tor_free(cells);
 }
 
 /** Run digestmap_t performance benchmarks. */
@@ -738,6 +786,124 @@ bench_md_parse(void)
   printf("Microdesc parse: %f nsec\n", NANOCOUNT(start, end, N));
 }
 
+/** Run insert/cancel/expire benchmarks on the EWFD timing wheel. */
+static void
+bench_ewfd_wheel(void)
+{
+  const int N = 1000000;
+  const uint64_t tick_ms = 50, spread_ms = 10000;
+  uint64_t start, end, now;
+  int i, expired = 0;
+  tor_weak_rng_t weak;
+  ewfd_wheel_st *wheel = tor_malloc_zero(sizeof(ewfd_wheel_st));
+  ewfd_wheel_node_st *nodes = tor_calloc(N, sizeof(ewfd_wheel_node_st));
+
+  tor_init_weak_random(&weak, 1337);
+  ewfd_wheel_init(wheel, 0);
+
+  reset_perftime();
+  start = perftime();
+  for (i = 0; i < N; ++i) {
+    ewfd_wheel_add(wheel, &nodes[i],
+                   tor_weak_random_range(&weak, (int32_t) spread_ms));
+  }
+  end = perftime();
+  printf("ewfd_wheel_add: %.2f nsec per event\n", NANOCOUNT(start, end, N));
+
+  start = perftime();
+  for (i = 0; i < N; i += 4) {
+    ewfd_wheel_del(wheel, &nodes[i]);
+  }
+  end = perftime();
+  printf("ewfd_wheel_del: %.2f nsec per event\n",
+         NANOCOUNT(start, end, N / 4));
+
+  start = perftime();
+  for (now = 0; now <= spread_ms; now += tick_ms) {
+    ewfd_wheel_update(wheel, now);
+    while (ewfd_wheel_get_expired(wheel) != NULL)
+      ++expired;
+  }
+  end = perftime();
+  tor_assert(wheel->node_num == 0);
+  printf("ewfd_wheel_update: %.2f nsec per expired event (%d events, "
+         "%d ms ticks)\n", NANOCOUNT(start, end, expired), expired,
+         (int) tick_ms);
+
+  tor_free(nodes);
+  tor_free(wheel);
+}
+
+/** Run circuit_get_by_circid_channel() lookups against channels holding
+ * increasing numbers of circuits. */
+static void
+bench_circid_lookup(void)
+{
+  const int n_chans = 16;
+  const int n_circs[] = { 16, 256, 4096, 65536, 262144, -1 };
+  const int iters = 4000000;
+  uint64_t start, end;
+  int i, j, found;
+  tor_weak_rng_t weak;
+  channel_t *chans = tor_calloc(n_chans, sizeof(channel_t));
+
+  tor_init_weak_random(&weak, 1337);
+
+  for (i = 0; n_circs[i] > 0; ++i) {
+    const int n = n_circs[i];
+    circuit_t *circs = tor_calloc(n, sizeof(circuit_t));
+    channel_t **lookup_chan = tor_calloc(n, sizeof(channel_t *));
+    circid_t *lookup_id = tor_calloc(n, sizeof(circid_t));
+
+    /* Spread the circuits over the channels, with random IDs as a peer
+     * would pick them. */
+    for (j = 0; j < n; ++j) {
+      channel_t *chan = &chans[j % n_chans];
+      circid_table_ent_t *ent;
+      circid_t id;
+      do {
+        crypto_rand((char *)&id, sizeof(id));
+      } while (circid_table_find(&chan->circid_table, id));
+      ent = circid_table_insert(&chan->circid_table, id);
+      ent->circuit = &circs[j];
+      lookup_chan[j] = chan;
+      lookup_id[j] = id;
+    }
+    /* Look them up in an order unrelated to insertion. */
+    for (j = n - 1; j > 0; --j) {
+      int k = tor_weak_random_range(&weak, j + 1);
+      channel_t *c = lookup_chan[j];
+      circid_t id = lookup_id[j];
+      lookup_chan[j] = lookup_chan[k];
+      lookup_id[j] = lookup_id[k];
+      lookup_chan[k] = c;
+      lookup_id[k] = id;
+    }
+
+    found = 0;
+    reset_perftime();
+    start = perftime();
+    for (j = 0; j < iters; ++j) {
+      if (circuit_get_by_circid_channel(lookup_id[j % n], lookup_chan[j % n]))
+        ++found;
+    }
+    end = perftime();
+    tor_assert(found == iters);
+    printf("%7d circuits on %d channels: %.2f ns per lookup "
+           "(%.2f M lookups/sec)\n", n, n_chans,
+           NANOCOUNT(start, end, iters),
+           1e3 / NANOCOUNT(start, end, iters));
+
+    for (j = 0; j < n_chans; ++j)
+      circid_table_clear(&chans[j].circid_table);
+    tor_free(circs);
+    tor_free(lookup_chan);
+    tor_free(lookup_id);
+  }
+
+  tor_free(chans);
+}
+
 typedef void (*bench_fn)(void);
 
 typedef struct benchmark_t {
@@ -768,6 +934,8 @@ static struct benchmark_t benchmarks[] = {
 #endif
 
   ENT(md_parse),
+  ENT(circid_lookup),
+  ENT(ewfd_wheel),
   {NULL,NULL,0}
 };
 
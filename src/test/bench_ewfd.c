@@ -0,0 +1,749 @@
+/* Copyright (c) 2007-2021, The Tor Project, Inc. */
+/* See LICENSE for licensing information */
+
+/**
+ * \file bench_ewfd.c
+ * \brief Offline simulator for the EWFD padding defenses.
+ *
+ * Recorded cell traces are replayed through one simulated channel that uses
+ * the ewfd_delay_policy cmux.  Each trace is one fake OR circuit; the
+ * defense's padding unit is run at its tick interval, its dummy events go
+ * through the real EWFD event queue, and the channel is drained at a fixed
+ * link rate.  For every defense we report the bandwidth overhead, the
+ * queueing latency of real cells, the CPU spent per cell and the depth of
+ * the event queue.
+ *
+ * Usage: bench_ewfd [--defense none|front|wpf-pad|ezlinear|all]
+ *                   [--circs N] [--rate CELLS_PER_MS] [--jit] [trace ...]
+ *
+ * A trace file has one cell per line: "<seconds> <direction>", where
+ * direction -1 is a cell sent towards the client (queued on the simulated
+ * channel) and +1 a cell received from the client.  Without trace files,
+ * N deterministic synthetic page loads are generated.
+ **/
+
+#define CHANNEL_OBJECT_PRIVATE
+#define CIRCUITBUILD_PRIVATE
+#define CIRCUITLIST_PRIVATE
+#define EWFD_UNITEST_TEST_PRIVATE
+
+#include "orconfig.h"
+
+#include "core/or/or.h"
+#include "app/config/config.h"
+#include "app/main/subsysmgr.h"
+#include "core/or/channel.h"
+#include "core/or/circuitmux.h"
+#include "core/or/circuitmux_ewfd.h"
+#include "core/or/relay.h"
+#include "core/or/scheduler.h"
+#include "core/or/cell_st.h"
+#include "core/or/cell_queue_st.h"
+#include "core/or/or_circuit_st.h"
+#include "feature/ewfd/circuit_padding.h"
+#include "feature/ewfd/ebpf_api.h"
+#include "feature/ewfd/ewfd.h"
+#include "feature/ewfd/ewfd_conf.h"
+#include "feature/ewfd/ewfd_unit.h"
+#include "feature/ewfd/utils.h"
+#include "lib/crypt_ops/crypto_init.h"
+#include "lib/ebpf/ewfd-defense/src/ewfd_api.h"
+#include "lib/ebpf/ewfd-defense/src/wpfpad_code.h"
+#include "lib/fs/files.h"
+#include "lib/intmath/weakrng.h"
+#include "lib/time/compat_time.h"
+
+#include "test/fakecircs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Real cells carry this tag and their enqueue time in the relay payload so
+ * that the channel can tell them from dummies. */
+#define BENCH_CELL_MAGIC "EWFDBNCH"
+#define BENCH_CELL_MAGIC_LEN 8
+#define BENCH_CELL_TAG_OFF RELAY_HEADER_SIZE
+
+/** How long the simulation keeps running after the last trace cell. */
+#define BENCH_TAIL_MS 1000
+/** Upper bound on the extra time spent draining queued real cells. */
+#define BENCH_MAX_DRAIN_MS 60000
+
+/** Simulated time starts here, and every run starts after the previous one
+ * so that the event queue wheel never goes back in time. */
+#define BENCH_START_MS 10000
+
+typedef struct bench_trace_ev_t {
+  uint32_t ti_ms;
+  int8_t dir;
+} bench_trace_ev_t;
+
+typedef struct bench_trace_t {
+  char *name;
+  bench_trace_ev_t *evs;
+  int n_evs;
+  int cap;
+} bench_trace_t;
+
+typedef struct bench_circ_t {
+  or_circuit_t *orcirc;
+  const bench_trace_t *trace;
+  int pos;
+  ewfd_unit_st *unit;
+  ewfd_padding_unit_st slot;
+  ewfd_padding_runtime_st *rt;
+  ewfd_circ_status_st status;
+  uint64_t next_tick_ti;
+} bench_circ_t;
+
+typedef struct bench_defense_t {
+  const char *name;
+  /** Why this defense can't run here, or NULL. */
+  const char *skip_reason;
+  ewfd_padding_conf_st *(*new_conf)(void);
+  void (*free_conf)(ewfd_padding_conf_st *conf);
+} bench_defense_t;
+
+typedef struct bench_result_t {
+  uint64_t real_cells;
+  uint64_t dummy_cells;
+  uint64_t recv_cells;
+  uint64_t unit_ticks;
+  uint64_t unit_nsec;
+  uint64_t sim_nsec;
+  uint64_t sim_ms;
+  uint64_t depth_sum;
+  uint32_t depth_max;
+  uint64_t events_dropped;
+  uint64_t events_late;
+  uint32_t *lat;
+  size_t n_lat;
+  size_t cap_lat;
+} bench_result_t;
+
+static int bench_use_jit = 0;
+static double bench_rate = 5.0; /* cells per ms */
+static uint64_t bench_now_ms = BENCH_START_MS;
+static bench_result_t *cur_result = NULL;
+
+static uint64_t
+cpu_nsec(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_PROCESS_CPUTIME_ID)
+  struct timespec ts;
+  int r = clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  tor_assert(r == 0);
+  return ((uint64_t)ts.tv_sec)*1000000000 + ts.tv_nsec;
+#else
+  return ((uint64_t)clock()) * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+static void
+set_sim_time(uint64_t now_ms)
+{
+  bench_now_ms = now_ms;
+  monotime_set_mock_time_nsec((int64_t)now_ms * 1000000);
+}
+
+/* ------------------------------------------------------------------
+ * Traces
+ */
+
+static void
+trace_add(bench_trace_t *trace, uint32_t ti_ms, int8_t dir)
+{
+  if (trace->n_evs == trace->cap) {
+    trace->cap = trace->cap ? trace->cap * 2 : 256;
+    trace->evs = tor_reallocarray(trace->evs, trace->cap,
+                                  sizeof(bench_trace_ev_t));
+  }
+  trace->evs[trace->n_evs].ti_ms = ti_ms;
+  trace->evs[trace->n_evs].dir = dir;
+  trace->n_evs++;
+}
+
+static int
+compare_trace_ev(const void *a_, const void *b_)
+{
+  const bench_trace_ev_t *a = a_, *b = b_;
+  if (a->ti_ms < b->ti_ms)
+    return -1;
+  return a->ti_ms > b->ti_ms;
+}
+
+/** Load a "<seconds> <direction>" trace; timestamps are made relative to the
+ * first cell. Return NULL on error. */
+static bench_trace_t *
+trace_load(const char *fname)
+{
+  char *body = read_file_to_str(fname, 0, NULL);
+  if (!body) {
+    fprintf(stderr, "Can't read trace %s\n", fname);
+    return NULL;
+  }
+
+  bench_trace_t *trace = tor_malloc_zero(sizeof(bench_trace_t));
+  trace->name = tor_strdup(fname);
+  double first = -1;
+  char *saveptr = NULL;
+  for (char *line = strtok_r(body, "\n", &saveptr); line;
+       line = strtok_r(NULL, "\n", &saveptr)) {
+    char *end = NULL;
+    double ti = strtod(line, &end);
+    if (end == line)
+      continue;
+    long dir = strtol(end, NULL, 10);
+    if (dir == 0)
+      continue;
+    if (first < 0)
+      first = ti;
+    double ms = (ti - first) * 1000.0;
+    trace_add(trace, ms > 0 ? (uint32_t)(ms + 0.5) : 0, dir > 0 ? 1 : -1);
+  }
+  tor_free(body);
+
+  qsort(trace->evs, trace->n_evs, sizeof(bench_trace_ev_t), compare_trace_ev);
+  return trace;
+}
+
+/** A synthetic page load: a few request/response rounds, each a couple of
+ * client cells followed by a burst of cells towards the client. */
+static bench_trace_t *
+trace_synthetic(int idx)
+{
+  tor_weak_rng_t rng;
+  bench_trace_t *trace = tor_malloc_zero(sizeof(bench_trace_t));
+  tor_asprintf(&trace->name, "synthetic-%d", idx);
+  tor_init_weak_random(&rng, 0x5eed + idx);
+
+  uint32_t ti = (uint32_t) tor_weak_random_range(&rng, 100);
+  int rounds = 6 + tor_weak_random_range(&rng, 10);
+  for (int r = 0; r < rounds; r++) {
+    int req = 1 + tor_weak_random_range(&rng, 3);
+    for (int i = 0; i < req; i++)
+      trace_add(trace, ti, 1);
+    ti += 20 + tor_weak_random_range(&rng, 80);
+    int resp = 10 + tor_weak_random_range(&rng, 300);
+    for (int i = 0; i < resp; i++) {
+      trace_add(trace, ti, -1);
+      ti += tor_weak_random_range(&rng, 3);
+    }
+    ti += 50 + tor_weak_random_range(&rng, 600);
+  }
+  return trace;
+}
+
+static void
+trace_free(bench_trace_t *trace)
+{
+  if (!trace)
+    return;
+  tor_free(trace->name);
+  tor_free(trace->evs);
+  tor_free(trace);
+}
+
+/* ------------------------------------------------------------------
+ * Defenses
+ */
+
+static ewfd_code_st *
+new_code(int code_type, const char *name, const unsigned char *code,
+         size_t len)
+{
+  ewfd_code_st *ewfd_code = tor_malloc_zero(sizeof(ewfd_code_st));
+  tor_assert(len <= sizeof(ewfd_code->code));
+  ewfd_code->code_type = code_type;
+  ewfd_code->code_len = (int) len;
+  strlcpy(ewfd_code->name, name, sizeof(ewfd_code->name));
+  memcpy(ewfd_code->code, code, len);
+  return ewfd_code;
+}
+
+/** front uses the code cache that the framework loads at init. */
+static ewfd_padding_conf_st *
+front_new_conf(void)
+{
+  return demo_get_front_padding_unit_conf();
+}
+
+static void
+front_free_conf(ewfd_padding_conf_st *conf)
+{
+  tor_free(conf);
+}
+
+static ewfd_padding_conf_st *
+wpfpad_new_conf(void)
+{
+  ewfd_padding_conf_st *conf = tor_malloc_zero(sizeof(ewfd_padding_conf_st));
+  conf->unit_uuid = 3;
+  conf->unit_type = EWFD_UNIT_PADDING;
+  conf->target_hopnum = 2;
+  conf->tick_interval = DEFAULT_EWFD_PADDING_GAP_MS;
+  conf->initial_hop = EWFD_NODE_ROLE_CLIENT;
+  conf->init_code = new_code(EWFD_CODE_TYPE_INIT, "wpf_pad_init_code",
+                             ewfd_wpf_pad_padding_init,
+                             sizeof(ewfd_wpf_pad_padding_init) - 1);
+  conf->main_code = new_code(EWFD_CODE_TYPE_MAIN, "wpf_pad_run_code",
+                             ewfd_wpf_pad_padding_tick,
+                             sizeof(ewfd_wpf_pad_padding_tick) - 1);
+  return conf;
+}
+
+static void
+wpfpad_free_conf(ewfd_padding_conf_st *conf)
+{
+  free_ewfd_code_vm(conf->init_code);
+  free_ewfd_code_vm(conf->main_code);
+  tor_free(conf->init_code);
+  tor_free(conf->main_code);
+  tor_free(conf);
+}
+
+static const bench_defense_t defenses[] = {
+  { "none", NULL, NULL, NULL },
+  { "front", NULL, front_new_conf, front_free_conf },
+  { "wpf-pad", NULL, wpfpad_new_conf, wpfpad_free_conf },
+  { "ezlinear",
+    "no compiled bytecode, and it reads ctx fields "
+    "ewfd_circ_status_st doesn't fill",
+    NULL, NULL },
+  { NULL, NULL, NULL, NULL },
+};
+
+/* ------------------------------------------------------------------
+ * Simulated channel
+ */
+
+static void
+sim_chan_close(channel_t *chan)
+{
+  (void) chan;
+}
+
+static const char *
+sim_chan_describe_peer(const channel_t *chan)
+{
+  (void) chan;
+  return "EWFD simulated channel";
+}
+
+static int
+sim_chan_get_remote_addr(const channel_t *chan, tor_addr_t *out)
+{
+  (void) chan;
+  tor_addr_from_ipv4h(out, 0x7f000001);
+  return 1;
+}
+
+static int
+sim_chan_num_cells_writeable(channel_t *chan)
+{
+  (void) chan;
+  return INT_MAX;
+}
+
+static void
+record_latency(bench_result_t *res, uint32_t lat)
+{
+  if (res->n_lat == res->cap_lat) {
+    res->cap_lat = res->cap_lat ? res->cap_lat * 2 : 4096;
+    res->lat = tor_reallocarray(res->lat, res->cap_lat, sizeof(uint32_t));
+  }
+  res->lat[res->n_lat++] = lat;
+}
+
+static int
+sim_chan_write_packed_cell(channel_t *chan, packed_cell_t *cell)
+{
+  const uint8_t *payload = (const uint8_t *) cell->body +
+    (chan->wide_circ_ids ? 4 : 2) + 1;
+  const uint8_t *tag = payload + BENCH_CELL_TAG_OFF;
+
+  if (!memcmp(tag, BENCH_CELL_MAGIC, BENCH_CELL_MAGIC_LEN)) {
+    uint32_t enq_ms = get_uint32(tag + BENCH_CELL_MAGIC_LEN);
+    cur_result->real_cells++;
+    record_latency(cur_result, (uint32_t)(bench_now_ms - enq_ms));
+  } else {
+    cur_result->dummy_cells++;
+  }
+  return 1;
+}
+
+static int
+sim_chan_write_var_cell(channel_t *chan, var_cell_t *var_cell)
+{
+  (void) chan;
+  (void) var_cell;
+  return 1;
+}
+
+static channel_t *
+new_sim_channel(void)
+{
+  channel_t *chan = tor_malloc_zero(sizeof(channel_t));
+  channel_init(chan);
+
+  chan->close = sim_chan_close;
+  chan->num_cells_writeable = sim_chan_num_cells_writeable;
+  chan->describe_peer = sim_chan_describe_peer;
+  chan->get_remote_addr = sim_chan_get_remote_addr;
+  chan->write_packed_cell = sim_chan_write_packed_cell;
+  chan->write_var_cell = sim_chan_write_var_cell;
+  chan->state = CHANNEL_STATE_OPEN;
+
+  chan->cmux = circuitmux_alloc();
+  circuitmux_set_policy(chan->cmux, &ewfd_delay_policy);
+  return chan;
+}
+
+static void
+free_sim_channel(channel_t *chan)
+{
+  if (!chan)
+    return;
+  if (chan->cmux)
+    circuitmux_free(chan->cmux);
+  tor_free(chan);
+}
+
+/** The simulation drains the channel itself. */
+static void
+scheduler_channel_has_waiting_cells_mock(channel_t *chan)
+{
+  (void) chan;
+}
+
+/* ------------------------------------------------------------------
+ * Simulation
+ */
+
+static void
+bench_circ_init(bench_circ_t *bc, const bench_trace_t *trace,
+                channel_t *nchan, channel_t *pchan,
+                ewfd_padding_conf_st *conf)
+{
+  memset(bc, 0, sizeof(*bc));
+  bc->trace = trace;
+  bc->orcirc = new_fake_orcirc(nchan, pchan);
+  tor_assert(bc->orcirc);
+  if (!conf)
+    return;
+
+  bc->unit = init_ewfd_unit(conf);
+  tor_assert(bc->unit);
+  bc->slot.conf = conf;
+  bc->slot.ewfd_unit = bc->unit;
+
+  /* Dummy events only need the active padding slot of the runtime. */
+  bc->rt = tor_malloc_zero(sizeof(ewfd_padding_runtime_st));
+  bc->rt->padding_slots[0] = &bc->slot;
+  bc->rt->on_circ = TO_CIRCUIT(bc->orcirc);
+  TO_CIRCUIT(bc->orcirc)->ewfd_padding_rt = bc->rt;
+
+  bc->status.ewfd_unit = (uint64_t) (uintptr_t) bc->unit;
+  bc->status.on_circ = (uint64_t) (uintptr_t) TO_CIRCUIT(bc->orcirc);
+  bc->status.padding_start_ti = (uint32_t) bench_now_ms;
+  bc->status.cur_padding_unit = conf->unit_uuid;
+  bc->next_tick_ti = bench_now_ms;
+}
+
+static void
+bench_circ_clear(bench_circ_t *bc)
+{
+  circuit_t *circ = TO_CIRCUIT(bc->orcirc);
+  ewfd_remove_circ_events((uintptr_t) circ);
+  circ->ewfd_padding_rt = NULL;
+  tor_free(bc->rt);
+  cell_queue_clear(&bc->orcirc->p_chan_cells);
+  if (bc->unit)
+    free_ewfd_unit(bc->unit);
+  free_fake_orcirc(bc->orcirc);
+}
+
+static void
+bench_circ_send_cell(bench_circ_t *bc, channel_t *chan)
+{
+  cell_t cell;
+  memset(&cell, 0, sizeof(cell));
+  cell.command = CELL_RELAY;
+  cell.circ_id = bc->orcirc->p_circ_id;
+  memcpy(cell.payload + BENCH_CELL_TAG_OFF, BENCH_CELL_MAGIC,
+         BENCH_CELL_MAGIC_LEN);
+  set_uint32(cell.payload + BENCH_CELL_TAG_OFF + BENCH_CELL_MAGIC_LEN,
+             (uint32_t) bench_now_ms);
+  append_cell_to_circuit_queue(TO_CIRCUIT(bc->orcirc), chan, &cell,
+                               CELL_DIRECTION_IN, 0);
+}
+
+static void
+bench_circ_tick(bench_circ_t *bc, bench_result_t *res)
+{
+  ewfd_circ_status_st *st = &bc->status;
+  uint32_t interval = bc->slot.conf->tick_interval;
+
+  st->now_ti = (uint32_t) bench_now_ms;
+  st->next_tick = 0;
+
+  uint64_t start = cpu_nsec();
+  run_ewfd_unit(bc->unit, &bc->status, sizeof(ewfd_circ_status_st));
+  res->unit_nsec += cpu_nsec() - start;
+  res->unit_ticks++;
+
+  st->last_padding_ti = st->now_ti;
+  bc->next_tick_ti = bench_now_ms + (st->next_tick ? st->next_tick : interval);
+}
+
+static int
+compare_u32(const void *a_, const void *b_)
+{
+  uint32_t a = *(const uint32_t *) a_, b = *(const uint32_t *) b_;
+  return a < b ? -1 : a > b;
+}
+
+static uint32_t
+percentile(const bench_result_t *res, double pct)
+{
+  if (res->n_lat == 0)
+    return 0;
+  size_t idx = (size_t) (pct / 100.0 * (res->n_lat - 1) + 0.5);
+  return res->lat[idx];
+}
+
+static void
+run_defense(const bench_defense_t *defense, smartlist_t *traces,
+            bench_result_t *res)
+{
+  int n_circs = smartlist_len(traces);
+  bench_circ_t *circs = tor_calloc(n_circs, sizeof(bench_circ_t));
+  channel_t *pchan = new_sim_channel();
+  channel_t *nchan = new_sim_channel();
+  ewfd_padding_conf_st *conf = NULL;
+  uint64_t start_ms = bench_now_ms;
+  uint64_t end_ms = start_ms;
+  ewfd_event_queue_stats_st old_stats = ewfd_event_queue_stats;
+
+  memset(res, 0, sizeof(*res));
+  cur_result = res;
+
+  if (defense->new_conf) {
+    conf = defense->new_conf();
+    tor_assert(conf);
+    conf->use_jit = bench_use_jit;
+  }
+
+  SMARTLIST_FOREACH_BEGIN(traces, bench_trace_t *, trace) {
+    bench_circ_init(&circs[trace_sl_idx], trace, nchan, pchan, conf);
+    if (trace->n_evs > 0)
+      end_ms = MAX(end_ms, start_ms + trace->evs[trace->n_evs - 1].ti_ms);
+  } SMARTLIST_FOREACH_END(trace);
+  end_ms += BENCH_TAIL_MS;
+
+  double credit = 0;
+  uint64_t cpu_start = cpu_nsec();
+  uint64_t now;
+  for (now = start_ms; ; now++) {
+    set_sim_time(now);
+
+    bool pending = false;
+    for (int i = 0; i < n_circs; i++) {
+      bench_circ_t *bc = &circs[i];
+      const bench_trace_t *trace = bc->trace;
+      while (bc->pos < trace->n_evs &&
+             start_ms + trace->evs[bc->pos].ti_ms <= now) {
+        if (trace->evs[bc->pos].dir < 0) {
+          bench_circ_send_cell(bc, pchan);
+          bc->status.send_cell_cnt++;
+        } else {
+          bc->status.recv_cell_cnt++;
+          res->recv_cells++;
+        }
+        bc->status.last_cell_ti = (uint32_t) now;
+        bc->pos++;
+      }
+      if (bc->unit && now >= bc->next_tick_ti)
+        bench_circ_tick(bc, res);
+      pending |= bc->orcirc->p_chan_cells.n > 0;
+    }
+
+    on_event_queue_tick(NULL, NULL);
+
+    uint32_t depth = 0;
+    for (int i = 0; i < n_circs; i++)
+      depth += ewfd_get_event_num((uintptr_t) TO_CIRCUIT(circs[i].orcirc));
+    res->depth_sum += depth;
+    res->depth_max = MAX(res->depth_max, depth);
+
+    credit += bench_rate;
+    if (credit >= 1) {
+      int max = (int) credit;
+      credit -= channel_flush_from_first_active_circuit(pchan, max);
+      /* Unused link capacity can't be saved for later. */
+      credit = MIN(credit, bench_rate);
+    }
+
+    if (now >= end_ms && (!pending || now >= end_ms + BENCH_MAX_DRAIN_MS))
+      break;
+  }
+  res->sim_nsec = cpu_nsec() - cpu_start;
+  res->sim_ms = now - start_ms + 1;
+  res->events_dropped = ewfd_event_queue_stats.dropped - old_stats.dropped;
+  res->events_late = ewfd_event_queue_stats.late - old_stats.late;
+
+  for (int i = 0; i < n_circs; i++) {
+    /* Dummies the channel never got to, so they don't leak into the cmux */
+    circs[i].orcirc->p_chan_cells.ewfd_dummy_n = 0;
+    bench_circ_clear(&circs[i]);
+  }
+  tor_free(circs);
+  free_sim_channel(pchan);
+  free_sim_channel(nchan);
+  if (conf)
+    defense->free_conf(conf);
+
+  qsort(res->lat, res->n_lat, sizeof(uint32_t), compare_u32);
+  set_sim_time(bench_now_ms + BENCH_TAIL_MS);
+  cur_result = NULL;
+}
+
+static void
+print_result(const bench_defense_t *defense, const bench_result_t *res,
+             const bench_result_t *base)
+{
+  uint64_t cells = res->real_cells + res->dummy_cells;
+  double overhead = res->real_cells ?
+    100.0 * res->dummy_cells / res->real_cells : 0;
+
+  printf("%-9s real %8"PRIu64" dummy %8"PRIu64" overhead %7.2f%%",
+         defense->name, res->real_cells, res->dummy_cells, overhead);
+  printf("  latency ms p50/p90/p99 %u/%u/%u",
+         percentile(res, 50), percentile(res, 90), percentile(res, 99));
+  if (base && base != res) {
+    printf(" (+%d/+%d/+%d)",
+           (int) percentile(res, 50) - (int) percentile(base, 50),
+           (int) percentile(res, 90) - (int) percentile(base, 90),
+           (int) percentile(res, 99) - (int) percentile(base, 99));
+  }
+  printf("\n%-9s cpu %.1f ns/cell, unit %.1f ns/tick (%"PRIu64" ticks)",
+         "", cells ? (double) res->sim_nsec / cells : 0,
+         res->unit_ticks ? (double) res->unit_nsec / res->unit_ticks : 0,
+         res->unit_ticks);
+  printf("  event queue depth mean %.1f max %u, dropped %"PRIu64
+         " late %"PRIu64"\n",
+         res->sim_ms ? (double) res->depth_sum / res->sim_ms : 0,
+         res->depth_max, res->events_dropped, res->events_late);
+}
+
+static void
+usage(void)
+{
+  printf("Usage: bench_ewfd [--defense none|front|wpf-pad|ezlinear|all]\n"
+         "                  [--circs N] [--rate CELLS_PER_MS] [--jit] "
+         "[trace ...]\n");
+}
+
+int
+main(int argc, const char **argv)
+{
+  const char *only = "all";
+  int n_synthetic = 20;
+  smartlist_t *traces = smartlist_new();
+  char *errmsg = NULL;
+  int ret = 1;
+
+  subsystems_init_upto(SUBSYS_LEVEL_LIBS);
+  flush_log_messages_from_startup();
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--defense") && i + 1 < argc) {
+      only = argv[++i];
+    } else if (!strcmp(argv[i], "--circs") && i + 1 < argc) {
+      n_synthetic = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+      bench_rate = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--jit")) {
+      bench_use_jit = 1;
+    } else if (argv[i][0] == '-') {
+      usage();
+      goto done;
+    } else {
+      bench_trace_t *trace = trace_load(argv[i]);
+      if (!trace)
+        goto done;
+      smartlist_add(traces, trace);
+    }
+  }
+  if (n_synthetic <= 0 || bench_rate <= 0) {
+    usage();
+    goto done;
+  }
+  if (smartlist_len(traces) == 0) {
+    for (int i = 0; i < n_synthetic; i++)
+      smartlist_add(traces, trace_synthetic(i));
+  }
+
+  if (crypto_global_init(0, NULL, NULL) < 0) {
+    printf("Couldn't seed RNG; exiting.\n");
+    goto done;
+  }
+
+  init_protocol_warning_severity_level();
+  or_options_t *options = options_new();
+  options->command = CMD_RUN_UNITTESTS;
+  options->DataDirectory = tor_strdup("");
+  options->KeyDirectory = tor_strdup("");
+  options->CacheDirectory = tor_strdup("");
+  options_init(options);
+  if (set_options(options, &errmsg) < 0) {
+    printf("Failed to set initial options: %s\n", errmsg);
+    tor_free(errmsg);
+    goto done;
+  }
+
+  monotime_enable_test_mocking();
+  set_sim_time(BENCH_START_MS);
+  MOCK(scheduler_channel_has_waiting_cells,
+       scheduler_channel_has_waiting_cells_mock);
+  ewfd_framework_init();
+
+  printf("%d circuits, link rate %.1f cells/ms, %s\n",
+         smartlist_len(traces), bench_rate,
+         bench_use_jit ? "jit" : "interpreter");
+
+  bench_result_t base;
+  bool have_base = false;
+  memset(&base, 0, sizeof(base));
+  for (const bench_defense_t *d = defenses; d->name; d++) {
+    if (strcmp(only, "all") && strcmp(only, d->name))
+      continue;
+    if (d->skip_reason) {
+      printf("%-9s skipped: %s\n", d->name, d->skip_reason);
+      continue;
+    }
+
+    bench_result_t res;
+    run_defense(d, traces, &res);
+    print_result(d, &res, have_base ? &base : NULL);
+    if (!d->new_conf && !have_base) {
+      base = res;
+      have_base = true;
+    } else {
+      tor_free(res.lat);
+    }
+  }
+  tor_free(base.lat);
+  ret = 0;
+
+  ewfd_framework_free();
+  UNMOCK(scheduler_channel_has_waiting_cells);
+  monotime_disable_test_mocking();
+
+ done:
+  SMARTLIST_FOREACH(traces, bench_trace_t *, trace, trace_free(trace));
+  smartlist_free(traces);
+  return ret;
+}
@@ -11,6 +11,7 @@
 #include "lib/tls/tortls.h"
 #include "lib/compress/compress.h"
 #include "lib/crypt_ops/crypto_rand.h"
+#include "lib/net/buffers_net.h"
 #include "core/proto/proto_http.h"
 #include "core/proto/proto_socks.h"
 #include "test/test.h"
@@ -789,6 +790,62 @@ test_buffers_chunk_size(void *arg)
   ;
 }
 
+static void
+test_buffers_flush_to_socket(void *arg)
+{
+  const size_t len = 30000;
+  buf_t *buf = buf_new();
+  tor_socket_t fds[2] = {TOR_INVALID_SOCKET, TOR_INVALID_SOCKET};
+  char *msg = tor_malloc(len), *got = tor_malloc_zero(len);
+  buf_flush_stats_t before, after;
+  const chunk_t *chunk;
+  size_t n_read = 0;
+  int n_chunks = 0;
+  (void)arg;
+
+  crypto_rand(msg, len);
+  tt_int_op(tor_socketpair(AF_UNIX, SOCK_STREAM, 0, fds), OP_EQ, 0);
+  /* Small writes, so that the data ends up spread over several chunks. */
+  for (n_read = 0; n_read < len; n_read += 1000)
+    buf_add(buf, msg + n_read, 1000);
+  n_read = 0;
+  for (chunk = buf->head; chunk; chunk = chunk->next)
+    ++n_chunks;
+  tt_int_op(n_chunks, OP_GT, 2);
+
+  /* Stop partway into the last chunk. */
+  buf_flush_get_socket_stats(&before);
+  tt_int_op(buf_flush_to_socket(buf, fds[0], len - 1000), OP_EQ, len - 1000);
+  buf_flush_get_socket_stats(&after);
+  tt_uint_op(buf_datalen(buf), OP_EQ, 1000);
+  tt_u64_op(after.n_bytes - before.n_bytes, OP_EQ, len - 1000);
+#ifdef HAVE_WRITEV
+  /* All the chunks went out in one call. */
+  tt_u64_op(after.n_syscalls - before.n_syscalls, OP_EQ, 1);
+#else
+  tt_u64_op(after.n_syscalls - before.n_syscalls, OP_EQ, n_chunks);
+#endif
+
+  tt_int_op(buf_flush_to_socket(buf, fds[0], 1000), OP_EQ, 1000);
+  tt_uint_op(buf_datalen(buf), OP_EQ, 0);
+
+  while (n_read < len) {
+    ssize_t r = tor_socket_recv(fds[1], got + n_read, len - n_read, 0);
+    tt_int_op(r, OP_GT, 0);
+    n_read += r;
+  }
+  tt_mem_op(got, OP_EQ, msg, len);
+
+ done:
+  if (SOCKET_OK(fds[0]))
+    tor_close_socket(fds[0]);
+  if (SOCKET_OK(fds[1]))
+    tor_close_socket(fds[1]);
+  buf_free(buf);
+  tor_free(msg);
+  tor_free(got);
+}
+
 static void
 test_buffers_find_contentlen(void *arg)
 {
@@ -870,6 +927,7 @@ struct testcase_t buffer_tests[] = {
   { "tls_read_mocked", test_buffers_tls_read_mocked, 0,
     NULL, NULL },
   { "chunk_size", test_buffers_chunk_size, 0, NULL, NULL },
+  { "flush_to_socket", test_buffers_flush_to_socket, TT_FORK, NULL, NULL },
   { "find_contentlen", test_buffers_find_contentlen, 0, NULL, NULL },
 
   { "compress/zlib", test_buffers_compress, TT_FORK,
@@ -4,7 +4,9 @@
 #define CIRCUITLIST_PRIVATE
 #define RELAY_PRIVATE
 #include "core/or/or.h"
+#include "core/or/cell_pool.h"
 #include "core/or/circuitlist.h"
+#include "core/or/connection_or.h"
 #include "core/or/relay.h"
 #include "test/test.h"
 
@@ -12,6 +14,7 @@
 #include "core/or/cell_queue_st.h"
 #include "core/or/or_circuit_st.h"
 #include "core/or/origin_circuit_st.h"
+#include "core/or/var_cell_st.h"
 
 static void
 test_cq_manip(void *arg)
@@ -139,9 +142,112 @@ test_circuit_n_cells(void *arg)
   circuit_free_(TO_CIRCUIT(origin_c));
 }
 
+static void
+test_cell_pool(void *arg)
+{
+  cell_pool_t *pool = cell_pool_new("test", 100);
+  cell_pool_stats_t stats;
+  smartlist_t *objs = smartlist_new();
+  size_t per_slab;
+  (void) arg;
+
+  /* Fill one slab and spill into a second. */
+  smartlist_add(objs, cell_pool_alloc(pool));
+  cell_pool_get_stats(pool, &stats);
+  tt_uint_op(stats.slot_size, OP_EQ, 128);
+  tt_uint_op(stats.n_slabs, OP_EQ, 1);
+  per_slab = stats.n_used + stats.n_free;
+  tt_uint_op(per_slab, OP_GT, 1);
+  while (smartlist_len(objs) <= (int)per_slab)
+    smartlist_add(objs, cell_pool_alloc(pool));
+  cell_pool_get_stats(pool, &stats);
+  tt_uint_op(stats.n_slabs, OP_EQ, 2);
+  tt_uint_op(stats.n_used, OP_EQ, per_slab + 1);
+
+  /* Objects are zeroed, cache-line aligned and don't overlap. */
+  SMARTLIST_FOREACH_BEGIN(objs, uint8_t *, obj) {
+    tt_assert(fast_mem_is_zero((const char *)obj, 100));
+    tt_uint_op(((uintptr_t)obj) % 64, OP_EQ, 0);
+    memset(obj, 0xff, 100);
+  } SMARTLIST_FOREACH_END(obj);
+
+  /* With no cache allowed, a slab goes as soon as it is empty. */
+  cell_pool_release(pool, smartlist_pop_last(objs));
+  cell_pool_get_stats(pool, &stats);
+  tt_uint_op(stats.n_slabs, OP_EQ, 1);
+  tt_uint_op(stats.n_slab_frees, OP_EQ, 1);
+
+  /* With room for one, the empty slab is kept and reused. */
+  cell_pool_set_max_cached(pool, 1024*1024);
+  SMARTLIST_FOREACH(objs, void *, obj, cell_pool_release(pool, obj));
+  smartlist_clear(objs);
+  cell_pool_get_stats(pool, &stats);
+  tt_uint_op(stats.n_used, OP_EQ, 0);
+  tt_uint_op(stats.n_slabs, OP_EQ, 1);
+  tt_uint_op(stats.n_empty_slabs, OP_EQ, 1);
+  smartlist_add(objs, cell_pool_alloc(pool));
+  cell_pool_get_stats(pool, &stats);
+  tt_uint_op(stats.n_slab_allocs, OP_EQ, 2);
+  tt_uint_op(stats.n_empty_slabs, OP_EQ, 0);
+  tt_assert(fast_mem_is_zero(smartlist_get(objs, 0), 100));
+
+  /* Trimming releases empty slabs only. */
+  tt_uint_op(cell_pool_trim(pool), OP_EQ, 0);
+  cell_pool_release(pool, smartlist_pop_last(objs));
+  tt_uint_op(cell_pool_trim(pool), OP_GT, 0);
+  cell_pool_get_stats(pool, &stats);
+  tt_uint_op(stats.n_slabs, OP_EQ, 0);
+  tt_uint_op(stats.bytes_allocated, OP_EQ, 0);
+
+ done:
+  SMARTLIST_FOREACH(objs, void *, obj, cell_pool_release(pool, obj));
+  smartlist_free(objs);
+  cell_pool_free(pool);
+}
+
+static void
+test_var_cell_pool(void *arg)
+{
+  var_cell_t *small = NULL, *big = NULL, *copy = NULL;
+  cell_pool_stats_t packed_stats, var_stats;
+  size_t used;
+  (void) arg;
+
+  cell_pools_get_stats(&packed_stats, &var_stats);
+  used = var_stats.n_used;
+
+  small = var_cell_new(CELL_PAYLOAD_SIZE);
+  big = var_cell_new(CELL_PAYLOAD_SIZE + 1);
+  tt_uint_op(small->payload_len, OP_EQ, CELL_PAYLOAD_SIZE);
+  tt_uint_op(big->payload_len, OP_EQ, CELL_PAYLOAD_SIZE + 1);
+  cell_pools_get_stats(&packed_stats, &var_stats);
+  tt_uint_op(var_stats.n_used, OP_EQ, used + 1);
+
+  /* Callers may shorten payload_len; the cell must still go back to where
+   * it came from. */
+  big->payload_len = 10;
+  memset(big->payload, 7, 10);
+  copy = var_cell_copy(big);
+  tt_mem_op(copy->payload, OP_EQ, big->payload, 10);
+  cell_pools_get_stats(&packed_stats, &var_stats);
+  tt_uint_op(var_stats.n_used, OP_EQ, used + 2);
+  var_cell_free(big);
+  var_cell_free(small);
+  var_cell_free(copy);
+  cell_pools_get_stats(&packed_stats, &var_stats);
+  tt_uint_op(var_stats.n_used, OP_EQ, used);
+
+ done:
+  var_cell_free(small);
+  var_cell_free(big);
+  var_cell_free(copy);
+}
+
 struct testcase_t cell_queue_tests[] = {
   { "basic", test_cq_manip, TT_FORK, NULL, NULL, },
   { "circ_n_cells", test_circuit_n_cells, TT_FORK, NULL, NULL },
+  { "pool", test_cell_pool, TT_FORK, NULL, NULL },
+  { "var_cell_pool", test_var_cell_pool, TT_FORK, NULL, NULL },
   END_OF_TESTCASES
 };
 
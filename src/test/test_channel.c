@@ -654,7 +654,8 @@ test_channel_outbound_cell(void *arg)
   if (circ) {
     circuit_free_(TO_CIRCUIT(circ));
   }
-  tor_free(p_cell);
+  packed_cell_free(p_cell);
+  packed_cell_free(p_cell2);
   channel_free_all();
   UNMOCK(scheduler_release_channel);
   monotime_disable_test_mocking();
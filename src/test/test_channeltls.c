@@ -19,6 +19,7 @@
 #include "core/or/scheduler.h"
 #include "lib/tls/tortls.h"
 
+#include "core/or/cell_st.h"
 #include "core/or/or_connection_st.h"
 #include "core/or/congestion_control_common.h"
 
@@ -30,6 +31,7 @@
 static void test_channeltls_create(void *arg);
 static void test_channeltls_num_bytes_queued(void *arg);
 static void test_channeltls_overhead_estimate(void *arg);
+static void test_channeltls_handle_cells(void *arg);
 
 /* Mocks used by channeltls unit tests */
 static size_t tlschan_buf_datalen_mock(const buf_t *buf);
@@ -258,6 +260,97 @@ test_channeltls_overhead_estimate(void *arg)
   return;
 }
 
+/* What the handlers installed by test_channeltls_handle_cells() saw: one
+ * entry per call, the circuit ID and how many cells it carried. */
+static circid_t tlschan_handled_circ_ids[8];
+static int tlschan_handled_n_cells[8];
+static int tlschan_n_handled = 0;
+
+static void
+tlschan_cell_handler(channel_t *chan, cell_t *cell)
+{
+  (void)chan;
+  tt_int_op(tlschan_n_handled, OP_LT, 8);
+  tlschan_handled_circ_ids[tlschan_n_handled] = cell->circ_id;
+  tlschan_handled_n_cells[tlschan_n_handled++] = 1;
+ done:
+  ;
+}
+
+static void
+tlschan_relay_cells_handler(channel_t *chan, cell_t **cells, int n_cells)
+{
+  (void)chan;
+  tt_int_op(tlschan_n_handled, OP_LT, 8);
+  for (int i = 1; i < n_cells; ++i)
+    tt_int_op(cells[i]->circ_id, OP_EQ, cells[0]->circ_id);
+  tlschan_handled_circ_ids[tlschan_n_handled] = cells[0]->circ_id;
+  tlschan_handled_n_cells[tlschan_n_handled++] = n_cells;
+ done:
+  ;
+}
+
+static void
+test_channeltls_handle_cells(void *arg)
+{
+  tor_addr_t test_addr;
+  channel_t *ch = NULL;
+  const char test_digest[DIGEST_LEN] = {
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+    0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14 };
+  const circid_t circ_ids[] = { 5, 3, 5, 3, 5, 5 };
+  const uint8_t commands[] = { CELL_RELAY, CELL_RELAY, CELL_RELAY_EARLY,
+                               CELL_DESTROY, CELL_RELAY, CELL_RELAY };
+  cell_t cells[6];
+  uint64_t n_cells_recved;
+  int i;
+
+  (void)arg;
+
+  test_addr.family = AF_INET;
+  test_addr.addr.in_addr.s_addr = htonl(0x01020304);
+  tlschan_local = false;
+  MOCK(is_local_to_resolve_addr, tlschan_resolved_addr_is_local_mock);
+  MOCK(connection_or_connect, tlschan_connection_or_connect_mock);
+
+  ch = channel_tls_connect(&test_addr, 567, test_digest, NULL);
+  tt_ptr_op(ch, OP_NE, NULL);
+  ch->state = CHANNEL_STATE_OPEN;
+  channel_set_cell_handlers(ch, tlschan_cell_handler);
+  channel_set_relay_cells_handler(ch, tlschan_relay_cells_handler);
+
+  memset(cells, 0, sizeof(cells));
+  for (i = 0; i < 6; ++i) {
+    cells[i].circ_id = circ_ids[i];
+    cells[i].command = commands[i];
+  }
+
+  /* Circuit 3 sorts first: its relay cell, then its destroy on its own.
+   * Then all four cells for circuit 5, in arrival order, in one run. */
+  n_cells_recved = ch->n_cells_recved;
+  channel_tls_handle_cells(cells, 6, BASE_CHAN_TO_TLS(ch)->conn);
+  tt_int_op(tlschan_n_handled, OP_EQ, 3);
+  tt_uint_op(tlschan_handled_circ_ids[0], OP_EQ, 3);
+  tt_int_op(tlschan_handled_n_cells[0], OP_EQ, 1);
+  tt_uint_op(tlschan_handled_circ_ids[1], OP_EQ, 3);
+  tt_int_op(tlschan_handled_n_cells[1], OP_EQ, 1);
+  tt_uint_op(tlschan_handled_circ_ids[2], OP_EQ, 5);
+  tt_int_op(tlschan_handled_n_cells[2], OP_EQ, 4);
+  tt_u64_op(ch->n_cells_recved, OP_EQ, n_cells_recved + 6);
+
+ done:
+  if (ch) {
+    MOCK(scheduler_release_channel, scheduler_release_channel_mock);
+    ch->close = tlschan_fake_close_method;
+    channel_mark_for_close(ch);
+    free_fake_channel(ch);
+    UNMOCK(scheduler_release_channel);
+  }
+
+  UNMOCK(connection_or_connect);
+  UNMOCK(is_local_to_resolve_addr);
+}
+
 static size_t
 tlschan_buf_datalen_mock(const buf_t *buf)
 {
@@ -337,5 +430,6 @@ struct testcase_t channeltls_tests[] = {
     TT_FORK, NULL, NULL },
   { "overhead_estimate", test_channeltls_overhead_estimate,
     TT_FORK, NULL, NULL },
+  { "handle_cells", test_channeltls_handle_cells, TT_FORK, NULL, NULL },
   END_OF_TESTCASES
 };
@@ -7,6 +7,7 @@
 #define HS_CIRCUITMAP_PRIVATE
 #include "core/or/or.h"
 #include "core/or/channel.h"
+#include "core/or/circid_table.h"
 #include "core/or/circuitbuild.h"
 #include "core/or/circuitlist.h"
 #include "core/or/circuitmux_ewma.h"
@@ -484,11 +485,89 @@ test_hs_circuitmap_isolation(void *arg)
   circuit_free_(TO_CIRCUIT(circ4));
 }
 
+/** Return the fake circuit pointer test_circid_table() stores for ID
+ * number <b>i</b>. */
+#define FAKE_CIRC(i) ((circuit_t *)(uintptr_t)(((i) + 1) * 16))
+/** Return the circuit ID test_circid_table() uses for ID number <b>i</b>:
+ * distinct, and spread over the whole ID space. */
+#define TABLE_ID(i) ((circid_t)((i) * 2654435761u))
+
+static void
+test_circid_table(void *arg)
+{
+  circid_table_t table;
+  circid_table_ent_t *ent, removed;
+  const uint32_t n = 5000;
+  uint32_t i, max_mask;
+  (void) arg;
+
+  memset(&table, 0, sizeof(table));
+  tt_ptr_op(circid_table_find(&table, 0), OP_EQ, NULL);
+  tt_int_op(circid_table_remove(&table, 0, NULL), OP_EQ, 0);
+
+  /* ID 0 is a valid key, and so is the largest one. */
+  circid_table_insert(&table, 0)->circuit = FAKE_CIRC(n);
+  circid_table_insert(&table, UINT32_MAX)->circuit = FAKE_CIRC(n+1);
+  tt_ptr_op(circid_table_find(&table, 0)->circuit, OP_EQ, FAKE_CIRC(n));
+  tt_ptr_op(circid_table_find(&table, UINT32_MAX)->circuit, OP_EQ,
+            FAKE_CIRC(n+1));
+
+  for (i = 1; i < n; ++i) {
+    ent = circid_table_insert(&table, TABLE_ID(i));
+    tt_ptr_op(ent->circuit, OP_EQ, NULL);
+    ent->circuit = FAKE_CIRC(i);
+  }
+  tt_uint_op(table.n_entries, OP_EQ, n + 1);
+  /* Never more than half full. */
+  tt_uint_op(table.n_entries * 2, OP_LE, table.mask + 1);
+  max_mask = table.mask;
+
+  /* Inserting an existing ID returns its entry. */
+  ent = circid_table_insert(&table, TABLE_ID(77));
+  tt_ptr_op(ent->circuit, OP_EQ, FAKE_CIRC(77));
+  tt_uint_op(table.n_entries, OP_EQ, n + 1);
+
+  /* Remove every other ID; the rest must stay reachable even though the
+   * removals shifted entries around. */
+  for (i = 1; i < n; i += 2) {
+    tt_int_op(circid_table_remove(&table, TABLE_ID(i), &removed), OP_EQ, 1);
+    tt_uint_op(removed.circ_id, OP_EQ, TABLE_ID(i));
+    tt_ptr_op(removed.circuit, OP_EQ, FAKE_CIRC(i));
+    tt_int_op(circid_table_remove(&table, TABLE_ID(i), NULL), OP_EQ, 0);
+  }
+  for (i = 1; i < n; ++i) {
+    ent = circid_table_find(&table, TABLE_ID(i));
+    if (i & 1) {
+      tt_ptr_op(ent, OP_EQ, NULL);
+    } else {
+      tt_assert(ent);
+      tt_ptr_op(ent->circuit, OP_EQ, FAKE_CIRC(i));
+    }
+  }
+  tt_ptr_op(circid_table_find(&table, 0)->circuit, OP_EQ, FAKE_CIRC(n));
+
+  /* Emptying the table shrinks it back down. */
+  for (i = 2; i < n; i += 2)
+    tt_int_op(circid_table_remove(&table, TABLE_ID(i), NULL), OP_EQ, 1);
+  tt_int_op(circid_table_remove(&table, 0, NULL), OP_EQ, 1);
+  tt_int_op(circid_table_remove(&table, UINT32_MAX, NULL), OP_EQ, 1);
+  tt_uint_op(table.n_entries, OP_EQ, 0);
+  tt_uint_op(table.mask, OP_LT, max_mask);
+  tt_ptr_op(circid_table_find(&table, TABLE_ID(2)), OP_EQ, NULL);
+
+ done:
+  circid_table_clear(&table);
+}
+
+#undef FAKE_CIRC
+#undef TABLE_ID
+
 struct testcase_t circuitlist_tests[] = {
   { "maps", test_clist_maps, TT_FORK, NULL, NULL },
   { "rend_token_maps", test_rend_token_maps, TT_FORK, NULL, NULL },
   { "pick_circid", test_pick_circid, TT_FORK, NULL, NULL },
   { "hs_circuitmap_isolation", test_hs_circuitmap_isolation,
     TT_FORK, NULL, NULL },
+  { "circid_table", test_circid_table, TT_FORK, NULL, NULL },
   END_OF_TESTCASES
 };
@@ -1,6 +1,8 @@
 /* Copyright (c) 2013-2021, The Tor Project, Inc. */
 /* See LICENSE for licensing information */
 
+#define TOR_TIMERS_PRIVATE
+
 #include "lib/container/smartlist.h"
 #include "lib/log/util_bug.h"
 #include "lib/smartlist_core/smartlist_core.h"
@@ -9,8 +11,10 @@
 #include "tinytest_macros.h"
 #include <stdint.h>
 #include <stdio.h>
+#define CIRCUITLIST_PRIVATE
 #define CIRCUITMUX_PRIVATE
 #define CIRCUITMUX_EWFD_PRIVATE
+#define RELAY_PRIVATE
 
 #include "core/or/or.h"
 #include "core/or/circuitmux.h"
@@ -312,16 +316,53 @@ static struct testcase_setup_t cmux_ewfd_test_setup = {
 #define EWFD_UNITEST_TEST_PRIVATE
 #include "feature/ewfd/ewfd.h"
 #include "feature/ewfd/ebpf_api.h"
+#include "feature/ewfd/ewfd_wheel.h"
+#include "lib/intmath/weakrng.h"
+#include "lib/thread/threads.h"
+#include "lib/time/compat_time.h"
+#include "lib/defs/time.h"
+#include "lib/evloop/timers.h"
+#include "feature/ewfd/ewfd_ticker.h"
+#include "feature/ewfd/ewfd_pool.h"
+#include "feature/ewfd/ewfd_unit.h"
+#include "feature/ewfd/ewfd_conf.h"
+#include "feature/ewfd/circuit_padding.h"
+#include "feature/ewfd/ewfd_rt.h"
+#include "lib/ebpf/ewfd-defense/src/ewfd_api.h"
+#include "lib/ebpf/ebpf_inst.h"
+#include "lib/fs/files.h"
 #include "core/or/origin_circuit_st.h"
+#include "core/or/relay.h"
+#include "core/or/cell_queue_st.h"
+#include "feature/ewfd/ewfd_op.h"
+#include "feature/ewfd/ewfd_trace.h"
+#include "feature/relay/relay_metrics.h"
+#include "lib/metrics/metrics_store.h"
+#include "lib/buf/buffers.h"
+#include "test/test_helpers.h"
+#include "core/mainloop/cpuworker.h"
+#include "lib/evloop/workqueue.h"
+#include "core/or/scheduler.h"
+#include "core/or/circuitlist.h"
+#include "trunnel/circpad_negotiation.h"
+#include "lib/encoding/confline.h"
+#include "lib/ebpf/ebpf_vm.h"
+#include <elf.h>
+#include "lib/fs/files.h"
+#include <sys/stat.h>
 
 /* 测试函数
 ewfd_get_event_num
 ewfd_remove_remain_events
 */
 static void test_ewfd_event_queue_delete(void *args) {
+  timers_initialize();
   ewfd_framework_init();
   start_ewfd_padding_framework();
   or_circuit_t circ1, circ2, circ3;
+  memset(&circ1, 0, sizeof(circ1));
+  memset(&circ2, 0, sizeof(circ2));
+  memset(&circ3, 0, sizeof(circ3));
   circ1.base_.magic = OR_CIRCUIT_MAGIC;
   circ1.base_.purpose = 0;
   circ1.p_circ_id = 1;
@@ -363,10 +404,14 @@ done:
 
 // 需要手动打开 ewfd.c 中 EWFD_UNITEST_TEST_PRIVATE 宏
 static void test_ewfd_event_queue_poll(void *args) {
+  timers_initialize();
   ewfd_framework_init();
   start_ewfd_padding_framework();
 
   or_circuit_t circ1, circ2, circ3;
+  memset(&circ1, 0, sizeof(circ1));
+  memset(&circ2, 0, sizeof(circ2));
+  memset(&circ3, 0, sizeof(circ3));
   circ1.base_.magic = OR_CIRCUIT_MAGIC;
   circ1.base_.purpose = 0;
   circ1.p_circ_id = 1;
@@ -425,6 +470,1657 @@ done:
   ewfd_framework_free();
 }
 
+/* 测试ewfd_get_event_num_by_type：随机添加/删除/过期事件，计数和实际一致
+*/
+#define CHURN_CIRC_NUM 8
+static void test_ewfd_event_num_churn(void *args) {
+  (void) args;
+  or_circuit_t circs[CHURN_CIRC_NUM];
+  // [circ][0: 会过期 1: 保留][type]
+  int expect[CHURN_CIRC_NUM][2][EWFD_EVENT_TYPE_NUM];
+  tor_weak_rng_t rng;
+
+  memset(circs, 0, sizeof(circs));
+  memset(expect, 0, sizeof(expect));
+  tor_init_weak_random(&rng, 1234);
+  monotime_enable_test_mocking();
+  monotime_set_mock_time_nsec(0);
+  ewfd_framework_init();
+
+  for (int i = 0; i < CHURN_CIRC_NUM; i++) {
+    circs[i].base_.magic = OR_CIRCUIT_MAGIC;
+    circs[i].p_circ_id = i + 1;
+  }
+
+#define CHECK_CIRC_NUM(c) do { \
+    uintptr_t on_circ_ = (uintptr_t) &circs[c]; \
+    int all_ = 0; \
+    for (int t_ = 0; t_ < EWFD_EVENT_TYPE_NUM; t_++) { \
+      int want_ = expect[c][0][t_] + expect[c][1][t_]; \
+      tt_int_op(ewfd_get_event_num_by_type(on_circ_, t_), OP_EQ, want_); \
+      all_ += want_; \
+    } \
+    tt_int_op(ewfd_get_event_num(on_circ_), OP_EQ, all_); \
+  } while (0)
+
+  for (int round = 0; round < 5000; round++) {
+    int c = tor_weak_random_range(&rng, CHURN_CIRC_NUM);
+    uintptr_t on_circ = (uintptr_t) &circs[c];
+    // 一半事件在[0, 1000)，tick时过期；另一半在[5000, 6000)
+    int keep = tor_weak_random_range(&rng, 2);
+    uint32_t ti = (keep ? 5000 : 0) + tor_weak_random_range(&rng, 1000);
+
+    switch (tor_weak_random_range(&rng, 16)) {
+      case 0: // circ关闭
+        ewfd_remove_circ_events(on_circ);
+        memset(expect[c], 0, sizeof(expect[c]));
+        break;
+      case 1: case 2: case 3: case 4: case 5: case 6: case 7:
+        ewfd_add_dummy_packet(on_circ, ti);
+        expect[c][keep][EWFD_EVENT_TYPE_DUMMY]++;
+        break;
+      default: // delay + notify
+        ewfd_add_delay_packet(on_circ, ti, ti, 1);
+        expect[c][keep][EWFD_EVENT_TYPE_DELAY]++;
+        expect[c][keep][EWFD_EVENT_TYPE_NOTIFY]++;
+        break;
+    }
+    CHECK_CIRC_NUM(c);
+  }
+
+  // [0, 1000) 的事件超过MAX_EWFD_TICK_GAP_MS，直接过期丢弃
+  monotime_set_mock_time_nsec(2000 * (int64_t) 1000000);
+  on_event_queue_tick(NULL, NULL);
+  for (int c = 0; c < CHURN_CIRC_NUM; c++) {
+    memset(expect[c][0], 0, sizeof(expect[c][0]));
+    CHECK_CIRC_NUM(c);
+  }
+
+  for (int c = 0; c < CHURN_CIRC_NUM; c++) {
+    ewfd_remove_circ_events((uintptr_t) &circs[c]);
+    memset(expect[c], 0, sizeof(expect[c]));
+    CHECK_CIRC_NUM(c);
+  }
+#undef CHECK_CIRC_NUM
+
+done:
+  ewfd_framework_free();
+  monotime_disable_test_mocking();
+}
+
+/* 测试共享data stream: 所有unit读同一个mmap文件，各自维护游标
+*/
+static void test_ewfd_data_stream(void *args) {
+  (void) args;
+  const uint32_t stream[4] = {10, 20, 30, 40};
+  const uint32_t builtin_first = ewfd_data_stream_get_shared()->data[0];
+  const uint32_t ds_fd = 1;
+  char *fname = tor_strdup(get_fname("ewfd_data_stream"));
+  ewfd_unit_st *unit1 = ewfd_unit_new_shared(NULL);
+  ewfd_unit_st *unit2 = ewfd_unit_new_shared(NULL);
+
+  // 大小不是uint32的整数倍
+  tt_int_op(write_bytes_to_file(fname, (const char *) stream, 7, 1), OP_EQ, 0);
+  tt_int_op(ewfd_map_data_stream_file(fname), OP_EQ, -1);
+  tt_int_op(ewfd_data_stream_get_shared()->data[0], OP_EQ, builtin_first);
+
+  tt_int_op(write_bytes_to_file(fname, (const char *) stream, sizeof(stream), 1), OP_EQ, 0);
+  tt_int_op(ewfd_map_data_stream_file(fname), OP_EQ, 0);
+  tt_uint_op(ewfd_data_stream_get_shared()->len, OP_EQ, 4);
+
+  ebpf_data_stream_init(unit1, ds_fd, NULL);
+  ebpf_data_stream_init(unit2, ds_fd, NULL);
+  tt_uint_op(ewfd_data_stream_fetch(unit1, ds_fd), OP_EQ, 10);
+  tt_int_op(ewfd_data_stream_dequeue(unit1, ds_fd), OP_EQ, 10);
+  tt_int_op(ewfd_data_stream_dequeue(unit1, ds_fd), OP_EQ, 20);
+  // unit2的游标不受unit1影响
+  tt_uint_op(ewfd_data_stream_fetch(unit2, ds_fd), OP_EQ, 10);
+
+  // 读完之后需要load_more，数据从上次的位置继续
+  tt_int_op(ewfd_data_stream_dequeue(unit1, ds_fd), OP_EQ, 30);
+  tt_int_op(ewfd_data_stream_dequeue(unit1, ds_fd), OP_EQ, 40);
+  tt_uint_op(ewfd_data_stream_fetch(unit1, ds_fd), OP_EQ, UINT32_MAX);
+  tt_int_op(ewfd_data_stream_load_more(unit1, ds_fd), OP_EQ, 4);
+  tt_uint_op(ewfd_data_stream_fetch(unit1, ds_fd), OP_EQ, 10);
+
+  ewfd_unmap_data_stream_file();
+  tt_int_op(ewfd_data_stream_get_shared()->data[0], OP_EQ, builtin_first);
+
+ done:
+  ewfd_unmap_data_stream_file();
+  ewfd_unit_clear(unit1);
+  ewfd_unit_clear(unit2);
+  tor_free(unit1);
+  tor_free(unit2);
+  tor_free(fname);
+}
+
+/* 测试对象池：复用空闲对象，最多缓存到high_water，trim释放全部缓存
+*/
+static void test_ewfd_pool(void *args) {
+  (void) args;
+  ewfd_pool_st pool = EWFD_POOL_INIT("test", 48);
+  void *objs[16];
+
+  for (int i = 0; i < 16; i++) {
+    objs[i] = ewfd_pool_alloc(&pool);
+    memset(objs[i], 0xff, 48);
+  }
+  tt_int_op(pool.used_num, OP_EQ, 16);
+  tt_int_op(pool.high_water, OP_EQ, 16);
+  tt_u64_op(pool.reuse_num, OP_EQ, 0);
+
+  for (int i = 0; i < 16; i++) {
+    ewfd_pool_free(&pool, objs[i]);
+  }
+  tt_int_op(pool.used_num, OP_EQ, 0);
+  tt_int_op(pool.free_num, OP_EQ, 16);
+
+  // 复用的对象是清零的
+  for (int i = 0; i < 8; i++) {
+    objs[i] = ewfd_pool_alloc(&pool);
+    tt_assert(fast_mem_is_zero(objs[i], 48));
+  }
+  tt_u64_op(pool.reuse_num, OP_EQ, 8);
+  tt_int_op(pool.free_num, OP_EQ, 8);
+  tt_u64_op(ewfd_pool_get_allocation(&pool), OP_EQ, 16 * 48);
+
+  // trim之后high_water降到当前使用量，释放的对象不再缓存
+  tt_u64_op(ewfd_pool_trim(&pool), OP_EQ, 8 * 48);
+  tt_int_op(pool.free_num, OP_EQ, 0);
+  tt_int_op(pool.high_water, OP_EQ, 8);
+  for (int i = 0; i < 4; i++) {
+    ewfd_pool_free(&pool, objs[i]);
+  }
+  tt_int_op(pool.free_num, OP_EQ, 4);
+  objs[16 - 1] = ewfd_pool_alloc(&pool);
+  objs[16 - 2] = ewfd_pool_alloc(&pool);
+  tt_int_op(pool.free_num, OP_EQ, 2);
+  ewfd_pool_free(&pool, objs[16 - 1]);
+  ewfd_pool_free(&pool, objs[16 - 2]);
+  for (int i = 4; i < 8; i++) {
+    ewfd_pool_free(&pool, objs[i]);
+  }
+  tt_int_op(pool.used_num, OP_EQ, 0);
+  tt_int_op(pool.free_num, OP_EQ, 8);
+
+  // 超过high_water: 先用完缓存再malloc，全部释放后缓存等于新的high_water
+  for (int i = 0; i < 12; i++) {
+    objs[i] = ewfd_pool_alloc(&pool);
+    tt_int_op(pool.used_num + pool.free_num, OP_LE, pool.high_water);
+  }
+  tt_int_op(pool.free_num, OP_EQ, 0);
+  tt_int_op(pool.high_water, OP_EQ, 12);
+  tt_u64_op(pool.reuse_num, OP_EQ, 8 + 2 + 8);
+  for (int i = 0; i < 12; i++) {
+    ewfd_pool_free(&pool, objs[i]);
+  }
+  tt_int_op(pool.free_num, OP_EQ, 12);
+  tt_u64_op(ewfd_pool_get_allocation(&pool), OP_EQ, 12 * 48);
+
+done:
+  ewfd_pool_trim(&pool);
+}
+
+/* 测试事件队列timer：空闲时不唤醒，按最早event唤醒，每次唤醒最多处理budget个event
+*/
+static void test_ewfd_event_queue_timer(void *args) {
+  (void) args;
+  or_circuit_t fake_circ; // 没有runtime，dummy event直接当作已处理
+  int64_t now_nsec = 1000 * TOR_NSEC_PER_MSEC;
+  ewfd_event_queue_stats_st old_stats = ewfd_event_queue_stats;
+  int event_num = EWFD_EVENT_QUEUE_BUDGET + 100;
+
+  memset(&fake_circ, 0, sizeof(fake_circ));
+  fake_circ.base_.magic = OR_CIRCUIT_MAGIC;
+  monotime_enable_test_mocking();
+  monotime_set_mock_time_nsec(now_nsec);
+  monotime_coarse_set_mock_time_nsec(now_nsec);
+  timers_initialize();
+  ewfd_framework_init();
+  start_ewfd_padding_framework();
+
+  // 空闲
+  tt_u64_op(ewfd_framework_instance->packet_ticker_armed_ti, OP_EQ, UINT64_MAX);
+
+  for (int i = 0; i < event_num; i++) {
+    ewfd_add_dummy_packet((uintptr_t) &fake_circ, 1003);
+  }
+  tt_u64_op(ewfd_framework_instance->packet_ticker_armed_ti, OP_EQ, 1005);
+
+  // 第一次唤醒只处理budget个event，剩下的马上再唤醒一次
+  now_nsec += 6 * TOR_NSEC_PER_MSEC;
+  monotime_set_mock_time_nsec(now_nsec);
+  monotime_coarse_set_mock_time_nsec(now_nsec);
+  timers_run_pending();
+  tt_u64_op(ewfd_event_queue_stats.wakeups, OP_EQ, old_stats.wakeups + 2);
+  tt_u64_op(ewfd_event_queue_stats.budget_exhausted, OP_EQ,
+            old_stats.budget_exhausted + 1);
+  tt_u64_op(ewfd_event_queue_stats.processed, OP_EQ,
+            old_stats.processed + event_num);
+  tt_int_op(ewfd_get_event_num((uintptr_t) &fake_circ), OP_EQ, 0);
+  tt_u64_op(ewfd_framework_instance->packet_ticker_armed_ti, OP_EQ, UINT64_MAX);
+
+  // 晚到的event计入late，过期太久的event丢弃
+  ewfd_add_dummy_packet((uintptr_t) &fake_circ, 1006 - EWFD_EVENT_LATE_MS - 10);
+  ewfd_add_dummy_packet((uintptr_t) &fake_circ, 1006 - MAX_EWFD_TICK_GAP_MS - 10);
+  tt_u64_op(ewfd_framework_instance->packet_ticker_armed_ti, OP_EQ, 1006);
+  timers_run_pending();
+  tt_u64_op(ewfd_event_queue_stats.late, OP_EQ, old_stats.late + 1);
+  tt_u64_op(ewfd_event_queue_stats.dropped, OP_EQ, old_stats.dropped + 1);
+  tt_u64_op(ewfd_framework_instance->packet_ticker_armed_ti, OP_EQ, UINT64_MAX);
+
+done:
+  ewfd_framework_free();
+  timers_shutdown();
+  monotime_disable_test_mocking();
+}
+
+/* 测试tick driver：同一个slot内到期的ticker在一次唤醒中执行
+*/
+static int tick_hits[3];
+static void test_tick_cb(void *arg) {
+  tick_hits[(intptr_t) arg]++;
+}
+
+static void test_ewfd_tick_driver(void *args) {
+  (void) args;
+  ewfd_ticker_st tickers[3];
+  int64_t now_nsec = 1000 * TOR_NSEC_PER_MSEC;
+
+  memset(tickers, 0, sizeof(tickers));
+  memset(tick_hits, 0, sizeof(tick_hits));
+  monotime_enable_test_mocking();
+  monotime_set_mock_time_nsec(now_nsec);
+  monotime_coarse_set_mock_time_nsec(now_nsec);
+  timers_initialize();
+
+  int allocated = total_ewfd_timer;
+  int released = released_ewfd_timer;
+  uint64_t wakeups = ewfd_tick_wakeups;
+
+  ewfd_init_ticker(&tickers[0], EWFD_TICK_PADDING, test_tick_cb, (void *) 0);
+  ewfd_init_ticker(&tickers[1], EWFD_TICK_PADDING, test_tick_cb, (void *) 1);
+  ewfd_init_ticker(&tickers[2], EWFD_TICK_SCHEDULE, test_tick_cb, (void *) 2);
+  tt_int_op(total_ewfd_timer, OP_EQ, allocated + 3);
+
+  // 11ms 和 14ms 对齐到同一个slot
+  ewfd_schedule_ticker(&tickers[0], 11);
+  ewfd_schedule_ticker(&tickers[1], 14);
+  ewfd_schedule_ticker(&tickers[2], 100);
+
+  now_nsec += 15 * TOR_NSEC_PER_MSEC;
+  monotime_set_mock_time_nsec(now_nsec);
+  monotime_coarse_set_mock_time_nsec(now_nsec);
+  timers_run_pending();
+  tt_int_op(tick_hits[0], OP_EQ, 1);
+  tt_int_op(tick_hits[1], OP_EQ, 1);
+  tt_int_op(tick_hits[2], OP_EQ, 0);
+  tt_u64_op(ewfd_tick_wakeups, OP_EQ, wakeups + 1);
+
+  // 删除后不再触发
+  ewfd_remove_ticker(&tickers[2]);
+  now_nsec += 200 * TOR_NSEC_PER_MSEC;
+  monotime_set_mock_time_nsec(now_nsec);
+  monotime_coarse_set_mock_time_nsec(now_nsec);
+  timers_run_pending();
+  tt_int_op(tick_hits[2], OP_EQ, 0);
+
+  for (int i = 0; i < 3; i++) {
+    ewfd_free_ticker(&tickers[i]);
+  }
+  tt_int_op(released_ewfd_timer, OP_EQ, released + 3);
+
+done:
+  ewfd_free_tick_driver();
+  timers_shutdown();
+  monotime_disable_test_mocking();
+}
+
+static int batch_calls = 0;
+static int batch_units = 0;
+static void test_tick_batch_fn(ewfd_ticker_st **tickers, int num) {
+  (void) tickers;
+  batch_calls++;
+  batch_units += num;
+  tt_int_op(num, OP_LE, EWFD_TICK_BATCH_MAX);
+ done:
+  ;
+}
+
+/* 同一个slot内到期的padding ticker按EWFD_TICK_BATCH_MAX分批交给batch fn
+*/
+static void test_ewfd_tick_batch(void *args) {
+  (void) args;
+  const int num = 100;
+  ewfd_ticker_st *tickers = tor_calloc(num + 1, sizeof(ewfd_ticker_st));
+  int64_t now_nsec = 1000 * TOR_NSEC_PER_MSEC;
+
+  memset(tick_hits, 0, sizeof(tick_hits));
+  monotime_enable_test_mocking();
+  monotime_set_mock_time_nsec(now_nsec);
+  monotime_coarse_set_mock_time_nsec(now_nsec);
+  timers_initialize();
+
+  uint64_t batches = ewfd_tick_batches;
+  ewfd_set_tick_batch_fn(EWFD_TICK_PADDING, test_tick_batch_fn);
+  for (int i = 0; i < num; i++) {
+    ewfd_init_ticker(&tickers[i], EWFD_TICK_PADDING, test_tick_cb, (void *) 0);
+    ewfd_schedule_ticker(&tickers[i], 10 + i % 3);
+  }
+  // schedule ticker没有batch fn，仍然逐个回调
+  ewfd_init_ticker(&tickers[num], EWFD_TICK_SCHEDULE, test_tick_cb, (void *) 2);
+  ewfd_schedule_ticker(&tickers[num], 10);
+
+  now_nsec += 15 * TOR_NSEC_PER_MSEC;
+  monotime_set_mock_time_nsec(now_nsec);
+  monotime_coarse_set_mock_time_nsec(now_nsec);
+  timers_run_pending();
+  tt_int_op(batch_calls, OP_EQ, 2);
+  tt_int_op(batch_units, OP_EQ, num);
+  tt_int_op(tick_hits[0], OP_EQ, 0);
+  tt_int_op(tick_hits[2], OP_EQ, 1);
+  tt_u64_op(ewfd_tick_batches, OP_EQ, batches + 2);
+
+ done:
+  ewfd_set_tick_batch_fn(EWFD_TICK_PADDING, NULL);
+  for (int i = 0; i <= num; i++) {
+    ewfd_free_ticker(&tickers[i]);
+  }
+  tor_free(tickers);
+  ewfd_free_tick_driver();
+  timers_shutdown();
+  monotime_disable_test_mocking();
+}
+
+/* 测试时间轮：到期顺序，删除，跨层cascade，超出范围的节点
+*/
+static void test_ewfd_timing_wheel(void *args) {
+  (void) args;
+  ewfd_wheel_st *wheel = tor_malloc_zero(sizeof(ewfd_wheel_st));
+  ewfd_wheel_node_st nodes[6];
+  const uint64_t expire[6] = {3, 20, 100, 5000, 300000, 10 + (1ULL << 31)};
+  memset(nodes, 0, sizeof(nodes));
+
+  ewfd_wheel_init(wheel, 10);
+  for (int i = 0; i < 6; i++) {
+    ewfd_wheel_add(wheel, &nodes[i], expire[i]);
+  }
+  tt_int_op(wheel->node_num, OP_EQ, 6);
+
+  // 已经过期的节点直接可以取出
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, &nodes[0]);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, NULL);
+
+  ewfd_wheel_del(wheel, &nodes[2]);
+  tt_assert(!ewfd_wheel_node_pending(&nodes[2]));
+  tt_int_op(wheel->node_num, OP_EQ, 4);
+
+  tt_u64_op(ewfd_wheel_next_expire(wheel), OP_EQ, 20);
+  ewfd_wheel_update(wheel, 19);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, NULL);
+  ewfd_wheel_update(wheel, 20);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, &nodes[1]);
+
+  // 高层的节点返回cascade的时间，不会晚于到期时间
+  tt_u64_op(ewfd_wheel_next_expire(wheel), OP_GT, 20);
+  tt_u64_op(ewfd_wheel_next_expire(wheel), OP_LE, 5000);
+
+  ewfd_wheel_update(wheel, 4999);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, NULL);
+  ewfd_wheel_update(wheel, 6000);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, &nodes[3]);
+
+  ewfd_wheel_update(wheel, 1 << 20);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, &nodes[4]);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, NULL);
+
+  // 超出时间轮范围的节点不能提前到期
+  ewfd_wheel_update(wheel, 1ULL << 31);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, NULL);
+  ewfd_wheel_update(wheel, 1ULL << 32);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, &nodes[5]);
+  tt_int_op(wheel->node_num, OP_EQ, 0);
+  tt_u64_op(ewfd_wheel_next_expire(wheel), OP_EQ, UINT64_MAX);
+
+  // 同一ms到期的节点按插入顺序取出
+  ewfd_wheel_add(wheel, &nodes[0], (1ULL << 32) + 70);
+  ewfd_wheel_add(wheel, &nodes[1], (1ULL << 32) + 70);
+  ewfd_wheel_update(wheel, (1ULL << 32) + 100);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, &nodes[0]);
+  tt_ptr_op(ewfd_wheel_get_expired(wheel), OP_EQ, &nodes[1]);
+
+done:
+  tor_free(wheel);
+}
+
+/* 测试code cache：多个unit共享同一个vm，maps每个unit独立
+*/
+static void test_ewfd_code_cache(void *args) {
+  (void) args;
+  ewfd_unit_st *unit1 = NULL, *unit2 = NULL;
+  ewfd_framework_init();
+
+  ewfd_padding_conf_st *conf = NULL;
+  SMARTLIST_FOREACH(ewfd_client_conf->client_unit_confs, ewfd_padding_conf_st *,
+    c, if (c->unit_type == EWFD_UNIT_PADDING) conf = c);
+  tt_assert(conf);
+
+  uint64_t miss = ewfd_code_cache_stats.cache_miss;
+  uint64_t hit = ewfd_code_cache_stats.cache_hit;
+
+  unit1 = init_ewfd_unit(conf);
+  tt_assert(unit1);
+  // init code + main code 第一次加载
+  tt_u64_op(ewfd_code_cache_stats.cache_miss, OP_EQ, miss + 2);
+
+  unit2 = init_ewfd_unit(conf);
+  tt_assert(unit2);
+  tt_u64_op(ewfd_code_cache_stats.cache_miss, OP_EQ, miss + 2);
+  tt_u64_op(ewfd_code_cache_stats.cache_hit, OP_EQ, hit + 2);
+
+  tt_ptr_op(unit1->vm, OP_EQ, unit2->vm);
+  tt_ptr_op(unit1->vm, OP_EQ, conf->main_code->vm);
+  tt_ptr_op(unit1->map_table.fd_table, OP_NE, unit2->map_table.fd_table);
+
+done:
+  if (unit1)
+    free_ewfd_unit(unit1);
+  if (unit2)
+    free_ewfd_unit(unit2);
+  ewfd_framework_free();
+}
+
+/* 测试delay描述符：描述符不占用cell队列，按位置生效，等待/超时
+*/
+static void test_ewfd_delay_desc(void *args) {
+  (void) args;
+  cell_queue_t queue;
+  packed_cell_t *cell = NULL;
+  uint8_t n_cell = 0;
+  int i;
+
+  cell_queue_init(&queue);
+  monotime_enable_test_mocking();
+  monotime_set_mock_time_nsec(1000 * (int64_t) 1000000);
+
+  // 1, 2, [t=1100, p=2], 3, 4
+  for (i = 1; i <= 4; i++) {
+    cell = packed_cell_new();
+    // delay描述符不再读取cell内容，写入旧的magic也不会被误判
+    memset(cell->body, 0xcc, sizeof(cell->body));
+    cell->body[0] = i;
+    cell_queue_append(&queue, cell);
+    if (i == 2)
+      ewfd_cell_queue_add_delay(&queue, NULL, 1100, 2);
+  }
+  cell = NULL;
+  tt_int_op(queue.n, OP_EQ, 4);
+  tt_int_op(ewfd_cell_queue_get_delay_num(&queue), OP_EQ, 1);
+  // 描述符计入cmux看到的数量
+  tt_int_op(ewfd_cell_queue_num_sendable(&queue), OP_EQ, 5);
+
+  // 描述符之前的包不受影响
+  cell = ewfd_cell_queue_pop_simple_delay(&queue, 1, &n_cell);
+  tt_assert(cell);
+  tt_int_op(cell->body[0], OP_EQ, 1);
+  tt_int_op(n_cell, OP_EQ, 1);
+  packed_cell_free(cell);
+  // 普通的cell_queue_pop同样推进描述符的生效位置
+  cell = cell_queue_pop(&queue);
+  tt_assert(cell);
+  tt_int_op(cell->body[0], OP_EQ, 2);
+  packed_cell_free(cell);
+
+  // 未到trigger时间，等待, 整个队列对cmux不可发送
+  tt_ptr_op(ewfd_cell_queue_pop_simple_delay(&queue, 1, &n_cell), OP_EQ, NULL);
+  tt_int_op(n_cell, OP_EQ, 0);
+  tt_int_op(queue.n, OP_EQ, 2);
+  tt_int_op(ewfd_cell_queue_num_sendable(&queue), OP_EQ, 0);
+
+  monotime_set_mock_time_nsec(1100 * (int64_t) 1000000);
+  tt_int_op(ewfd_cell_queue_num_sendable(&queue), OP_EQ, 3);
+  for (i = 3; i <= 4; i++) {
+    cell = ewfd_cell_queue_pop_simple_delay(&queue, 1, &n_cell);
+    tt_assert(cell);
+    tt_int_op(cell->body[0], OP_EQ, i);
+    tt_int_op(n_cell, OP_EQ, 1);
+    packed_cell_free(cell);
+  }
+  tt_int_op(queue.n, OP_EQ, 0);
+  tt_int_op(ewfd_cell_queue_get_delay_num(&queue), OP_EQ, 0);
+
+  // 超时的描述符被丢弃，real cell照常发送
+  cell = packed_cell_new();
+  cell->body[0] = 5;
+  cell_queue_append(&queue, cell);
+  ewfd_cell_queue_add_delay(&queue, NULL, 1100, 3);
+  ewfd_cell_queue_add_delay(&queue, NULL, 1100, 3);
+  cell = packed_cell_new();
+  cell->body[0] = 6;
+  cell_queue_append(&queue, cell);
+  cell = NULL;
+  monotime_set_mock_time_nsec(2000 * (int64_t) 1000000);
+
+  cell = ewfd_cell_queue_pop_simple_delay(&queue, 1, &n_cell);
+  tt_assert(cell);
+  tt_int_op(cell->body[0], OP_EQ, 5);
+  packed_cell_free(cell);
+  cell = ewfd_cell_queue_pop_simple_delay(&queue, 1, &n_cell);
+  tt_assert(cell);
+  tt_int_op(cell->body[0], OP_EQ, 6);
+  tt_int_op(n_cell, OP_EQ, 1);
+  packed_cell_free(cell);
+  tt_int_op(ewfd_cell_queue_get_delay_num(&queue), OP_EQ, 1);
+
+  // 清空队列时释放剩余的描述符
+  cell_queue_clear(&queue);
+  tt_ptr_op(queue.ewfd_delay, OP_EQ, NULL);
+
+done:
+  packed_cell_free(cell);
+  cell_queue_clear(&queue);
+  monotime_disable_test_mocking();
+}
+
+/* delay描述符从对象池分配并计入OOM统计，pkt_num不截断
+*/
+static void test_ewfd_delay_desc_pool(void *args) {
+  (void) args;
+  cell_queue_t queue;
+  ewfd_delay_desc_st *desc;
+  size_t base;
+
+  cell_queue_init(&queue);
+  base = ewfd_framework_get_total_allocation();
+
+  ewfd_cell_queue_add_delay(&queue, NULL, 1100, 1000);
+  desc = TOR_SIMPLEQ_FIRST(&queue.ewfd_delay->head);
+  tt_uint_op(desc->pkt_num, OP_EQ, 1000);
+  tt_u64_op(ewfd_framework_get_total_allocation() - base, OP_EQ,
+            sizeof(ewfd_delay_desc_st) + sizeof(ewfd_delay_desc_queue_st));
+  tt_uint_op(ewfd_delay_desc_pool.used_num, OP_EQ, 1);
+
+  // 释放后缓存在池中，仍然计入，OOM时trim掉
+  cell_queue_clear(&queue);
+  tt_uint_op(ewfd_delay_desc_pool.used_num, OP_EQ, 0);
+  tt_uint_op(ewfd_delay_queue_pool.used_num, OP_EQ, 0);
+  tt_u64_op(ewfd_framework_get_total_allocation() - base, OP_EQ,
+            sizeof(ewfd_delay_desc_st) + sizeof(ewfd_delay_desc_queue_st));
+  tt_u64_op(ewfd_framework_handle_oom(), OP_GE,
+            sizeof(ewfd_delay_desc_st) + sizeof(ewfd_delay_desc_queue_st));
+  tt_u64_op(ewfd_framework_get_total_allocation(), OP_EQ, 0);
+
+ done:
+  cell_queue_clear(&queue);
+}
+
+static atomic_counter_t ewfd_trace_thread_done;
+
+/* 另一个线程写一条记录，使用自己的ring */
+static void
+ewfd_trace_thread_fn(void *arg)
+{
+  (void) arg;
+  EWFD_TRACE(EWFD_TRACE_EVENT_TICK, 0, 42, 0);
+  atomic_counter_add(&ewfd_trace_thread_done, 1);
+  spawn_exit();
+}
+
+/* 测试trace ring：定长记录，写满后覆盖最旧的记录，dump文件可以解析
+*/
+static void test_ewfd_trace(void *args) {
+  (void) args;
+  char *fname = tor_strdup(get_fname("ewfd-trace"));
+  char *body = NULL, *summary = NULL;
+  size_t body_len = 0;
+  struct stat st;
+  const ewfd_trace_rec_st *recs;
+  uint32_t ring_hdr[2];
+  int i;
+
+  ewfd_trace_init();
+  tt_assert(ewfd_trace_enabled);
+
+  EWFD_TRACE(EWFD_TRACE_SEND_CELL, 7, RELAY_COMMAND_DATA, 0);
+  EWFD_TRACE(EWFD_TRACE_EVENT_PROCESS, 8, 3 | (1ULL << 32), 1234);
+  tt_int_op(ewfd_trace_dump(fname), OP_EQ, 2);
+
+  body = read_file_to_str(fname, RFTS_BIN, &st);
+  tt_assert(body);
+  body_len = (size_t) st.st_size;
+  tt_mem_op(body, OP_EQ, EWFD_TRACE_MAGIC, 8);
+  // header 24字节，然后是ring header
+  memcpy(ring_hdr, body + 24, sizeof(ring_hdr));
+  tt_int_op(ring_hdr[1], OP_EQ, 2);
+  tt_u64_op(body_len, OP_EQ, 24 + 8 + 2 * sizeof(ewfd_trace_rec_st));
+  recs = (const ewfd_trace_rec_st *) (body + 32);
+  tt_int_op(recs[0].op, OP_EQ, EWFD_TRACE_SEND_CELL);
+  tt_int_op(recs[0].circ_id, OP_EQ, 7);
+  tt_u64_op(recs[0].args[0], OP_EQ, RELAY_COMMAND_DATA);
+  tt_int_op(recs[1].op, OP_EQ, EWFD_TRACE_EVENT_PROCESS);
+  tt_u64_op(recs[1].args[0] >> 32, OP_EQ, 1);
+  tt_u64_op(recs[1].args[1], OP_EQ, 1234);
+  tor_free(body);
+
+  // 写满之后只保留最新的EWFD_TRACE_RING_SIZE条
+  for (i = 0; i < EWFD_TRACE_RING_SIZE + 5; i++) {
+    EWFD_TRACE(EWFD_TRACE_EVENT_TICK, 0, i, 0);
+  }
+  tt_int_op(ewfd_trace_dump(fname), OP_EQ, EWFD_TRACE_RING_SIZE);
+  body = read_file_to_str(fname, RFTS_BIN, &st);
+  tt_assert(body);
+  recs = (const ewfd_trace_rec_st *) (body + 32);
+  // 加上前面的2条，最旧的是第5个tick
+  tt_u64_op(recs[0].args[0], OP_EQ, 5);
+  tt_u64_op(recs[EWFD_TRACE_RING_SIZE - 1].args[0], OP_EQ,
+            EWFD_TRACE_RING_SIZE + 4);
+
+  tor_free(body);
+
+  // 其他线程的记录在自己的ring里
+  atomic_counter_init(&ewfd_trace_thread_done);
+  tt_int_op(spawn_func(ewfd_trace_thread_fn, NULL), OP_EQ, 0);
+  while (atomic_counter_get(&ewfd_trace_thread_done) == 0)
+    tor_sleep_msec(1);
+  summary = ewfd_trace_get_summary();
+  tt_str_op(summary, OP_EQ, "enabled=1 rings=2 records=8193");
+  tor_free(summary);
+
+  ewfd_trace_free();
+  tt_assert(!ewfd_trace_enabled);
+  tt_int_op(ewfd_trace_dump(fname), OP_EQ, -1);
+  summary = ewfd_trace_get_summary();
+  tt_str_op(summary, OP_EQ, "enabled=0 rings=0 records=0");
+  tor_free(summary);
+  // 关闭之后的记录直接丢弃
+  ewfd_trace_record(EWFD_TRACE_EVENT_TICK, 0, 0, 0);
+
+  // 再次init之后，线程不再使用已经释放的ring
+  ewfd_trace_init();
+  EWFD_TRACE(EWFD_TRACE_SEND_CELL, 9, RELAY_COMMAND_DATA, 0);
+  tt_int_op(ewfd_trace_dump(fname), OP_EQ, 1);
+  summary = ewfd_trace_get_summary();
+  tt_str_op(summary, OP_EQ, "enabled=1 rings=1 records=1");
+
+done:
+  ewfd_trace_free();
+  tor_free(summary);
+  tor_free(body);
+  tor_free(fname);
+}
+
+/* 每个cmux上几千个gap中的circ，唤醒时只处理到期的circ
+*/
+#define SLEEP_CMUX_NUM 2
+#define SLEEP_CIRC_NUM 4000
+static void test_ewfd_cmux_sleep_wheel(void *args) {
+  (void) args;
+  circuitmux_t cmux[SLEEP_CMUX_NUM]; /* garbage */
+  circuitmux_policy_data_t *pol_data[SLEEP_CMUX_NUM] = {0};
+  ewfd_policy_data_t *pol[SLEEP_CMUX_NUM] = {0};
+  ewfd_policy_circ_data_t *ewfd_data = NULL;
+  circuitmux_policy_circ_data_t **circ_data = NULL;
+  circuit_t *circs = NULL;
+  int i, c, total = SLEEP_CMUX_NUM * SLEEP_CIRC_NUM;
+
+  circs = tor_calloc(total, sizeof(circuit_t));
+  circ_data = tor_calloc(total, sizeof(circuitmux_policy_circ_data_t *));
+  tt_ptr_op(circ_data, OP_NE, NULL);
+
+  for (c = 0; c < SLEEP_CMUX_NUM; c++) {
+    pol_data[c] = ewfd_delay_policy.alloc_cmux_data(&cmux[c]);
+    tt_ptr_op(pol_data[c], OP_NE, NULL);
+    pol[c] = TO_EWFD_POL_DATA(pol_data[c]);
+    tt_ptr_op(pol[c], OP_NE, NULL);
+    for (i = 0; i < SLEEP_CIRC_NUM; i++) {
+      int idx = c * SLEEP_CIRC_NUM + i;
+      circs[idx].magic = ORIGIN_CIRCUIT_MAGIC;
+      circ_data[idx] = ewfd_delay_policy.alloc_circ_data(&cmux[c], pol_data[c],
+                                                  &circs[idx], CELL_DIRECTION_OUT, 0);
+      ewfd_data = TO_EWFD_POL_CIRC_DATA(circ_data[idx]);
+      tt_ptr_op(ewfd_data, OP_NE, NULL);
+      // burst在1000ms结束, gap结束时间分布在 (1000, 2000]
+      cell_ewfd_delay_t *item = &ewfd_data->cell_ewfd_delay;
+      item->delay_state = EWFD_MODE_GAP;
+      item->burst_finish_ti = 1000;
+      item->gap_ti = 1 + i % 1000;
+      ewfd_delay_add_sleeper(pol[c], ewfd_data, 1000);
+    }
+    tt_ptr_op(pol[c]->sleep_wheel, OP_NE, NULL);
+    tt_int_op(pol[c]->sleep_wheel->node_num, OP_EQ, SLEEP_CIRC_NUM);
+  }
+  tt_u64_op(circuitmux_ewfd_next_wake_ti(), OP_EQ, 1001);
+
+  // 没有到期的circ
+  tt_int_op(circuitmux_ewfd_wake_sleepers(1000), OP_EQ, 0);
+
+  // gap_ti <= 10 的circ到期: GAP -> WAIT_TO_BURST
+  tt_int_op(circuitmux_ewfd_wake_sleepers(1010), OP_EQ, SLEEP_CMUX_NUM * 40);
+  for (i = 0; i < total; i++) {
+    ewfd_data = TO_EWFD_POL_CIRC_DATA(circ_data[i]);
+    tt_ptr_op(ewfd_data, OP_NE, NULL);
+    cell_ewfd_delay_t *item = &ewfd_data->cell_ewfd_delay;
+    tt_int_op(item->delay_state, OP_EQ, item->gap_ti <= 10 ? EWFD_MODE_WAIT_TO_BURST : EWFD_MODE_GAP);
+  }
+  tt_u64_op(circuitmux_ewfd_next_wake_ti(), OP_EQ, 1011);
+  // WAIT_TO_BURST在gap结束500ms之后才再次唤醒
+  tt_int_op(circuitmux_ewfd_wake_sleepers(1010), OP_EQ, 0);
+
+  // gap_ti <= 510 的circ结束gap，之前WAIT_TO_BURST的circ回到NORMAL并离开时间轮
+  tt_int_op(circuitmux_ewfd_wake_sleepers(1510), OP_EQ, SLEEP_CMUX_NUM * 2040);
+  for (c = 0; c < SLEEP_CMUX_NUM; c++) {
+    tt_int_op(pol[c]->sleep_wheel->node_num, OP_EQ, SLEEP_CIRC_NUM - 40);
+  }
+  ewfd_data = TO_EWFD_POL_CIRC_DATA(circ_data[0]);
+  tt_ptr_op(ewfd_data, OP_NE, NULL);
+  tt_int_op(ewfd_data->cell_ewfd_delay.delay_state, OP_EQ, EWFD_MODE_NORMAL);
+  ewfd_data = TO_EWFD_POL_CIRC_DATA(circ_data[10]);
+  tt_ptr_op(ewfd_data, OP_NE, NULL);
+  tt_int_op(ewfd_data->cell_ewfd_delay.delay_state, OP_EQ, EWFD_MODE_WAIT_TO_BURST);
+  ewfd_data = TO_EWFD_POL_CIRC_DATA(circ_data[999]);
+  tt_ptr_op(ewfd_data, OP_NE, NULL);
+  tt_int_op(ewfd_data->cell_ewfd_delay.delay_state, OP_EQ, EWFD_MODE_GAP);
+
+  // 释放circ时从时间轮上删除
+  ewfd_delay_policy.free_circ_data(&cmux[0], pol_data[0], &circs[999], circ_data[999]);
+  circ_data[999] = NULL;
+  tt_int_op(pol[0]->sleep_wheel->node_num, OP_EQ, SLEEP_CIRC_NUM - 41);
+
+  // 全部到期之后cmux离开sleep列表
+  tt_int_op(circuitmux_ewfd_wake_sleepers(3000), OP_EQ, SLEEP_CMUX_NUM * (SLEEP_CIRC_NUM - 40) - 1);
+  for (c = 0; c < SLEEP_CMUX_NUM; c++) {
+    tt_int_op(pol[c]->sleep_wheel->node_num, OP_EQ, 0);
+    tt_int_op(pol[c]->sleep_idx, OP_EQ, -1);
+  }
+  tt_u64_op(circuitmux_ewfd_next_wake_ti(), OP_EQ, UINT64_MAX);
+  tt_int_op(circuitmux_ewfd_wake_sleepers(4000), OP_EQ, 0);
+
+done:
+  for (c = 0; c < SLEEP_CMUX_NUM; c++) {
+    for (i = 0; i < SLEEP_CIRC_NUM && circ_data; i++) {
+      int idx = c * SLEEP_CIRC_NUM + i;
+      if (circ_data[idx])
+        ewfd_delay_policy.free_circ_data(&cmux[c], pol_data[c], &circs[idx], circ_data[idx]);
+    }
+    if (pol_data[c])
+      ewfd_delay_policy.free_cmux_data(&cmux[c], pol_data[c]);
+  }
+  tor_free(circ_data);
+  tor_free(circs);
+}
+
+/* 测试MetricsPort导出的EWFD统计: event按类型计数, unit执行时间直方图 */
+static void test_ewfd_unit_stats(void *args) {
+  (void) args;
+  const uint8_t uuid = 200;
+  or_circuit_t circ;
+  buf_t *buf = NULL;
+  char *out = NULL;
+  size_t out_len = 0;
+
+  timers_initialize();
+  ewfd_framework_init();
+  start_ewfd_padding_framework();
+  memset(&circ, 0, sizeof(circ));
+  circ.base_.magic = OR_CIRCUIT_MAGIC;
+  circ.p_circ_id = 1;
+
+  ewfd_event_queue_stats_st old_stats = ewfd_event_queue_stats;
+  ewfd_add_dummy_packet((uintptr_t) &circ, 100);
+  ewfd_add_dummy_packet((uintptr_t) &circ, 100);
+  tt_u64_op(ewfd_event_queue_stats.type_queued[EWFD_EVENT_TYPE_DUMMY], OP_EQ,
+            old_stats.type_queued[EWFD_EVENT_TYPE_DUMMY] + 2);
+  ewfd_remove_circ_events((uintptr_t) &circ);
+  tt_u64_op(ewfd_event_queue_stats.type_dropped[EWFD_EVENT_TYPE_DUMMY], OP_EQ,
+            old_stats.type_dropped[EWFD_EVENT_TYPE_DUMMY] + 2);
+  tt_u64_op(ewfd_event_queue_stats.type_queued[EWFD_EVENT_TYPE_DELAY], OP_EQ,
+            old_stats.type_queued[EWFD_EVENT_TYPE_DELAY]);
+
+  memset(&ewfd_unit_stats[uuid], 0, sizeof(ewfd_unit_stats_st));
+  ewfd_unit_stats_add_exec(uuid, 500, 1); // 0us -> le=1
+  ewfd_unit_stats_add_exec(uuid, 30000, 2); // 15us/次 -> le=20
+  ewfd_unit_stats_add_exec(uuid, 1000000, 1); // 1ms -> +Inf
+  tt_u64_op(ewfd_unit_stats[uuid].exec_num, OP_EQ, 4);
+  tt_u64_op(ewfd_unit_stats[uuid].exec_hist[0], OP_EQ, 1);
+  tt_u64_op(ewfd_unit_stats[uuid].exec_hist[4], OP_EQ, 2);
+  tt_u64_op(ewfd_unit_stats[uuid].exec_hist[EWFD_EXEC_HIST_BUCKETS - 1],
+            OP_EQ, 1);
+  ewfd_unit_stats[uuid].real_cells = 200;
+  ewfd_unit_stats[uuid].dummy_cells = 50;
+
+  buf = buf_new();
+  SMARTLIST_FOREACH(relay_metrics_get_stores(), metrics_store_t *, store,
+                    metrics_store_get_output(METRICS_FORMAT_PROMETHEUS,
+                                             store, buf));
+  out = buf_get_contents(buf, &out_len);
+  tt_assert(strstr(out, "_ewfd_unit_exec_usec_bucket"
+                        "{unit=\"200\",le=\"10\"} 1\n"));
+  tt_assert(strstr(out, "_ewfd_unit_exec_usec_bucket"
+                        "{unit=\"200\",le=\"+Inf\"} 4\n"));
+  tt_assert(strstr(out, "_ewfd_unit_exec_usec_count{unit=\"200\"} 4\n"));
+  tt_assert(strstr(out, "_ewfd_unit_exec_usec_sum{unit=\"200\"} 1030\n"));
+  tt_assert(strstr(out, "_ewfd_overhead_permille{unit=\"200\"} 250\n"));
+  tt_assert(strstr(out, "_ewfd_event_type_total"
+                        "{type=\"dummy\",outcome=\"dropped\"}"));
+
+done:
+  memset(&ewfd_unit_stats[uuid], 0, sizeof(ewfd_unit_stats_st));
+  tor_free(out);
+  buf_free(buf);
+  ewfd_framework_free();
+}
+
+/* cpuworker在主线程中执行，先执行所有work再处理reply */
+typedef struct ewfd_fake_work_t {
+  workqueue_reply_t (*fn)(void *, void *);
+  void (*reply_fn)(void *);
+  void *arg;
+} ewfd_fake_work_t;
+static smartlist_t *ewfd_fake_works = NULL;
+
+static workqueue_entry_t *
+mock_ewfd_cpuworker_queue_work(workqueue_priority_t prio,
+                               workqueue_reply_t (*fn)(void *, void *),
+                               void (*reply_fn)(void *), void *arg)
+{
+  (void) prio;
+  ewfd_fake_work_t *work = tor_malloc_zero(sizeof(ewfd_fake_work_t));
+  work->fn = fn;
+  work->reply_fn = reply_fn;
+  work->arg = arg;
+  smartlist_add(ewfd_fake_works, work);
+  return (workqueue_entry_t *) work;
+}
+
+static void
+ewfd_run_fake_works(void)
+{
+  SMARTLIST_FOREACH(ewfd_fake_works, ewfd_fake_work_t *, work,
+                    tt_int_op(work->fn(NULL, work->arg), OP_EQ, WQ_RPL_REPLY));
+ done:
+  SMARTLIST_FOREACH(ewfd_fake_works, ewfd_fake_work_t *, work, {
+    work->reply_fn(work->arg);
+    tor_free(work);
+  });
+  smartlist_clear(ewfd_fake_works);
+}
+
+static ewfd_padding_conf_st *
+ewfd_find_client_conf(uint8_t uuid)
+{
+  SMARTLIST_FOREACH(ewfd_client_conf->client_unit_confs,
+                    ewfd_padding_conf_st *, c,
+                    if (c->unit_uuid == uuid) return c);
+  return NULL;
+}
+
+/* r1 = on_circ; r2 = 0; call ewfd_get_event_num; r0 = 0; exit */
+static const uint8_t ewfd_test_prog[] = {
+  0x79, 0x11, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0xb7, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x85, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+  0xb7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x95, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/* 最小的clang -target bpf目标文件: 一个section "ewfd/test"，helper调用通过
+ * R_BPF_64_32 relocation按名字解析 */
+enum { SEC_NULL, SEC_TEXT, SEC_REL, SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB,
+       SEC_NUM };
+
+static char *
+ewfd_build_test_elf(size_t *len_out)
+{
+  static const char shstrtab[] =
+    "\0ewfd/test\0.rel.ewfd/test\0.symtab\0.strtab\0.shstrtab";
+  static const char strtab[] = "\0ewfd_get_event_num";
+  Elf64_Sym syms[2];
+  Elf64_Rel rel;
+  Elf64_Shdr shdrs[SEC_NUM];
+  Elf64_Ehdr ehdr;
+  size_t off = sizeof(ehdr);
+
+  memset(syms, 0, sizeof(syms));
+  syms[1].st_name = 1;
+  syms[1].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+  memset(&rel, 0, sizeof(rel));
+  rel.r_offset = 16;
+  rel.r_info = ELF64_R_INFO(1, 10);
+
+  memset(shdrs, 0, sizeof(shdrs));
+  shdrs[SEC_TEXT].sh_name = 1;
+  shdrs[SEC_TEXT].sh_type = SHT_PROGBITS;
+  shdrs[SEC_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+  shdrs[SEC_TEXT].sh_size = sizeof(ewfd_test_prog);
+  shdrs[SEC_REL].sh_name = 11;
+  shdrs[SEC_REL].sh_type = SHT_REL;
+  shdrs[SEC_REL].sh_link = SEC_SYMTAB;
+  shdrs[SEC_REL].sh_info = SEC_TEXT;
+  shdrs[SEC_REL].sh_size = sizeof(rel);
+  shdrs[SEC_SYMTAB].sh_name = 26;
+  shdrs[SEC_SYMTAB].sh_type = SHT_SYMTAB;
+  shdrs[SEC_SYMTAB].sh_link = SEC_STRTAB;
+  shdrs[SEC_SYMTAB].sh_size = sizeof(syms);
+  shdrs[SEC_STRTAB].sh_name = 34;
+  shdrs[SEC_STRTAB].sh_type = SHT_STRTAB;
+  shdrs[SEC_STRTAB].sh_size = sizeof(strtab);
+  shdrs[SEC_SHSTRTAB].sh_name = 42;
+  shdrs[SEC_SHSTRTAB].sh_type = SHT_STRTAB;
+  shdrs[SEC_SHSTRTAB].sh_size = sizeof(shstrtab);
+
+  const void *datas[SEC_NUM] = {
+    NULL, ewfd_test_prog, &rel, syms, strtab, shstrtab,
+  };
+  for (int i = 1; i < SEC_NUM; i++) {
+    shdrs[i].sh_offset = off;
+    off += shdrs[i].sh_size;
+  }
+  off = (off + 7) & ~(size_t) 7;
+
+  memset(&ehdr, 0, sizeof(ehdr));
+  memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_type = ET_REL;
+  ehdr.e_machine = 247; // EM_BPF
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_ehsize = sizeof(ehdr);
+  ehdr.e_shoff = off;
+  ehdr.e_shentsize = sizeof(Elf64_Shdr);
+  ehdr.e_shnum = SEC_NUM;
+  ehdr.e_shstrndx = SEC_SHSTRTAB;
+
+  *len_out = off + sizeof(shdrs);
+  char *elf = tor_malloc_zero(*len_out);
+  memcpy(elf, &ehdr, sizeof(ehdr));
+  for (int i = 1; i < SEC_NUM; i++) {
+    memcpy(elf + shdrs[i].sh_offset, datas[i], shdrs[i].sh_size);
+  }
+  memcpy(elf + off, shdrs, sizeof(shdrs));
+  return elf;
+}
+
+/* 测试EWFDUnit热加载: 在cpuworker中编译，完成后替换ewfd_client_conf */
+static void test_ewfd_unit_reload(void *args) {
+  (void) args;
+  config_line_t *lines = NULL, *bad_lines = NULL;
+  char *bin_fname = tor_strdup(get_fname("ewfd_unit.bin"));
+  char *elf_fname = tor_strdup(get_fname("ewfd_unit.o"));
+  char *msg = NULL, *line = NULL, *elf = NULL;
+  size_t elf_len = 0;
+  ewfd_padding_conf_st *old_conf = NULL;
+  ewfd_padding_unit_st unit;
+  ewfd_padding_runtime_st *rt = NULL;
+  // raw bytecode: next_tick = 1234; r0 = 0; exit
+  const struct ebpf_inst padding_prog[] = {
+    { .opcode = EBPF_OP_STW, .dst = 1,
+      .offset = offsetof(ewfd_circ_status_st, next_tick), .imm = 1234 },
+    { .opcode = EBPF_OP_MOV64_IMM, .dst = 0, .imm = 0 },
+    { .opcode = EBPF_OP_EXIT },
+  };
+
+  memset(&unit, 0, sizeof(unit));
+  timers_initialize();
+  ewfd_framework_init();
+  ewfd_fake_works = smartlist_new();
+  MOCK(cpuworker_queue_work, mock_ewfd_cpuworker_queue_work);
+
+  tt_int_op(write_bytes_to_file(bin_fname, (const char *) padding_prog,
+                                sizeof(padding_prog), 1), OP_EQ, 0);
+  elf = ewfd_build_test_elf(&elf_len);
+  tt_int_op(write_bytes_to_file(elf_fname, elf, elf_len, 1), OP_EQ, 0);
+
+  tor_asprintf(&line, "uuid=7 type=padding main=%s interval=100", bin_fname);
+  config_line_append(&lines, "EWFDUnit", line);
+  tor_free(line);
+  tor_asprintf(&line, "uuid=8 type=schedule main=%s:ewfd/test jit=1",
+               elf_fname);
+  config_line_append(&lines, "EWFDUnit", line);
+  tor_free(line);
+
+  // 语法错误在validate时拒绝
+  config_line_append(&bad_lines, "EWFDUnit", "uuid=7 type=foo main=x");
+  tt_int_op(ewfd_validate_unit_lines(bad_lines, &msg), OP_EQ, -1);
+  tt_assert(msg);
+  tor_free(msg);
+  tt_int_op(ewfd_validate_unit_lines(lines, &msg), OP_EQ, 0);
+
+  // 编译完成之前继续使用内置的unit
+  tt_int_op(ewfd_reload_unit_confs(lines), OP_EQ, 0);
+  tt_int_op(smartlist_len(ewfd_fake_works), OP_EQ, 1);
+  tt_uint_op(ewfd_client_conf->conf_version, OP_EQ, 0);
+  ewfd_run_fake_works();
+
+  uint32_t version = ewfd_client_conf->conf_version;
+  tt_uint_op(version, OP_GT, 0);
+  tt_int_op(smartlist_len(ewfd_client_conf->client_unit_confs), OP_EQ, 2);
+  tt_assert(ewfd_client_conf->need_reload);
+  ewfd_padding_conf_st *conf = ewfd_find_client_conf(7);
+  tt_assert(conf);
+  tt_int_op(conf->unit_type, OP_EQ, EWFD_UNIT_PADDING);
+  tt_uint_op(conf->tick_interval, OP_EQ, 100);
+  tt_assert(conf->main_code->vm);
+  tt_assert(conf->main_code->vm->verified);
+  conf = ewfd_find_client_conf(8);
+  tt_assert(conf);
+  tt_int_op(conf->unit_type, OP_EQ, EWFD_UNIT_SCHEDULE);
+  tt_assert(conf->main_code->vm->verified);
+  tt_assert(conf->main_code->vm->jitted);
+  tt_int_op(conf->main_code->vm->insts[2].imm, OP_EQ, 8);
+
+  // 默认执行torrc加载的eBPF code，而不是ewfd_dev.c中的C unit
+  tt_assert(!ewfd_rt_use_c_units());
+  unit.conf = ewfd_find_client_conf(7);
+  unit.ewfd_unit = init_ewfd_unit(unit.conf);
+  tt_ptr_op(unit.ewfd_unit, OP_NE, NULL);
+  rt = tor_malloc_zero(sizeof(ewfd_padding_runtime_st));
+  rt->padding_slots[0] = &unit;
+  uint64_t exec_num = ewfd_unit_stats[7].exec_num;
+  run_ewfd_padding_vm(rt);
+  tt_u64_op(rt->padding_unit_ctx.next_tick, OP_EQ, 1234);
+  tt_u64_op(rt->circ_status.ewfd_unit, OP_EQ, (uint64_t) unit.ewfd_unit);
+  tt_u64_op(ewfd_unit_stats[7].exec_num, OP_EQ, exec_num + 1);
+
+  // 已有的unit继续持有旧的conf
+  old_conf = ewfd_find_client_conf(7);
+  ewfd_padding_conf_incref(old_conf);
+
+  // 加载失败时保持当前的conf
+  config_free_lines(bad_lines);
+  config_line_append(&bad_lines, "EWFDUnit",
+                     "uuid=9 type=padding main=/nonexistent/ewfd.o");
+  tt_int_op(ewfd_reload_unit_confs(bad_lines), OP_EQ, 0);
+  ewfd_run_fake_works();
+  tt_uint_op(ewfd_client_conf->conf_version, OP_EQ, version);
+
+  // 连续两次reload，只有最后一次生效
+  tt_int_op(ewfd_reload_unit_confs(lines), OP_EQ, 0);
+  tt_int_op(ewfd_reload_unit_confs(lines), OP_EQ, 0);
+  ewfd_run_fake_works();
+  tt_uint_op(ewfd_client_conf->conf_version, OP_EQ, version + 3);
+  tt_ptr_op(ewfd_find_client_conf(7), OP_NE, old_conf);
+  tt_uint_op(old_conf->refcnt, OP_EQ, 1);
+  tt_uint_op(old_conf->tick_interval, OP_EQ, 100);
+
+  // 删除所有EWFDUnit，恢复内置的unit
+  tt_int_op(ewfd_reload_unit_confs(NULL), OP_EQ, 0);
+  tt_uint_op(ewfd_client_conf->conf_version, OP_EQ, 0);
+  tt_assert(ewfd_find_client_conf(1));
+
+ done:
+  tor_free(rt);
+  if (unit.ewfd_unit)
+    free_ewfd_unit(unit.ewfd_unit);
+  ewfd_padding_conf_decref(old_conf);
+  UNMOCK(cpuworker_queue_work);
+  SMARTLIST_FOREACH(ewfd_fake_works, ewfd_fake_work_t *, work, tor_free(work));
+  smartlist_free(ewfd_fake_works);
+  config_free_lines(lines);
+  config_free_lines(bad_lines);
+  tor_free(msg);
+  tor_free(elf);
+  tor_free(bin_fname);
+  tor_free(elf_fname);
+  ewfd_framework_free();
+}
+
+/* 返回test elf中的section header */
+static Elf64_Shdr *
+ewfd_test_elf_shdr(char *elf, int idx)
+{
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *) elf;
+  return (Elf64_Shdr *) (elf + ehdr->e_shoff) + idx;
+}
+
+/* load elf到一个新的code中，返回ewfd_code_load的结果
+ * msg_out不为NULL时返回错误信息，由调用者释放 */
+static int
+ewfd_test_load_elf(const char *elf, size_t elf_len, char **msg_out)
+{
+  ewfd_code_st *code = tor_malloc_zero(sizeof(ewfd_code_st));
+  char *err_msg = NULL;
+  code->code_type = EWFD_CODE_TYPE_MAIN;
+  int res = ewfd_code_load(code, elf, elf_len, "ewfd/test",
+                           sizeof(ewfd_circ_status_st), &err_msg);
+  free_ewfd_code_vm(code);
+  tor_free(code);
+  if (msg_out)
+    *msg_out = err_msg;
+  else
+    free(err_msg);
+  return res;
+}
+
+/* 畸形的elf在load时拒绝，不能越界或者解引用NULL */
+static void test_ewfd_unit_bad_elf(void *args) {
+  (void) args;
+  char *elf = NULL;
+  size_t elf_len = 0;
+  char *msg = NULL;
+  Elf64_Shdr *shdr;
+  Elf64_Rel *rel;
+
+  elf = ewfd_build_test_elf(&elf_len);
+  tt_int_op(ewfd_test_load_elf(elf, elf_len, NULL), OP_EQ, 0);
+
+  // r_offset + 8 回绕到0
+  shdr = ewfd_test_elf_shdr(elf, SEC_REL);
+  rel = (Elf64_Rel *) (elf + shdr->sh_offset);
+  rel->r_offset = UINT64_MAX - 7;
+  tt_int_op(ewfd_test_load_elf(elf, elf_len, NULL), OP_EQ,
+            EWFD_CODE_LOAD_FAILED);
+  rel->r_offset = sizeof(ewfd_test_prog);
+  tt_int_op(ewfd_test_load_elf(elf, elf_len, NULL), OP_EQ,
+            EWFD_CODE_LOAD_FAILED);
+  rel->r_offset = 16;
+  tt_int_op(ewfd_test_load_elf(elf, elf_len, NULL), OP_EQ, 0);
+
+  // sh_link指向NOBITS的symtab/strtab, data为NULL
+  shdr = ewfd_test_elf_shdr(elf, SEC_SYMTAB);
+  shdr->sh_type = SHT_NOBITS;
+  tt_int_op(ewfd_test_load_elf(elf, elf_len, NULL), OP_EQ,
+            EWFD_CODE_LOAD_FAILED);
+  shdr->sh_type = SHT_SYMTAB;
+  shdr = ewfd_test_elf_shdr(elf, SEC_STRTAB);
+  shdr->sh_type = SHT_NOBITS;
+  shdr->sh_size = 1 << 20;
+  tt_int_op(ewfd_test_load_elf(elf, elf_len, NULL), OP_EQ,
+            EWFD_CODE_LOAD_FAILED);
+  shdr->sh_type = SHT_STRTAB;
+  shdr->sh_size = sizeof("\0ewfd_get_event_num");
+  tt_int_op(ewfd_test_load_elf(elf, elf_len, NULL), OP_EQ, 0);
+
+  // 不支持全局变量/.rodata/map的lddw relocation
+  rel->r_info = ELF64_R_INFO(1, 1); // R_BPF_64_64
+  tt_int_op(ewfd_test_load_elf(elf, elf_len, &msg), OP_EQ,
+            EWFD_CODE_LOAD_FAILED);
+  tt_assert(msg);
+  tt_assert(strstr(msg, "R_BPF_64_64"));
+
+ done:
+  free(msg);
+  tor_free(elf);
+}
+
+static int
+mock_ewfd_relay_send_command(streamid_t stream_id, circuit_t *circ,
+                             uint8_t relay_command, const char *payload,
+                             size_t payload_len, crypt_path_t *cpath_layer,
+                             const char *filename, int lineno)
+{
+  (void) stream_id; (void) circ; (void) relay_command; (void) payload;
+  (void) payload_len; (void) cpath_layer; (void) filename; (void) lineno;
+  return 0;
+}
+
+static void
+mock_ewfd_channel_has_waiting_cells(channel_t *chan)
+{
+  (void) chan;
+}
+
+static int
+ewfd_test_negotiate(circuit_t *circ, uint8_t command)
+{
+  circpad_negotiate_t *negotiate = circpad_negotiate_new();
+  negotiate->command = command;
+  negotiate->machine_type = 1; // 内置的front padding unit
+  negotiate->machine_ctr = 1;
+  return ewfd_handle_padding_negotiate(circ, negotiate);
+}
+
+/* STOP时丢弃还没发送的dummy, 之后的pop不再访问已经释放的unit */
+static void test_ewfd_stop_pending_dummy(void *args) {
+  (void) args;
+  channel_t *pchan = NULL, *nchan = NULL;
+  or_circuit_t *orcirc = NULL;
+  circuit_t *circ = NULL;
+
+  timers_initialize();
+  ewfd_framework_init();
+  MOCK(relay_send_command_from_edge_, mock_ewfd_relay_send_command);
+  MOCK(scheduler_channel_has_waiting_cells,
+       mock_ewfd_channel_has_waiting_cells);
+  pchan = new_fake_channel();
+  nchan = new_fake_channel();
+  orcirc = new_fake_orcirc(nchan, pchan);
+  tt_ptr_op(orcirc, OP_NE, NULL);
+  circ = TO_CIRCUIT(orcirc);
+
+  tt_int_op(ewfd_test_negotiate(circ, CIRCPAD_COMMAND_EWFD_START), OP_EQ, 0);
+  tt_ptr_op(circ->ewfd_padding_rt, OP_NE, NULL);
+  tt_assert(ewfd_paddding_op_dummy_impl(circ));
+  tt_assert(ewfd_paddding_op_dummy_impl(circ));
+  tt_int_op(orcirc->p_chan_cells.ewfd_dummy_n, OP_EQ, 2);
+  tt_uint_op(circuitmux_num_cells_for_circuit(pchan->cmux, circ), OP_EQ, 2);
+
+  tt_int_op(ewfd_test_negotiate(circ, CIRCPAD_COMMAND_EWFD_STOP), OP_EQ, 0);
+  tt_ptr_op(circ->ewfd_padding_rt->padding_slots[0], OP_EQ, NULL);
+  tt_int_op(orcirc->p_chan_cells.ewfd_dummy_n, OP_EQ, 0);
+  tt_uint_op(circuitmux_num_cells_for_circuit(pchan->cmux, circ), OP_EQ, 0);
+  tt_int_op(circuitmux_is_circuit_active(pchan->cmux, circ), OP_EQ, 0);
+
+  // unit已经STOP: 不再接受新的dummy, 遗留的dummy在pop时丢弃
+  tt_assert(!ewfd_paddding_op_dummy_impl(circ));
+  orcirc->p_chan_cells.ewfd_dummy_n = 1;
+  tt_ptr_op(ewfd_cell_queue_pop_dummy(circ, &orcirc->p_chan_cells), OP_EQ,
+            NULL);
+  tt_int_op(orcirc->p_chan_cells.ewfd_dummy_n, OP_EQ, 0);
+
+  // runtime释放之后同样丢弃
+  tt_int_op(ewfd_test_negotiate(circ, CIRCPAD_COMMAND_EWFD_START), OP_EQ, 0);
+  tt_assert(ewfd_paddding_op_dummy_impl(circ));
+  free_ewfd_runtime_on_circ(circ);
+  tt_int_op(orcirc->p_chan_cells.ewfd_dummy_n, OP_EQ, 0);
+  tt_uint_op(circuitmux_num_cells_for_circuit(pchan->cmux, circ), OP_EQ, 0);
+  orcirc->p_chan_cells.ewfd_dummy_n = 1;
+  tt_ptr_op(ewfd_cell_queue_pop_dummy(circ, &orcirc->p_chan_cells), OP_EQ,
+            NULL);
+
+ done:
+  if (circ)
+    free_ewfd_runtime_on_circ(circ);
+  free_fake_orcirc(orcirc);
+  free_fake_channel(pchan);
+  free_fake_channel(nchan);
+  UNMOCK(scheduler_channel_has_waiting_cells);
+  UNMOCK(relay_send_command_from_edge_);
+  ewfd_framework_free();
+}
+
+/* STOP一个padding unit只丢弃它自己入队的dummy, 其他unit的dummy继续发送 */
+static void test_ewfd_stop_unit_dummy(void *args) {
+  (void) args;
+  channel_t *pchan = NULL, *nchan = NULL;
+  or_circuit_t *orcirc = NULL;
+  circuit_t *circ = NULL;
+  ewfd_padding_unit_st *other = NULL;
+  packed_cell_t *cell = NULL;
+
+  timers_initialize();
+  ewfd_framework_init();
+  MOCK(relay_send_command_from_edge_, mock_ewfd_relay_send_command);
+  MOCK(scheduler_channel_has_waiting_cells,
+       mock_ewfd_channel_has_waiting_cells);
+  pchan = new_fake_channel();
+  nchan = new_fake_channel();
+  orcirc = new_fake_orcirc(nchan, pchan);
+  tt_ptr_op(orcirc, OP_NE, NULL);
+  circ = TO_CIRCUIT(orcirc);
+
+  tt_int_op(ewfd_test_negotiate(circ, CIRCPAD_COMMAND_EWFD_START), OP_EQ, 0);
+  tt_ptr_op(circ->ewfd_padding_rt->padding_slots[0], OP_NE, NULL);
+  tt_assert(ewfd_paddding_op_dummy_impl(circ));
+  tt_assert(ewfd_paddding_op_dummy_impl(circ));
+
+  // 第二个unit使用同一个conf, 只占用slot, 不计入units_num
+  other = tor_malloc_zero(sizeof(*other));
+  other->conf = circ->ewfd_padding_rt->padding_slots[0]->conf;
+  circ->ewfd_padding_rt->padding_slots[1] = other;
+  circ->ewfd_padding_rt->padding_unit_ctx.active_slot = 1;
+  tt_assert(ewfd_paddding_op_dummy_impl(circ));
+  tt_uint_op(other->queued_dummy, OP_EQ, 1);
+  tt_int_op(orcirc->p_chan_cells.ewfd_dummy_n, OP_EQ, 3);
+
+  tt_int_op(ewfd_test_negotiate(circ, CIRCPAD_COMMAND_EWFD_STOP), OP_EQ, 0);
+  tt_ptr_op(circ->ewfd_padding_rt->padding_slots[0], OP_EQ, NULL);
+  tt_int_op(orcirc->p_chan_cells.ewfd_dummy_n, OP_EQ, 1);
+  tt_uint_op(circuitmux_num_cells_for_circuit(pchan->cmux, circ), OP_EQ, 1);
+
+  cell = ewfd_cell_queue_pop_dummy(circ, &orcirc->p_chan_cells);
+  tt_ptr_op(cell, OP_NE, NULL);
+  tt_uint_op(other->queued_dummy, OP_EQ, 0);
+  tt_int_op(orcirc->p_chan_cells.ewfd_dummy_n, OP_EQ, 0);
+
+ done:
+  packed_cell_free(cell);
+  if (circ && circ->ewfd_padding_rt &&
+      circ->ewfd_padding_rt->padding_slots[1] == other) {
+    circ->ewfd_padding_rt->padding_slots[1] = NULL;
+    circ->ewfd_padding_rt->padding_unit_ctx.active_slot = 0;
+  }
+  tor_free(other);
+  if (circ)
+    free_ewfd_runtime_on_circ(circ);
+  free_fake_orcirc(orcirc);
+  free_fake_channel(pchan);
+  free_fake_channel(nchan);
+  UNMOCK(scheduler_channel_has_waiting_cells);
+  UNMOCK(relay_send_command_from_edge_);
+  ewfd_framework_free();
+}
+
+/* 只有delay描述符没有real cell的circ也要被cmux调度，等待期间计数为0
+*/
+static void test_ewfd_delay_schedule(void *args) {
+  (void) args;
+  channel_t *pchan = NULL, *nchan = NULL;
+  or_circuit_t *orcirc = NULL;
+  circuit_t *circ = NULL;
+
+  monotime_enable_test_mocking();
+  monotime_set_mock_time_nsec(1000 * (int64_t) 1000000);
+  MOCK(scheduler_channel_has_waiting_cells,
+       mock_ewfd_channel_has_waiting_cells);
+  pchan = new_fake_channel();
+  nchan = new_fake_channel();
+  orcirc = new_fake_orcirc(nchan, pchan);
+  tt_ptr_op(orcirc, OP_NE, NULL);
+  circ = TO_CIRCUIT(orcirc);
+
+  tt_assert(ewfd_paddding_op_delay_impl(circ, 1100, 2));
+  tt_int_op(orcirc->p_chan_cells.n, OP_EQ, 0);
+  tt_uint_op(circuitmux_num_cells_for_circuit(pchan->cmux, circ), OP_EQ, 0);
+  tt_int_op(circuitmux_is_circuit_active(pchan->cmux, circ), OP_EQ, 0);
+
+  // NOTIFY event到期，circ重新变为active
+  monotime_set_mock_time_nsec(1100 * (int64_t) 1000000);
+  tt_assert(ewfd_paddding_op_delay_notify_impl(circ));
+  tt_uint_op(circuitmux_num_cells_for_circuit(pchan->cmux, circ), OP_EQ, 1);
+  tt_int_op(circuitmux_is_circuit_active(pchan->cmux, circ), OP_EQ, 1);
+
+ done:
+  free_fake_orcirc(orcirc);
+  free_fake_channel(pchan);
+  free_fake_channel(nchan);
+  UNMOCK(scheduler_channel_has_waiting_cells);
+  monotime_disable_test_mocking();
+}
+
+/* circ释放时删除它的event, 没有runtime的circ也一样 */
+static void test_ewfd_free_circ_events(void *args) {
+  (void) args;
+  or_circuit_t *orcirc = NULL;
+  uintptr_t on_circ;
+
+  timers_initialize();
+  ewfd_framework_init();
+  start_ewfd_padding_framework();
+
+  orcirc = or_circuit_new(0, NULL);
+  tt_ptr_op(orcirc, OP_NE, NULL);
+  tt_ptr_op(TO_CIRCUIT(orcirc)->ewfd_padding_rt, OP_EQ, NULL);
+  on_circ = (uintptr_t) TO_CIRCUIT(orcirc);
+  ewfd_add_dummy_packet(on_circ, monotime_absolute_msec() + 10);
+  ewfd_add_dummy_packet(on_circ, monotime_absolute_msec() + 20);
+  tt_int_op(ewfd_get_event_num(on_circ), OP_EQ, 2);
+
+  circuit_free_(TO_CIRCUIT(orcirc));
+  orcirc = NULL;
+  tt_int_op(ewfd_get_event_num(on_circ), OP_EQ, 0);
+
+ done:
+  if (orcirc)
+    circuit_free_(TO_CIRCUIT(orcirc));
+  ewfd_framework_free();
+}
+
+static int ewfd_offload_done_num = 0;
+
+static void
+ewfd_offload_done(ewfd_padding_runtime_st *ewfd_rt)
+{
+  (void) ewfd_rt;
+  ewfd_offload_done_num++;
+}
+
+// reply中会派发下一个job，按顺序一次执行一个work
+static void
+ewfd_run_one_fake_work(void)
+{
+  ewfd_fake_work_t *work = smartlist_get(ewfd_fake_works, 0);
+  smartlist_del_keeporder(ewfd_fake_works, 0);
+  work->fn(NULL, work->arg);
+  work->reply_fn(work->arg);
+  tor_free(work);
+}
+
+/* 测试EWFDOffloadUnits: worker上unit产生的op在reply时才入队，
+ * 执行期间到期的rt排到下一个job，释放的rt不再回写 */
+static void test_ewfd_unit_offload(void *args) {
+  (void) args;
+  or_circuit_t circ;
+  ewfd_framework_st worker;
+  ewfd_circ_event_count_st count;
+  ewfd_padding_unit_st unit;
+  ewfd_padding_runtime_st *rts[2] = {NULL, NULL};
+  smartlist_t *ops = smartlist_new();
+  struct ewfd_unit_t *jit_unit = NULL;
+  bool use_c_units = ewfd_rt_use_c_units();
+  const uint32_t stream[2] = {10, 20};
+  const uint32_t builtin_first = ewfd_data_stream_get_shared()->data[0];
+  char *fname = tor_strdup(get_fname("ewfd_offload_data_stream"));
+
+  memset(&unit, 0, sizeof(unit));
+  timers_initialize();
+  ewfd_framework_init();
+  start_ewfd_padding_framework();
+  ewfd_fake_works = smartlist_new();
+  MOCK(cpuworker_queue_work, mock_ewfd_cpuworker_queue_work);
+  memset(&circ, 0, sizeof(circ));
+  circ.base_.magic = OR_CIRCUIT_MAGIC;
+  circ.p_circ_id = 1;
+  uintptr_t on_circ = (uintptr_t) &circ;
+
+  // worker: 只记录op，event数量 = 派发时的快照 + 已经记录的op
+  ewfd_add_dummy_packet(on_circ, 100);
+  ewfd_get_circ_event_count(on_circ, &count);
+  tt_uint_op(count.type_num[EWFD_EVENT_TYPE_DUMMY], OP_EQ, 1);
+  memset(&worker, 0, sizeof(worker));
+  worker.pending_ops = ops;
+  worker.event_count = &count;
+  ewfd_framework_enter_worker(&worker);
+  tt_ptr_op(ewfd_framework_current(), OP_EQ, &worker);
+  ewfd_add_dummy_packet(on_circ, 100);
+  ewfd_add_delay_packet(on_circ, 100, 200, 1);
+  tt_int_op(ewfd_get_event_num(on_circ), OP_EQ, 4);
+  tt_int_op(ewfd_get_event_num_by_type(on_circ, EWFD_EVENT_TYPE_DUMMY),
+            OP_EQ, 2);
+  ewfd_framework_leave_worker();
+  tt_ptr_op(ewfd_framework_current(), OP_EQ, ewfd_framework_instance);
+  tt_int_op(ewfd_get_event_num(on_circ), OP_EQ, 1);
+  ewfd_framework_commit_ops(ops);
+  tt_int_op(smartlist_len(ops), OP_EQ, 0);
+  tt_int_op(ewfd_get_event_num(on_circ), OP_EQ, 4);
+  tt_int_op(ewfd_get_event_num_by_type(on_circ, EWFD_EVENT_TYPE_NOTIFY),
+            OP_EQ, 1);
+  ewfd_remove_circ_events(on_circ);
+
+  // 两个circ的schedule unit, last_cell_ti在未来，不会触发reset
+  unit.conf = ewfd_find_client_conf(2);
+  tt_assert(unit.conf);
+  unit.ewfd_unit = init_ewfd_unit(unit.conf);
+  tt_ptr_op(unit.ewfd_unit, OP_NE, NULL);
+  struct ebpf_vm *vm = unit.ewfd_unit->vm;
+  tt_ptr_op(vm->jitted, OP_EQ, NULL);
+  uint32_t refcnt = unit.conf->refcnt;
+  for (int i = 0; i < 2; i++) {
+    rts[i] = tor_malloc_zero(sizeof(ewfd_padding_runtime_st));
+    rts[i]->schedule_slots[0] = &unit;
+    rts[i]->padding_slots[0] = &unit;
+    rts[i]->circ_status.on_circ = on_circ;
+    rts[i]->circ_status.last_cell_ti = monotime_absolute_msec() + 100000;
+  }
+
+  tt_assert(!ewfd_rt_offload_batch(EWFD_TICK_SCHEDULE, rts, 2,
+                                   ewfd_offload_done));
+  // 默认执行eBPF unit，打开offload之后直接生效
+  tt_assert(!ewfd_rt_use_c_units());
+  tt_assert(ewfd_rt_set_offload(true));
+  tt_assert(ewfd_rt_offload_batch(EWFD_TICK_SCHEDULE, rts, 2,
+                                  ewfd_offload_done));
+  tt_assert(ewfd_rt_job_in_flight());
+  tt_int_op(smartlist_len(ewfd_fake_works), OP_EQ, 1);
+  tt_uint_op(unit.conf->refcnt, OP_EQ, refcnt + 2);
+  tt_u64_op(rts[0]->circ_status.now_ti, OP_GT, 0);
+
+  // 执行期间到期的rt等当前job完成再派发
+  ewfd_rt_set_offload(false);
+  tt_assert(ewfd_rt_offload_batch(EWFD_TICK_SCHEDULE, rts, 1,
+                                  ewfd_offload_done));
+  tt_int_op(smartlist_len(ewfd_fake_works), OP_EQ, 1);
+
+  // worker可能正在解释执行同一个vm，jit推迟到job结束
+  unit.conf->use_jit = true;
+  jit_unit = init_ewfd_unit(unit.conf);
+  unit.conf->use_jit = false;
+  tt_ptr_op(jit_unit, OP_NE, NULL);
+  tt_ptr_op(jit_unit->vm, OP_EQ, vm);
+  tt_ptr_op(vm->jitted, OP_EQ, NULL);
+
+  // 替换data stream同样推迟到job结束
+  tt_int_op(write_bytes_to_file(fname, (const char *) stream, sizeof(stream),
+                                1), OP_EQ, 0);
+  tt_int_op(ewfd_map_data_stream_file(fname), OP_EQ, 0);
+  tt_uint_op(ewfd_data_stream_get_shared()->data[0], OP_EQ, builtin_first);
+
+  // rts[1]在执行期间释放
+  ewfd_rt_forget_runtime(rts[1]);
+  tor_free(rts[1]);
+  uint64_t discarded = ewfd_unit_job_stats.discarded;
+  ewfd_run_one_fake_work();
+  tt_int_op(ewfd_offload_done_num, OP_EQ, 1);
+  tt_u64_op(ewfd_unit_job_stats.discarded, OP_EQ, discarded + 1);
+  tt_u64_op(rts[0]->schedule_unit_ctx.next_tick, OP_EQ,
+            unit.conf->tick_interval);
+  tt_ptr_op(vm->jitted, OP_NE, NULL);
+  tt_uint_op(ewfd_data_stream_get_shared()->len, OP_EQ, 2);
+  tt_uint_op(ewfd_data_stream_get_shared()->data[0], OP_EQ, 10);
+  tt_int_op(smartlist_len(ewfd_fake_works), OP_EQ, 1);
+  tt_assert(ewfd_rt_job_in_flight());
+  // 恢复内置数据也要等job结束
+  tt_int_op(ewfd_map_data_stream_file(NULL), OP_EQ, 0);
+  tt_uint_op(ewfd_data_stream_get_shared()->data[0], OP_EQ, 10);
+  ewfd_run_one_fake_work();
+  tt_uint_op(ewfd_data_stream_get_shared()->data[0], OP_EQ, builtin_first);
+  tt_int_op(ewfd_offload_done_num, OP_EQ, 2);
+  tt_uint_op(unit.conf->refcnt, OP_EQ, refcnt);
+
+  // 关闭之后在主线程执行
+  tt_assert(!ewfd_rt_offload_batch(EWFD_TICK_SCHEDULE, rts, 1,
+                                   ewfd_offload_done));
+
+  // C实现的dev unit不能在worker中执行，offload不生效
+  ewfd_rt_set_c_units(true);
+  tt_assert(!ewfd_rt_set_offload(true));
+  tt_assert(!ewfd_rt_offload_batch(EWFD_TICK_SCHEDULE, rts, 1,
+                                   ewfd_offload_done));
+
+ done:
+  ewfd_rt_set_offload(false);
+  UNMOCK(cpuworker_queue_work);
+  SMARTLIST_FOREACH(ewfd_fake_works, ewfd_fake_work_t *, work, tor_free(work));
+  smartlist_free(ewfd_fake_works);
+  smartlist_free(ops);
+  tor_free(rts[0]);
+  tor_free(rts[1]);
+  if (jit_unit)
+    free_ewfd_unit(jit_unit);
+  if (unit.ewfd_unit)
+    free_ewfd_unit(unit.ewfd_unit);
+  ewfd_rt_set_c_units(use_c_units);
+  ewfd_framework_free();
+  tor_free(fname);
+}
+
+/* next_tick = send_cell_cnt + k, 不同的k对应不同的vm */
+static ewfd_code_st *
+ewfd_new_next_tick_code(int32_t k)
+{
+  const struct ebpf_inst insts[] = {
+    { .opcode = EBPF_OP_LDXW, .dst = 2, .src = 1,
+      .offset = offsetof(ewfd_circ_status_st, send_cell_cnt) },
+    { .opcode = EBPF_OP_ADD64_IMM, .dst = 2, .imm = k },
+    { .opcode = EBPF_OP_STXW, .dst = 1, .src = 2,
+      .offset = offsetof(ewfd_circ_status_st, next_tick) },
+    { .opcode = EBPF_OP_MOV64_IMM, .dst = 0, .imm = 0 },
+    { .opcode = EBPF_OP_EXIT },
+  };
+  ewfd_code_st *code = tor_malloc_zero(sizeof(ewfd_code_st));
+
+  code->code_type = EWFD_CODE_TYPE_MAIN;
+  code->code_len = sizeof(insts);
+  tor_snprintf(code->name, sizeof(code->name), "next_tick_%d", k);
+  memcpy(code->code, insts, sizeof(insts));
+  return code;
+}
+
+/* 测试eBPF unit的批量执行: 到期的rt按vm分组执行, 每个rt拿到自己的结果
+ * rts[1]和rts[3]在vm B上, 其它rt在vm A上 */
+static void test_ewfd_unit_batch(void *args) {
+  (void) args;
+  ewfd_code_st *codes[2] = {NULL, NULL};
+  ewfd_padding_conf_st confs[2];
+  ewfd_padding_unit_st units[4];
+  ewfd_padding_runtime_st *rts[4] = {NULL, NULL, NULL, NULL};
+  bool use_c_units = ewfd_rt_use_c_units();
+
+  memset(confs, 0, sizeof(confs));
+  memset(units, 0, sizeof(units));
+  ewfd_framework_init();
+  ewfd_rt_set_c_units(false);
+
+  for (int i = 0; i < 2; i++) {
+    codes[i] = ewfd_new_next_tick_code(i + 1);
+    confs[i].unit_uuid = 100 + i;
+    confs[i].tick_interval = 1000;
+    confs[i].main_code = codes[i];
+  }
+  for (int i = 0; i < 4; i++) {
+    units[i].conf = &confs[i % 2];
+    units[i].ewfd_unit = init_ewfd_unit(units[i].conf);
+    tt_ptr_op(units[i].ewfd_unit, OP_NE, NULL);
+    rts[i] = tor_malloc_zero(sizeof(ewfd_padding_runtime_st));
+    rts[i]->schedule_slots[0] = &units[i];
+    rts[i]->padding_slots[0] = &units[i];
+    rts[i]->circ_status.send_cell_cnt = (i + 1) * 10;
+  }
+  tt_ptr_op(units[0].ewfd_unit->vm, OP_EQ, units[2].ewfd_unit->vm);
+  tt_ptr_op(units[0].ewfd_unit->vm, OP_NE, units[1].ewfd_unit->vm);
+
+  uint64_t exec_a = ewfd_unit_stats[100].exec_num;
+  uint64_t exec_b = ewfd_unit_stats[101].exec_num;
+  run_ewfd_schedule_vm_batch(rts, 4);
+  for (int i = 0; i < 4; i++) {
+    tt_u64_op(rts[i]->schedule_unit_ctx.next_tick, OP_EQ,
+              (i + 1) * 10 + i % 2 + 1);
+  }
+  tt_u64_op(ewfd_unit_stats[100].exec_num, OP_EQ, exec_a + 2);
+  tt_u64_op(ewfd_unit_stats[101].exec_num, OP_EQ, exec_b + 2);
+
+  // 超过dummy上限的rt不执行
+  rts[0]->padding_unit_ctx.total_dummy_pkt = 1001;
+  for (int i = 0; i < 4; i++) {
+    rts[i]->circ_status.send_cell_cnt += 100;
+  }
+  run_ewfd_padding_vm_batch(rts, 4);
+  tt_u64_op(rts[0]->padding_unit_ctx.next_tick, OP_EQ, 0);
+  for (int i = 1; i < 4; i++) {
+    tt_u64_op(rts[i]->padding_unit_ctx.next_tick, OP_EQ,
+              (i + 1) * 10 + 100 + i % 2 + 1);
+    tt_u64_op(rts[i]->circ_status.ewfd_unit, OP_EQ,
+              (uint64_t) units[i].ewfd_unit);
+  }
+  tt_u64_op(ewfd_unit_stats[100].exec_num, OP_EQ, exec_a + 3);
+  tt_u64_op(ewfd_unit_stats[101].exec_num, OP_EQ, exec_b + 4);
+
+ done:
+  for (int i = 0; i < 4; i++) {
+    tor_free(rts[i]);
+    if (units[i].ewfd_unit)
+      free_ewfd_unit(units[i].ewfd_unit);
+  }
+  for (int i = 0; i < 2; i++) {
+    if (codes[i])
+      free_ewfd_code_vm(codes[i]);
+    tor_free(codes[i]);
+  }
+  ewfd_rt_set_c_units(use_c_units);
+  ewfd_framework_free();
+}
+
 struct testcase_t circuitmux_ewfd_tests[] = {
   TEST_CMUX_EWFD(ewma_active_circuit), // checked
   TEST_CMUX_EWFD(ewma_policy_data),
@@ -442,5 +2138,26 @@ struct testcase_t circuitmux_ewfd_tests[] = {
   // customize test cases
   TEST_EWFD(event_queue_delete),
   TEST_EWFD(event_queue_poll),
+  TEST_EWFD(timing_wheel),
+  TEST_EWFD(code_cache),
+  TEST_EWFD(event_num_churn),
+  TEST_EWFD(tick_driver),
+  TEST_EWFD(tick_batch),
+  TEST_EWFD(data_stream),
+  TEST_EWFD(event_queue_timer),
+  TEST_EWFD(pool),
+  TEST_EWFD(delay_desc),
+  TEST_EWFD(delay_desc_pool),
+  TEST_EWFD(trace),
+  TEST_EWFD(cmux_sleep_wheel),
+  TEST_EWFD(unit_stats),
+  TEST_EWFD(unit_reload),
+  TEST_EWFD(unit_bad_elf),
+  TEST_EWFD(stop_pending_dummy),
+  TEST_EWFD(stop_unit_dummy),
+  TEST_EWFD(free_circ_events),
+  TEST_EWFD(delay_schedule),
+  TEST_EWFD(unit_offload),
+  TEST_EWFD(unit_batch),
   END_OF_TESTCASES
 };
@@ -14,6 +14,7 @@
 #include "feature/client/entrynodes.h"
 #include "feature/dircache/cached_dir_st.h"
 #include "feature/dircache/dirserv.h"
+#include "feature/ewfd/ewfd_trace.h"
 #include "feature/hs/hs_common.h"
 #include "feature/nodelist/networkstatus.h"
 #include "feature/nodelist/authcert.h"
@@ -21,6 +22,7 @@
 #include "feature/stats/rephist.h"
 #include "test/test.h"
 #include "test/test_helpers.h"
+#include "lib/fs/files.h"
 #include "lib/net/resolve.h"
 #include "lib/encoding/confline.h"
 #include "lib/encoding/kvline.h"
@@ -31,6 +33,10 @@
 #include "feature/nodelist/microdesc_st.h"
 #include "feature/nodelist/node_st.h"
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 typedef struct {
   const char *input;
   const char *expected_parse;
@@ -1956,6 +1962,67 @@ test_control_getconf(void *arg)
   smartlist_free(reply_strs);
 }
 
+/* GETINFO ewfd/trace只返回统计，DUMPEWFDTRACE才写文件 */
+static void
+test_control_ewfd_trace(void *arg)
+{
+  (void)arg;
+  control_connection_t conn;
+  char *args = NULL, *fname = NULL, *expected = NULL;
+  int r = -1;
+
+  memset(&conn, 0, sizeof(conn));
+  MOCK(control_write_reply, mock_control_write_reply_list);
+  reply_strs = smartlist_new();
+  fname = get_datadir_fname("ewfd-trace");
+  (void) unlink(fname);
+
+  ewfd_trace_init();
+  EWFD_TRACE(EWFD_TRACE_SEND_CELL, 7, RELAY_COMMAND_DATA, 0);
+
+  conn.current_cmd = tor_strdup("GETINFO");
+  args = tor_strdup("ewfd/trace");
+  r = handle_control_command(&conn, (uint32_t)strlen(args), args);
+  tt_int_op(r, OP_EQ, 0);
+  tt_int_op(smartlist_len(reply_strs), OP_EQ, 2);
+  tt_str_op((char *)smartlist_get(reply_strs, 0), OP_EQ,
+            "250-ewfd/trace=enabled=1 rings=1 records=1");
+  tt_int_op(file_status(fname), OP_EQ, FN_NOENT);
+  SMARTLIST_FOREACH(reply_strs, char *, p, tor_free(p));
+  smartlist_clear(reply_strs);
+  tor_free(args);
+  tor_free(conn.current_cmd);
+
+  conn.current_cmd = tor_strdup("DUMPEWFDTRACE");
+  args = tor_strdup("");
+  r = handle_control_command(&conn, (uint32_t)strlen(args), args);
+  tt_int_op(r, OP_EQ, 0);
+  tt_int_op(smartlist_len(reply_strs), OP_EQ, 2);
+  tor_asprintf(&expected, "250-FILENAME=%s", fname);
+  tt_str_op((char *)smartlist_get(reply_strs, 0), OP_EQ, expected);
+  tt_str_op((char *)smartlist_get(reply_strs, 1), OP_EQ, "250 OK");
+  tt_int_op(file_status(fname), OP_EQ, FN_FILE);
+  SMARTLIST_FOREACH(reply_strs, char *, p, tor_free(p));
+  smartlist_clear(reply_strs);
+
+  ewfd_trace_free();
+  r = handle_control_command(&conn, (uint32_t)strlen(args), args);
+  tt_int_op(r, OP_EQ, 0);
+  tt_int_op(smartlist_len(reply_strs), OP_EQ, 1);
+  tt_str_op((char *)smartlist_get(reply_strs, 0), OP_EQ,
+            "551 Unable to dump EWFD trace");
+
+ done:
+  ewfd_trace_free();
+  tor_free(conn.current_cmd);
+  tor_free(args);
+  tor_free(expected);
+  tor_free(fname);
+  UNMOCK(control_write_reply);
+  SMARTLIST_FOREACH(reply_strs, char *, p, tor_free(p));
+  smartlist_free(reply_strs);
+}
+
 static int
 mock_rep_hist_get_circuit_handshake(uint16_t type)
 {
@@ -2071,6 +2138,7 @@ struct testcase_t controller_tests[] = {
   { "getinfo_md_all", test_getinfo_md_all, 0, NULL, NULL },
   { "control_reply", test_control_reply, 0, NULL, NULL },
   { "control_getconf", test_control_getconf, 0, NULL, NULL },
+  { "control_ewfd_trace", test_control_ewfd_trace, TT_FORK, NULL, NULL },
   { "stats", test_stats, 0, NULL, NULL },
   END_OF_TESTCASES
 };
@@ -129,6 +129,54 @@ test_relaycrypt_outbound(void *arg)
   ;
 }
 
+/* As above, but let each hop crypt a run of cells at once with
+ * relay_crypt_or_circ_cells() before recognizing them one by one. */
+static void
+test_relaycrypt_outbound_batched(void *arg)
+{
+  testing_circuitset_t *cs = arg;
+  tt_assert(cs);
+
+  relay_header_t rh;
+  cell_t orig[8];
+  cell_t encrypted[8];
+  cell_t *run[8];
+  int i, j, k;
+
+  for (i = 0; i < 10; ++i) {
+    for (k = 0; k < 8; ++k) {
+      crypto_rand((char *)&orig[k], sizeof(orig[k]));
+
+      relay_header_unpack(&rh, orig[k].payload);
+      rh.recognized = 0;
+      memset(rh.integrity, 0, sizeof(rh.integrity));
+      relay_header_pack(orig[k].payload, &rh);
+
+      memcpy(&encrypted[k], &orig[k], sizeof(orig[k]));
+      relay_encrypt_cell_outbound(&encrypted[k], cs->origin_circ,
+                                  cs->origin_circ->cpath->prev);
+      run[k] = &encrypted[k];
+    }
+
+    for (j = 0; j < 3; ++j) {
+      relay_crypt_or_circ_cells(cs->or_circ[j], run, 8, CELL_DIRECTION_OUT);
+      for (k = 0; k < 8; ++k) {
+        char recognized = 0;
+        relay_or_circ_cell_recognize(cs->or_circ[j], run[k],
+                                     CELL_DIRECTION_OUT, &recognized);
+        tt_int_op(recognized != 0, OP_EQ, j == 2);
+      }
+    }
+
+    for (k = 0; k < 8; ++k)
+      tt_mem_op(orig[k].payload, OP_EQ, encrypted[k].payload,
+                CELL_PAYLOAD_SIZE);
+  }
+
+ done:
+  ;
+}
+
 /* As above, but simulate inbound cells from the last hop. */
 static void
 test_relaycrypt_inbound(void *arg)
@@ -186,6 +234,7 @@ test_relaycrypt_inbound(void *arg)
 
 struct testcase_t relaycrypt_tests[] = {
   TEST(outbound),
+  TEST(outbound_batched),
   TEST(inbound),
   END_OF_TESTCASES
 };